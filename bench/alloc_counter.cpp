@@ -0,0 +1,46 @@
+#include "alloc_counter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    std::atomic<uint64_t> g_count{ 0 };
+    std::atomic<uint64_t> g_bytes{ 0 };
+
+    void* Allocate(size_t size)
+    {
+        g_count.fetch_add(1, std::memory_order_relaxed);
+        g_bytes.fetch_add(size, std::memory_order_relaxed);
+        void* p = malloc(size ? size : 1);
+        if (!p) throw std::bad_alloc();
+        return p;
+    }
+}
+
+AllocationSnapshot CurrentAllocations()
+{
+    AllocationSnapshot snapshot;
+    snapshot.count = g_count.load(std::memory_order_relaxed);
+    snapshot.bytes = g_bytes.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+void* operator new(size_t size) { return Allocate(size); }
+void* operator new[](size_t size) { return Allocate(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    try {
+        return Allocate(size);
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
@@ -0,0 +1,15 @@
+﻿#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstdint>
+
+// bench 替换了全局 operator new，统计整个进程的堆分配次数与字节数
+struct AllocationSnapshot
+{
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+};
+
+AllocationSnapshot CurrentAllocations();
+
+#endif
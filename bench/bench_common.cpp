@@ -0,0 +1,195 @@
+﻿#include "bench_common.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+std::string BenchArgs::Get(const std::string& name, const std::string& fallback) const
+{
+    auto it = options.find(name);
+    return it == options.end() ? fallback : it->second;
+}
+
+long long BenchArgs::GetInt(const std::string& name, long long fallback) const
+{
+    auto it = options.find(name);
+    return it == options.end() ? fallback : atoll(it->second.c_str());
+}
+
+BenchArgs ParseBenchArgs(int argc, char** argv, int first)
+{
+    BenchArgs args;
+    for (int i = first; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+            std::string name = arg.substr(2);
+            std::string value = "1";
+            size_t eq = name.find('=');
+            if (eq != std::string::npos) {
+                value = name.substr(eq + 1);
+                name.resize(eq);
+            }
+            else if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0) {
+                value = argv[++i];
+            }
+            args.options[name] = value;
+        }
+        else {
+            args.positional.push_back(arg);
+        }
+    }
+    return args;
+}
+
+SyntheticSiteOptions SiteOptionsFromArgs(const BenchArgs& args)
+{
+    SyntheticSiteOptions options;
+    options.pageCount = (int)args.GetInt("pages", options.pageCount);
+    options.fanOut = (int)args.GetInt("fanout", options.fanOut);
+    options.pageBytes = (size_t)args.GetInt("page-bytes", (long long)options.pageBytes);
+    options.mediaPerPage = (int)args.GetInt("media", options.mediaPerPage);
+    options.mediaBytes = (size_t)args.GetInt("media-bytes", (long long)options.mediaBytes);
+    options.latencyMs = (int)args.GetInt("latency-ms", options.latencyMs);
+    options.throttleEvery = (int)args.GetInt("throttle-every", options.throttleEvery);
+    options.slowBodyEvery = (int)args.GetInt("slow-every", options.slowBodyEvery);
+    options.slowBodyMs = (int)args.GetInt("slow-ms", options.slowBodyMs);
+    return options;
+}
+
+bool ReadFile(const std::string& path, std::string& content)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    std::ostringstream buffer;
+    buffer << in.rdbuf();
+    content = buffer.str();
+    return true;
+}
+
+bool LoadCorpus(const BenchArgs& args, std::vector<std::pair<std::string, std::string>>& corpus)
+{
+    std::vector<std::string> paths = args.positional;
+    if (args.Has("corpus")) {
+        std::error_code ec;
+        std::vector<std::string> found;
+        for (fs::recursive_directory_iterator it(args.Get("corpus"), ec), end; !ec && it != end; it.increment(ec)) {
+            std::string ext = it->path().extension().string();
+            std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+            if (it->is_regular_file() && (ext == ".htm" || ext == ".html")) found.push_back(it->path().string());
+        }
+        std::sort(found.begin(), found.end());
+        paths.insert(paths.end(), found.begin(), found.end());
+    }
+    for (const auto& path : paths) {
+        std::string content;
+        if (!ReadFile(path, content)) {
+            fprintf(stderr, "Cannot read %s\n", path.c_str());
+            return false;
+        }
+        corpus.emplace_back(path, std::move(content));
+    }
+    if (corpus.empty()) {
+        corpus.emplace_back("synthetic-small", MakeSyntheticPage(50));
+        corpus.emplace_back("synthetic-large", MakeSyntheticPage(2000));
+        corpus.emplace_back("synthetic-site", MakeSyntheticSitePage(SyntheticSiteOptions(), 1));
+    }
+    return true;
+}
+
+std::string MakeSyntheticPage(int blocks)
+{
+    std::ostringstream out;
+    out << "<!DOCTYPE html>\n<html><head><title>综合新闻</title>\n"
+        << "<style type=\"text/css\">.nav { color: red; } a > b { margin: 0 }</style>\n"
+        << "<script type=\"text/javascript\">var menu = '<a href=\"/js.htm\">'; if (a < b) {}</script>\n"
+        << "</head><body>\n";
+    for (int i = 0; i < blocks; ++i) {
+        out << "<div class=\"news-item\">\n"
+            << "  <a href=\"/info/1003/" << 56000 + i << ".htm\" target=\"_blank\" title=\"新闻 " << i << "\">标题 " << i << "</a>\n"
+            << "  <a href='../list" << i << ".htm'>列表</a> <a href=\"#top\">顶部</a>\n"
+            << "  <IMG alt=\"pic\" SRC=\"/__local/" << i << "/logo_" << i << ".png\" />\n"
+            << "  <p>山东理工大学 &nbsp; 第" << i << "条 &amp; 新闻 &lt;摘要&gt; &quot;引用&quot; &#39;单引号&#39;\n"
+            << "     多余   空白\t\t和换行</p>\n";
+        if (i % 8 == 0) {
+            out << "  <video src=\"/media/clip" << i << ".mp4\" poster=\"/media/poster" << i << ".jpg\" controls></video>\n"
+                << "  <audio src=\"audio" << i << ".mp3\"></audio>\n"
+                << "  <video controls><source src=\"//cdn.sdut.edu.cn/v" << i << ".webm\" type=\"video/webm\"/></video>\n"
+                << "  <div class=\"wp_video_player player\" id=\"p" << i << "\" sudy-wp-src=\"/_upload/video/v" << i << ".mp4\"></div>\n"
+                << "  <script>document.write('<img src=\"inline.gif\">');</script>\n";
+        }
+        out << "</div>\n";
+    }
+    out << "</body></html>\n";
+    return out.str();
+}
+
+void JsonLine::Key(const std::string& key)
+{
+    if (!m_body.empty()) m_body += ",";
+    m_body += "\"" + key + "\":";
+}
+
+JsonLine& JsonLine::Add(const std::string& key, const std::string& value)
+{
+    Key(key);
+    m_body += "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            m_body += '\\';
+            m_body += c;
+        }
+        else if ((unsigned char)c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)c);
+            m_body += escaped;
+        }
+        else {
+            m_body += c;
+        }
+    }
+    m_body += "\"";
+    return *this;
+}
+
+JsonLine& JsonLine::Add(const std::string& key, double value)
+{
+    Key(key);
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.6g", value);
+    m_body += buffer;
+    return *this;
+}
+
+JsonLine& JsonLine::Add(const std::string& key, long long value)
+{
+    Key(key);
+    m_body += std::to_string(value);
+    return *this;
+}
+
+JsonOutput::JsonOutput(const std::string& path)
+{
+    if (path.empty()) return;
+    if (path == "-") {
+        m_file = stdout;
+        return;
+    }
+    m_file = fopen(path.c_str(), "w");
+    m_owned = m_file != nullptr;
+}
+
+JsonOutput::~JsonOutput()
+{
+    if (m_owned) fclose(m_file);
+}
+
+void JsonOutput::Write(const JsonLine& line)
+{
+    if (!m_file) return;
+    fprintf(m_file, "%s\n", line.Str().c_str());
+    fflush(m_file);
+}
@@ -0,0 +1,78 @@
+﻿#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include "synthetic_site.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// "--name value" 形式的选项和其余的位置参数
+struct BenchArgs
+{
+    std::map<std::string, std::string> options;
+    std::vector<std::string> positional;
+
+    bool Has(const std::string& name) const { return options.count(name) > 0; }
+    std::string Get(const std::string& name, const std::string& fallback = "") const;
+    long long GetInt(const std::string& name, long long fallback) const;
+};
+
+BenchArgs ParseBenchArgs(int argc, char** argv, int first);
+SyntheticSiteOptions SiteOptionsFromArgs(const BenchArgs& args);
+
+bool ReadFile(const std::string& path, std::string& content);
+// 命令行给出的页面、--corpus 目录下的 .htm/.html，都没有时用生成的页面
+bool LoadCorpus(const BenchArgs& args, std::vector<std::pair<std::string, std::string>>& corpus);
+std::string MakeSyntheticPage(int blocks);
+
+template <typename F>
+double TimeMs(int iterations, F&& f)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+}
+
+// 机器可读的结果：每个结果一行 JSON，写到 --json 指定的文件（"-" 为标准输出）
+class JsonLine
+{
+public:
+    JsonLine& Add(const std::string& key, const std::string& value);
+    JsonLine& Add(const std::string& key, const char* value) { return Add(key, std::string(value)); }
+    JsonLine& Add(const std::string& key, double value);
+    JsonLine& Add(const std::string& key, long long value);
+    JsonLine& Add(const std::string& key, uint64_t value) { return Add(key, (long long)value); }
+    JsonLine& Add(const std::string& key, int value) { return Add(key, (long long)value); }
+    std::string Str() const { return "{" + m_body + "}"; }
+
+private:
+    void Key(const std::string& key);
+    std::string m_body;
+};
+
+class JsonOutput
+{
+public:
+    explicit JsonOutput(const std::string& path);
+    ~JsonOutput();
+    bool IsOpen() const { return m_file != nullptr; }
+    void Write(const JsonLine& line);
+
+private:
+    FILE* m_file = nullptr;
+    bool m_owned = false;
+};
+
+// 各子命令，返回进程退出码
+int RunExtractBenchmark(const BenchArgs& args);
+int RunMicroBenchmark(const BenchArgs& args);
+int RunSiteServer(const BenchArgs& args);
+int RunCrawlBenchmark(const BenchArgs& args);
+int RunIndexBenchmark(const BenchArgs& args);
+
+#endif
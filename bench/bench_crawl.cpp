@@ -0,0 +1,117 @@
+﻿#include "alloc_counter.h"
+#include "bench_common.h"
+#include "crawler.h"
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+int RunSiteServer(const BenchArgs& args)
+{
+    SyntheticSiteServer server(SiteOptionsFromArgs(args));
+    if (!server.Start((int)args.GetInt("port", 8780))) {
+        fprintf(stderr, "Cannot listen on port %lld\n", args.GetInt("port", 8780));
+        return 1;
+    }
+    printf("Serving synthetic site at %s/p/0\n", server.BaseUrl().c_str());
+    long long seconds = args.GetInt("seconds", 0);
+    if (seconds > 0) {
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    }
+    else {
+        printf("Press Enter to stop...\n");
+        std::string line;
+        std::getline(std::cin, line);
+    }
+    const SyntheticSiteStats& stats = server.Stats();
+    printf("requests: %llu, pages: %llu, media: %llu, throttled: %llu\n", (unsigned long long)stats.requests.load(),
+        (unsigned long long)stats.pages.load(), (unsigned long long)stats.media.load(),
+        (unsigned long long)stats.throttled.load());
+    server.Stop();
+    return 0;
+}
+
+// 端到端：在本进程里起合成站点，用默认的抓取流程抓完并统计页面数/秒与每页分配次数
+int RunCrawlBenchmark(const BenchArgs& args)
+{
+    SyntheticSiteOptions site = SiteOptionsFromArgs(args);
+    int threads = (int)args.GetInt("threads", 8);
+    int runs = std::max(1, (int)args.GetInt("runs", 1));
+    std::string workDir = args.Get("work-dir", "bench_work");
+    std::string host = args.Get("host", "127.0.0.1");
+    JsonOutput json(args.Get("json"));
+    int failures = 0;
+    for (int run = 0; run < runs; ++run) {
+        SyntheticSiteServer server(site);
+        if (!server.Start()) {
+            fprintf(stderr, "Cannot start synthetic site\n");
+            return 1;
+        }
+        // 每轮使用新的工作目录，缓存、媒体库和检查点不会让后一轮跳过请求
+        std::error_code ec;
+        fs::remove_all(workDir, ec);
+        fs::create_directories(workDir, ec);
+        CrawlerOptions options;
+        options.maxDepth = (int)args.GetInt("depth", 64);
+        options.threadCount = threads;
+        options.scheduler.perHostConcurrency = (int)args.GetInt("per-host", threads);
+        options.scheduler.minDelayMs = (int)args.GetInt("delay-ms", 0);
+        options.scheduler.maxDelayMs = options.scheduler.minDelayMs;
+        // 默认测吞吐上限；--adaptive 时按自适应限速抓取，速率状态写在工作目录里
+        options.scheduler.rateLimit.enabled = args.Has("adaptive");
+        options.scheduler.rateLimit.maxRate = (double)args.GetInt("max-rate", 50);
+        // --host 用主机名代替 127.0.0.1 访问站点，配合 --nameserver 指向的本地桩解析器测解析缓存
+        options.dns.nameserver = args.Get("nameserver");
+        // 合成站点的页面正文几乎相同，默认不做近似重复检测，免得归档量和以前的结果不可比
+        options.nearDuplicate.enabled = args.Has("near-dup");
+        // 全文索引同理，--index 时打开，看抓取时建索引的开销
+        options.index.enabled = args.Has("index");
+        options.scheduler.frontier.maxInMemory = (size_t)args.GetInt("max-frontier", 100000);
+        options.scheduler.frontier.spillPath = (fs::path(workDir) / "frontier.spill").string();
+        options.scheduler.rateLimit.statePath = (fs::path(workDir) / "rate_limits.tsv").string();
+        options.archive.directory = (fs::path(workDir) / "archive").string();
+        options.mediaStore.directory = (fs::path(workDir) / "media_store").string();
+        options.httpCache.path = (fs::path(workDir) / "http_cache.tsv").string();
+        options.checkpoint.directory = (fs::path(workDir) / "checkpoint").string();
+        options.index.directory = (fs::path(workDir) / "index").string();
+        options.metrics.path = (fs::path(workDir) / "metrics.json").string();
+        options.metrics.format = MetricsFormat::Json;
+        options.metrics.consoleRate = false;
+
+        bool ok;
+        double seconds;
+        AllocationSnapshot before, after;
+        {
+            Crawler crawler(options);
+            before = CurrentAllocations();
+            auto started = std::chrono::steady_clock::now();
+            ok = crawler.Start("http://" + host + ":" + std::to_string(server.Port()) + "/p/0");
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            after = CurrentAllocations();
+        }
+        server.Stop();
+        if (!ok) failures++;
+
+        const SyntheticSiteStats& stats = server.Stats();
+        double pages = (double)std::max<uint64_t>(1, stats.pages.load());
+        double pagesPerSec = stats.pages.load() / seconds;
+        double bytesPerSec = stats.bytes.load() / seconds;
+        double allocsPerPage = (after.count - before.count) / pages;
+        double allocBytesPerPage = (after.bytes - before.bytes) / pages;
+        printf("run %d: %llu pages, %llu media, %llu throttled in %.3f s: %.1f pages/s, %.1f MB/s, "
+            "%.1f allocs/page, %.1f KB allocated/page\n", run + 1, (unsigned long long)stats.pages.load(),
+            (unsigned long long)stats.media.load(), (unsigned long long)stats.throttled.load(), seconds, pagesPerSec,
+            bytesPerSec / (1024 * 1024), allocsPerPage, allocBytesPerPage / 1024);
+        json.Write(JsonLine().Add("benchmark", "crawl").Add("run", run + 1).Add("threads", threads)
+            .Add("sitePages", site.pageCount).Add("fanOut", site.fanOut).Add("pageBytes", (long long)site.pageBytes)
+            .Add("mediaPerPage", site.mediaPerPage).Add("latencyMs", site.latencyMs)
+            .Add("throttleEvery", site.throttleEvery).Add("slowBodyEvery", site.slowBodyEvery)
+            .Add("pages", stats.pages.load()).Add("media", stats.media.load()).Add("throttled", stats.throttled.load())
+            .Add("requests", stats.requests.load()).Add("seconds", seconds).Add("pagesPerSec", pagesPerSec)
+            .Add("bytesPerSec", bytesPerSec).Add("allocsPerPage", allocsPerPage)
+            .Add("allocBytesPerPage", allocBytesPerPage));
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+﻿#include "bench_common.h"
+#include "crawler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <regex>
+
+// 对比单遍 HtmlTokenizer 与原来基于 std::regex 的提取实现
+
+namespace
+{
+    const char* kBaseUrl = "https://lgwindow.sdut.edu.cn/info/1003/56494.htm";
+
+    std::vector<std::string> RegexExtractLinks(const std::string& html, const std::string& baseUrl)
+    {
+        std::vector<std::string> links;
+        std::regex linkRegex(R"(<a\s+[^>]*href\s*=\s*[\"']([^\"'#]+)[\"'][^>]*>)", std::regex_constants::icase);
+        std::sregex_iterator iter(html.begin(), html.end(), linkRegex);
+        std::sregex_iterator end;
+        HttpTarget base;
+        if (!ParseHttpTarget(baseUrl, base)) return links;
+        std::string baseOrigin = base.Origin();
+        for (; iter != end; ++iter) {
+            std::string href = (*iter)[1].str();
+            if (href.empty()) continue;
+            std::string absoluteUrl;
+            if (href.substr(0, 2) == "//") {
+                absoluteUrl = base.scheme + ":" + href;
+            }
+            else if (href[0] == '/') {
+                absoluteUrl = baseOrigin + href;
+            }
+            else if (href.substr(0, 7) == "http://" || href.substr(0, 8) == "https://") {
+                absoluteUrl = href;
+            }
+            else {
+                size_t lastSlash = base.path.find_last_of('/');
+                absoluteUrl = baseOrigin + (lastSlash != std::string::npos ? base.path.substr(0, lastSlash + 1) : "/") + href;
+            }
+            if (absoluteUrl.find(baseOrigin) == 0) links.push_back(absoluteUrl);
+        }
+        return links;
+    }
+
+    std::set<std::string> RegexExtractMediaUrls(Crawler& crawler, const std::string& html, const std::string& baseUrl)
+    {
+        std::set<std::string> urls;
+        std::vector<std::string> patterns = {
+            R"(<div\s+[^>]*?class\s*=\s*["'](?:[^"']*?\s+)?wp_video_player(?:\s+[^"']*)?["'][^>]*?sudy-wp-src\s*=\s*["']([^"']+)["'][^>]*>)",
+            R"(<source\s+[^>]*?\bsrc\s*=\s*["']([^"']+)["'][^>]*?/?>)",
+            R"(<video\s+[^>]*?\bsrc\s*=\s*["']([^"']+)["'][^>]*?>)",
+            R"(<video\s+[^>]*?\bposter\s*=\s*["']([^"']+)["'][^>]*?>)",
+            R"(<audio\s+[^>]*?\bsrc\s*=\s*["']([^"']+)["'][^>]*?/?>)",
+            R"(<img\s+[^>]*?\bsrc\s*=\s*["']([^"']+)["'][^>]*?/?>)"
+        };
+        for (const auto& pattern : patterns) {
+            std::regex urlRegex(pattern, std::regex_constants::icase);
+            std::sregex_iterator iter(html.begin(), html.end(), urlRegex);
+            std::sregex_iterator end;
+            for (; iter != end; ++iter) {
+                std::string url = (*iter)[1].str();
+                if (url.empty()) continue;
+                std::string absoluteUrl = crawler.ConvertToAbsoluteUrl(url, baseUrl);
+                if (!absoluteUrl.empty()) urls.insert(absoluteUrl);
+            }
+        }
+        return urls;
+    }
+
+    void EraseBlocks(std::string& text, const char* open, const char* close)
+    {
+        size_t start;
+        size_t closeLen = strlen(close);
+        while ((start = text.find(open, 0)) != std::string::npos) {
+            size_t tagEnd = text.find('>', start);
+            size_t end = (tagEnd == std::string::npos) ? std::string::npos : text.find(close, tagEnd);
+            if (end == std::string::npos) {
+                text.erase(start);
+                break;
+            }
+            text.erase(start, end + closeLen - start);
+        }
+    }
+
+    std::string RegexExtractTextContent(const std::string& html)
+    {
+        if (html.empty()) return "";
+        std::string text = html;
+        EraseBlocks(text, "<script", "</script>");
+        EraseBlocks(text, "<style", "</style>");
+        text = std::regex_replace(text, std::regex(R"(<[^>]*>)"), "");
+        text = std::regex_replace(text, std::regex("&nbsp;"), " ");
+        text = std::regex_replace(text, std::regex("&amp;"), "&");
+        text = std::regex_replace(text, std::regex("&lt;"), "<");
+        text = std::regex_replace(text, std::regex("&gt;"), ">");
+        text = std::regex_replace(text, std::regex("&quot;"), "\"");
+        text = std::regex_replace(text, std::regex("&#39;"), "'");
+        text = std::regex_replace(text, std::regex(R"([ \t\f\v\n\r]+)"), " ");
+        size_t start = text.find_first_not_of(' ');
+        if (start == std::string::npos) return "";
+        size_t end = text.find_last_not_of(' ');
+        return text.substr(start, end - start + 1);
+    }
+}
+
+int RunExtractBenchmark(const BenchArgs& args)
+{
+    std::vector<std::pair<std::string, std::string>> corpus;
+    if (!LoadCorpus(args, corpus)) return 1;
+    JsonOutput json(args.Get("json"));
+
+    Crawler crawler(0);
+    bool allMatch = true;
+    printf("%-20s %10s %-10s %12s %12s %8s %s\n", "page", "bytes", "extractor", "regex_ms", "single_ms", "speedup", "match");
+    for (const auto& entry : corpus) {
+        const std::string& html = entry.second;
+        int iterations = html.size() > 500000 ? 3 : 20;
+
+        auto links = crawler.ExtractLinks(html, kBaseUrl);
+        auto media = crawler.ExtractMediaUrls(html, kBaseUrl);
+        auto regexText = RegexExtractTextContent(html);
+        auto text = crawler.ExtractTextContent(html);
+        // 有意的行为变化：单遍扫描不把 <script>/<style> 里用字符串拼出的标签当作链接或媒体，
+        // 原正则会匹配到它们。因此正则版在去掉这两种块的页面上运行，两边结果应完全相同
+        std::string markup = html;
+        EraseBlocks(markup, "<script", "</script>");
+        EraseBlocks(markup, "<style", "</style>");
+        // 旧实现只做字符串拼接，比较前先把 "../" 之类的点段规范化
+        std::set<std::string> regexLinks;
+        for (const auto& link : RegexExtractLinks(markup, kBaseUrl)) {
+            regexLinks.insert(crawler.ConvertToAbsoluteUrl(link, link));
+        }
+        bool linksMatch = std::set<std::string>(links.begin(), links.end()) == regexLinks;
+        bool mediaMatch = media == RegexExtractMediaUrls(crawler, markup, kBaseUrl);
+        bool textMatch = (text == regexText);
+
+        struct Row { const char* name; double regexMs; double singleMs; bool match; };
+        Row rows[] = {
+            { "links", TimeMs(iterations, [&] { RegexExtractLinks(html, kBaseUrl); }),
+                TimeMs(iterations, [&] { crawler.ExtractLinks(html, kBaseUrl); }), linksMatch },
+            { "media", TimeMs(iterations, [&] { RegexExtractMediaUrls(crawler, html, kBaseUrl); }),
+                TimeMs(iterations, [&] { crawler.ExtractMediaUrls(html, kBaseUrl); }), mediaMatch },
+            { "text", TimeMs(iterations, [&] { RegexExtractTextContent(html); }),
+                TimeMs(iterations, [&] { crawler.ExtractTextContent(html); }), textMatch },
+        };
+        PageContent page;
+        double parseMs = TimeMs(iterations, [&] { page = PageContent(); crawler.ParsePage(html, kBaseUrl, true, page); });
+        double regexTotal = 0;
+        for (const auto& row : rows) {
+            printf("%-20s %10zu %-10s %12.3f %12.3f %7.1fx %s\n", entry.first.c_str(), html.size(), row.name,
+                row.regexMs, row.singleMs, row.regexMs / row.singleMs, row.match ? "yes" : "NO");
+            regexTotal += row.regexMs;
+            allMatch = allMatch && row.match;
+            json.Write(JsonLine().Add("benchmark", "extract").Add("page", entry.first).Add("bytes", (long long)html.size())
+                .Add("extractor", row.name).Add("regexMs", row.regexMs).Add("singleMs", row.singleMs)
+                .Add("match", row.match ? "yes" : "no"));
+        }
+        printf("%-20s %10zu %-10s %12.3f %12.3f %7.1fx\n", entry.first.c_str(), html.size(), "all-in-one",
+            regexTotal, parseMs, regexTotal / parseMs);
+    }
+    return allMatch ? 0 : 1;
+}
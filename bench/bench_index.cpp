@@ -0,0 +1,154 @@
+﻿#include "bench_common.h"
+#include "index_query.h"
+#include "inverted_index.h"
+#include <algorithm>
+#include <filesystem>
+#include <random>
+
+// 全文索引：用合成的中英混排正文建索引，报告建索引吞吐、段数与合并次数，再在建好的索引上计时一组查询
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const char* const kChineseChars[] = { "的", "一", "是", "在", "不", "了", "有", "和", "人", "这", "中", "大", "为",
+        "上", "个", "国", "我", "以", "要", "他", "时", "来", "用", "们", "生", "到", "作", "地", "于", "出", "就", "分",
+        "对", "成", "会", "可", "主", "发", "年", "动", "同", "工", "也", "能", "下", "过", "子", "说", "产", "种", "面",
+        "而", "方", "后", "多", "定", "行", "学", "法", "所", "民", "得", "经", "十", "三", "之", "进", "着", "等", "部",
+        "度", "家", "电", "力", "里", "如", "水", "化", "高", "自", "二", "理", "起", "小", "物", "现", "实", "加", "量",
+        "都", "两", "体", "制", "机", "当", "使", "点", "从", "业", "本", "去", "把", "性", "好", "应", "开", "它", "合",
+        "还", "因", "由", "其", "些", "然", "前", "外", "天", "政", "四", "日", "那", "社", "义", "事", "平", "形", "相",
+        "全", "表", "间", "样", "与", "关", "各", "重", "新", "线", "内", "数", "正", "心", "反", "你", "明", "看", "原",
+        "又", "么", "利", "比", "或", "但", "质", "气", "第", "向", "道", "命", "此", "变", "条", "只", "没", "结", "解",
+        "山", "东", "科", "技", "校", "院", "信", "息", "网", "络", "研", "究", "通", "知", "公", "告", "招", "聘" };
+    const char* const kEnglishWords[] = { "the", "of", "and", "to", "in", "university", "news", "research", "student",
+        "campus", "library", "science", "engineering", "computer", "network", "data", "system", "model", "learning",
+        "report", "notice", "service", "center", "international", "conference", "lecture", "award", "project", "lab",
+        "ai", "chip", "energy", "materials", "chemistry", "physics", "biology", "medicine", "economics", "history" };
+    const char* const kDefaultQueries[] = { "university", "research data", "\"computer science\"", "学校", "山东",
+        "理工 大学", "\"科技 信息\"", "中", "news OR notice -lecture", "(ai OR chip) 研究" };
+
+    // 词频大致服从 Zipf 分布：下标越小越常见
+    class ZipfPicker
+    {
+    public:
+        ZipfPicker(size_t count, uint32_t seed) : m_random(seed)
+        {
+            double total = 0;
+            for (size_t i = 0; i < count; ++i) {
+                total += 1.0 / (double)(i + 1);
+                m_cumulative.push_back(total);
+            }
+            m_uniform = std::uniform_real_distribution<double>(0, total);
+        }
+
+        size_t Pick()
+        {
+            double value = m_uniform(m_random);
+            return std::lower_bound(m_cumulative.begin(), m_cumulative.end(), value) - m_cumulative.begin();
+        }
+
+        std::mt19937& Random() { return m_random; }
+
+    private:
+        std::mt19937 m_random;
+        std::vector<double> m_cumulative;
+        std::uniform_real_distribution<double> m_uniform;
+    };
+
+    // 汉字串与英文词交替出现，汉字串之间用中文标点隔开
+    void MakeDocument(ZipfPicker& chinese, ZipfPicker& english, int words, std::string& text)
+    {
+        text.clear();
+        std::uniform_int_distribution<int> runLength(2, 8);
+        std::uniform_int_distribution<int> choice(0, 3);
+        int produced = 0;
+        while (produced < words) {
+            if (choice(chinese.Random()) == 0) {
+                text += kEnglishWords[english.Pick()];
+                text += ' ';
+                ++produced;
+                continue;
+            }
+            int run = runLength(chinese.Random());
+            for (int i = 0; i < run; ++i) text += kChineseChars[chinese.Pick()];
+            text += "，";
+            produced += run;
+        }
+    }
+}
+
+int RunIndexBenchmark(const BenchArgs& args)
+{
+    long long docs = std::max(1ll, args.GetInt("docs", 200000));
+    int words = (int)std::max(1ll, args.GetInt("doc-words", 300));
+    int runs = (int)std::max(1ll, args.GetInt("runs", 5));
+    std::string workDir = args.Get("work-dir", (fs::temp_directory_path() / "pachong-bench-index").string());
+    JsonOutput json(args.Get("json"));
+    IndexOptions options;
+    options.directory = workDir;
+    options.segmentMemoryBytes = (size_t)std::max(1ll, args.GetInt("segment-mb", 64)) * 1024 * 1024;
+    options.mergeFactor = (int)args.GetInt("merge-factor", options.mergeFactor);
+    options.flushIntervalSeconds = 3600;
+
+    if (!args.Has("reuse")) {
+        std::error_code ec;
+        fs::remove_all(workDir, ec);
+        ZipfPicker chinese(sizeof(kChineseChars) / sizeof(kChineseChars[0]), 1);
+        ZipfPicker english(sizeof(kEnglishWords) / sizeof(kEnglishWords[0]), 2);
+        std::string text;
+        uint64_t textBytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        IndexWriter writer(options);
+        if (!writer.IsReady()) {
+            fprintf(stderr, "cannot create index in %s\n", workDir.c_str());
+            return 1;
+        }
+        for (long long i = 0; i < docs; ++i) {
+            MakeDocument(chinese, english, words, text);
+            textBytes += text.size();
+            writer.Add("https://bench.example/page/" + std::to_string(i), 1700000000000ll + i, text);
+        }
+        writer.Flush();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        uint64_t indexBytes = 0;
+        for (fs::directory_iterator it(workDir, ec), end; !ec && it != end; it.increment(ec)) {
+            indexBytes += it->file_size(ec);
+        }
+        printf("indexed %lld docs (%.1f MB text) in %.2f s: %.0f docs/s, %.1f MB/s\n", docs, textBytes / 1048576.0,
+            seconds, docs / seconds, textBytes / 1048576.0 / seconds);
+        printf("index %.1f MB (%.0f%% of text), %zu segments, %llu merges\n", indexBytes / 1048576.0,
+            100.0 * (double)indexBytes / (double)std::max<uint64_t>(1, textBytes), writer.SegmentCount(),
+            (unsigned long long)writer.Stats().merges.load());
+        json.Write(JsonLine().Add("benchmark", "index").Add("docs", docs).Add("textBytes", textBytes)
+            .Add("seconds", seconds).Add("docsPerSec", docs / seconds).Add("indexBytes", indexBytes)
+            .Add("segments", (long long)writer.SegmentCount()).Add("merges", writer.Stats().merges.load()));
+    }
+
+    IndexSearcher searcher;
+    if (!searcher.Open({ workDir })) {
+        fprintf(stderr, "no index in %s\n", workDir.c_str());
+        return 1;
+    }
+    std::vector<std::string> queries(args.positional.begin(), args.positional.end());
+    if (queries.empty()) queries.assign(std::begin(kDefaultQueries), std::end(kDefaultQueries));
+    printf("%-32s %12s %10s %10s\n", "query", "matches", "median ms", "max ms");
+    for (const auto& query : queries) {
+        SearchResults results;
+        std::string error;
+        std::vector<double> times;
+        for (int run = 0; run < runs; ++run) {
+            times.push_back(TimeMs(1, [&] { searcher.Search(query, 10, results, error); }));
+        }
+        if (!error.empty()) {
+            printf("%-32s %s\n", query.c_str(), error.c_str());
+            continue;
+        }
+        std::sort(times.begin(), times.end());
+        printf("%-32s %12llu %10.2f %10.2f\n", query.c_str(), (unsigned long long)results.matches,
+            times[times.size() / 2], times.back());
+        json.Write(JsonLine().Add("benchmark", "index-query").Add("query", query).Add("matches", results.matches)
+            .Add("medianMs", times[times.size() / 2]).Add("maxMs", times.back()));
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+﻿#include "bench_common.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+namespace
+{
+    void PrintUsage()
+    {
+        printf("usage: bench <command> [options]\n"
+            "  extract [page.html ...] [--corpus dir] [--json out]\n"
+            "      single-pass tokenizer vs the old std::regex extractors\n"
+            "  micro [page.html ...] [--corpus dir] [--iterations n] [--target-ms n] [--json out]\n"
+            "      ExtractLinks / ExtractMediaUrls / ExtractTextContent / ConvertToAbsoluteUrl / GetMediaTypeFromUrl\n"
+            "  serve [--port n] [--seconds n] [site options]\n"
+            "      run the synthetic site alone for manual crawls\n"
+            "  crawl [--threads n] [--depth n] [--per-host n] [--delay-ms n] [--adaptive] [--max-rate n] [--runs n]\n"
+            "        [--max-frontier n] [--near-dup] [--index] [--host name] [--nameserver ip:port] [--work-dir dir]\n"
+            "        [--json out] [site options]\n"
+            "      end-to-end crawl of an in-process synthetic site, reports pages/s and allocations/page\n"
+            "  index [query ...] [--docs n] [--doc-words n] [--segment-mb n] [--merge-factor n] [--runs n] [--reuse]\n"
+            "        [--work-dir dir] [--json out]\n"
+            "      build a full-text index from synthetic mixed Chinese/English pages, then time queries on it\n"
+            "site options: --pages n --fanout n --page-bytes n --media n --media-bytes n --latency-ms n\n"
+            "              --throttle-every n (429) --slow-every n --slow-ms n\n"
+            "--json out writes one JSON object per result line; \"-\" writes to stdout\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    // 不带子命令时保持原来 bench_extract 的行为
+    const char* command = argc > 1 && strncmp(argv[1], "--", 2) != 0 ? argv[1] : "extract";
+    int first = command == argv[1] ? 2 : 1;
+    BenchArgs args = ParseBenchArgs(argc, argv, first);
+    if (args.Has("help")) {
+        PrintUsage();
+        return 0;
+    }
+    if (strcmp(command, "extract") == 0) return RunExtractBenchmark(args);
+    if (strcmp(command, "micro") == 0) return RunMicroBenchmark(args);
+    if (strcmp(command, "serve") == 0) return RunSiteServer(args);
+    if (strcmp(command, "crawl") == 0) return RunCrawlBenchmark(args);
+    if (strcmp(command, "index") == 0) return RunIndexBenchmark(args);
+    // 旧用法：bench_extract page.html ...
+    std::error_code ec;
+    if (std::filesystem::is_regular_file(command, ec)) return RunExtractBenchmark(ParseBenchArgs(argc, argv, 1));
+    PrintUsage();
+    return 2;
+}
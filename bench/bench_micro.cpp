@@ -0,0 +1,94 @@
+﻿#include "alloc_counter.h"
+#include "bench_common.h"
+#include "crawler.h"
+#include <cstdio>
+
+// 提取函数与 URL 工具函数的微基准：每个语料页面上分别计时并统计每次调用的分配次数
+
+namespace
+{
+    const char* kBaseUrl = "https://lgwindow.sdut.edu.cn/info/1003/56494.htm";
+
+    struct MicroResult
+    {
+        double nsPerOp = 0;
+        double allocsPerOp = 0;
+        long long iterations = 0;
+    };
+
+    // 先跑一次估计耗时，再按目标时长决定迭代次数
+    template <typename F>
+    MicroResult Measure(long long fixedIterations, double targetMs, F&& f)
+    {
+        long long iterations = fixedIterations;
+        if (iterations <= 0) {
+            double onceMs = TimeMs(1, f);
+            iterations = std::max(1ll, std::min(1000000ll, (long long)(targetMs / std::max(onceMs, 1e-6))));
+        }
+        AllocationSnapshot before = CurrentAllocations();
+        double totalMs = TimeMs((int)iterations, f) * (double)iterations;
+        AllocationSnapshot after = CurrentAllocations();
+        MicroResult result;
+        result.iterations = iterations;
+        result.nsPerOp = totalMs * 1e6 / (double)iterations;
+        result.allocsPerOp = (double)(after.count - before.count) / (double)iterations;
+        return result;
+    }
+}
+
+int RunMicroBenchmark(const BenchArgs& args)
+{
+    std::vector<std::pair<std::string, std::string>> corpus;
+    if (!LoadCorpus(args, corpus)) return 1;
+    long long fixedIterations = args.GetInt("iterations", 0);
+    double targetMs = (double)args.GetInt("target-ms", 200);
+    JsonOutput json(args.Get("json"));
+    Crawler crawler(0);
+
+    printf("%-24s %10s %-22s %8s %12s %10s %10s\n", "page", "bytes", "op", "calls", "ns/call", "MB/s", "allocs");
+    for (const auto& entry : corpus) {
+        const std::string& html = entry.second;
+        // 原始 href/src 供 ConvertToAbsoluteUrl 使用，解析后的地址供 GetMediaTypeFromUrl 使用
+        std::vector<std::string> references;
+        HtmlCallbacks callbacks;
+        callbacks.onLink = [&](std::string_view href) { references.emplace_back(href); };
+        callbacks.onMedia = [&](std::string_view src) { references.emplace_back(src); };
+        HtmlTokenizer tokenizer;
+        tokenizer.Tokenize(html, callbacks);
+        std::vector<std::string> urls = crawler.ExtractLinks(html, kBaseUrl);
+        for (const auto& url : crawler.ExtractMediaUrls(html, kBaseUrl)) urls.push_back(url);
+
+        struct Op
+        {
+            const char* name;
+            size_t calls;
+            MicroResult result;
+        };
+        size_t sink = 0;
+        Op ops[] = {
+            { "ExtractLinks", 1, Measure(fixedIterations, targetMs, [&] { sink += crawler.ExtractLinks(html, kBaseUrl).size(); }) },
+            { "ExtractMediaUrls", 1, Measure(fixedIterations, targetMs, [&] { sink += crawler.ExtractMediaUrls(html, kBaseUrl).size(); }) },
+            { "ExtractTextContent", 1, Measure(fixedIterations, targetMs, [&] { sink += crawler.ExtractTextContent(html).size(); }) },
+            { "ConvertToAbsoluteUrl", references.size(), Measure(fixedIterations, targetMs, [&] {
+                for (const auto& reference : references) sink += crawler.ConvertToAbsoluteUrl(reference, kBaseUrl).size();
+            }) },
+            { "GetMediaTypeFromUrl", urls.size(), Measure(fixedIterations, targetMs, [&] {
+                for (const auto& url : urls) sink += (size_t)crawler.GetMediaTypeFromUrl(url);
+            }) },
+        };
+        for (const auto& op : ops) {
+            // 按单次调用折算；整页操作的吞吐按页面字节数计算
+            double calls = (double)std::max<size_t>(1, op.calls);
+            double nsPerCall = op.result.nsPerOp / calls;
+            double mbPerSec = op.calls == 1 ? html.size() / (op.result.nsPerOp / 1e9) / (1024 * 1024) : 0;
+            double allocsPerCall = op.result.allocsPerOp / calls;
+            printf("%-24s %10zu %-22s %8zu %12.1f %10.1f %10.2f\n", entry.first.c_str(), html.size(), op.name, op.calls,
+                nsPerCall, mbPerSec, allocsPerCall);
+            json.Write(JsonLine().Add("benchmark", "micro").Add("page", entry.first).Add("bytes", (long long)html.size())
+                .Add("op", op.name).Add("calls", (long long)op.calls).Add("iterations", op.result.iterations)
+                .Add("nsPerCall", nsPerCall).Add("mbPerSec", mbPerSec).Add("allocsPerCall", allocsPerCall));
+        }
+        if (sink == 0) printf("(empty page)\n");
+    }
+    return 0;
+}
@@ -0,0 +1,318 @@
+﻿#include "synthetic_site.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifdef _WIN32
+    using SocketHandle = SOCKET;
+    const intptr_t kInvalidSocket = (intptr_t)INVALID_SOCKET;
+
+    void CloseSocket(intptr_t s) { closesocket((SOCKET)s); }
+    void ShutdownSocket(intptr_t s) { shutdown((SOCKET)s, SD_BOTH); }
+
+    bool InitSockets()
+    {
+        static bool ok = [] {
+            WSADATA data;
+            return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+        }();
+        return ok;
+    }
+#else
+    using SocketHandle = int;
+    const intptr_t kInvalidSocket = -1;
+
+    void CloseSocket(intptr_t s) { close((int)s); }
+    void ShutdownSocket(intptr_t s) { shutdown((int)s, SHUT_RDWR); }
+    bool InitSockets() { return true; }
+#endif
+
+    const char* const kWords[] = { "山东理工大学", "新闻", "crawler", "benchmark", "学院", "通知公告", "synthetic",
+        "page", "研究", "&amp;", "&nbsp;", "教学", "科研", "content" };
+
+    bool StartsWith(const std::string& s, const char* prefix)
+    {
+        return s.compare(0, strlen(prefix), prefix) == 0;
+    }
+
+    std::string HeaderValue(const std::string& head, const char* name)
+    {
+        size_t nameLen = strlen(name);
+        size_t pos = 0;
+        while ((pos = head.find("\r\n", pos)) != std::string::npos) {
+            pos += 2;
+            if (head.size() - pos > nameLen && head[pos + nameLen] == ':') {
+                bool match = true;
+                for (size_t i = 0; i < nameLen && match; ++i) {
+                    match = tolower((unsigned char)head[pos + i]) == tolower((unsigned char)name[i]);
+                }
+                if (match) {
+                    size_t start = head.find_first_not_of(' ', pos + nameLen + 1);
+                    size_t end = head.find("\r\n", pos);
+                    if (start == std::string::npos || start >= end) return "";
+                    return head.substr(start, end - start);
+                }
+            }
+        }
+        return "";
+    }
+
+    std::string MakeMedia(int page, int index, size_t size)
+    {
+        std::string data(size, '\0');
+        static const unsigned char kJpegHeader[] = { 0xFF, 0xD8, 0xFF, 0xE0 };
+        for (size_t i = 0; i < size; ++i) {
+            data[i] = i < sizeof(kJpegHeader) ? (char)kJpegHeader[i] : (char)((i * 131 + page * 7 + index) & 0xFF);
+        }
+        return data;
+    }
+}
+
+std::string MakeSyntheticSitePage(const SyntheticSiteOptions& options, int index)
+{
+    std::ostringstream out;
+    out << "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>合成页面 " << index << "</title>\n"
+        << "<style>.nav { color: #333 } a > b { margin: 0 }</style>\n"
+        << "<script>var nav = '<a href=\"/js.htm\">'; if (a < b) {}</script>\n</head><body>\n<div class=\"nav\">"
+        << "<a href=\"/p/0\">首页</a> <a href=\"/p/" << (index > 0 ? (index - 1) / std::max(1, options.fanOut) : 0)
+        << "\">上一级</a> <a href=\"#top\">顶部</a></div>\n<ul>\n";
+    for (int i = 1; i <= options.fanOut; ++i) {
+        long long child = (long long)index * options.fanOut + i;
+        if (child >= options.pageCount) break;
+        out << "<li><a href=\"" << (i % 2 ? "/p/" : "../p/") << child << "\" title=\"第 " << child << " 页\">标题 "
+            << child << "</a></li>\n";
+    }
+    out << "</ul>\n";
+    for (int k = 0; k < options.mediaPerPage; ++k) {
+        out << "<img alt=\"pic\" src=\"/m/" << index << "_" << k << ".jpg\" />\n";
+    }
+    // 用确定的伪随机词填充到目标大小
+    uint32_t seed = (uint32_t)index * 2654435761u + 1;
+    std::string filler;
+    size_t target = options.pageBytes;
+    while ((size_t)out.tellp() + filler.size() + 32 < target) {
+        filler += "<p>";
+        for (int w = 0; w < 12; ++w) {
+            seed = seed * 1103515245u + 12345u;
+            filler += kWords[(seed >> 16) % (sizeof(kWords) / sizeof(kWords[0]))];
+            filler += (w % 4 == 3) ? "\n" : " ";
+        }
+        filler += "</p>\n";
+    }
+    out << filler << "</body></html>\n";
+    return out.str();
+}
+
+SyntheticSiteServer::SyntheticSiteServer(const SyntheticSiteOptions& options)
+    : m_options(options)
+{
+    m_options.pageCount = std::max(1, m_options.pageCount);
+    m_options.fanOut = std::max(1, m_options.fanOut);
+}
+
+SyntheticSiteServer::~SyntheticSiteServer()
+{
+    Stop();
+}
+
+bool SyntheticSiteServer::Start(int port)
+{
+    if (!InitSockets()) return false;
+    SocketHandle listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if ((intptr_t)listener == kInvalidSocket) return false;
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short)port);
+    socklen_t len = sizeof(addr);
+    if (bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 128) != 0 ||
+        getsockname(listener, (sockaddr*)&addr, &len) != 0) {
+        CloseSocket((intptr_t)listener);
+        return false;
+    }
+    m_listener = (intptr_t)listener;
+    m_port = ntohs(addr.sin_port);
+    m_stopping = false;
+    m_acceptThread = std::thread(&SyntheticSiteServer::AcceptLoop, this);
+    return true;
+}
+
+void SyntheticSiteServer::Stop()
+{
+    if (!m_acceptThread.joinable()) return;
+    m_stopping = true;
+    ShutdownSocket(m_listener);
+    CloseSocket(m_listener);
+    m_acceptThread.join();
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (intptr_t client : m_clients) ShutdownSocket(client);
+        threads.swap(m_threads);
+    }
+    for (auto& thread : threads) thread.join();
+    m_listener = kInvalidSocket;
+}
+
+void SyntheticSiteServer::AcceptLoop()
+{
+    while (!m_stopping) {
+        SocketHandle client = accept((SocketHandle)m_listener, nullptr, nullptr);
+        if ((intptr_t)client == kInvalidSocket) {
+            if (m_stopping) break;
+            continue;
+        }
+        int one = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping) {
+            CloseSocket((intptr_t)client);
+            break;
+        }
+        m_clients.push_back((intptr_t)client);
+        m_threads.emplace_back(&SyntheticSiteServer::ServeConnection, this, (intptr_t)client);
+    }
+}
+
+void SyntheticSiteServer::ServeConnection(intptr_t client)
+{
+    std::string buffer;
+    char chunk[4096];
+    while (!m_stopping) {
+        size_t end = buffer.find("\r\n\r\n");
+        if (end == std::string::npos) {
+            int n = (int)recv((SocketHandle)client, chunk, sizeof(chunk), 0);
+            if (n <= 0) break;
+            buffer.append(chunk, (size_t)n);
+            if (buffer.size() > 64 * 1024) break;
+            continue;
+        }
+        std::string head = buffer.substr(0, end + 2);
+        buffer.erase(0, end + 4);
+        if (!HandleRequest(client, head)) break;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_clients.erase(std::remove(m_clients.begin(), m_clients.end(), client), m_clients.end());
+    CloseSocket(client);
+}
+
+bool SyntheticSiteServer::SendAll(intptr_t client, const char* data, size_t size)
+{
+    while (size > 0) {
+        int n = (int)send((SocketHandle)client, data, (int)std::min<size_t>(size, 1 << 20), 0);
+        if (n <= 0) return false;
+        data += n;
+        size -= (size_t)n;
+        m_stats.bytes += (uint64_t)n;
+    }
+    return true;
+}
+
+bool SyntheticSiteServer::HandleRequest(intptr_t client, const std::string& head)
+{
+    uint64_t requestNumber = ++m_stats.requests;
+    size_t sp1 = head.find(' ');
+    size_t sp2 = sp1 == std::string::npos ? std::string::npos : head.find(' ', sp1 + 1);
+    if (sp2 == std::string::npos) return false;
+    std::string method = head.substr(0, sp1);
+    std::string path = head.substr(sp1 + 1, sp2 - sp1 - 1);
+    if (m_options.latencyMs > 0) std::this_thread::sleep_for(std::chrono::milliseconds(m_options.latencyMs));
+
+    int status = 200;
+    std::string contentType = "text/html; charset=utf-8";
+    std::string body;
+    std::string extraHeaders;
+    bool slow = false;
+    if (m_options.throttleEvery > 0 && requestNumber % (uint64_t)m_options.throttleEvery == 0) {
+        status = 429;
+        extraHeaders = "Retry-After: 1\r\n";
+        body = "too many requests\n";
+        m_stats.throttled++;
+    }
+    else if (path == "/" || StartsWith(path, "/p/")) {
+        int index = path == "/" ? 0 : atoi(path.c_str() + 3);
+        if (index >= 0 && index < m_options.pageCount) {
+            body = MakeSyntheticSitePage(m_options, index);
+            m_stats.pages++;
+            uint64_t pageNumber = ++m_pageCounter;
+            slow = m_options.slowBodyEvery > 0 && pageNumber % (uint64_t)m_options.slowBodyEvery == 0;
+        }
+        else {
+            status = 404;
+        }
+    }
+    else if (StartsWith(path, "/m/")) {
+        int page = 0, index = 0;
+        if (sscanf(path.c_str() + 3, "%d_%d", &page, &index) == 2 && index < m_options.mediaPerPage) {
+            body = MakeMedia(page, index, m_options.mediaBytes);
+            contentType = "image/jpeg";
+            extraHeaders = "Accept-Ranges: bytes\r\n";
+            m_stats.media++;
+            long long first = 0, last = -1;
+            std::string range = HeaderValue(head, "Range");
+            if (!range.empty() && sscanf(range.c_str(), "bytes=%lld-%lld", &first, &last) >= 1) {
+                long long total = (long long)body.size();
+                if (last < 0 || last >= total) last = total - 1;
+                if (first >= total) {
+                    status = 416;
+                    extraHeaders += "Content-Range: bytes */" + std::to_string(total) + "\r\n";
+                    body.clear();
+                }
+                else {
+                    status = 206;
+                    extraHeaders += "Content-Range: bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" +
+                        std::to_string(total) + "\r\n";
+                    body = body.substr((size_t)first, (size_t)(last - first + 1));
+                }
+            }
+        }
+        else {
+            status = 404;
+        }
+    }
+    else {
+        status = 404;
+    }
+    if (status == 404) {
+        body = "not found\n";
+        m_stats.notFound++;
+    }
+
+    const char* reason = status == 200 ? "OK" : status == 206 ? "Partial Content" : status == 404 ? "Not Found" :
+        status == 416 ? "Range Not Satisfiable" : "Too Many Requests";
+    std::string response = "HTTP/1.1 " + std::to_string(status) + " " + reason + "\r\nContent-Type: " + contentType +
+        "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n" + extraHeaders + "\r\n";
+    bool sendBody = method != "HEAD";
+    if (!slow || !sendBody) {
+        // 头和体一起发送，避免 Nagle 与延迟确认叠加出 40ms 的假延迟
+        if (sendBody) response += body;
+        return SendAll(client, response.data(), response.size());
+    }
+    if (!SendAll(client, response.data(), response.size())) return false;
+    size_t piece = body.size() / 10 + 1;
+    for (size_t offset = 0; offset < body.size(); offset += piece) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(m_options.slowBodyMs / 10));
+        if (!SendAll(client, body.data() + offset, std::min(piece, body.size() - offset))) return false;
+    }
+    return true;
+}
@@ -0,0 +1,75 @@
+﻿#ifndef SYNTHETIC_SITE_H
+#define SYNTHETIC_SITE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 合成站点：页面 /p/<n> 链接到 n*fanOut+1 .. n*fanOut+fanOut，媒体 /m/<n>_<k>.jpg
+struct SyntheticSiteOptions
+{
+    int pageCount = 1000;
+    int fanOut = 8;
+    size_t pageBytes = 16 * 1024;
+    int mediaPerPage = 1;
+    size_t mediaBytes = 32 * 1024;
+    // 每个响应前的固定延迟
+    int latencyMs = 0;
+    // 每 N 个请求回一次 429，0 表示不限流
+    int throttleEvery = 0;
+    // 每 N 个页面把响应体拆成 10 段慢慢发送，总共耗时 slowBodyMs
+    int slowBodyEvery = 0;
+    int slowBodyMs = 200;
+};
+
+struct SyntheticSiteStats
+{
+    std::atomic<uint64_t> requests{ 0 };
+    std::atomic<uint64_t> pages{ 0 };
+    std::atomic<uint64_t> media{ 0 };
+    std::atomic<uint64_t> throttled{ 0 };
+    std::atomic<uint64_t> notFound{ 0 };
+    std::atomic<uint64_t> bytes{ 0 };
+};
+
+std::string MakeSyntheticSitePage(const SyntheticSiteOptions& options, int index);
+
+// 只监听 127.0.0.1 的 HTTP/1.1 服务器，每个连接一个线程，支持 keep-alive 与单段 Range
+class SyntheticSiteServer
+{
+public:
+    explicit SyntheticSiteServer(const SyntheticSiteOptions& options);
+    ~SyntheticSiteServer();
+    SyntheticSiteServer(const SyntheticSiteServer&) = delete;
+    SyntheticSiteServer& operator=(const SyntheticSiteServer&) = delete;
+
+    // port 为 0 时由系统分配
+    bool Start(int port = 0);
+    void Stop();
+    int Port() const { return m_port; }
+    std::string BaseUrl() const { return "http://127.0.0.1:" + std::to_string(m_port); }
+    const SyntheticSiteStats& Stats() const { return m_stats; }
+
+private:
+    void AcceptLoop();
+    void ServeConnection(intptr_t client);
+    bool HandleRequest(intptr_t client, const std::string& head);
+    bool SendAll(intptr_t client, const char* data, size_t size);
+
+    SyntheticSiteOptions m_options;
+    SyntheticSiteStats m_stats;
+    intptr_t m_listener = -1;
+    int m_port = 0;
+    std::atomic<bool> m_stopping{ false };
+    std::atomic<uint64_t> m_pageCounter{ 0 };
+    std::thread m_acceptThread;
+    std::mutex m_mutex;
+    std::vector<intptr_t> m_clients;
+    std::vector<std::thread> m_threads;
+};
+
+#endif
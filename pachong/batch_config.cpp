@@ -0,0 +1,255 @@
+﻿#include "batch_config.h"
+#include <cctype>
+#include <charconv>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    std::string_view Trim(std::string_view text)
+    {
+        while (!text.empty() && isspace((unsigned char)text.front())) text.remove_prefix(1);
+        while (!text.empty() && isspace((unsigned char)text.back())) text.remove_suffix(1);
+        return text;
+    }
+
+    bool ParseInt(std::string_view value, int minimum, int& out)
+    {
+        int parsed = 0;
+        auto result = std::from_chars(value.data(), value.data() + value.size(), parsed);
+        if (result.ec != std::errc() || result.ptr != value.data() + value.size() || parsed < minimum) return false;
+        out = parsed;
+        return true;
+    }
+
+    bool ParseDouble(std::string_view value, double& out)
+    {
+        std::string text(value);
+        char* end = nullptr;
+        double parsed = strtod(text.c_str(), &end);
+        if (text.empty() || *end != '\0' || !(parsed >= 0)) return false;
+        out = parsed;
+        return true;
+    }
+
+    bool ParseBool(std::string_view value, bool& out)
+    {
+        std::string lower(value);
+        for (auto& c : lower) c = (char)tolower((unsigned char)c);
+        if (lower == "1" || lower == "true" || lower == "yes" || lower == "on") out = true;
+        else if (lower == "0" || lower == "false" || lower == "no" || lower == "off") out = false;
+        else return false;
+        return true;
+    }
+
+    // "500" 或 "500-2000"
+    bool ParseDelay(std::string_view value, SchedulerOptions& scheduler)
+    {
+        size_t dash = value.find('-');
+        int minDelay = 0;
+        int maxDelay = 0;
+        if (!ParseInt(Trim(value.substr(0, dash)), 0, minDelay)) return false;
+        if (dash == std::string_view::npos) maxDelay = minDelay;
+        else if (!ParseInt(Trim(value.substr(dash + 1)), minDelay, maxDelay)) return false;
+        scheduler.minDelayMs = minDelay;
+        scheduler.maxDelayMs = maxDelay;
+        return true;
+    }
+
+    struct Setting
+    {
+        const char* name;
+        const char* help;
+        bool (*apply)(BatchConfig& config, std::string_view value);
+    };
+
+    const Setting kSettings[] = {
+        { "seeds", "seed file, one URL per line, - for stdin; repeatable",
+            [](BatchConfig& c, std::string_view v) { c.seedFiles.emplace_back(v); return !v.empty(); } },
+        { "url", "a single seed URL; repeatable",
+            [](BatchConfig& c, std::string_view v) { c.urls.emplace_back(v); return !v.empty(); } },
+        { "depth", "link depth to follow from each seed",
+            [](BatchConfig& c, std::string_view v) { return ParseInt(v, 0, c.crawler.maxDepth); } },
+        { "threads", "page fetch threads",
+            [](BatchConfig& c, std::string_view v) { return ParseInt(v, 1, c.crawler.threadCount); } },
+        { "media-threads", "media download threads",
+            [](BatchConfig& c, std::string_view v) { return ParseInt(v, 1, c.crawler.media.workerCount); } },
+        { "per-host", "concurrent requests per host",
+            [](BatchConfig& c, std::string_view v) { return ParseInt(v, 1, c.crawler.scheduler.perHostConcurrency); } },
+        { "rate", "initial requests/s per host, adapted from responses",
+            [](BatchConfig& c, std::string_view v) { return ParseDouble(v, c.crawler.scheduler.rateLimit.initialRate) &&
+                c.crawler.scheduler.rateLimit.initialRate > 0; } },
+        { "max-rate", "upper bound of requests/s per host",
+            [](BatchConfig& c, std::string_view v) { return ParseDouble(v, c.crawler.scheduler.rateLimit.maxRate) &&
+                c.crawler.scheduler.rateLimit.maxRate > 0; } },
+        { "rate-limit", "on|off; when off, hosts are paced by delay-ms",
+            [](BatchConfig& c, std::string_view v) { return ParseBool(v, c.crawler.scheduler.rateLimit.enabled); } },
+        { "delay-ms", "random delay between requests to one host without rate-limit, 500 or 500-2000",
+            [](BatchConfig& c, std::string_view v) { return ParseDelay(v, c.crawler.scheduler); } },
+        { "timeout-ms", "socket read/write timeout",
+            [](BatchConfig& c, std::string_view v) { return ParseInt(v, 1, c.crawler.transport.ioTimeoutMs); } },
+        { "user-agent", "User-Agent header",
+            [](BatchConfig& c, std::string_view v) { c.crawler.transport.userAgent = std::string(v); return !v.empty(); } },
+        { "header", "\"pattern Name: value\" per-host header, empty value removes it; pattern is host, *.domain or *",
+            [](BatchConfig& c, std::string_view v) {
+                HeaderRule rule;
+                if (!ParseHeaderRule(v, rule)) return false;
+                c.crawler.headerRules.push_back(std::move(rule));
+                return true;
+            } },
+        { "strip-param", "query parameter ignored when deduplicating URLs, name or prefix*; repeatable",
+            [](BatchConfig& c, std::string_view v) {
+                c.crawler.canonical.stripQueryParams.emplace_back(v);
+                return !v.empty();
+            } },
+        { "external", "on|off; follow links to other hosts",
+            [](BatchConfig& c, std::string_view v) { return ParseBool(v, c.crawler.followExternalLinks); } },
+        { "near-dup", "on|off; archive near-duplicate pages as aliases and leave them out of the index",
+            [](BatchConfig& c, std::string_view v) { return ParseBool(v, c.crawler.nearDuplicate.enabled); } },
+        { "visited-memory-mb", "memory for seen-URL fingerprints; beyond it they spill to output/visited (default 256)",
+            [](BatchConfig& c, std::string_view v) {
+                int megabytes = 0;
+                if (!ParseInt(v, 1, megabytes)) return false;
+                c.crawler.visited.memoryBudgetBytes = (size_t)megabytes * 1024 * 1024;
+                return true;
+            } },
+        { "bloom-filter", "on|off; check a Bloom filter before the seen-URL set, saves disk reads once it spills",
+            [](BatchConfig& c, std::string_view v) { return ParseBool(v, c.crawler.visited.useBloomFilter); } },
+        { "head-probe", "on|off; send HEAD before downloading media",
+            [](BatchConfig& c, std::string_view v) { return ParseBool(v, c.crawler.media.probeWithHead); } },
+        { "output", "directory for archive, media, caches and checkpoint (default: program directory)",
+            [](BatchConfig& c, std::string_view v) { c.crawler.dataDir = std::string(v); return !v.empty(); } },
+        { "archive", "on|off; write pages to the archive",
+            [](BatchConfig& c, std::string_view v) { return ParseBool(v, c.crawler.archive.enabled); } },
+        { "index", "on|off; build the full-text index under output/index for --search",
+            [](BatchConfig& c, std::string_view v) { return ParseBool(v, c.crawler.index.enabled); } },
+        { "resume", "on|off; continue from the last checkpoint",
+            [](BatchConfig& c, std::string_view v) { return ParseBool(v, c.crawler.checkpoint.resume); } },
+        { "summary", "write a JSON summary here when done",
+            [](BatchConfig& c, std::string_view v) { c.summaryPath = std::string(v); return !v.empty(); } },
+        { "max-failure-ratio", "exit with 3 when failed/attempted pages exceeds this",
+            [](BatchConfig& c, std::string_view v) { return ParseDouble(v, c.maxFailureRatio); } },
+    };
+}
+
+bool ApplyBatchSetting(BatchConfig& config, std::string_view name, std::string_view value, std::string& error)
+{
+    value = Trim(value);
+    for (const auto& setting : kSettings) {
+        if (name != setting.name) continue;
+        if (setting.apply(config, value)) return true;
+        error = "invalid value for " + std::string(name) + ": " + std::string(value);
+        return false;
+    }
+    error = "unknown setting " + std::string(name);
+    return false;
+}
+
+bool LoadBatchConfig(const std::string& path, BatchConfig& config, std::string& error)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        error = "cannot open " + path;
+        return false;
+    }
+    // 配置里的相对路径按配置文件所在目录解释，不受启动目录影响
+    fs::path base = fs::path(path).parent_path();
+    auto resolve = [&](std::string_view value) {
+        fs::path file{ std::string(value) };
+        if (value == "-" || file.is_absolute() || base.empty()) return std::string(value);
+        return (base / file).string();
+    };
+    std::string hostPattern;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line)) {
+        ++lineNumber;
+        std::string_view text = line;
+        if (lineNumber == 1 && text.substr(0, 3) == "\xEF\xBB\xBF") text.remove_prefix(3);
+        text = Trim(text);
+        if (text.empty() || text[0] == '#' || text[0] == ';') continue;
+        std::string where = path + ":" + std::to_string(lineNumber) + ": ";
+        if (text.front() == '[') {
+            if (text.back() != ']') {
+                error = where + "unterminated section";
+                return false;
+            }
+            std::string_view section = Trim(text.substr(1, text.size() - 2));
+            if (section == "crawl") hostPattern.clear();
+            else if (section.substr(0, 5) == "host " && !Trim(section.substr(5)).empty()) {
+                hostPattern = std::string(Trim(section.substr(5)));
+            }
+            else {
+                error = where + "unknown section " + std::string(section);
+                return false;
+            }
+            continue;
+        }
+        size_t equals = text.find('=');
+        if (equals == std::string_view::npos) {
+            error = where + "expected name = value";
+            return false;
+        }
+        std::string_view name = Trim(text.substr(0, equals));
+        std::string_view value = Trim(text.substr(equals + 1));
+        if (!hostPattern.empty()) {
+            // 值里可以有 '='，例如 Cookie
+            config.crawler.headerRules.push_back({ hostPattern, std::string(name), std::string(value) });
+            continue;
+        }
+        std::string resolved;
+        if (name == "seeds" || name == "output" || name == "summary") {
+            resolved = resolve(value);
+            value = resolved;
+        }
+        if (!ApplyBatchSetting(config, name, value, error)) {
+            error = where + error;
+            return false;
+        }
+    }
+    return true;
+}
+
+const char* BatchSettingsHelp()
+{
+    static const std::string help = [] {
+        std::string text;
+        for (const auto& setting : kSettings) {
+            std::string name = std::string("  --") + setting.name;
+            text += name + std::string(name.size() < 22 ? 22 - name.size() : 1, ' ') + setting.help + "\n";
+        }
+        return text;
+    }();
+    return help.c_str();
+}
+
+int BatchExitCode(const CrawlSummary& summary, bool seedFilesFailed, const BatchConfig& config)
+{
+    uint64_t attempted = summary.pages + summary.failedPages;
+    if (summary.pages == 0 && (attempted > 0 || summary.invalidSeeds > 0 || seedFilesFailed)) {
+        return kExitNothingFetched;
+    }
+    if (summary.invalidSeeds > 0 || seedFilesFailed) return kExitPartial;
+    if (attempted > 0 && (double)summary.failedPages / attempted > config.maxFailureRatio) return kExitPartial;
+    return kExitOk;
+}
+
+bool WriteBatchSummary(const std::string& path, const CrawlSummary& summary, int exitCode)
+{
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::trunc);
+        if (!out.is_open()) return false;
+        out << "{\"exitCode\":" << exitCode << ",\"seeds\":" << summary.seeds << ",\"invalidSeeds\":" << summary.invalidSeeds
+            << ",\"pages\":" << summary.pages << ",\"failedPages\":" << summary.failedPages << ",\"pageBytes\":"
+            << summary.pageBytes << ",\"mediaFiles\":" << summary.mediaFiles << ",\"failedMedia\":" << summary.failedMedia
+            << ",\"seconds\":" << summary.seconds << "}\n";
+        if (out.fail()) return false;
+    }
+    std::error_code ec;
+    fs::rename(tempPath, path, ec);
+    return !ec;
+}
@@ -0,0 +1,42 @@
+﻿#ifndef BATCH_CONFIG_H
+#define BATCH_CONFIG_H
+
+#include "crawler.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 批量模式的退出码，供 cron 等调度方判断结果
+constexpr int kExitOk = 0;
+// 初始化失败、分片进程异常等，没有完成抓取
+constexpr int kExitError = 1;
+// 命令行或配置文件有误
+constexpr int kExitUsage = 2;
+// 抓取完成，但有格式错误或读不到的种子，或失败页面的比例超过 maxFailureRatio
+constexpr int kExitPartial = 3;
+// 有种子却一页都没抓到
+constexpr int kExitNothingFetched = 4;
+
+struct BatchConfig
+{
+    CrawlerOptions crawler;
+    std::vector<std::string> urls;
+    std::vector<std::string> seedFiles;
+    // 为空时不写汇总文件；分片进程在文件名后加 .shard-N
+    std::string summaryPath;
+    double maxFailureRatio = 0.5;
+};
+
+// 配置文件每行一个 "名称 = 值"，# 开头的行是注释。[host 模式] 之后的行是该主机的请求头，
+// 写法同样是 "名称 = 值"，直到下一个段落；[crawl] 回到普通设置
+bool LoadBatchConfig(const std::string& path, BatchConfig& config, std::string& error);
+// 命令行的 --名称 值 与配置文件共用同一套名称
+bool ApplyBatchSetting(BatchConfig& config, std::string_view name, std::string_view value, std::string& error);
+// 所有可用的设置名和说明，用于打印帮助
+const char* BatchSettingsHelp();
+
+int BatchExitCode(const CrawlSummary& summary, bool seedFilesFailed, const BatchConfig& config);
+// 写成一个 JSON 对象，先写临时文件再改名
+bool WriteBatchSummary(const std::string& path, const CrawlSummary& summary, int exitCode);
+
+#endif
@@ -0,0 +1,25 @@
+#include "byte_budget.h"
+#include <algorithm>
+
+ByteBudget::ByteBudget(long long capacity)
+    : m_capacity(std::max(1ll, capacity)), m_available(m_capacity)
+{
+}
+
+long long ByteBudget::Acquire(long long bytes)
+{
+    bytes = std::clamp(bytes, 1ll, m_capacity);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [&] { return m_available >= bytes; });
+    m_available -= bytes;
+    return bytes;
+}
+
+void ByteBudget::Release(long long bytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_available += bytes;
+    }
+    m_cv.notify_all();
+}
@@ -0,0 +1,23 @@
+﻿#ifndef BYTE_BUDGET_H
+#define BYTE_BUDGET_H
+
+#include <condition_variable>
+#include <mutex>
+
+// 多个线程共享的字节预算，余量不足时 Acquire 阻塞
+class ByteBudget
+{
+public:
+    explicit ByteBudget(long long capacity);
+    // 单次请求超过总预算时按总预算计，返回实际占用的字节数
+    long long Acquire(long long bytes);
+    void Release(long long bytes);
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    long long m_capacity;
+    long long m_available;
+};
+
+#endif
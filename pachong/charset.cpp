@@ -0,0 +1,414 @@
+﻿#include "charset.h"
+#include "simd_scan.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+
+extern const uint16_t kGbkToUnicode[126 * 191];
+
+namespace
+{
+    // 0x80-0x9F，未定义的位置与浏览器一样映射到同值的 C1 控制字符
+    const uint16_t kWindows1252High[32] = {
+        0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021, 0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+        0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014, 0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178,
+    };
+
+    const char kBom[] = "\xEF\xBB\xBF";
+    const char kReplacement[] = "\xEF\xBF\xBD";
+    // 页面开头这么多字节内找 <meta charset>，与 HTML 规范的预扫描长度一致
+    constexpr size_t kPrescanBytes = 1024;
+    // 没有任何声明时，攒够这么多非 ASCII 字节再做统计
+    constexpr size_t kGuessNonAscii = 64;
+
+    size_t FindNoCase(std::string_view haystack, std::string_view needle, size_t from = 0)
+    {
+        if (needle.size() > haystack.size()) return std::string_view::npos;
+        for (size_t i = from; i + needle.size() <= haystack.size(); ++i) {
+            size_t j = 0;
+            while (j < needle.size() && tolower((unsigned char)haystack[i + j]) == needle[j]) ++j;
+            if (j == needle.size()) return i;
+        }
+        return std::string_view::npos;
+    }
+
+    // value 从 "charset" 之后开始：跳过空白、'=' 和引号，取出编码名
+    Charset ParseCharsetValue(std::string_view value)
+    {
+        size_t i = 0;
+        while (i < value.size() && isspace((unsigned char)value[i])) ++i;
+        if (i >= value.size() || value[i] != '=') return Charset::Unknown;
+        ++i;
+        while (i < value.size() && (isspace((unsigned char)value[i]) || value[i] == '"' || value[i] == '\'')) ++i;
+        size_t start = i;
+        while (i < value.size() && (isalnum((unsigned char)value[i]) || strchr("-_.:", value[i]))) ++i;
+        return CharsetFromName(value.substr(start, i - start));
+    }
+
+    // p 处完整合法序列的长度；非法返回 0，数据不够判断时返回 -1
+    int Utf8SequenceLength(const unsigned char* p, size_t avail)
+    {
+        unsigned char c = p[0];
+        if (c < 0x80) return 1;
+        int length;
+        unsigned char low = 0x80, high = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF) length = 2;
+        else if (c == 0xE0) { length = 3; low = 0xA0; }
+        else if (c == 0xED) { length = 3; high = 0x9F; }
+        else if (c >= 0xE1 && c <= 0xEF) length = 3;
+        else if (c == 0xF0) { length = 4; low = 0x90; }
+        else if (c >= 0xF1 && c <= 0xF3) length = 4;
+        else if (c == 0xF4) { length = 4; high = 0x8F; }
+        else return 0;
+        for (int i = 1; i < length; ++i) {
+            if ((size_t)i >= avail) return -1;
+            unsigned char b = p[i];
+            if (b < (i == 1 ? low : 0x80) || b > (i == 1 ? high : 0xBF)) return 0;
+        }
+        return length;
+    }
+
+    // 移位式 DFA：每个状态占 6 位，kUtf8Dfa[byte] >> state 的低 6 位就是下一个状态，
+    // 每字节只有一次查表和一次移位，没有分支
+    constexpr uint64_t kUtf8Accept = 0;
+    constexpr uint64_t kUtf8Error = 8 * 6;
+
+    constexpr uint64_t Utf8DfaRow(unsigned c)
+    {
+        // 状态：0 完整，1/2/3 还差几个后续字节，4 E0 之后，5 ED 之后，6 F0 之后，7 F4 之后，8 错误
+        int next[9] = { 8, 8, 8, 8, 8, 8, 8, 8, 8 };
+        if (c < 0x80) next[0] = 0;
+        else if (c >= 0xC2 && c <= 0xDF) next[0] = 1;
+        else if (c == 0xE0) next[0] = 4;
+        else if (c == 0xED) next[0] = 5;
+        else if (c >= 0xE1 && c <= 0xEF) next[0] = 2;
+        else if (c == 0xF0) next[0] = 6;
+        else if (c >= 0xF1 && c <= 0xF3) next[0] = 3;
+        else if (c == 0xF4) next[0] = 7;
+        if (c >= 0x80 && c <= 0xBF) {
+            next[1] = 0;
+            next[2] = 1;
+            next[3] = 2;
+            if (c >= 0xA0) next[4] = 1;
+            if (c <= 0x9F) next[5] = 1;
+            if (c >= 0x90) next[6] = 2;
+            if (c <= 0x8F) next[7] = 2;
+        }
+        uint64_t row = 0;
+        for (int state = 0; state < 9; ++state) row |= (uint64_t)(next[state] * 6) << (state * 6);
+        return row;
+    }
+
+    struct Utf8Dfa
+    {
+        uint64_t rows[256];
+        constexpr Utf8Dfa() : rows()
+        {
+            for (unsigned c = 0; c < 256; ++c) rows[c] = Utf8DfaRow(c);
+        }
+    };
+
+    constexpr Utf8Dfa kUtf8Dfa;
+
+    char* PutUtf8(char* out, uint32_t cp)
+    {
+        if (cp < 0x80) {
+            *out++ = (char)cp;
+        }
+        else if (cp < 0x800) {
+            *out++ = (char)(0xC0 | (cp >> 6));
+            *out++ = (char)(0x80 | (cp & 0x3F));
+        }
+        else {
+            *out++ = (char)(0xE0 | (cp >> 12));
+            *out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+            *out++ = (char)(0x80 | (cp & 0x3F));
+        }
+        return out;
+    }
+
+    // 转换 data 追加到 out，返回用掉的字节数；final 为 false 时末尾不完整的字符留给下一块
+    size_t GbkToUtf8(const char* data, size_t size, bool final, std::string& out)
+    {
+        size_t base = out.size();
+        // 单个字节最多变成三个（U+20AC、U+FFFD）
+        out.resize(base + size * 3);
+        char* o = &out[base];
+        const char* p = data;
+        const char* end = data + size;
+        while (p < end) {
+            if ((unsigned char)*p < 0x80) {
+                const char* run = simd::FindNonAscii(p, end);
+                memcpy(o, p, run - p);
+                o += run - p;
+                p = run;
+                continue;
+            }
+            unsigned char lead = (unsigned char)*p;
+            uint32_t cp = 0xFFFD;
+            size_t used = 1;
+            if (lead == 0x80) {
+                cp = 0x20AC;
+            }
+            else if (lead < 0xFF) {
+                if (end - p < 2) {
+                    if (!final) break;
+                }
+                else {
+                    unsigned char trail = (unsigned char)p[1];
+                    if (trail >= 0x30 && trail <= 0x39) {
+                        // GB18030 的四字节序列不在对照表里，整体替换
+                        if (end - p < 4 && !final) break;
+                        used = std::min<size_t>(4, end - p);
+                    }
+                    else if (trail >= 0x40 && trail != 0x7F && trail != 0xFF) {
+                        cp = kGbkToUnicode[(lead - 0x81) * 191 + (trail - 0x40)];
+                        used = 2;
+                    }
+                }
+            }
+            o = PutUtf8(o, cp);
+            p += used;
+        }
+        out.resize(o - out.data());
+        return p - data;
+    }
+
+    size_t Windows1252ToUtf8(const char* data, size_t size, std::string& out)
+    {
+        size_t base = out.size();
+        out.resize(base + size * 3);
+        char* o = &out[base];
+        const char* p = data;
+        const char* end = data + size;
+        while (p < end) {
+            const char* run = simd::FindNonAscii(p, end);
+            memcpy(o, p, run - p);
+            o += run - p;
+            p = run;
+            if (p == end) break;
+            unsigned char c = (unsigned char)*p++;
+            o = PutUtf8(o, c < 0xA0 ? kWindows1252High[c - 0x80] : c);
+        }
+        out.resize(o - out.data());
+        return size;
+    }
+}
+
+const char* CharsetName(Charset charset)
+{
+    switch (charset) {
+    case Charset::Utf8: return "utf-8";
+    case Charset::Gbk: return "gbk";
+    case Charset::Windows1252: return "windows-1252";
+    default: return "unknown";
+    }
+}
+
+Charset CharsetFromName(std::string_view name)
+{
+    std::string lower(name);
+    for (auto& c : lower) c = (char)tolower((unsigned char)c);
+    static const char* const utf8[] = { "utf-8", "utf8", "unicode-1-1-utf-8" };
+    static const char* const gbk[] = { "gbk", "gb2312", "gb18030", "x-gbk", "cp936", "ms936", "windows-936",
+        "csgb2312", "chinese", "gb_2312-80", "iso-ir-58", "euc-cn" };
+    static const char* const latin[] = { "windows-1252", "cp1252", "iso-8859-1", "iso8859-1", "latin1", "l1",
+        "us-ascii", "ascii", "cp819", "ibm819" };
+    for (const char* candidate : utf8) {
+        if (lower == candidate) return Charset::Utf8;
+    }
+    for (const char* candidate : gbk) {
+        if (lower == candidate) return Charset::Gbk;
+    }
+    for (const char* candidate : latin) {
+        if (lower == candidate) return Charset::Windows1252;
+    }
+    return Charset::Unknown;
+}
+
+Charset CharsetFromContentType(std::string_view contentType)
+{
+    size_t pos = FindNoCase(contentType, "charset");
+    return pos == std::string_view::npos ? Charset::Unknown : ParseCharsetValue(contentType.substr(pos + 7));
+}
+
+Charset CharsetFromMeta(std::string_view head)
+{
+    for (size_t pos = FindNoCase(head, "<meta"); pos != std::string_view::npos; pos = FindNoCase(head, "<meta", pos + 5)) {
+        size_t close = head.find('>', pos);
+        std::string_view tag = head.substr(pos, close == std::string_view::npos ? std::string_view::npos : close - pos);
+        size_t charset = FindNoCase(tag, "charset");
+        if (charset == std::string_view::npos) continue;
+        Charset result = ParseCharsetValue(tag.substr(charset + 7));
+        if (result != Charset::Unknown) return result;
+    }
+    return Charset::Unknown;
+}
+
+Charset GuessCharset(std::string_view data)
+{
+    const char* p = data.data();
+    const char* end = p + data.size();
+    // 偶尔夹杂几个坏字节的 UTF-8 页面仍按 UTF-8 处理，坏字节会被替换
+    size_t utf8Good = 0, utf8Bad = 0;
+    while (p < end) {
+        p = simd::FindNonAscii(p, end);
+        if (p == end) break;
+        int n = Utf8SequenceLength((const unsigned char*)p, end - p);
+        if (n < 0) break;
+        if (n == 0) {
+            utf8Bad++;
+            p++;
+        }
+        else {
+            utf8Good++;
+            p += n;
+        }
+    }
+    if (utf8Bad == 0 || utf8Bad * 20 < utf8Good) return Charset::Utf8;
+    size_t pairs = 0, bad = 0;
+    p = data.data();
+    while (p < end) {
+        p = simd::FindNonAscii(p, end);
+        if (end - p < 2) break;
+        unsigned char lead = (unsigned char)p[0];
+        unsigned char trail = (unsigned char)p[1];
+        if (lead >= 0x81 && lead <= 0xFE && trail >= 0x40 && trail <= 0xFE && trail != 0x7F) {
+            pairs++;
+            p += 2;
+        }
+        else {
+            bad++;
+            p++;
+        }
+    }
+    return pairs > 0 && bad * 20 < pairs ? Charset::Gbk : Charset::Windows1252;
+}
+
+size_t Utf8ValidPrefix(const char* data, size_t size)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    const unsigned char* end = p + size;
+    const unsigned char* blockStart = p;
+    uint64_t state = kUtf8Accept;
+    uint64_t blockState = kUtf8Accept;
+    while (p < end) {
+        if (state == kUtf8Accept) {
+            p = (const unsigned char*)simd::FindNonAscii((const char*)p, (const char*)end);
+            if (p == end) break;
+        }
+        // 按块跑 DFA，块内不判断，错误状态会一直保持到块尾
+        blockStart = p;
+        blockState = state;
+        const unsigned char* stop = p + std::min<size_t>(end - p, 64);
+        for (; p < stop; ++p) state = (kUtf8Dfa.rows[*p] >> state) & 63;
+        if (state == kUtf8Error) break;
+    }
+    if (state == kUtf8Accept) return size;
+    // 出错或末尾不完整：从出问题的块前最后一个字符边界开始逐字节找
+    const unsigned char* q = blockStart;
+    if (blockState != kUtf8Accept) {
+        do {
+            --q;
+        } while ((*q & 0xC0) == 0x80);
+    }
+    const unsigned char* lastAccept = q;
+    state = kUtf8Accept;
+    for (; q < end; ++q) {
+        state = (kUtf8Dfa.rows[*q] >> state) & 63;
+        if (state == kUtf8Accept) lastAccept = q + 1;
+        else if (state == kUtf8Error) break;
+    }
+    return lastAccept - (const unsigned char*)data;
+}
+
+void Utf8Normalizer::Reset(std::string_view contentType)
+{
+    m_charset = CharsetFromContentType(contentType);
+    m_bomChecked = false;
+    m_metaChecked = false;
+    m_repaired = false;
+    m_ready = 0;
+    m_nonAscii = 0;
+}
+
+size_t Utf8Normalizer::Feed(std::string_view chunk, std::string& html)
+{
+    html.append(chunk.data(), chunk.size());
+    if (m_charset == Charset::Unknown) m_nonAscii += simd::CountNonAscii(chunk.data(), chunk.data() + chunk.size());
+    if (!Decide(html, false)) {
+        m_ready = simd::FindNonAscii(html.data() + m_ready, html.data() + html.size()) - html.data();
+        return m_ready;
+    }
+    Convert(html, false);
+    return m_ready;
+}
+
+size_t Utf8Normalizer::Finish(std::string& html)
+{
+    Decide(html, true);
+    Convert(html, true);
+    return m_ready;
+}
+
+bool Utf8Normalizer::Decide(std::string& html, bool final)
+{
+    if (!m_bomChecked) {
+        // BOM 优先于响应头和 meta 声明
+        size_t have = std::min<size_t>(html.size(), 3);
+        if (have < 3 && !final && html.compare(0, have, kBom, have) == 0) return false;
+        m_bomChecked = true;
+        if (have == 3 && html.compare(0, 3, kBom) == 0) {
+            html.erase(0, 3);
+            m_charset = Charset::Utf8;
+        }
+    }
+    if (m_charset != Charset::Unknown) return true;
+    if (!m_metaChecked) {
+        size_t head = std::min(html.size(), kPrescanBytes);
+        m_charset = CharsetFromMeta(std::string_view(html.data(), head));
+        if (m_charset != Charset::Unknown) return true;
+        m_metaChecked = head == kPrescanBytes;
+    }
+    if (!final && (!m_metaChecked || m_nonAscii < kGuessNonAscii)) return false;
+    m_charset = m_nonAscii == 0 ? Charset::Utf8 : GuessCharset(html);
+    return true;
+}
+
+void Utf8Normalizer::Convert(std::string& html, bool final)
+{
+    if (m_ready >= html.size()) return;
+    if (m_charset != Charset::Utf8) {
+        m_raw.assign(html, m_ready, std::string::npos);
+        html.resize(m_ready);
+        size_t used = m_charset == Charset::Gbk ? GbkToUtf8(m_raw.data(), m_raw.size(), final, html) :
+            Windows1252ToUtf8(m_raw.data(), m_raw.size(), html);
+        m_ready = html.size();
+        html.append(m_raw, used, std::string::npos);
+        return;
+    }
+    // 合法的 UTF-8 只校验不复制
+    size_t valid = m_ready + Utf8ValidPrefix(html.data() + m_ready, html.size() - m_ready);
+    if (valid == html.size() ||
+        (!final && Utf8SequenceLength((const unsigned char*)html.data() + valid, html.size() - valid) < 0)) {
+        m_ready = valid;
+        return;
+    }
+    m_raw.assign(html, valid, std::string::npos);
+    html.resize(valid);
+    const char* p = m_raw.data();
+    const char* end = p + m_raw.size();
+    while (p < end) {
+        size_t ok = Utf8ValidPrefix(p, end - p);
+        html.append(p, ok);
+        p += ok;
+        if (p == end) break;
+        if (!final && Utf8SequenceLength((const unsigned char*)p, end - p) < 0) break;
+        html.append(kReplacement, 3);
+        m_repaired = true;
+        p++;
+    }
+    m_ready = html.size();
+    html.append(p, end - p);
+}
@@ -0,0 +1,63 @@
+﻿#ifndef CHARSET_H
+#define CHARSET_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+enum class Charset
+{
+    Unknown,
+    Utf8,
+    // 包括 GB2312 和 GB18030 的双字节部分
+    Gbk,
+    // 也用于声明为 ISO-8859-1 / US-ASCII 的页面，与浏览器的处理一致
+    Windows1252,
+    Count
+};
+
+const char* CharsetName(Charset charset);
+// 不支持的编码名返回 Unknown
+Charset CharsetFromName(std::string_view name);
+// 从 Content-Type 的 charset 参数取编码
+Charset CharsetFromContentType(std::string_view contentType);
+// 在页面开头查找 <meta charset=...> 或 <meta http-equiv content="...; charset=...">
+Charset CharsetFromMeta(std::string_view head);
+// 按内容统计推测：合法的 UTF-8 视为 UTF-8，其次看高位字节是否大多组成 GBK 双字节字符
+Charset GuessCharset(std::string_view data);
+
+// 最长的合法 UTF-8 前缀的长度，末尾不完整的多字节序列不计入
+size_t Utf8ValidPrefix(const char* data, size_t size);
+
+// 边收边把响应体转成 UTF-8：编码按 BOM、Content-Type、<meta charset> 的顺序确定，都没有时按内容统计推测。
+// 判断出编码之前只有 ASCII 前缀算作已完成，ASCII 在支持的各编码下都相同，可以先交给解析器
+class Utf8Normalizer
+{
+public:
+    void Reset(std::string_view contentType);
+    // chunk 追加到 html 并就地转换，返回 html 开头已经是最终 UTF-8 的字节数
+    size_t Feed(std::string_view chunk, std::string& html);
+    // 响应体结束，转换剩余部分，返回值等于 html.size()
+    size_t Finish(std::string& html);
+
+    Charset Detected() const { return m_charset; }
+    // 原始编码不是 UTF-8，内容已经转换过
+    bool Transcoded() const { return m_charset != Charset::Utf8 && m_charset != Charset::Unknown; }
+    // 内容里有非法字节，已替换为 U+FFFD
+    bool Repaired() const { return m_repaired; }
+
+private:
+    bool Decide(std::string& html, bool final);
+    void Convert(std::string& html, bool final);
+
+    Charset m_charset = Charset::Unknown;
+    bool m_bomChecked = false;
+    bool m_metaChecked = false;
+    bool m_repaired = false;
+    size_t m_ready = 0;
+    size_t m_nonAscii = 0;
+    // 转换时复用的缓冲
+    std::string m_raw;
+};
+
+#endif
@@ -0,0 +1,370 @@
+﻿#include "checkpoint.h"
+#include "url.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <set>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const char kCheckpointMagic[8] = { 'C', 'R', 'A', 'W', 'L', 'C', 'K', 'P' };
+    const uint32_t kCheckpointVersion = 1;
+
+    // 日志记录：'P' id fp depth len url / 'D' id / 'M' len url，整数按小端写入
+    const char kPush = 'P';
+    const char kDone = 'D';
+    const char kMedia = 'M';
+
+    struct Progress
+    {
+        std::unordered_map<uint64_t, CrawlTask> pending;
+        std::vector<uint64_t> visited;
+        std::set<std::string> media;
+        uint64_t nextId = 1;
+    };
+
+    template <typename T>
+    void PutRaw(std::string& out, T value)
+    {
+        out.append((const char*)&value, sizeof(value));
+    }
+
+    void PutString(std::string& out, const std::string& value)
+    {
+        PutRaw<uint32_t>(out, (uint32_t)value.size());
+        out += value;
+    }
+
+    template <typename T>
+    bool GetRaw(std::istream& in, T& value)
+    {
+        return (bool)in.read((char*)&value, sizeof(value));
+    }
+
+    bool GetString(std::istream& in, std::string& value)
+    {
+        uint32_t size = 0;
+        if (!GetRaw(in, size) || size > (64u << 20)) return false;
+        value.resize(size);
+        return size == 0 || (bool)in.read(&value[0], size);
+    }
+
+    CrawlTask MakeTask(uint64_t id, std::string url, int depth)
+    {
+        CrawlTask task;
+        UrlView view;
+        if (ParseUrl(url, view)) task.host = std::string(view.host);
+        task.url = std::move(url);
+        task.depth = depth;
+        task.id = id;
+        return task;
+    }
+
+    bool ReadCheckpointFile(const std::string& path, Progress& progress)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open()) return false;
+        char magic[8];
+        uint32_t version = 0;
+        uint64_t count = 0;
+        if (!in.read(magic, sizeof(magic)) || memcmp(magic, kCheckpointMagic, sizeof(magic)) != 0 ||
+            !GetRaw(in, version) || version != kCheckpointVersion || !GetRaw(in, progress.nextId) ||
+            !GetRaw(in, count)) {
+            return false;
+        }
+        size_t base = progress.visited.size();
+        progress.visited.resize(base + (size_t)count);
+        if (count > 0 && !in.read((char*)&progress.visited[base], count * sizeof(uint64_t))) return false;
+        if (!GetRaw(in, count)) return false;
+        for (uint64_t i = 0; i < count; ++i) {
+            uint64_t id = 0;
+            uint32_t depth = 0;
+            std::string url;
+            if (!GetRaw(in, id) || !GetRaw(in, depth) || !GetString(in, url)) return false;
+            progress.pending[id] = MakeTask(id, std::move(url), (int)depth);
+        }
+        if (!GetRaw(in, count)) return false;
+        for (uint64_t i = 0; i < count; ++i) {
+            std::string url;
+            if (!GetString(in, url)) return false;
+            progress.media.insert(std::move(url));
+        }
+        return true;
+    }
+
+    // 进程被杀时最后一条记录可能不完整，读到那里为止
+    void ReplayJournal(const std::string& path, Progress& progress)
+    {
+        std::ifstream in(path, std::ios::binary);
+        char type;
+        while (in.get(type)) {
+            if (type == kPush) {
+                uint64_t id = 0, fingerprint = 0;
+                uint32_t depth = 0;
+                std::string url;
+                if (!GetRaw(in, id) || !GetRaw(in, fingerprint) || !GetRaw(in, depth) || !GetString(in, url)) break;
+                progress.visited.push_back(fingerprint);
+                progress.pending[id] = MakeTask(id, std::move(url), (int)depth);
+                progress.nextId = std::max(progress.nextId, id + 1);
+            }
+            else if (type == kDone) {
+                uint64_t id = 0;
+                if (!GetRaw(in, id)) break;
+                progress.pending.erase(id);
+            }
+            else if (type == kMedia) {
+                std::string url;
+                if (!GetString(in, url)) break;
+                progress.media.insert(std::move(url));
+            }
+            else {
+                break;
+            }
+        }
+    }
+
+    bool WriteCheckpointFile(const std::string& path, const Progress& progress, const std::vector<CrawlTask>& pending,
+        const std::vector<std::string>& media)
+    {
+        std::string tempPath = path + ".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            if (!out.is_open()) return false;
+            std::string buffer;
+            buffer.append(kCheckpointMagic, sizeof(kCheckpointMagic));
+            PutRaw(buffer, kCheckpointVersion);
+            PutRaw<uint64_t>(buffer, progress.nextId);
+            PutRaw<uint64_t>(buffer, progress.visited.size());
+            out.write(buffer.data(), buffer.size());
+            out.write((const char*)progress.visited.data(), progress.visited.size() * sizeof(uint64_t));
+            buffer.clear();
+            PutRaw<uint64_t>(buffer, pending.size());
+            for (const auto& task : pending) {
+                PutRaw<uint64_t>(buffer, task.id);
+                PutRaw<uint32_t>(buffer, (uint32_t)task.depth);
+                PutString(buffer, task.url);
+            }
+            PutRaw<uint64_t>(buffer, media.size());
+            for (const auto& url : media) PutString(buffer, url);
+            out.write(buffer.data(), buffer.size());
+            out.close();
+            if (out.fail()) return false;
+        }
+        std::error_code ec;
+        fs::rename(tempPath, path, ec);
+        return !ec;
+    }
+
+    // journal-NNNNNN.log 的编号，不匹配时返回 -1
+    int ParseJournalSeq(const std::string& filename)
+    {
+        if (filename.size() != 18 || filename.compare(0, 8, "journal-") != 0 ||
+            filename.compare(14, 4, ".log") != 0) return -1;
+        int seq = 0;
+        for (size_t i = 8; i < 14; ++i) {
+            if (filename[i] < '0' || filename[i] > '9') return -1;
+            seq = seq * 10 + (filename[i] - '0');
+        }
+        return seq;
+    }
+
+    std::vector<std::pair<int, std::string>> ListJournals(const std::string& directory)
+    {
+        std::vector<std::pair<int, std::string>> journals;
+        std::error_code ec;
+        for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+            int seq = ParseJournalSeq(it->path().filename().string());
+            if (seq >= 0) journals.emplace_back(seq, it->path().string());
+        }
+        std::sort(journals.begin(), journals.end());
+        return journals;
+    }
+
+    std::string JournalName(int seq)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "journal-%06d.log", seq);
+        return name;
+    }
+
+    // 把检查点与编号不超过 maxSeq 的日志合并；已完成的媒体、重复的指纹在这里去掉
+    void LoadProgress(const std::string& directory, int maxSeq, Progress& progress)
+    {
+        ReadCheckpointFile((fs::path(directory) / "checkpoint.bin").string(), progress);
+        for (const auto& journal : ListJournals(directory)) {
+            if (journal.first > maxSeq) break;
+            ReplayJournal(journal.second, progress);
+        }
+        std::sort(progress.visited.begin(), progress.visited.end());
+        progress.visited.erase(std::unique(progress.visited.begin(), progress.visited.end()), progress.visited.end());
+    }
+
+    void Flatten(const Progress& progress, const CrawlCheckpoint::MediaDonePredicate& mediaDone,
+        std::vector<CrawlTask>& pending, std::vector<std::string>& media)
+    {
+        pending.clear();
+        pending.reserve(progress.pending.size());
+        for (const auto& item : progress.pending) pending.push_back(item.second);
+        // 按编号排序，恢复后仍按原来的入队顺序抓取
+        std::sort(pending.begin(), pending.end(), [](const CrawlTask& a, const CrawlTask& b) { return a.id < b.id; });
+        media.clear();
+        for (const auto& url : progress.media) {
+            if (!mediaDone || !mediaDone(url)) media.push_back(url);
+        }
+    }
+}
+
+CrawlCheckpoint::CrawlCheckpoint(const CheckpointOptions& options, MediaDonePredicate mediaDone)
+    : m_options(options), m_mediaDone(std::move(mediaDone))
+{
+    m_options.intervalSeconds = std::max(1, m_options.intervalSeconds);
+    m_options.journalFlushMs = std::max(10, m_options.journalFlushMs);
+    std::error_code ec;
+    fs::create_directories(m_options.directory, ec);
+}
+
+CrawlCheckpoint::~CrawlCheckpoint()
+{
+    Stop();
+}
+
+std::string CrawlCheckpoint::PathOf(const std::string& name) const
+{
+    return (fs::path(m_options.directory) / name).string();
+}
+
+bool CrawlCheckpoint::Load(CheckpointState& state)
+{
+    Progress progress;
+    LoadProgress(m_options.directory, INT32_MAX, progress);
+    Flatten(progress, m_mediaDone, state.pending, state.media);
+    state.visited = std::move(progress.visited);
+    state.nextId = progress.nextId;
+    for (const auto& task : state.pending) state.nextId = std::max(state.nextId, task.id + 1);
+    return !state.pending.empty() || !state.media.empty();
+}
+
+bool CrawlCheckpoint::OpenJournal(int seq)
+{
+    m_journal.close();
+    m_journalSeq = seq;
+    m_journal.open(PathOf(JournalName(seq)), std::ios::binary | std::ios::trunc);
+    return m_journal.is_open();
+}
+
+void CrawlCheckpoint::Begin(uint64_t nextId, bool keepExisting)
+{
+    std::error_code ec;
+    auto journals = ListJournals(m_options.directory);
+    if (keepExisting) {
+        // 先把旧日志并入检查点，末尾可能写了一半的日志不再追加
+        m_journalSeq = journals.empty() ? 0 : journals.back().first;
+        Compact();
+    }
+    else {
+        for (const auto& journal : journals) fs::remove(journal.second, ec);
+        fs::remove(PathOf("checkpoint.bin"), ec);
+        m_journalSeq = 0;
+    }
+    m_nextId = std::max<uint64_t>(1, nextId);
+    OpenJournal(m_journalSeq + 1);
+    m_stopping = false;
+    m_thread = std::thread(&CrawlCheckpoint::BackgroundLoop, this);
+}
+
+void CrawlCheckpoint::Stop()
+{
+    if (!m_thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(m_stopMutex);
+        m_stopping = true;
+    }
+    m_stopCv.notify_all();
+    m_thread.join();
+    FlushJournal();
+    Compact();
+    m_journal.close();
+}
+
+uint64_t CrawlCheckpoint::RecordPush(const CrawlTask& task, uint64_t fingerprint)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t id = m_nextId++;
+    m_buffer.push_back(kPush);
+    PutRaw<uint64_t>(m_buffer, id);
+    PutRaw<uint64_t>(m_buffer, fingerprint);
+    PutRaw<uint32_t>(m_buffer, (uint32_t)task.depth);
+    PutString(m_buffer, task.url);
+    return id;
+}
+
+void CrawlCheckpoint::RecordDone(uint64_t id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_buffer.push_back(kDone);
+    PutRaw<uint64_t>(m_buffer, id);
+}
+
+void CrawlCheckpoint::RecordMedia(const std::string& url)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_buffer.push_back(kMedia);
+    PutString(m_buffer, url);
+}
+
+void CrawlCheckpoint::FlushJournal()
+{
+    {
+        // 抓取线程只会在交换缓冲区时等待
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_writing.swap(m_buffer);
+    }
+    if (m_writing.empty()) return;
+    m_journal.write(m_writing.data(), m_writing.size());
+    m_journal.flush();
+    m_writing.clear();
+}
+
+bool CrawlCheckpoint::Compact()
+{
+    // 换到新日志后，旧日志与检查点的合并完全在后台线程上进行
+    int mergedSeq = m_journalSeq;
+    if (m_journal.is_open()) {
+        FlushJournal();
+        OpenJournal(m_journalSeq + 1);
+    }
+    Progress progress;
+    LoadProgress(m_options.directory, mergedSeq, progress);
+    std::vector<CrawlTask> pending;
+    std::vector<std::string> media;
+    Flatten(progress, m_mediaDone, pending, media);
+    if (!WriteCheckpointFile(PathOf("checkpoint.bin"), progress, pending, media)) return false;
+    std::error_code ec;
+    for (const auto& journal : ListJournals(m_options.directory)) {
+        if (journal.first > mergedSeq) break;
+        fs::remove(journal.second, ec);
+    }
+    return true;
+}
+
+void CrawlCheckpoint::BackgroundLoop()
+{
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point nextCompact = Clock::now() + std::chrono::seconds(m_options.intervalSeconds);
+    std::unique_lock<std::mutex> lock(m_stopMutex);
+    while (!m_stopping) {
+        m_stopCv.wait_for(lock, std::chrono::milliseconds(m_options.journalFlushMs));
+        if (m_stopping) break;
+        lock.unlock();
+        FlushJournal();
+        if (Clock::now() >= nextCompact) {
+            Compact();
+            nextCompact = Clock::now() + std::chrono::seconds(m_options.intervalSeconds);
+        }
+        lock.lock();
+    }
+}
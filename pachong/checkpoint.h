@@ -0,0 +1,79 @@
+﻿#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "scheduler.h"
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct CheckpointOptions
+{
+    bool enabled = true;
+    // 启动时从上次的检查点继续，而不是从种子地址重新开始
+    bool resume = false;
+    // 为空时使用程序目录下的 checkpoint
+    std::string directory;
+    // 把日志合并进检查点文件的间隔
+    int intervalSeconds = 60;
+    // 日志缓冲写入磁盘的间隔，进程被杀时最多丢失这么久的进度
+    int journalFlushMs = 1000;
+};
+
+struct CheckpointState
+{
+    std::vector<CrawlTask> pending;
+    std::vector<uint64_t> visited;
+    std::vector<std::string> media;
+    uint64_t nextId = 1;
+};
+
+// 抓取进度的持久化：抓取线程只往内存日志里追加很小的记录（入队、完成、媒体任务），
+// 后台线程定期写盘，并把旧日志与上一个检查点合并成新的 checkpoint.bin。
+// 合并期间抓取线程只在切换日志文件的一瞬间等待，与已访问集合的大小无关
+class CrawlCheckpoint
+{
+public:
+    using MediaDonePredicate = std::function<bool(const std::string& url)>;
+
+    CrawlCheckpoint(const CheckpointOptions& options, MediaDonePredicate mediaDone);
+    ~CrawlCheckpoint();
+
+    // 读取检查点与日志，得到未完成的任务、已访问指纹和未完成的媒体下载
+    bool Load(CheckpointState& state);
+    // 丢弃旧的进度，从 nextId 开始编号并启动后台线程
+    void Begin(uint64_t nextId, bool keepExisting);
+    void Stop();
+
+    // 返回分配给该任务的编号
+    uint64_t RecordPush(const CrawlTask& task, uint64_t fingerprint);
+    void RecordDone(uint64_t id);
+    void RecordMedia(const std::string& url);
+
+private:
+    void BackgroundLoop();
+    void FlushJournal();
+    bool OpenJournal(int seq);
+    bool Compact();
+    std::string PathOf(const std::string& name) const;
+
+    CheckpointOptions m_options;
+    MediaDonePredicate m_mediaDone;
+    std::mutex m_mutex;
+    std::string m_buffer;
+    uint64_t m_nextId = 1;
+    // 以下只由后台线程使用（Begin 之前与 Stop 之后由调用线程使用）
+    std::ofstream m_journal;
+    int m_journalSeq = 0;
+    std::string m_writing;
+    std::mutex m_stopMutex;
+    std::condition_variable m_stopCv;
+    bool m_stopping = false;
+    std::thread m_thread;
+};
+
+#endif
@@ -0,0 +1,197 @@
+﻿#include "content_decoder.h"
+#ifdef CRAWLER_USE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef CRAWLER_USE_BROTLI
+#include <brotli/decode.h>
+#endif
+
+namespace
+{
+    bool EqualsToken(std::string_view a, std::string_view b)
+    {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); ++i) {
+            char c = a[i];
+            if (c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+            if (c != b[i]) return false;
+        }
+        return true;
+    }
+
+    const size_t kOutputChunk = 16 * 1024;
+
+#ifdef CRAWLER_USE_ZLIB
+    class ZlibDecoder : public ContentDecoder
+    {
+    public:
+        explicit ZlibDecoder(bool gzip)
+            : m_gzip(gzip)
+        {
+            // 15 + 32 让 zlib 自动识别 gzip 与 zlib 头
+            Init(gzip ? 15 + 32 : 15);
+        }
+
+        ~ZlibDecoder() override
+        {
+            if (m_initialized) inflateEnd(&m_stream);
+        }
+
+        bool Decode(const char* data, size_t size, const DecodeSink& sink) override
+        {
+            if (!m_initialized) return false;
+            if (m_ended) return true;
+            bool firstChunk = m_firstChunk;
+            m_firstChunk = false;
+            m_stream.next_in = (Bytef*)data;
+            m_stream.avail_in = (uInt)size;
+            unsigned char out[kOutputChunk];
+            do {
+                m_stream.next_out = out;
+                m_stream.avail_out = sizeof(out);
+                int ret = inflate(&m_stream, Z_NO_FLUSH);
+                if (ret == Z_DATA_ERROR && !m_gzip && firstChunk && m_stream.total_out == 0) {
+                    // 有些服务器的 deflate 是不带 zlib 头的原始流，从头按原始流重试
+                    firstChunk = false;
+                    inflateEnd(&m_stream);
+                    Init(-15);
+                    if (!m_initialized) return false;
+                    m_stream.next_in = (Bytef*)data;
+                    m_stream.avail_in = (uInt)size;
+                    continue;
+                }
+                if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) return false;
+                size_t produced = sizeof(out) - m_stream.avail_out;
+                if (produced > 0 && !sink((const char*)out, produced)) return false;
+                if (ret == Z_STREAM_END) {
+                    // gzip 允许多个成员首尾相接
+                    if (m_gzip && m_stream.avail_in > 0) {
+                        inflateReset(&m_stream);
+                        continue;
+                    }
+                    m_ended = true;
+                    return true;
+                }
+                if (ret == Z_BUF_ERROR && produced == 0) break;
+            } while (m_stream.avail_in > 0 || m_stream.avail_out == 0);
+            return true;
+        }
+
+        bool Finish() override
+        {
+            return m_ended;
+        }
+
+    private:
+        void Init(int windowBits)
+        {
+            m_stream = z_stream();
+            m_initialized = inflateInit2(&m_stream, windowBits) == Z_OK;
+        }
+
+        z_stream m_stream;
+        bool m_gzip;
+        bool m_initialized = false;
+        bool m_firstChunk = true;
+        bool m_ended = false;
+    };
+#endif
+
+#ifdef CRAWLER_USE_BROTLI
+    class BrotliDecoder : public ContentDecoder
+    {
+    public:
+        BrotliDecoder()
+            : m_state(BrotliDecoderCreateInstance(nullptr, nullptr, nullptr))
+        {
+        }
+
+        ~BrotliDecoder() override
+        {
+            if (m_state) BrotliDecoderDestroyInstance(m_state);
+        }
+
+        bool Decode(const char* data, size_t size, const DecodeSink& sink) override
+        {
+            if (!m_state) return false;
+            const uint8_t* next = (const uint8_t*)data;
+            size_t available = size;
+            uint8_t out[kOutputChunk];
+            for (;;) {
+                uint8_t* nextOut = out;
+                size_t availableOut = sizeof(out);
+                BrotliDecoderResult result = BrotliDecoderDecompressStream(m_state, &available, &next,
+                    &availableOut, &nextOut, nullptr);
+                size_t produced = sizeof(out) - availableOut;
+                if (produced > 0 && !sink((const char*)out, produced)) return false;
+                if (result == BROTLI_DECODER_RESULT_ERROR) return false;
+                if (result == BROTLI_DECODER_RESULT_SUCCESS) {
+                    m_ended = true;
+                    return true;
+                }
+                if (result == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT) return true;
+            }
+        }
+
+        bool Finish() override
+        {
+            return m_ended;
+        }
+
+    private:
+        BrotliDecoderState* m_state;
+        bool m_ended = false;
+    };
+#endif
+}
+
+const char* ContentEncodingName(ContentEncoding encoding)
+{
+    switch (encoding) {
+    case ContentEncoding::Identity: return "identity";
+    case ContentEncoding::Gzip: return "gzip";
+    case ContentEncoding::Deflate: return "deflate";
+    case ContentEncoding::Brotli: return "br";
+    default: return "unknown";
+    }
+}
+
+ContentEncoding ParseContentEncoding(std::string_view value)
+{
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.remove_suffix(1);
+    if (value.empty() || EqualsToken(value, "identity")) return ContentEncoding::Identity;
+    if (EqualsToken(value, "gzip") || EqualsToken(value, "x-gzip")) return ContentEncoding::Gzip;
+    if (EqualsToken(value, "deflate")) return ContentEncoding::Deflate;
+    if (EqualsToken(value, "br")) return ContentEncoding::Brotli;
+    return ContentEncoding::Unknown;
+}
+
+const std::string& SupportedAcceptEncoding()
+{
+    static const std::string value = [] {
+        std::string result;
+#ifdef CRAWLER_USE_ZLIB
+        result = "gzip, deflate";
+#endif
+#ifdef CRAWLER_USE_BROTLI
+        result += result.empty() ? "br" : ", br";
+#endif
+        return result;
+    }();
+    return value;
+}
+
+std::unique_ptr<ContentDecoder> CreateContentDecoder(ContentEncoding encoding)
+{
+    switch (encoding) {
+#ifdef CRAWLER_USE_ZLIB
+    case ContentEncoding::Gzip: return std::make_unique<ZlibDecoder>(true);
+    case ContentEncoding::Deflate: return std::make_unique<ZlibDecoder>(false);
+#endif
+#ifdef CRAWLER_USE_BROTLI
+    case ContentEncoding::Brotli: return std::make_unique<BrotliDecoder>();
+#endif
+    default: return nullptr;
+    }
+}
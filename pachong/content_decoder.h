@@ -0,0 +1,42 @@
+﻿#ifndef CONTENT_DECODER_H
+#define CONTENT_DECODER_H
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// 编译时通过 CRAWLER_USE_ZLIB / CRAWLER_USE_BROTLI 启用对应的解码器
+enum class ContentEncoding
+{
+    Identity,
+    Gzip,
+    Deflate,
+    Brotli,
+    Unknown,
+    Count
+};
+
+const char* ContentEncodingName(ContentEncoding encoding);
+ContentEncoding ParseContentEncoding(std::string_view value);
+// 本次编译支持的 Accept-Encoding 取值，例如 "gzip, deflate, br"；都不支持时为空
+const std::string& SupportedAcceptEncoding();
+
+using DecodeSink = std::function<bool(const char*, size_t)>;
+
+// 流式解码：每收到一块压缩数据调用 Decode，解出的数据立刻交给 sink，不缓存整个响应体
+class ContentDecoder
+{
+public:
+    virtual ~ContentDecoder() = default;
+    // 数据损坏或 sink 返回 false 时返回 false
+    virtual bool Decode(const char* data, size_t size, const DecodeSink& sink) = 0;
+    // 数据流是否完整结束
+    virtual bool Finish() = 0;
+};
+
+// 不支持的编码返回 nullptr
+std::unique_ptr<ContentDecoder> CreateContentDecoder(ContentEncoding encoding);
+
+#endif
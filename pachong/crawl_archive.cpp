@@ -0,0 +1,508 @@
+﻿#include "crawl_archive.h"
+#include "metrics.h"
+#include "visited_store.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#ifdef CRAWLER_USE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const char kIndexMagic[8] = { 'C', 'R', 'A', 'W', 'L', 'I', 'D', 'X' };
+    const uint32_t kIndexVersion = 1;
+    const size_t kIndexHeaderSize = 16;
+    const char kRecordMagic[] = "CRAWL/1.0\r\n";
+
+    std::string SegmentName(int id, const char* extension)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "segment-%05d%s", id, extension);
+        return name;
+    }
+
+    // 解析 segment-NNNNN.seg 的编号，不匹配时返回 -1
+    int ParseSegmentId(const std::string& filename)
+    {
+        if (filename.size() != 17 || filename.compare(0, 8, "segment-") != 0 ||
+            filename.compare(13, 4, ".seg") != 0) return -1;
+        int id = 0;
+        for (size_t i = 8; i < 13; ++i) {
+            if (filename[i] < '0' || filename[i] > '9') return -1;
+            id = id * 10 + (filename[i] - '0');
+        }
+        return id;
+    }
+
+    std::string FormatTime(int64_t timeMs)
+    {
+        time_t seconds = (time_t)(timeMs / 1000);
+        struct tm utc;
+#ifdef _WIN32
+        gmtime_s(&utc, &seconds);
+#else
+        gmtime_r(&seconds, &utc);
+#endif
+        char buffer[32];
+        strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", &utc);
+        return buffer;
+    }
+
+    bool IsSingleLine(const std::string& value)
+    {
+        return value.find_first_of("\r\n") == std::string::npos;
+    }
+}
+
+// 不经过用户态缓冲的追加写文件，批量数据一次写出，Sync 对应 fsync / FlushFileBuffers
+class ArchiveWriter::OutputFile
+{
+public:
+    ~OutputFile()
+    {
+#ifdef _WIN32
+        if (m_handle != INVALID_HANDLE_VALUE) CloseHandle(m_handle);
+#else
+        if (m_fd >= 0) close(m_fd);
+#endif
+    }
+
+    bool Open(const std::string& path)
+    {
+#ifdef _WIN32
+        m_handle = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL, NULL);
+        return m_handle != INVALID_HANDLE_VALUE;
+#else
+        m_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        return m_fd >= 0;
+#endif
+    }
+
+    bool Write(const char* data, size_t size)
+    {
+        while (size > 0) {
+#ifdef _WIN32
+            DWORD chunk = (DWORD)std::min<size_t>(size, 1u << 30);
+            DWORD written = 0;
+            if (!WriteFile(m_handle, data, chunk, &written, NULL) || written == 0) return false;
+#else
+            ssize_t written = write(m_fd, data, size);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) return false;
+#endif
+            data += written;
+            size -= (size_t)written;
+        }
+        return true;
+    }
+
+    bool Sync()
+    {
+#ifdef _WIN32
+        return FlushFileBuffers(m_handle) != 0;
+#else
+        return fsync(m_fd) == 0;
+#endif
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE m_handle = INVALID_HANDLE_VALUE;
+#else
+    int m_fd = -1;
+#endif
+};
+
+ArchiveWriter::ArchiveWriter(const ArchiveOptions& options, CrawlMetrics* metrics)
+    : m_options(options), m_metrics(metrics), m_queue(4096), m_budget(std::max(options.memoryBudgetBytes, 64ll * 1024))
+{
+    m_options.segmentBytes = std::max<uint64_t>(m_options.segmentBytes, 1024 * 1024);
+    m_options.memoryBudgetBytes = std::max(m_options.memoryBudgetBytes, 64ll * 1024);
+    // 攒批的数据占着内存预算，批大小不能超过预算的一半，否则生产者会一直等到超时才被放行
+    m_options.writeBatchBytes = std::clamp<size_t>(m_options.writeBatchBytes, 4096,
+        (size_t)m_options.memoryBudgetBytes / 2);
+    m_options.flushIntervalMs = std::max(1, m_options.flushIntervalMs);
+#ifndef CRAWLER_USE_ZSTD
+    m_options.compressText = false;
+#endif
+    std::error_code ec;
+    fs::create_directories(m_options.directory, ec);
+    // 接着目录中已有的最大编号写，旧段保持不变
+    for (const auto& segment : ListArchiveSegments(m_options.directory)) {
+        m_segmentId = std::max(m_segmentId, ParseSegmentId(fs::path(segment).filename().string()));
+    }
+    // 段文件在第一条记录写入时才创建，没有抓到页面的运行不留下空段
+    m_ready = fs::is_directory(m_options.directory, ec);
+    if (m_ready) m_thread = std::thread(&ArchiveWriter::WriterLoop, this);
+}
+
+ArchiveWriter::~ArchiveWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_stopping = true;
+    }
+    m_wakeCv.notify_one();
+    if (m_thread.joinable()) m_thread.join();
+}
+
+void ArchiveWriter::Serialize(const ArchiveRecord& record, PendingRecord& pending)
+{
+    std::string headerBlock;
+    for (const auto& header : record.headers) {
+        if (!IsSingleLine(header.first) || !IsSingleLine(header.second)) continue;
+        headerBlock += header.first;
+        headerBlock += ": ";
+        headerBlock += header.second;
+        headerBlock += "\r\n";
+    }
+    std::string_view text = record.text;
+    std::string compressed;
+#ifdef CRAWLER_USE_ZSTD
+    if (m_options.compressText && !record.text.empty()) {
+        compressed.resize(ZSTD_compressBound(record.text.size()));
+        size_t size = ZSTD_compress(&compressed[0], compressed.size(), record.text.data(), record.text.size(),
+            m_options.zstdLevel);
+        if (ZSTD_isError(size)) {
+            compressed.clear();
+        }
+        else {
+            compressed.resize(size);
+            text = compressed;
+        }
+    }
+#endif
+    std::string& out = pending.bytes;
+    out.reserve(256 + record.url.size() + headerBlock.size() + record.html.size() + text.size());
+    out += kRecordMagic;
+    out += "URL: " + record.url + "\r\n";
+    out += "Depth: " + std::to_string(record.depth) + "\r\n";
+    out += "Fetch-Time: " + FormatTime(record.fetchTimeMs) + "\r\n";
+    out += "Status: " + std::to_string(record.status) + "\r\n";
+    if (!record.aliasOf.empty() && IsSingleLine(record.aliasOf)) out += "Alias-Of: " + record.aliasOf + "\r\n";
+    if (!compressed.empty()) out += "Text-Encoding: zstd\r\n";
+    out += "Header-Length: " + std::to_string(headerBlock.size()) + "\r\n";
+    out += "Html-Length: " + std::to_string(record.html.size()) + "\r\n";
+    out += "Text-Length: " + std::to_string(text.size()) + "\r\n\r\n";
+    out += headerBlock;
+    out += record.html;
+    out += text;
+    out += "\r\n\r\n";
+
+    ArchiveIndexEntry& entry = pending.entry;
+    entry.urlFingerprint = FingerprintUrl(record.url);
+    entry.offset = 0;
+    entry.length = out.size();
+    entry.fetchTimeMs = record.fetchTimeMs;
+    entry.depth = (uint32_t)std::max(0, record.depth);
+    entry.status = (uint32_t)std::max(0, record.status);
+}
+
+bool ArchiveWriter::Append(const ArchiveRecord& record)
+{
+    if (!IsReady()) return false;
+    auto pending = std::make_unique<PendingRecord>();
+    Serialize(record, *pending);
+    pending->reserved = m_budget.Acquire((long long)pending->bytes.size());
+    // 内存预算一般先于队列槽位耗尽，这里的自旋很少发生
+    while (!m_queue.TryPush(pending)) std::this_thread::yield();
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_writerSleeping.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_wakeCv.notify_one();
+    }
+    return true;
+}
+
+void ArchiveWriter::Flush()
+{
+    if (!m_thread.joinable()) return;
+    std::unique_lock<std::mutex> lock(m_wakeMutex);
+    uint64_t target = ++m_flushRequested;
+    m_wakeCv.notify_one();
+    m_flushedCv.wait(lock, [&] { return m_flushCompleted >= target; });
+}
+
+bool ArchiveWriter::OpenSegment()
+{
+    CloseSegment();
+    m_segmentId++;
+    m_segmentSize = 0;
+    fs::path base(m_options.directory);
+    m_segment = std::make_unique<OutputFile>();
+    m_index = std::make_unique<OutputFile>();
+    if (!m_segment->Open((base / SegmentName(m_segmentId, ".seg")).string()) ||
+        !m_index->Open((base / SegmentName(m_segmentId, ".idx")).string())) {
+        return false;
+    }
+    char header[kIndexHeaderSize] = { 0 };
+    memcpy(header, kIndexMagic, sizeof(kIndexMagic));
+    uint32_t version = kIndexVersion;
+    uint32_t entrySize = sizeof(ArchiveIndexEntry);
+    memcpy(header + 8, &version, 4);
+    memcpy(header + 12, &entrySize, 4);
+    return m_index->Write(header, sizeof(header));
+}
+
+void ArchiveWriter::CloseSegment()
+{
+    if (m_segment && m_options.syncPolicy != SyncPolicy::None) {
+        m_segment->Sync();
+        m_index->Sync();
+    }
+    m_segment.reset();
+    m_index.reset();
+}
+
+void ArchiveWriter::Stage(PendingRecord& pending)
+{
+    uint64_t length = pending.bytes.size();
+    uint64_t staged = m_segmentSize + m_batch.size();
+    if (!m_segment || (staged > 0 && staged + length > m_options.segmentBytes)) {
+        WriteBatch();
+        if (!OpenSegment()) m_failed = true;
+    }
+    if (m_batch.empty()) m_batchStarted = std::chrono::steady_clock::now();
+    pending.entry.offset = m_segmentSize + m_batch.size();
+    m_batch += pending.bytes;
+    m_indexBatch.append((const char*)&pending.entry, sizeof(pending.entry));
+    m_batchReserved += pending.reserved;
+    if (m_batch.size() >= m_options.writeBatchBytes) WriteBatch();
+}
+
+void ArchiveWriter::WriteBatch()
+{
+    if (!m_batch.empty()) {
+        auto started = std::chrono::steady_clock::now();
+        // 先写记录再写索引，崩溃时索引最多缺少最后一批
+        bool ok = !m_failed && m_segment && m_segment->Write(m_batch.data(), m_batch.size()) &&
+            m_index->Write(m_indexBatch.data(), m_indexBatch.size());
+        if (ok && m_options.syncPolicy == SyncPolicy::EveryFlush) ok = m_segment->Sync() && m_index->Sync();
+        if (!ok) m_failed = true;
+        if (m_metrics) m_metrics->RecordStage(MetricStage::DiskWrite, started);
+        m_segmentSize += m_batch.size();
+        m_batch.clear();
+        m_indexBatch.clear();
+    }
+    if (m_batchReserved > 0) {
+        m_budget.Release(m_batchReserved);
+        m_batchReserved = 0;
+    }
+}
+
+void ArchiveWriter::WriterLoop()
+{
+    using Clock = std::chrono::steady_clock;
+    const auto interval = std::chrono::milliseconds(m_options.flushIntervalMs);
+    std::unique_ptr<PendingRecord> item;
+    for (;;) {
+        // 先读请求再取队列：Flush 调用之前入队的记录一定会在本轮写出
+        uint64_t flushTarget = m_flushRequested.load();
+        bool stopping = m_stopping.load();
+        while (m_queue.TryPop(item)) {
+            Stage(*item);
+            item.reset();
+        }
+        Clock::time_point now = Clock::now();
+        if (!m_batch.empty() && now - m_batchStarted >= interval) WriteBatch();
+        if (flushTarget > m_flushCompleted || stopping) {
+            WriteBatch();
+            std::lock_guard<std::mutex> lock(m_wakeMutex);
+            m_flushCompleted = flushTarget;
+            m_flushedCv.notify_all();
+        }
+        if (stopping) {
+            CloseSegment();
+            return;
+        }
+        m_writerSleeping = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        {
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            Clock::time_point deadline = m_batch.empty() ? now + interval : m_batchStarted + interval;
+            m_wakeCv.wait_until(lock, deadline, [&] {
+                return !m_queue.Empty() || m_stopping || m_flushRequested > m_flushCompleted;
+            });
+        }
+        m_writerSleeping = false;
+    }
+}
+
+std::vector<std::string> ListArchiveSegments(const std::string& directory)
+{
+    std::vector<std::pair<int, std::string>> found;
+    std::error_code ec;
+    for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+        int id = ParseSegmentId(it->path().filename().string());
+        if (id >= 0) found.emplace_back(id, it->path().string());
+    }
+    std::sort(found.begin(), found.end());
+    std::vector<std::string> segments;
+    for (auto& item : found) segments.push_back(std::move(item.second));
+    return segments;
+}
+
+ArchiveReader::~ArchiveReader()
+{
+    Close();
+}
+
+void ArchiveReader::Close()
+{
+#ifdef _WIN32
+    if (m_mapping) UnmapViewOfFile(m_mapping);
+    if (m_mapHandle) CloseHandle(m_mapHandle);
+    if (m_fileHandle && m_fileHandle != INVALID_HANDLE_VALUE) CloseHandle(m_fileHandle);
+    m_mapHandle = nullptr;
+    m_fileHandle = nullptr;
+#else
+    if (m_mapping) munmap(m_mapping, m_mappedSize);
+#endif
+    m_mapping = nullptr;
+    m_mappedSize = 0;
+    m_entries = nullptr;
+    m_count = 0;
+    m_segment.close();
+}
+
+bool ArchiveReader::Open(const std::string& segmentPath)
+{
+    Close();
+    std::string indexPath = fs::path(segmentPath).replace_extension(".idx").string();
+#ifdef _WIN32
+    m_fileHandle = CreateFileA(indexPath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_fileHandle == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_fileHandle, &size) || size.QuadPart < (LONGLONG)kIndexHeaderSize) return false;
+    m_mappedSize = (size_t)size.QuadPart;
+    m_mapHandle = CreateFileMappingA(m_fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!m_mapHandle) return false;
+    m_mapping = MapViewOfFile(m_mapHandle, FILE_MAP_READ, 0, 0, 0);
+#else
+    int fd = open(indexPath.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)kIndexHeaderSize) {
+        close(fd);
+        return false;
+    }
+    m_mappedSize = (size_t)st.st_size;
+    void* mapping = mmap(nullptr, m_mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    m_mapping = (mapping == MAP_FAILED) ? nullptr : mapping;
+#endif
+    if (!m_mapping) return false;
+    const char* base = (const char*)m_mapping;
+    uint32_t version = 0;
+    uint32_t entrySize = 0;
+    memcpy(&version, base + 8, 4);
+    memcpy(&entrySize, base + 12, 4);
+    if (memcmp(base, kIndexMagic, sizeof(kIndexMagic)) != 0 || version != kIndexVersion ||
+        entrySize != sizeof(ArchiveIndexEntry)) {
+        Close();
+        return false;
+    }
+    m_entries = (const ArchiveIndexEntry*)(base + kIndexHeaderSize);
+    // 末尾写了一半的条目忽略
+    m_count = (m_mappedSize - kIndexHeaderSize) / sizeof(ArchiveIndexEntry);
+    m_segment.open(segmentPath, std::ios::binary);
+    if (!m_segment.is_open()) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool ArchiveReader::Read(size_t i, ArchiveRecord& record)
+{
+    if (i >= m_count) return false;
+    const ArchiveIndexEntry& entry = m_entries[i];
+    std::string raw((size_t)entry.length, '\0');
+    m_segment.clear();
+    m_segment.seekg((std::streamoff)entry.offset);
+    if (!m_segment.read(&raw[0], raw.size())) return false;
+    if (raw.compare(0, sizeof(kRecordMagic) - 1, kRecordMagic) != 0) return false;
+    size_t headEnd = raw.find("\r\n\r\n");
+    if (headEnd == std::string::npos) return false;
+    size_t headerLength = 0, htmlLength = 0, textLength = 0;
+    bool zstdText = false;
+    record = ArchiveRecord();
+    record.depth = (int)entry.depth;
+    record.status = (int)entry.status;
+    record.fetchTimeMs = entry.fetchTimeMs;
+    size_t pos = sizeof(kRecordMagic) - 1;
+    while (pos < headEnd) {
+        size_t lineEnd = raw.find("\r\n", pos);
+        std::string_view line(raw.data() + pos, lineEnd - pos);
+        size_t colon = line.find(": ");
+        if (colon != std::string_view::npos) {
+            std::string_view name = line.substr(0, colon);
+            std::string value(line.substr(colon + 2));
+            if (name == "URL") record.url = value;
+            else if (name == "Header-Length") headerLength = (size_t)strtoull(value.c_str(), nullptr, 10);
+            else if (name == "Html-Length") htmlLength = (size_t)strtoull(value.c_str(), nullptr, 10);
+            else if (name == "Text-Length") textLength = (size_t)strtoull(value.c_str(), nullptr, 10);
+            else if (name == "Text-Encoding") zstdText = (value == "zstd");
+            else if (name == "Alias-Of") record.aliasOf = value;
+        }
+        pos = lineEnd + 2;
+    }
+    size_t body = headEnd + 4;
+    if (body + headerLength + htmlLength + textLength > raw.size()) return false;
+    std::string_view headers(raw.data() + body, headerLength);
+    while (!headers.empty()) {
+        size_t lineEnd = headers.find("\r\n");
+        std::string_view line = headers.substr(0, lineEnd);
+        size_t colon = line.find(": ");
+        if (colon != std::string_view::npos) {
+            record.headers.emplace_back(std::string(line.substr(0, colon)), std::string(line.substr(colon + 2)));
+        }
+        if (lineEnd == std::string_view::npos) break;
+        headers.remove_prefix(lineEnd + 2);
+    }
+    record.html.assign(raw, body + headerLength, htmlLength);
+    record.text.assign(raw, body + headerLength + htmlLength, textLength);
+    if (zstdText) {
+#ifdef CRAWLER_USE_ZSTD
+        unsigned long long size = ZSTD_getFrameContentSize(record.text.data(), record.text.size());
+        if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN) return false;
+        std::string decoded((size_t)size, '\0');
+        size_t written = ZSTD_decompress(&decoded[0], decoded.size(), record.text.data(), record.text.size());
+        if (ZSTD_isError(written)) return false;
+        decoded.resize(written);
+        record.text.swap(decoded);
+#else
+        // 没有 zstd 时无法还原正文
+        return false;
+#endif
+    }
+    return true;
+}
+
+bool ArchiveReader::Find(std::string_view url, ArchiveRecord& record)
+{
+    uint64_t fingerprint = FingerprintUrl(url);
+    for (size_t i = m_count; i > 0; --i) {
+        if (m_entries[i - 1].urlFingerprint != fingerprint) continue;
+        if (Read(i - 1, record) && record.url == url) return true;
+    }
+    return false;
+}
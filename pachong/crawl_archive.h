@@ -0,0 +1,169 @@
+﻿#ifndef CRAWL_ARCHIVE_H
+#define CRAWL_ARCHIVE_H
+
+#include "bounded_queue.h"
+#include "byte_budget.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class CrawlMetrics;
+
+enum class SyncPolicy
+{
+    // 只写入操作系统缓存
+    None,
+    // 段文件写满换段以及关闭时 fsync
+    OnRollover,
+    // 每次写出一批后都 fsync
+    EveryFlush
+};
+
+struct ArchiveOptions
+{
+    bool enabled = true;
+    // 为空时使用程序目录下的 archive
+    std::string directory;
+    // 单个段文件的大小上限，超过后换新段
+    uint64_t segmentBytes = 1ull << 30;
+    // 写线程把多条记录攒成一次顺序写入的大小
+    size_t writeBatchBytes = 1u << 20;
+    // 攒批最长等待时间，到时不满也写出
+    int flushIntervalMs = 1000;
+    SyncPolicy syncPolicy = SyncPolicy::OnRollover;
+    // 排队等待写入的记录总字节数上限，超过后抓取线程才会阻塞
+    long long memoryBudgetBytes = 64ll * 1024 * 1024;
+    // 用 zstd 压缩正文，需要以 CRAWLER_USE_ZSTD 编译
+    bool compressText = false;
+    int zstdLevel = 3;
+};
+
+struct ArchiveRecord
+{
+    std::string url;
+    int depth = 0;
+    int status = 0;
+    // Unix 时间，毫秒
+    int64_t fetchTimeMs = 0;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string html;
+    std::string text;
+    // 非空时本条是该 URL 页面的近似重复，只记元数据，不存 HTML 和正文
+    std::string aliasOf;
+};
+
+// 索引文件（segment-NNNNN.idx）中的定长条目，按小端写入，可以直接 mmap 成数组使用
+struct ArchiveIndexEntry
+{
+    uint64_t urlFingerprint;
+    uint64_t offset;
+    uint64_t length;
+    int64_t fetchTimeMs;
+    uint32_t depth;
+    uint32_t status;
+};
+static_assert(sizeof(ArchiveIndexEntry) == 40, "ArchiveIndexEntry layout is part of the file format");
+
+// 仿 WARC 的只追加段文件：每条记录是文本头 + 响应头 + 原始 HTML + 正文。
+// 段写满后滚动到下一个编号，已有的段不会再被修改。
+// Append 只在调用线程上序列化记录并放入无锁队列，由单独的写线程攒批顺序写盘
+class ArchiveWriter
+{
+public:
+    // metrics 不为空时记录每批写盘的耗时
+    explicit ArchiveWriter(const ArchiveOptions& options, CrawlMetrics* metrics = nullptr);
+    ~ArchiveWriter();
+    ArchiveWriter(const ArchiveWriter&) = delete;
+    ArchiveWriter& operator=(const ArchiveWriter&) = delete;
+
+    bool IsReady() const { return m_ready && !m_failed; }
+    // 线程安全；只有排队数据超出内存预算时才阻塞
+    bool Append(const ArchiveRecord& record);
+    // 等待此前提交的记录全部写出
+    void Flush();
+
+private:
+    struct PendingRecord
+    {
+        std::string bytes;
+        ArchiveIndexEntry entry;
+        long long reserved = 0;
+    };
+    class OutputFile;
+
+    void Serialize(const ArchiveRecord& record, PendingRecord& pending);
+    void WriterLoop();
+    void Stage(PendingRecord& pending);
+    void WriteBatch();
+    bool OpenSegment();
+    void CloseSegment();
+
+    ArchiveOptions m_options;
+    CrawlMetrics* m_metrics;
+    bool m_ready = false;
+    std::atomic<bool> m_failed{ false };
+    BoundedQueue<std::unique_ptr<PendingRecord>> m_queue;
+    ByteBudget m_budget;
+
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wakeCv;
+    std::condition_variable m_flushedCv;
+    std::atomic<bool> m_writerSleeping{ false };
+    std::atomic<bool> m_stopping{ false };
+    std::atomic<uint64_t> m_flushRequested{ 0 };
+    uint64_t m_flushCompleted = 0;
+    std::thread m_thread;
+
+    // 以下只由写线程访问
+    std::unique_ptr<OutputFile> m_segment;
+    std::unique_ptr<OutputFile> m_index;
+    int m_segmentId = 0;
+    uint64_t m_segmentSize = 0;
+    std::string m_batch;
+    std::string m_indexBatch;
+    long long m_batchReserved = 0;
+    std::chrono::steady_clock::time_point m_batchStarted;
+};
+
+// 按编号排序的段文件路径（.seg）
+std::vector<std::string> ListArchiveSegments(const std::string& directory);
+
+// 通过 mmap 的索引定位并读取某个段中的记录
+class ArchiveReader
+{
+public:
+    ArchiveReader() = default;
+    ~ArchiveReader();
+    ArchiveReader(const ArchiveReader&) = delete;
+    ArchiveReader& operator=(const ArchiveReader&) = delete;
+
+    bool Open(const std::string& segmentPath);
+    void Close();
+    size_t Count() const { return m_count; }
+    const ArchiveIndexEntry& Entry(size_t i) const { return m_entries[i]; }
+    bool Read(size_t i, ArchiveRecord& record);
+    // 按 URL 查找该段内最后一次抓取的记录，找不到返回 false
+    bool Find(std::string_view url, ArchiveRecord& record);
+
+private:
+    void* m_mapping = nullptr;
+    size_t m_mappedSize = 0;
+#ifdef _WIN32
+    void* m_fileHandle = nullptr;
+    void* m_mapHandle = nullptr;
+#endif
+    const ArchiveIndexEntry* m_entries = nullptr;
+    size_t m_count = 0;
+    std::ifstream m_segment;
+};
+
+#endif
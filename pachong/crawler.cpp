@@ -1,54 +1,220 @@
 ﻿#include "crawler.h"
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
 #include <cwctype>
 #include <algorithm>
+#include <cstring>
 #include <codecvt>
 #include <locale>
 #include <set>
-#include <regex>
 #include <iostream>
 #include <fstream>
 #include <random>
 #include <thread>
 #include <chrono>
 #include <filesystem>
+#include <optional>
 
 namespace fs = std::filesystem;
 
 Crawler::Crawler(int maxDepth)
-    : m_maxDepth(maxDepth), m_hSession(nullptr)
+    : Crawler(MakeOptions(maxDepth))
 {
-    m_hSession = WinHttpOpen(L"Crawler/1.0", WINHTTP_ACCESS_TYPE_DEFAULT_PROXY,
-        WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
-    if (!m_hSession) {
-        std::cerr << "Failed to initialize WinHTTP session.\n";
+}
+
+Crawler::Crawler(const CrawlerOptions& options)
+    : m_options(options), m_scorer(options.scheduler.frontier), m_visited(VisitedOptions(options)), m_maxDepth(options.maxDepth)
+{
+    m_options.threadCount = std::max(1, m_options.threadCount);
+    m_dataDir = DataDirectory(m_options);
+    std::error_code ec;
+    fs::create_directories(m_dataDir, ec);
+    if (m_options.scheduler.frontier.spillPath.empty()) {
+        m_options.scheduler.frontier.spillPath = m_dataDir + "frontier.spill";
+    }
+    m_options.transport.maxConnectionsPerHost =
+        std::max(m_options.transport.maxConnectionsPerHost, m_options.scheduler.perHostConcurrency);
+    if (!m_options.transport.dnsCache && m_options.dns.enabled) {
+        m_options.transport.dnsCache = std::make_shared<DnsCache>(m_options.dns);
+    }
+    m_transport = CreateHttpTransport(m_options.transport);
+    if (!m_transport->IsReady()) {
+        std::cerr << "Failed to initialize HTTP transport.\n";
+    }
+    std::string storeDir = m_options.mediaStore.directory;
+    if (storeDir.empty()) storeDir = m_dataDir + "media_store";
+    m_mediaStore = std::make_unique<MediaStore>(storeDir, m_options.mediaStore.hardLink);
+    if (!m_mediaStore->IsReady()) {
+        std::cerr << "Failed to open media index in " << storeDir << "\n";
+    }
+    if (m_options.archive.enabled) {
+        ArchiveOptions archiveOptions = m_options.archive;
+        if (archiveOptions.directory.empty()) archiveOptions.directory = m_dataDir + "archive";
+        m_archive = std::make_unique<ArchiveWriter>(archiveOptions, &m_metrics);
+        if (!m_archive->IsReady()) {
+            std::cerr << "Failed to open crawl archive in " << archiveOptions.directory << "\n";
+        }
+    }
+    if (m_options.scheduler.rateLimit.enabled) {
+        RateLimiterOptions rateOptions = m_options.scheduler.rateLimit;
+        if (rateOptions.statePath.empty()) rateOptions.statePath = m_dataDir + "rate_limits.tsv";
+        m_rateLimiter = std::make_unique<HostRateLimiter>(rateOptions);
+    }
+    if (m_options.checkpoint.enabled) {
+        CheckpointOptions checkpointOptions = m_options.checkpoint;
+        if (checkpointOptions.directory.empty()) checkpointOptions.directory = m_dataDir + "checkpoint";
+        // 已经进入内容寻址存储的媒体不必在恢复时重新排队
+        m_checkpoint = std::make_unique<CrawlCheckpoint>(checkpointOptions, [this](const std::string& url) {
+            std::string digest;
+            return m_mediaStore->Lookup(url, digest);
+        });
+    }
+    if (m_options.nearDuplicate.enabled) {
+        m_nearDuplicates = std::make_unique<NearDuplicateIndex>(m_options.nearDuplicate);
+    }
+    if (m_options.index.enabled) {
+        IndexOptions indexOptions = m_options.index;
+        if (indexOptions.directory.empty()) indexOptions.directory = m_dataDir + "index";
+        m_index = std::make_unique<IndexWriter>(indexOptions, &m_metrics);
+        if (!m_index->IsReady()) {
+            std::cerr << "Failed to open full-text index in " << indexOptions.directory << "\n";
+        }
+    }
+    if (m_options.httpCache.enabled) {
+        std::string cachePath = m_options.httpCache.path;
+        if (cachePath.empty()) cachePath = m_dataDir + "http_cache.tsv";
+        m_httpCache = std::make_unique<HttpCacheIndex>(cachePath);
+        if (!m_httpCache->IsReady()) {
+            std::cerr << "Failed to open HTTP cache index " << cachePath << "\n";
+        }
     }
 }
 
 Crawler::~Crawler()
 {
-    if (m_hSession) {
-        WinHttpCloseHandle(m_hSession);
+}
+
+CrawlerOptions Crawler::MakeOptions(int maxDepth)
+{
+    CrawlerOptions options;
+    options.maxDepth = maxDepth;
+    return options;
+}
+
+VisitedStoreOptions Crawler::VisitedOptions(const CrawlerOptions& options)
+{
+    VisitedStoreOptions visited = options.visited;
+    if (visited.spillDirectory.empty()) visited.spillDirectory = DataDirectory(options) + "visited";
+    return visited;
+}
+
+uint64_t Crawler::VisitedFingerprint(const std::string& url)
+{
+    // 以规范化后的指纹去重，http://A/x/ 与 http://a/x?utm_source=... 视为同一页
+    std::string canonical;
+    if (!CanonicalizeUrl(url, m_options.canonical, canonical)) canonical = url;
+    return FingerprintUrl(canonical);
+}
+
+void Crawler::Prioritize(CrawlTask& task)
+{
+    time_t lastModified = 0;
+    std::string value;
+    if (m_httpCache && m_httpCache->LookupLastModified(CacheKey(task.url), value)) ParseHttpDate(value, lastModified);
+    task.priority = m_scorer.Score(task.url, task.depth, lastModified);
+}
+
+void Crawler::Schedule(PolitenessScheduler& scheduler, CrawlTask task, uint64_t fingerprint)
+{
+    Prioritize(task);
+    if (m_checkpoint) task.id = m_checkpoint->RecordPush(task, fingerprint);
+    scheduler.Push(std::move(task));
+}
+
+bool Crawler::ResumeCheckpoint(PolitenessScheduler& scheduler)
+{
+    CheckpointState state;
+    if (!m_checkpoint->Load(state)) return false;
+    for (uint64_t fingerprint : state.visited) m_visited.Insert(fingerprint);
+    // 沿用原来的编号，完成记录才能对应上
+    std::unordered_set<std::string> pendingKeys;
+    for (auto& task : state.pending)
+    {
+        if (m_index && m_httpCache) pendingKeys.insert(CacheKey(task.url));
+        Prioritize(task);
+        scheduler.Push(std::move(task));
+    }
+    m_checkpoint->Begin(state.nextId, true);
+    // 检查点记为完成、正文却没来得及写进索引段的页面按最大深度重新抓一次，只补索引，链接上次已经展开过
+    size_t reindex = 0;
+    if (m_index && m_httpCache)
+    {
+        auto unindexed = m_httpCache->Select([this](const CacheEntry& entry) {
+            return !entry.indexed && !(entry.nearDuplicate && m_nearDuplicates);
+        });
+        for (const auto& url : unindexed)
+        {
+            UrlView target;
+            if (pendingKeys.count(url) || !ParseUrl(url, target) || !target.IsHttp()) continue;
+            Schedule(scheduler, { url, m_maxDepth, std::string(target.host) }, VisitedFingerprint(url));
+            reindex++;
+        }
+    }
+    for (const auto& url : state.media)
+    {
+        if (MarkMediaSeen(url) && EnqueueMediaDownload(url)) m_checkpoint->RecordMedia(url);
     }
+    std::cout << "Resumed: " << state.pending.size() << " pending pages, " << state.visited.size()
+        << " visited, " << state.media.size() << " media downloads\n";
+    if (reindex > 0) std::cout << "Re-indexing " << reindex << " finished pages missing from the index\n";
+    return true;
 }
 
-void Crawler::RandomDelay()
+std::string Crawler::CacheKey(const std::string& url)
 {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_int_distribution<> dis(500, 2000);
-    int delayMs = dis(gen);
-    std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+    std::string canonical;
+    if (!CanonicalizeUrl(url, m_options.canonical, canonical)) canonical = url;
+    return canonical;
+}
+
+bool Crawler::MarkMediaSeen(const std::string& url)
+{
+    std::lock_guard<std::mutex> lock(m_mediaMutex);
+    return m_mediaSeen.insert(url).second;
+}
+
+std::string Crawler::DataDirectory(const CrawlerOptions& options)
+{
+    // 每个分片进程用自己的子目录，互不覆盖归档、缓存和检查点
+    std::string dir = options.dataDir.empty() ? GetExeDirectoryBase() : options.dataDir;
+    if (dir.back() != '/' && dir.back() != (char)fs::path::preferred_separator) {
+        dir += (char)fs::path::preferred_separator;
+    }
+    if (options.shard.count > 1) {
+        dir += "shard-" + std::to_string(options.shard.index) + (char)fs::path::preferred_separator;
+    }
+    return dir;
 }
 
 std::string Crawler::GetExeDirectoryBase()
 {
+#ifdef _WIN32
     char path[MAX_PATH] = { 0 };
     GetModuleFileNameA(NULL, path, MAX_PATH);
     std::string exePath(path);
+#else
+    char path[4096] = { 0 };
+    ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    std::string exePath(path, len > 0 ? (size_t)len : 0);
+#endif
     size_t lastSlash = exePath.find_last_of("\\/");
     if (lastSlash != std::string::npos)
         return exePath.substr(0, lastSlash + 1);
-    return ".\\";
+    return std::string(".") + (char)fs::path::preferred_separator;
 }
 
 std::string Crawler::GetMediaSubdir(MediaType type)
@@ -63,30 +229,7 @@ std::string Crawler::GetMediaSubdir(MediaType type)
 
 MediaType Crawler::GetMediaTypeFromUrl(const std::string& url)
 {
-    std::string lowerUrl = url;
-    std::transform(lowerUrl.begin(), lowerUrl.end(), lowerUrl.begin(), ::tolower);
-    const std::vector<std::string> imageExtensions = { ".jpg", ".jpeg", ".png", ".gif", ".bmp", ".webp", ".svg", ".ico" };
-    const std::vector<std::string> videoExtensions = { ".mp4", ".avi", ".mov", ".wmv", ".flv", ".webm", ".mkv" };
-    const std::vector<std::string> audioExtensions = { ".mp3", ".wav", ".ogg", ".flac", ".aac", ".m4a" };
-    for (const auto& ext : imageExtensions) {
-        if (lowerUrl.size() >= ext.size() &&
-            lowerUrl.compare(lowerUrl.size() - ext.size(), ext.size(), ext) == 0) {
-            return MediaType::Image;
-        }
-    }
-    for (const auto& ext : videoExtensions) {
-        if (lowerUrl.size() >= ext.size() &&
-            lowerUrl.compare(lowerUrl.size() - ext.size(), ext.size(), ext) == 0) {
-            return MediaType::Video;
-        }
-    }
-    for (const auto& ext : audioExtensions) {
-        if (lowerUrl.size() >= ext.size() &&
-            lowerUrl.compare(lowerUrl.size() - ext.size(), ext.size(), ext) == 0) {
-            return MediaType::Audio;
-        }
-    }
-    return MediaType::Unknown;
+    return MediaTypeFromUrl(url);
 }
 
 std::string Crawler::GetFileNameFromUrl(const std::string& url)
@@ -106,433 +249,607 @@ std::string Crawler::GetFileNameFromUrl(const std::string& url)
     return filename;
 }
 
-bool Crawler::FetchPage(const std::string& url, const std::string& referer, std::string& html)
+bool Crawler::FetchPage(const std::string& url, const std::string& referer, std::string& html, PageParser* parser,
+    const CacheEntry* cached, FetchResult* result)
 {
-    if (!m_hSession) return false;
-    std::wstring wUrl(url.begin(), url.end());
-    URL_COMPONENTS urlComp = {};
-    urlComp.dwStructSize = sizeof(urlComp);
-    urlComp.dwSchemeLength = (DWORD)-1;
-    urlComp.dwHostNameLength = (DWORD)-1;
-    urlComp.dwUrlPathLength = (DWORD)-1;
-    urlComp.dwExtraInfoLength = (DWORD)-1;
-    if (!WinHttpCrackUrl(wUrl.c_str(), static_cast<DWORD>(wUrl.length()), 0, &urlComp)) {
-        return false;
-    }
-    std::wstring scheme(urlComp.lpszScheme, urlComp.dwSchemeLength);
-    std::wstring hostName(urlComp.lpszHostName, urlComp.dwHostNameLength);
-    std::wstring urlPath(urlComp.lpszUrlPath, urlComp.dwUrlPathLength);
-    if (urlComp.lpszExtraInfo) {
-        std::wstring extraInfo(urlComp.lpszExtraInfo, urlComp.dwExtraInfoLength);
-        urlPath += extraInfo;
-    }
-    INTERNET_PORT port = (scheme == L"https") ? INTERNET_DEFAULT_HTTPS_PORT : INTERNET_DEFAULT_HTTP_PORT;
-    DWORD dwOpenRequestFlags = (scheme == L"https") ? WINHTTP_FLAG_SECURE : 0;
-    HINTERNET hConnect = WinHttpConnect(m_hSession, hostName.c_str(), port, 0);
-    if (!hConnect) return false;
-    HINTERNET hRequest = WinHttpOpenRequest(
-        hConnect, L"GET", urlPath.c_str(), NULL,
-        WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES, dwOpenRequestFlags);
-    if (!hRequest) {
-        WinHttpCloseHandle(hConnect);
+    // html 由调用方在多页之间复用，clear 不释放容量
+    html.clear();
+    if (!m_transport->IsReady()) return false;
+    HttpRequest request;
+    request.url = url;
+    if (!referer.empty()) {
+        request.headers.emplace_back("Referer", referer);
+    }
+    UrlView target;
+    ParseUrl(url, target);
+    ApplyHeaderRules(m_options.headerRules, target.host, request.headers);
+    if (cached) {
+        if (!cached->etag.empty()) request.headers.emplace_back("If-None-Match", cached->etag);
+        if (!cached->lastModified.empty()) request.headers.emplace_back("If-Modified-Since", cached->lastModified);
+    }
+    HostMetrics& host = m_metrics.Host(std::string(target.host));
+    auto started = std::chrono::steady_clock::now();
+    uint64_t parseMicros = 0;
+    uint64_t transcodeMicros = 0;
+    bool success = false;
+    // 解析器只拿到已经转成 UTF-8 的部分
+    Utf8Normalizer normalizer;
+    size_t parsed = 0;
+    auto feedParser = [&](size_t ready) {
+        if (!parser || ready <= parsed) return;
+        auto parseStarted = std::chrono::steady_clock::now();
+        parser->Feed(std::string_view(html).substr(parsed, ready - parsed));
+        parseMicros += CrawlMetrics::MicrosSince(parseStarted);
+        parsed = ready;
+    };
+    request.onHeaders = [&](const HttpResponse& response) {
+        if (result) {
+            result->status = response.status;
+            result->fetchTimeMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            result->headers = response.headers;
+            result->etag = response.GetHeader("ETag");
+            result->lastModified = response.GetHeader("Last-Modified");
+            result->finalUrl = response.finalUrl.empty() ? url : response.finalUrl;
+        }
+        // 错误页和 304 不需要响应体
+        success = response.status >= 200 && response.status < 300;
+        if (!success) return false;
+        // 相对链接要按重定向后的地址解析
+        if (parser && !response.finalUrl.empty() && response.finalUrl != url) parser->Rebase(response.finalUrl);
+        long long length = response.ContentLength();
+        if (length > 0) html.reserve((size_t)std::min<long long>(length, kMaxBodyReserve));
+        normalizer.Reset(response.GetHeader("Content-Type"));
+        return true;
+    };
+    request.onBody = [&](const char* data, size_t size) {
+        auto transcodeStarted = std::chrono::steady_clock::now();
+        size_t ready = normalizer.Feed(std::string_view(data, size), html);
+        transcodeMicros += CrawlMetrics::MicrosSince(transcodeStarted);
+        feedParser(ready);
+        return true;
+    };
+    HttpResponse response;
+    bool sent = m_transport->Send(request, response);
+    m_metrics.RecordTransport(response.timing);
+    if (m_rateLimiter) {
+        HostFeedback feedback = sent ? HostRateLimiter::ClassifyStatus(response.status) :
+            (response.error == TransportError::BadUrl || response.error == TransportError::Aborted ||
+                response.error == TransportError::Decode) ? HostFeedback::Neutral : HostFeedback::NetworkError;
+        m_rateLimiter->Report(std::string(target.host), feedback, response.timing.firstByteUs,
+            sent ? response.GetHeader("Retry-After") : std::string());
+    }
+    if (!sent) {
+        m_metrics.RecordFailure(&host, FailureFromTransport(response.error));
         return false;
     }
-    std::wstring wReferer(referer.begin(), referer.end());
-    if (!referer.empty()) {
-        WinHttpAddRequestHeaders(hRequest, (L"Referer: " + wReferer).c_str(), -1, WINHTTP_ADDREQ_FLAG_ADD);
-    }
-    BOOL bResults = WinHttpSendRequest(hRequest, WINHTTP_NO_ADDITIONAL_HEADERS, 0,
-        WINHTTP_NO_REQUEST_DATA, 0, 0, 0);
-    if (bResults) bResults = WinHttpReceiveResponse(hRequest, NULL);
-    std::string pageData;
-    if (bResults) {
-        DWORD dwSize = 0;
-        DWORD dwDownloaded = 0;
-        LPSTR pszOutBuffer;
-        do {
-            dwSize = 0;
-            if (!WinHttpQueryDataAvailable(hRequest, &dwSize)) break;
-            if (dwSize == 0) break;
-            pszOutBuffer = new char[dwSize + 1];
-            if (!pszOutBuffer) break;
-            ZeroMemory(pszOutBuffer, dwSize + 1);
-            if (!WinHttpReadData(hRequest, (LPVOID)pszOutBuffer, dwSize, &dwDownloaded)) {
-                delete[] pszOutBuffer;
-                break;
-            }
-            else {
-                pageData.append(pszOutBuffer, dwDownloaded);
-            }
-            delete[] pszOutBuffer;
-        } while (dwSize > 0);
-    }
-    WinHttpCloseHandle(hRequest);
-    WinHttpCloseHandle(hConnect);
-    if (!bResults) return false;
-    html = pageData;
+    if (response.status >= 400) m_metrics.RecordFailure(&host, FailureReason::HttpStatus, response.status);
+    if (!success) return true;
+    auto transcodeStarted = std::chrono::steady_clock::now();
+    feedParser(normalizer.Finish(html));
+    transcodeMicros += CrawlMetrics::MicrosSince(transcodeStarted);
+    m_metrics.RecordStage(MetricStage::Transcode, transcodeMicros);
+    if (normalizer.Transcoded()) m_transcodedPages++;
+    if (normalizer.Repaired()) m_repairedPages++;
+    if (result) result->charset = normalizer.Detected();
+    uint64_t fetchMicros = CrawlMetrics::MicrosSince(started);
+    if (parser) {
+        auto parseStarted = std::chrono::steady_clock::now();
+        parser->Finish();
+        parseMicros += CrawlMetrics::MicrosSince(parseStarted);
+        m_metrics.RecordStage(MetricStage::Parse, parseMicros);
+    }
+    // 边收边解析时解析时间也算在抓取时间里
+    m_metrics.RecordPage(host, html.size(), fetchMicros);
     return true;
 }
 
+void Crawler::ParsePage(const std::string& html, const std::string& baseUrl, bool wantLinks, PageContent& page)
+{
+    auto started = std::chrono::steady_clock::now();
+    PageParser parser(baseUrl, wantLinks, page, !m_options.followExternalLinks);
+    parser.Feed(html);
+    parser.Finish();
+    m_metrics.RecordStage(MetricStage::Parse, started);
+}
+
 std::vector<std::string> Crawler::ExtractLinks(const std::string& html, const std::string& baseUrl)
 {
     std::vector<std::string> links;
-    std::regex linkRegex(R"(<a\s+[^>]*href\s*=\s*[\"']([^\"'#]+)[\"'][^>]*>)", std::regex_constants::icase);
-    std::sregex_iterator iter(html.begin(), html.end(), linkRegex);
-    std::sregex_iterator end;
-    std::wstring wBaseUrl(baseUrl.begin(), baseUrl.end());
-    URL_COMPONENTS baseComp = {};
-    baseComp.dwStructSize = sizeof(baseComp);
-    baseComp.dwSchemeLength = (DWORD)-1;
-    baseComp.dwHostNameLength = (DWORD)-1;
-    baseComp.dwUrlPathLength = (DWORD)-1;
-    if (!WinHttpCrackUrl(wBaseUrl.c_str(), static_cast<DWORD>(wBaseUrl.length()), 0, &baseComp)) {
+    UrlView base;
+    if (!ParseUrl(baseUrl, base) || !base.IsHttp()) {
         return links;
     }
-    std::wstring baseScheme(baseComp.lpszScheme, baseComp.dwSchemeLength);
-    std::wstring baseHost(baseComp.lpszHostName, baseComp.dwHostNameLength);
-    std::string baseOrigin(std::string(baseScheme.begin(), baseScheme.end()) + "://" +
-        std::string(baseHost.begin(), baseHost.end()));
-    for (; iter != end; ++iter) {
-        std::string href = (*iter)[1].str();
-        if (href.empty()) continue;
+    HtmlCallbacks callbacks;
+    callbacks.onLink = [&](std::string_view href) {
         std::string absoluteUrl;
-        if (href.substr(0, 2) == "//") {
-            absoluteUrl = std::string(baseScheme.begin(), baseScheme.end()) + ":" + href;
-        }
-        else if (href[0] == '/') {
-            absoluteUrl = baseOrigin + href;
-        }
-        else if (href.substr(0, 7) == "http://" || href.substr(0, 8) == "https://") {
-            absoluteUrl = href;
-        }
-        else {
-            std::wstring basePath(baseComp.lpszUrlPath, baseComp.dwUrlPathLength);
-            std::string basePathStr(basePath.begin(), basePath.end());
-            size_t lastSlash = basePathStr.find_last_of('/');
-            if (lastSlash != std::string::npos) {
-                absoluteUrl = baseOrigin + basePathStr.substr(0, lastSlash + 1) + href;
-            }
-            else {
-                absoluteUrl = baseOrigin + "/" + href;
-            }
+        if (ResolveLink(href, base, absoluteUrl)) {
+            links.push_back(std::move(absoluteUrl));
         }
-        if (absoluteUrl.find(baseOrigin) == 0) {
-            links.push_back(absoluteUrl);
-        }
-    }
+    };
+    HtmlTokenizer tokenizer;
+    tokenizer.Tokenize(html, callbacks);
     return links;
 }
 
 std::set<std::string> Crawler::ExtractMediaUrls(const std::string& html, const std::string& baseUrl)
 {
     std::set<std::string> urls;
-    std::vector<std::string> patterns = {
-        // 新增：匹配 sudy-wp-src 的 div
-        R"(<div\s+[^>]*?class\s*=\s*["'](?:[^"']*?\s+)?wp_video_player(?:\s+[^"']*)?["'][^>]*?sudy-wp-src\s*=\s*["']([^"']+)["'][^>]*>)",
-        // 原有模式
-        R"(<source\s+[^>]*?\bsrc\s*=\s*["']([^"']+)["'][^>]*?/?>)",
-        R"(<video\s+[^>]*?\bsrc\s*=\s*["']([^"']+)["'][^>]*?>)",
-        R"(<video\s+[^>]*?\bposter\s*=\s*["']([^"']+)["'][^>]*?>)",
-        R"(<audio\s+[^>]*?\bsrc\s*=\s*["']([^"']+)["'][^>]*?/?>)",
-        R"(<img\s+[^>]*?\bsrc\s*=\s*["']([^"']+)["'][^>]*?/?>)"
-    };
-    for (const auto& pattern : patterns) {
-        try {
-            std::regex urlRegex(pattern, std::regex_constants::icase);
-            std::sregex_iterator iter(html.begin(), html.end(), urlRegex);
-            std::sregex_iterator end;
-            for (; iter != end; ++iter) {
-                std::smatch match = *iter;
-                if (match.size() > 1) {
-                    std::string url = match[1].str();
-                    if (!url.empty()) {
-                        std::string absoluteUrl = ConvertToAbsoluteUrl(url, baseUrl);
-                        if (!absoluteUrl.empty()) {
-                            urls.insert(absoluteUrl);
-                        }
-                    }
-                }
-            }
-        }
-        catch (...) {}
+    UrlView base;
+    if (!ParseUrl(baseUrl, base) || !base.IsHttp()) {
+        return urls;
     }
+    HtmlCallbacks callbacks;
+    callbacks.onMedia = [&](std::string_view src) {
+        std::string absoluteUrl;
+        if (ResolveMediaUrl(src, base, absoluteUrl)) {
+            urls.insert(std::move(absoluteUrl));
+        }
+    };
+    HtmlTokenizer tokenizer;
+    tokenizer.Tokenize(html, callbacks);
     return urls;
 }
 
 std::string Crawler::ExtractTextContent(const std::string& html)
 {
-    if (html.empty()) return "";
-    std::string text = html;
-    size_t script_start_pos;
-    while ((script_start_pos = text.find("<script", 0)) != std::string::npos) {
-        size_t script_tag_end = text.find('>', script_start_pos);
-        if (script_tag_end == std::string::npos) {
-            text.erase(script_start_pos);
-            break;
-        }
-        size_t script_end_pos = text.find("</script>", script_tag_end);
-        if (script_end_pos != std::string::npos) {
-            text.erase(script_start_pos, script_end_pos + 9 - script_start_pos);
-        }
-        else {
-            text.erase(script_start_pos);
-            break;
-        }
-    }
-    size_t style_start_pos;
-    while ((style_start_pos = text.find("<style", 0)) != std::string::npos) {
-        size_t style_tag_end = text.find('>', style_start_pos);
-        if (style_tag_end == std::string::npos) {
-            text.erase(style_start_pos);
-            break;
-        }
-        size_t style_end_pos = text.find("</style>", style_tag_end);
-        if (style_end_pos != std::string::npos) {
-            text.erase(style_start_pos, style_end_pos + 8 - style_start_pos);
-        }
-        else {
-            text.erase(style_start_pos);
-            break;
-        }
-    }
-    std::regex tagRegex(R"(<[^>]*>)");
-    text = std::regex_replace(text, tagRegex, "");
-    text = std::regex_replace(text, std::regex("&nbsp;"), " ");
-    text = std::regex_replace(text, std::regex("&amp;"), "&");
-    text = std::regex_replace(text, std::regex("&lt;"), "<");
-    text = std::regex_replace(text, std::regex("&gt;"), ">");
-    text = std::regex_replace(text, std::regex("&quot;"), "\"");
-    text = std::regex_replace(text, std::regex("&#39;"), "'");
-    std::regex whitespaceRegex(R"([ \t\f\v\n\r]+)");
-    text = std::regex_replace(text, whitespaceRegex, " ");
-    if (!text.empty()) {
-        size_t start = text.find_first_not_of(' ');
-        if (start == std::string::npos) return "";
-        size_t end = text.find_last_not_of(' ');
-        text = text.substr(start, end - start + 1);
-    }
+    std::string text;
+    ExtractTextContent(html, text);
     return text;
 }
 
-bool Crawler::SaveTextToFile(const std::string& text, const std::string& baseUrl, int depth)
-{
-    if (text.empty()) return true;
-    std::string filename = GetFileNameFromUrl(baseUrl);
-    if (filename.empty() || filename == "page.htm") {
-        std::wstring wurl(baseUrl.begin(), baseUrl.end());
-        URL_COMPONENTS uc = {};
-        uc.dwStructSize = sizeof(uc);
-        uc.dwSchemeLength = (DWORD)-1;
-        uc.dwHostNameLength = (DWORD)-1;
-        uc.dwUrlPathLength = (DWORD)-1;
-        uc.dwExtraInfoLength = (DWORD)-1;
-        if (WinHttpCrackUrl(wurl.c_str(), (DWORD)wurl.length(), 0, &uc)) {
-            std::wstring host(uc.lpszHostName, uc.dwHostNameLength);
-            std::wstring path(uc.lpszUrlPath, uc.dwUrlPathLength);
-            std::string hostStr(host.begin(), host.end());
-            std::string pathStr(path.begin(), path.end());
-            if (!pathStr.empty() && pathStr[0] == '/') pathStr = pathStr.substr(1);
-            std::replace(pathStr.begin(), pathStr.end(), '/', '_');
-            filename = hostStr + "_" + pathStr;
-            size_t dotPos = filename.find_last_of('.');
-            if (dotPos != std::string::npos) filename = filename.substr(0, dotPos);
-            for (char& c : filename) {
-                if (strchr("/\\:*?\"<>|", c)) c = '_';
-            }
-        }
-        else {
-            filename = "unknown_page_" + std::to_string(std::hash<std::string>{}(baseUrl));
+void Crawler::ExtractTextContent(const std::string& html, std::string& text)
+{
+    HtmlTextBuilder textBuilder(text);
+    if (html.empty()) return;
+    auto started = std::chrono::steady_clock::now();
+    HtmlCallbacks callbacks;
+    callbacks.onText = [&](std::string_view raw) { textBuilder.Append(raw); };
+    HtmlTokenizer tokenizer;
+    tokenizer.Tokenize(html, callbacks);
+    m_metrics.RecordStage(MetricStage::TextExtract, started);
+}
+
+bool Crawler::ArchivePage(const std::string& url, int depth, FetchResult& fetch, PageContent& page,
+    const std::string& aliasOf)
+{
+    if (!m_archive) return false;
+    ArchiveRecord record;
+    record.url = url;
+    record.depth = depth;
+    record.status = fetch.status;
+    record.fetchTimeMs = fetch.fetchTimeMs;
+    record.headers = std::move(fetch.headers);
+    // 归档的正文是转换后的 UTF-8，响应头里的编码声明跟着改，读档时不会再按 GBK 解一遍
+    if (fetch.charset != Charset::Utf8 && fetch.charset != Charset::Unknown)
+    {
+        for (auto& header : record.headers)
+        {
+            std::string name = header.first;
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            if (name != "content-type") continue;
+            header.second = header.second.substr(0, header.second.find(';')) + "; charset=utf-8";
         }
     }
-    else {
-        size_t dotPos = filename.find_last_of('.');
-        if (dotPos != std::string::npos) filename = filename.substr(0, dotPos);
-        if (filename.length() > 100) filename = filename.substr(0, 100);
-    }
-    if (filename.empty()) filename = "page_" + std::to_string(std::hash<std::string>{}(baseUrl));
-    filename += "_depth_" + std::to_string(depth) + ".txt";
-    std::string fullDir = GetExeDirectoryBase() + "texts";
-    std::error_code ec;
-    fs::create_directories(fullDir, ec);
-    std::string filepath = fullDir + "\\" + filename;
-    std::ofstream outFile(filepath, std::ios::binary);
-    if (!outFile.is_open()) return false;
-    outFile << "Source URL: " << baseUrl << "\n";
-    outFile << "Depth: " << depth << "\n";
-    outFile << "----------------------------------------\n";
-    outFile << text;
-    outFile.close();
-    if (outFile.fail()) return false;
-    return true;
+    if (!aliasOf.empty())
+    {
+        record.aliasOf = aliasOf;
+        return m_archive->Append(record);
+    }
+    // 借用页面缓冲而不复制，写完再还回去以保留其容量
+    record.html.swap(page.html);
+    record.text.swap(page.text);
+    bool ok = m_archive->Append(record);
+    record.html.swap(page.html);
+    record.text.swap(page.text);
+    return ok;
 }
 
-bool Crawler::DownloadMediaFile(const std::string& fileUrl)
+bool Crawler::EnqueueMediaDownload(const std::string& fileUrl)
 {
-    MediaType type = GetMediaTypeFromUrl(fileUrl);
-    if (type == MediaType::Unknown) return false;
+    // 以前的运行已经下载过的地址直接跳过，不产生任何网络请求
+    std::string digest;
+    if (m_mediaStore->Lookup(fileUrl, digest)) return true;
+    // 没有扩展名或带查询串的地址也交给下载器，由响应头和文件头决定类型和存放目录
     std::string filename = GetFileNameFromUrl(fileUrl);
-    if (filename.empty()) return false;
-    std::string subdir = GetMediaSubdir(type);
-    std::string fullDir = GetExeDirectoryBase() + subdir;
-    if (!fs::exists(fullDir)) {
+    MediaJob job;
+    job.url = fileUrl;
+    job.type = GetMediaTypeFromUrl(fileUrl);
+    job.filepath = m_mediaStore->StagingPath(fileUrl);
+    job.onComplete = [this, filename](const MediaJob& done, const std::string& contentDigest, MediaType type) {
+        std::string fullDir = m_dataDir + GetMediaSubdir(type);
         std::error_code ec;
         fs::create_directories(fullDir, ec);
-    }
-    std::string filepath = fullDir + "\\" + filename;
-    if (fs::exists(filepath)) return true;
-    if (!m_hSession) return false;
-    std::wstring wFileUrl(fileUrl.begin(), fileUrl.end());
-    URL_COMPONENTS urlComp = {};
-    urlComp.dwStructSize = sizeof(urlComp);
-    urlComp.dwSchemeLength = (DWORD)-1;
-    urlComp.dwHostNameLength = (DWORD)-1;
-    urlComp.dwUrlPathLength = (DWORD)-1;
-    urlComp.dwExtraInfoLength = (DWORD)-1;
-    if (!WinHttpCrackUrl(wFileUrl.c_str(), static_cast<DWORD>(wFileUrl.length()), 0, &urlComp)) return false;
-    std::wstring scheme(urlComp.lpszScheme, urlComp.dwSchemeLength);
-    std::wstring hostName(urlComp.lpszHostName, urlComp.dwHostNameLength);
-    std::wstring urlPath(urlComp.lpszUrlPath, urlComp.dwUrlPathLength);
-    if (urlComp.lpszExtraInfo) {
-        std::wstring extraInfo(urlComp.lpszExtraInfo, urlComp.dwExtraInfoLength);
-        urlPath += extraInfo;
-    }
-    INTERNET_PORT port = (scheme == L"https") ? INTERNET_DEFAULT_HTTPS_PORT : INTERNET_DEFAULT_HTTP_PORT;
-    DWORD dwOpenRequestFlags = (scheme == L"https") ? WINHTTP_FLAG_SECURE : 0;
-    HINTERNET hConnect = WinHttpConnect(m_hSession, hostName.c_str(), port, 0);
-    if (!hConnect) return false;
-    HINTERNET hRequest = WinHttpOpenRequest(hConnect, L"GET", urlPath.c_str(), NULL,
-        WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES, dwOpenRequestFlags);
-    if (!hRequest) {
-        WinHttpCloseHandle(hConnect);
+        std::string name = filename.empty() ? contentDigest.substr(0, 16) : filename;
+        std::string visiblePath = (fs::path(fullDir) / name).string();
+        return !m_mediaStore->Commit(done.url, done.filepath, contentDigest, visiblePath).empty();
+    };
+    if (!m_downloader) return false;
+    UrlView target;
+    if (ParseUrl(fileUrl, target))
+    {
+        // 防盗链一般只认本站的 Referer，默认带上文件所在的源站，特殊的站点用规则覆盖
+        std::string origin = std::string(target.scheme) + "://" + std::string(target.host);
+        if (!target.port.empty()) origin += ":" + std::string(target.port);
+        job.headers.emplace_back("Referer", origin + "/");
+        ApplyHeaderRules(m_options.headerRules, target.host, job.headers);
+        PrefetchHost(target.host);
+    }
+    return m_downloader->Enqueue(std::move(job));
+}
+
+void Crawler::PrefetchHost(std::string_view host)
+{
+    if (m_options.transport.dnsCache) m_options.transport.dnsCache->Prefetch(std::string(host));
+}
+
+bool Crawler::Start(const std::string& startUrl)
+{
+    UrlView startTarget;
+    if (startUrl.empty() ||
+        (startUrl.substr(0, 7) != "http://" && startUrl.substr(0, 8) != "https://") ||
+        !ParseUrl(startUrl, startTarget) || !startTarget.IsHttp())
+    {
+        std::cerr << "Error: URL must start with http:// or https://\n";
         return false;
     }
-    // 添加 Referer 防盗链（针对山东理工）
-    std::wstring refererHeader = L"Referer: https://www.sdut.edu.cn/\r\n";
-    WinHttpAddRequestHeaders(hRequest, refererHeader.c_str(), -1, WINHTTP_ADDREQ_FLAG_ADD);
-    if (!WinHttpSendRequest(hRequest, WINHTTP_NO_ADDITIONAL_HEADERS, 0, WINHTTP_NO_REQUEST_DATA, 0, 0, 0)) {
-        WinHttpCloseHandle(hRequest);
-        WinHttpCloseHandle(hConnect);
+    SeedReader seeds(startUrl);
+    return Start(seeds);
+}
+
+bool Crawler::Start(SeedReader& seeds)
+{
+    auto started = std::chrono::steady_clock::now();
+    m_summary = CrawlSummary();
+    m_fetchedPages = 0;
+    m_failedPages = 0;
+    m_seedsQueued = false;
+    PolitenessScheduler scheduler(m_options.scheduler, m_rateLimiter.get());
+    if (m_options.metrics.enabled) m_metrics.StartReporter(m_options.metrics, m_dataDir);
+    m_downloader = std::make_unique<MediaDownloader>(*m_transport, m_options.media, &m_metrics);
+    if (m_options.shard.count > 1 && !ConnectShard(scheduler))
+    {
+        m_downloader.reset();
+        m_metrics.StopReporter();
         return false;
     }
-    if (!WinHttpReceiveResponse(hRequest, NULL)) {
-        WinHttpCloseHandle(hRequest);
-        WinHttpCloseHandle(hConnect);
-        return false;
+    // 种子还在读的时候边界可能暂时为空，工作线程不能就此退出
+    if (!m_shard) scheduler.Hold(nullptr);
+    if (!m_checkpoint || !m_options.checkpoint.resume || !ResumeCheckpoint(scheduler))
+    {
+        if (m_checkpoint) m_checkpoint->Begin(1, false);
+    }
+    std::vector<std::thread> workers;
+    for (int i = 0; i < m_options.threadCount; ++i)
+    {
+        workers.emplace_back(&Crawler::WorkerLoop, this, std::ref(scheduler));
+    }
+    // 恢复时已经抓过的种子由访问集合挡掉
+    QueueSeeds(seeds, scheduler);
+    m_seedsQueued = true;
+    if (!m_shard) scheduler.Release();
+    else if (scheduler.IsIdle()) m_shard->ReportIdle();
+    for (auto& worker : workers)
+    {
+        worker.join();
     }
-    DWORD dwStatusCode = 0;
-    DWORD dwSize = sizeof(dwStatusCode);
-    if (WinHttpQueryHeaders(hRequest, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
-        WINHTTP_HEADER_NAME_BY_INDEX, &dwStatusCode, &dwSize, WINHTTP_NO_HEADER_INDEX)) {
-        if (dwStatusCode != 200) {
-            WinHttpCloseHandle(hRequest);
-            WinHttpCloseHandle(hConnect);
-            return false;
+    if (m_shard)
+    {
+        std::cout << "Shard " << m_options.shard.index << "/" << m_options.shard.count << ": "
+            << m_shard->SentLinks() << " links handed to other shards, " << m_shard->ReceivedLinks() << " received\n";
+        m_shard->Close();
+        m_shard.reset();
+    }
+    m_downloader->Finish();
+    const MediaDownloadStats& mediaStats = m_downloader->Stats();
+    m_summary.mediaFiles = mediaStats.completed;
+    m_summary.failedMedia = mediaStats.failed;
+    if (mediaStats.rejectedType > 0 || mediaStats.rejectedSize > 0) {
+        std::cout << "Media skipped: " << mediaStats.rejectedType << " not media, " << mediaStats.rejectedSize
+            << " over the size limit\n";
+    }
+    m_downloader.reset();
+    if (m_checkpoint) m_checkpoint->Stop();
+    const TransportStats& stats = m_transport->Stats();
+    for (size_t i = 0; i < (size_t)ContentEncoding::Count; ++i) {
+        uint64_t wire = stats.wireBytes[i];
+        if (wire == 0 || i == (size_t)ContentEncoding::Identity) continue;
+        std::cout << "Encoding " << ContentEncodingName((ContentEncoding)i) << ": " << wire << " bytes on the wire, "
+            << stats.decodedBytes[i] << " bytes decoded\n";
+    }
+    if (m_archive) m_archive->Flush();
+    if (m_index) {
+        m_index->Flush();
+        const IndexWriterStats& indexStats = m_index->Stats();
+        if (indexStats.documents > 0) {
+            std::cout << "Index: " << indexStats.documents << " pages indexed, " << m_index->SegmentCount()
+                << " segments, " << indexStats.merges << " merges\n";
         }
     }
-    FILE* pFile = nullptr;
-    errno_t err = fopen_s(&pFile, filepath.c_str(), "wb");
-    if (err != 0 || !pFile) {
-        WinHttpCloseHandle(hRequest);
-        WinHttpCloseHandle(hConnect);
-        return false;
+    if (m_transcodedPages > 0 || m_repairedPages > 0) {
+        std::cout << "Charset: " << m_transcodedPages << " pages transcoded to UTF-8, " << m_repairedPages
+            << " with invalid bytes replaced\n";
+    }
+    if (m_nearDuplicateCount > 0) {
+        std::cout << "Near-duplicates: " << m_nearDuplicateCount << " pages recorded as aliases\n";
     }
-    DWORD dwBytesRead = 0;
-    char buffer[8192];
-    bool bSuccess = true;
-    while (WinHttpReadData(hRequest, buffer, sizeof(buffer), &dwBytesRead) && dwBytesRead > 0) {
-        if (fwrite(buffer, 1, dwBytesRead, pFile) != dwBytesRead) {
-            bSuccess = false;
-            break;
+    if (m_httpCache) {
+        m_httpCache->Compact();
+        if (m_notModified > 0 || m_unchanged > 0) {
+            std::cout << "Recrawl: " << m_notModified << " not modified, " << m_unchanged << " unchanged\n";
         }
     }
-    fclose(pFile);
-    WinHttpCloseHandle(hRequest);
-    WinHttpCloseHandle(hConnect);
-    if (bSuccess) {
-        return true;
+    if (m_rateLimiter) m_rateLimiter->Save();
+    if (m_options.transport.dnsCache && m_options.transport.dnsCache->Stats().misses > 0) {
+        const DnsCacheStats& dns = m_options.transport.dnsCache->Stats();
+        std::cout << "DNS cache: " << dns.hits << " hits, " << dns.misses << " misses, " << dns.negativeHits
+            << " negative hits, " << dns.prefetches << " prefetched, " << dns.coalesced << " waited on a lookup\n";
+    }
+    m_metrics.StopReporter();
+    m_summary.pages = m_fetchedPages;
+    m_summary.failedPages = m_failedPages;
+    m_summary.pageBytes = m_metrics.PageBytes();
+    m_summary.seconds = CrawlMetrics::MicrosSince(started) / 1e6;
+    if (m_summary.seeds > 1 || m_summary.invalidSeeds > 0 || seeds.Failed()) {
+        std::cout << "Seeds: " << m_summary.seeds << " valid, " << m_summary.invalidSeeds << " invalid"
+            << (seeds.Failed() ? ", some seed files could not be read" : "") << "\n";
+    }
+    std::cout << m_metrics.Summary() << "\n";
+    return true;
+}
+
+void Crawler::QueueSeeds(SeedReader& seeds, PolitenessScheduler& scheduler)
+{
+    // 边界积压到内存上限的一半时等工作线程消化，种子文件再大也只有一小段在内存里
+    size_t backlog = std::max<size_t>(1024, m_options.scheduler.frontier.maxInMemory / 2);
+    std::string url;
+    while (seeds.Next(url))
+    {
+        UrlView target;
+        if (!ParseUrl(url, target) || !target.IsHttp() || target.host.empty())
+        {
+            // 每个分片读的是同一份种子，格式错误只由 0 号分片报告
+            if (m_options.shard.index != 0) continue;
+            if (m_summary.invalidSeeds < 10) std::cerr << seeds.Where() << ": invalid seed " << url << "\n";
+            m_summary.invalidSeeds++;
+            continue;
+        }
+        if (OwnerShard(target.host) >= 0) continue;
+        m_summary.seeds++;
+        uint64_t fingerprint = VisitedFingerprint(url);
+        if (!m_visited.Insert(fingerprint)) continue;
+        while (scheduler.Pending() >= backlog)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        Schedule(scheduler, { url, 0, std::string(target.host) }, fingerprint);
     }
-    else {
-        std::remove(filepath.c_str());
-        return false;
+}
+
+void Crawler::WorkerLoop(PolitenessScheduler& scheduler)
+{
+    CrawlTask task;
+    // 每个线程复用同一份页面缓冲，避免逐页重新分配
+    PageContent page;
+    // Pop 阻塞的时间主要是同主机的礼貌间隔，边界暂时为空时的等待也算在内
+    auto waitStarted = std::chrono::steady_clock::now();
+    while (scheduler.Pop(task))
+    {
+        m_metrics.RecordStage(MetricStage::PolitenessWait, waitStarted);
+        ProcessPage(task, scheduler, page);
+        // 完成记录写在新链接的入队记录之后，恢复时不会漏掉它们
+        if (m_checkpoint && task.id != 0) m_checkpoint->RecordDone(task.id);
+        scheduler.Done(task);
+        waitStarted = std::chrono::steady_clock::now();
     }
 }
 
-bool Crawler::Start(const std::string& startUrl)
+void Crawler::ProcessPage(const CrawlTask& task, PolitenessScheduler& scheduler, PageContent& page)
 {
-    if (startUrl.empty() ||
-        (startUrl.substr(0, 7) != "http://" && startUrl.substr(0, 8) != "https://"))
+    const std::string& currentUrl = task.url;
+    int depth = task.depth;
+    if (depth > m_maxDepth) return;
+    // 开着缓存时叶子页也收集链接，以后加大深度时内容没变也能接着往下走
+    bool wantLinks = depth < m_maxDepth || m_httpCache;
+    std::string cacheKey;
+    CacheEntry cached;
+    bool haveCached = false;
+    if (m_httpCache) {
+        cacheKey = CacheKey(currentUrl);
+        haveCached = m_httpCache->Lookup(cacheKey, cached);
+    }
+    // 没有缓存记录时边下载边解析；有记录时先比较内容摘要，没变就不再解析。
+    // 记录不够这次运行用时不带条件头取回正文重新解析
+    std::optional<PageParser> parser;
+    if (!haveCached) parser.emplace(currentUrl, wantLinks, page, !m_options.followExternalLinks);
+    bool conditional = haveCached && CanReuse(cached);
+    FetchResult fetch;
+    if (!FetchPage(currentUrl, "", page.html, parser ? &*parser : nullptr, conditional ? &cached : nullptr, &fetch))
     {
-        std::cerr << "Error: URL must start with http:// or https://\n";
-        return false;
+        m_failedPages++;
+        return;
+    }
+    if (fetch.status >= 400) m_failedPages++;
+    else if (fetch.status == 304 || (fetch.status >= 200 && fetch.status < 300)) m_fetchedPages++;
+    // 重定向后以最终地址为准：记入访问集合，缓存、归档和索引都用它
+    const std::string& pageUrl = fetch.finalUrl.empty() ? currentUrl : fetch.finalUrl;
+    if (fetch.status == 304 && conditional)
+    {
+        m_notModified++;
+        for (const auto& url : cached.mediaUrls) QueueMedia(url);
+        FollowCachedLinks(cached, pageUrl, depth, scheduler);
+        return;
+    }
+    if (fetch.status < 200 || fetch.status >= 300)
+    {
+        return;
     }
-    std::queue<std::pair<std::string, int>> q;
-    q.push({ startUrl, 0 });
-    m_visited.insert(startUrl);
-    while (!q.empty())
+    if (pageUrl != currentUrl)
     {
-        RandomDelay();
-        auto current = q.front();
-        q.pop();
-        std::string currentUrl = current.first;
-        int depth = current.second;
-        if (depth > m_maxDepth) continue;
-        std::string html;
-        if (!FetchPage(currentUrl, "", html))
+        // 最终地址已经抓过或在队列里，这一页交给它
+        if (!m_visited.Insert(VisitedFingerprint(pageUrl))) return;
+        if (m_httpCache)
         {
-            continue;
+            cacheKey = CacheKey(pageUrl);
+            haveCached = m_httpCache->Lookup(cacheKey, cached);
         }
-        std::string textContent = ExtractTextContent(html);
-        SaveTextToFile(textContent, currentUrl, depth);
-        std::set<std::string> mediaUrls = ExtractMediaUrls(html, currentUrl);
-        for (const auto& url : mediaUrls)
+    }
+    CacheEntry entry;
+    if (m_httpCache)
+    {
+        Sha256 hasher;
+        hasher.Update(page.html.data(), page.html.size());
+        entry.etag = std::move(fetch.etag);
+        entry.lastModified = std::move(fetch.lastModified);
+        entry.contentHash = hasher.HexDigest();
+        if (haveCached && CanReuse(cached) && entry.contentHash == cached.contentHash)
         {
-            DownloadMediaFile(url);
+            m_unchanged++;
+            entry.links = std::move(cached.links);
+            entry.mediaUrls = std::move(cached.mediaUrls);
+            entry.externalLinks = cached.externalLinks;
+            entry.nearDuplicate = cached.nearDuplicate;
+            entry.indexed = cached.indexed;
+            entry.complete = true;
+            m_httpCache->Update(cacheKey, entry);
+            // 上次发现但没来得及下载的媒体在这里补上，已经入库的由 EnqueueMediaDownload 跳过
+            for (const auto& url : entry.mediaUrls) QueueMedia(url);
+            FollowCachedLinks(entry, pageUrl, depth, scheduler);
+            return;
         }
-        if (depth < m_maxDepth)
+        if (!parser) ParsePage(page.html, pageUrl, wantLinks, page);
+    }
+    // 打印版、镜像地址、翻页变体这类近似重复只记一条别名，按设置不再展开它们的链接
+    std::string original;
+    bool nearDuplicate = m_nearDuplicates && m_nearDuplicates->FindOrAdd(pageUrl, page.text, original);
+    bool followLinks = !nearDuplicate || !m_options.nearDuplicate.suppressLinks;
+    if (nearDuplicate) m_nearDuplicateCount++;
+    if (m_httpCache)
+    {
+        // 链接总是全部保存，跟不跟随由每次运行的设置决定
+        entry.links = page.links;
+        entry.mediaUrls.assign(page.mediaUrls.begin(), page.mediaUrls.end());
+        entry.externalLinks = m_options.followExternalLinks;
+        entry.nearDuplicate = nearDuplicate;
+        entry.complete = true;
+        m_httpCache->Update(cacheKey, entry);
+    }
+    ArchivePage(pageUrl, depth, fetch, page, original);
+    // 近似重复的正文和原页几乎一样，不再进索引。缓存记录等正文所在的段写完才标为已索引
+    if (m_index && !nearDuplicate)
+    {
+        std::function<void()> onDurable;
+        if (m_httpCache) onDurable = [this, cacheKey] { m_httpCache->MarkIndexed(cacheKey); };
+        m_index->Add(pageUrl, fetch.fetchTimeMs, page.text, std::move(onDurable));
+    }
+    for (const auto& url : page.mediaUrls) QueueMedia(url);
+    if (followLinks) FollowLinks(page.links, depth, scheduler);
+}
+
+bool Crawler::CanReuse(const CacheEntry& entry) const
+{
+    // 上次没来得及写进索引段的页面要重新取回正文补进索引
+    bool indexed = !m_index || entry.indexed || (entry.nearDuplicate && m_nearDuplicates);
+    return entry.complete && indexed && (entry.externalLinks || !m_options.followExternalLinks);
+}
+
+void Crawler::FollowCachedLinks(const CacheEntry& entry, const std::string& pageUrl, int depth,
+    PolitenessScheduler& scheduler)
+{
+    if (entry.nearDuplicate && m_nearDuplicates && m_options.nearDuplicate.suppressLinks) return;
+    if (!entry.externalLinks || m_options.followExternalLinks)
+    {
+        FollowLinks(entry.links, depth, scheduler);
+        return;
+    }
+    // 记录里有外站链接而这次不跟随，按页面地址筛掉
+    UrlView base;
+    if (!ParseUrl(pageUrl, base)) return;
+    std::vector<std::string> links;
+    for (const auto& link : entry.links)
+    {
+        UrlView target;
+        if (ParseUrl(link, target) && IsSameOrigin(base, target)) links.push_back(link);
+    }
+    FollowLinks(links, depth, scheduler);
+}
+
+void Crawler::QueueMedia(const std::string& url)
+{
+    if (!MarkMediaSeen(url)) return;
+    UrlView target;
+    int owner = ParseUrl(url, target) ? OwnerShard(target.host) : -1;
+    if (owner >= 0)
+    {
+        m_shard->SendMedia(owner, url);
+    }
+    else if (EnqueueMediaDownload(url) && m_checkpoint)
+    {
+        m_checkpoint->RecordMedia(url);
+    }
+}
+
+void Crawler::FollowLinks(const std::vector<std::string>& links, int depth, PolitenessScheduler& scheduler)
+{
+    if (depth >= m_maxDepth) return;
+    for (const auto& link : links)
+    {
+        UrlView target;
+        if (!ParseUrl(link, target)) continue;
+        uint64_t fingerprint = VisitedFingerprint(link);
+        if (!m_visited.Insert(fingerprint)) continue;
+        // 别的分片的主机交给协调进程转发，本地的访问集合只用来避免重复转发
+        int owner = OwnerShard(target.host);
+        if (owner >= 0)
         {
-            auto links = ExtractLinks(html, currentUrl);
-            for (const auto& link : links)
-            {
-                if (m_visited.find(link) == m_visited.end())
-                {
-                    m_visited.insert(link);
-                    q.push({ link, depth + 1 });
-                }
-            }
+            m_shard->SendLink(owner, depth + 1, link);
+            continue;
         }
+        PrefetchHost(target.host);
+        Schedule(scheduler, { link, depth + 1, std::string(target.host) }, fingerprint);
     }
-    return true;
+}
+
+int Crawler::OwnerShard(std::string_view host)
+{
+    if (m_options.shard.count <= 1) return -1;
+    int shard = ShardOfHost(host, m_options.shard.count);
+    return shard == m_options.shard.index ? -1 : shard;
+}
+
+bool Crawler::ConnectShard(PolitenessScheduler& scheduler)
+{
+    // 本地边界空了不代表抓取结束，由协调进程确认所有分片都空闲后再放行
+    scheduler.Hold([this] { if (m_shard && m_seedsQueued) m_shard->ReportIdle(); });
+    ShardClient::Handlers handlers;
+    handlers.onLink = [this, &scheduler](const std::string& url, int depth)
+    {
+        UrlView target;
+        if (depth > m_maxDepth || !ParseUrl(url, target)) return;
+        uint64_t fingerprint = VisitedFingerprint(url);
+        if (!m_visited.Insert(fingerprint)) return;
+        PrefetchHost(target.host);
+        Schedule(scheduler, { url, depth, std::string(target.host) }, fingerprint);
+    };
+    handlers.onMedia = [this](const std::string& url)
+    {
+        if (MarkMediaSeen(url) && EnqueueMediaDownload(url) && m_checkpoint) m_checkpoint->RecordMedia(url);
+    };
+    handlers.isIdle = [this, &scheduler] { return m_seedsQueued && scheduler.IsIdle(); };
+    handlers.onStop = [&scheduler] { scheduler.Release(); };
+    m_shard = std::make_unique<ShardClient>(m_options.shard, std::move(handlers));
+    if (m_shard->Connect()) return true;
+    m_shard.reset();
+    scheduler.Release();
+    return false;
 }
 
 std::string Crawler::ConvertToAbsoluteUrl(const std::string& url, const std::string& baseUrl)
 {
     if (url.empty()) return "";
-    if (url.substr(0, 7) == "http://" || url.substr(0, 8) == "https://")
-        return url;
-    std::wstring wBaseUrl(baseUrl.begin(), baseUrl.end());
-    URL_COMPONENTS baseComp = {};
-    baseComp.dwStructSize = sizeof(baseComp);
-    baseComp.dwSchemeLength = (DWORD)-1;
-    baseComp.dwHostNameLength = (DWORD)-1;
-    baseComp.dwUrlPathLength = (DWORD)-1;
-    baseComp.dwExtraInfoLength = (DWORD)-1;
-    if (!WinHttpCrackUrl(wBaseUrl.c_str(), static_cast<DWORD>(wBaseUrl.length()), 0, &baseComp)) {
+    UrlView base;
+    if (!ParseUrl(baseUrl, base) || !base.IsHttp()) {
         return url;
     }
-    std::wstring scheme(baseComp.lpszScheme, baseComp.dwSchemeLength);
-    std::wstring host(baseComp.lpszHostName, baseComp.dwHostNameLength);
-    std::wstring basePath(baseComp.lpszUrlPath, baseComp.dwUrlPathLength);
-    std::string schemeStr(scheme.begin(), scheme.end());
-    std::string hostStr(host.begin(), host.end());
-    std::string basePathStr(basePath.begin(), basePath.end());
-    std::string baseOrigin = schemeStr + "://" + hostStr;
-    if (url.size() > 2 && url.substr(0, 2) == "//") {
-        return schemeStr + ":" + url;
-    }
-    if (!url.empty() && url[0] == '/') {
-        return baseOrigin + url;
-    }
-    size_t lastSlash = basePathStr.find_last_of('/');
-    std::string pathPrefix = (lastSlash != std::string::npos) ? basePathStr.substr(0, lastSlash + 1) : "/";
-    return baseOrigin + pathPrefix + url;
-}
\ No newline at end of file
+    return ResolveUrl(base, url);
+}
@@ -1,8 +1,27 @@
-#ifndef CRAWLER_H
+﻿#ifndef CRAWLER_H
 #define CRAWLER_H
 
-#include <windows.h>
-#include <winhttp.h>
+#include "charset.h"
+#include "checkpoint.h"
+#include "crawl_archive.h"
+#include "dns_cache.h"
+#include "header_rules.h"
+#include "html_tokenizer.h"
+#include "http_cache.h"
+#include "inverted_index.h"
+#include "media_downloader.h"
+#include "media_store.h"
+#include "media_type.h"
+#include "metrics.h"
+#include "near_duplicate.h"
+#include "page_parser.h"
+#include "scheduler.h"
+#include "seed_reader.h"
+#include "shard.h"
+#include "sha256.h"
+#include "transport.h"
+#include "url.h"
+#include "visited_store.h"
 #include <iostream>
 #include <string>
 #include <vector>
@@ -14,46 +33,167 @@
 #include <thread>
 #include <chrono>
 #include <fstream>
-#include <regex>
+#include <string_view>
 #include <map>
 #include <cwctype>
-
-#pragma comment(lib, "winhttp.lib")
+#include <memory>
+#include <mutex>
+#include <atomic>
 
 namespace fs = std::filesystem;
 
-enum class MediaType
+struct CrawlerOptions
 {
-    Image,
-    Video,
-    Audio,
-    Unknown
+    int maxDepth = 1;
+    int threadCount = 4;
+    // 默认只跟随同源链接；分片抓取多个站点时需要打开
+    bool followExternalLinks = false;
+    // 归档、缓存、检查点等数据的目录，为空时使用程序目录
+    std::string dataDir;
+    // 按主机附加的请求头；媒体请求默认带上所在源站作为 Referer，可以用规则替换或去掉
+    std::vector<HeaderRule> headerRules;
+    SchedulerOptions scheduler;
+    TransportOptions transport;
+    CanonicalizeOptions canonical;
+    VisitedStoreOptions visited;
+    MediaDownloadOptions media;
+    MediaStoreOptions mediaStore;
+    HttpCacheOptions httpCache;
+    ArchiveOptions archive;
+    CheckpointOptions checkpoint;
+    MetricsOptions metrics;
+    NearDuplicateOptions nearDuplicate;
+    ShardOptions shard;
+    IndexOptions index;
+    // transport.dnsCache 已经给出时沿用调用方的缓存，忽略这里的设置
+    DnsCacheOptions dns;
+};
+
+struct FetchResult
+{
+    int status = 0;
+    int64_t fetchTimeMs = 0;
+    // 跟随重定向后的地址，没有重定向时就是请求地址
+    std::string finalUrl;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string etag;
+    std::string lastModified;
+    // 响应体原来的编码，html 已经统一转成 UTF-8
+    Charset charset = Charset::Unknown;
+};
+
+// Start 结束后的汇总
+struct CrawlSummary
+{
+    // 分片模式下只计属于本分片的种子
+    uint64_t seeds = 0;
+    uint64_t invalidSeeds = 0;
+    // 2xx 和 304
+    uint64_t pages = 0;
+    // 网络失败和 4xx/5xx
+    uint64_t failedPages = 0;
+    uint64_t pageBytes = 0;
+    uint64_t mediaFiles = 0;
+    uint64_t failedMedia = 0;
+    double seconds = 0;
 };
 
 class Crawler
 {
 public:
     explicit Crawler(int maxDepth = 1);
+    explicit Crawler(const CrawlerOptions& options);
     ~Crawler();
     bool Start(const std::string& startUrl);
+    // 所有种子共用同一批连接、DNS 缓存和去重集合；种子边读边入队，边界积压时暂停读取。
+    // 格式不对的种子跳过并计入汇总，只有初始化失败时返回 false
+    bool Start(SeedReader& seeds);
+    const CrawlSummary& Summary() const { return m_summary; }
+    // 归档、索引等数据所在的目录，分片模式下是其中的 shard-N 子目录，以分隔符结尾
+    static std::string DataDirectory(const CrawlerOptions& options);
 
-private:
-    HINTERNET m_hSession;
-    std::set<std::string> m_visited;
-    int m_maxDepth;
-
-    void RandomDelay();
-    std::string GetExeDirectoryBase();
-    std::string GetMediaSubdir(MediaType type);
     MediaType GetMediaTypeFromUrl(const std::string& url);
-    std::string GetFileNameFromUrl(const std::string& url);
-    bool FetchPage(const std::string& url, const std::string& referer, std::string& html);
     std::vector<std::string> ExtractLinks(const std::string& html, const std::string& baseUrl);
     std::set<std::string> ExtractMediaUrls(const std::string& html, const std::string& baseUrl);
     std::string ExtractTextContent(const std::string& html);
-    bool SaveTextToFile(const std::string& text, const std::string& baseUrl, int depth);
-    bool DownloadMediaFile(const std::string& fileUrl);
+    // 写入调用方的缓冲区，重复调用时复用其容量
+    void ExtractTextContent(const std::string& html, std::string& text);
     std::string ConvertToAbsoluteUrl(const std::string& url, const std::string& baseUrl);
+    // 一次扫描同时得到链接、媒体地址和正文
+    void ParsePage(const std::string& html, const std::string& baseUrl, bool wantLinks, PageContent& page);
+
+private:
+    CrawlerOptions m_options;
+    CrawlMetrics m_metrics;
+    UrlScorer m_scorer;
+    std::unique_ptr<HttpTransport> m_transport;
+    // 只在 Start 期间存在，页面线程把媒体任务交给它后继续抓取
+    std::unique_ptr<MediaDownloader> m_downloader;
+    std::unique_ptr<MediaStore> m_mediaStore;
+    std::unique_ptr<HttpCacheIndex> m_httpCache;
+    std::unique_ptr<ArchiveWriter> m_archive;
+    std::unique_ptr<CrawlCheckpoint> m_checkpoint;
+    std::unique_ptr<HostRateLimiter> m_rateLimiter;
+    std::unique_ptr<NearDuplicateIndex> m_nearDuplicates;
+    std::unique_ptr<IndexWriter> m_index;
+    // 只在分片模式的 Start 期间存在
+    std::unique_ptr<ShardClient> m_shard;
+    std::atomic<uint64_t> m_notModified{ 0 };
+    std::atomic<uint64_t> m_unchanged{ 0 };
+    std::atomic<uint64_t> m_nearDuplicateCount{ 0 };
+    std::atomic<uint64_t> m_transcodedPages{ 0 };
+    std::atomic<uint64_t> m_repairedPages{ 0 };
+    std::atomic<uint64_t> m_fetchedPages{ 0 };
+    std::atomic<uint64_t> m_failedPages{ 0 };
+    // 种子全部入队之前，分片不向协调进程报告空闲
+    std::atomic<bool> m_seedsQueued{ false };
+    CrawlSummary m_summary;
+    VisitedStore m_visited;
+    std::mutex m_mediaMutex;
+    std::set<std::string> m_mediaSeen;
+    int m_maxDepth;
+    // 程序目录，分片模式下是其中的 shard-N 子目录
+    std::string m_dataDir;
+
+    static CrawlerOptions MakeOptions(int maxDepth);
+    // 没有指定溢出目录时用数据目录下的 visited
+    static VisitedStoreOptions VisitedOptions(const CrawlerOptions& options);
+    uint64_t VisitedFingerprint(const std::string& url);
+    // 按 URL、深度和上次抓取时的 Last-Modified 打分
+    void Prioritize(CrawlTask& task);
+    // 入队并记入检查点日志
+    void Schedule(PolitenessScheduler& scheduler, CrawlTask task, uint64_t fingerprint);
+    // 恢复上次的进度，没有可恢复的内容时返回 false
+    bool ResumeCheckpoint(PolitenessScheduler& scheduler);
+    bool MarkMediaSeen(const std::string& url);
+    void WorkerLoop(PolitenessScheduler& scheduler);
+    void ProcessPage(const CrawlTask& task, PolitenessScheduler& scheduler, PageContent& page);
+    void FollowLinks(const std::vector<std::string>& links, int depth, PolitenessScheduler& scheduler);
+    // 主机属于别的分片时返回该分片编号，属于本进程（或未分片）时返回 -1
+    int OwnerShard(std::string_view host);
+    bool ConnectShard(PolitenessScheduler& scheduler);
+    void QueueSeeds(SeedReader& seeds, PolitenessScheduler& scheduler);
+    static std::string GetExeDirectoryBase();
+    std::string GetMediaSubdir(MediaType type);
+    std::string GetFileNameFromUrl(const std::string& url);
+    // parser 不为空时 2xx 的响应体边到边解析；cached 不为空时带上条件请求头。
+    // 仅在网络失败时返回 false，状态码见 result
+    bool FetchPage(const std::string& url, const std::string& referer, std::string& html, PageParser* parser = nullptr,
+        const CacheEntry* cached = nullptr, FetchResult* result = nullptr);
+    std::string CacheKey(const std::string& url);
+    // aliasOf 非空时只写一条指向它的别名记录
+    bool ArchivePage(const std::string& url, int depth, FetchResult& fetch, PageContent& page,
+        const std::string& aliasOf = "");
+    bool EnqueueMediaDownload(const std::string& fileUrl);
+    // 每次运行每个地址只排一次，别的分片的主机转给协调进程
+    void QueueMedia(const std::string& url);
+    // 缓存记录里的链接和媒体地址够这次运行用、正文也已进索引，内容没变时不必重新解析
+    bool CanReuse(const CacheEntry& entry) const;
+    // 按这次运行的外站和近似重复设置跟随缓存记录里的链接
+    void FollowCachedLinks(const CacheEntry& entry, const std::string& pageUrl, int depth,
+        PolitenessScheduler& scheduler);
+    // 发现新主机时提前在后台解析，等工作线程取到这个地址时已经有结果
+    void PrefetchHost(std::string_view host);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,460 @@
+﻿#include "dns_cache.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <random>
+
+#ifdef _WIN32
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifdef _WIN32
+    using SocketHandle = SOCKET;
+    const SocketHandle kInvalidSocket = INVALID_SOCKET;
+    void CloseSocket(SocketHandle s) { closesocket(s); }
+    int PollSockets(WSAPOLLFD* fds, size_t count, int timeoutMs) { return WSAPoll(fds, (ULONG)count, timeoutMs); }
+    using PollEntry = WSAPOLLFD;
+
+    // WSAStartup 按引用计数，和缓存同生命周期即可
+    struct WinsockInit
+    {
+        WinsockInit()
+        {
+            WSADATA data;
+            WSAStartup(MAKEWORD(2, 2), &data);
+        }
+        ~WinsockInit() { WSACleanup(); }
+    };
+#else
+    using SocketHandle = int;
+    const SocketHandle kInvalidSocket = -1;
+    void CloseSocket(SocketHandle s) { close(s); }
+    int PollSockets(pollfd* fds, size_t count, int timeoutMs) { return poll(fds, (nfds_t)count, timeoutMs); }
+    using PollEntry = pollfd;
+#endif
+
+    const uint16_t kTypeA = 1;
+    const uint16_t kTypeCname = 5;
+    const uint16_t kTypeSoa = 6;
+    const uint16_t kTypeAaaa = 28;
+
+    class SystemResolver : public DnsResolver
+    {
+    public:
+        bool Resolve(const std::string& host, DnsResult& result) override
+        {
+            addrinfo hints = {};
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            addrinfo* list = nullptr;
+            if (getaddrinfo(host.c_str(), nullptr, &hints, &list) != 0) return false;
+            for (addrinfo* ai = list; ai; ai = ai->ai_next) {
+                if (ai->ai_addrlen > sizeof(sockaddr_storage)) continue;
+                ResolvedAddress address;
+                memcpy(&address.addr, ai->ai_addr, ai->ai_addrlen);
+                address.length = (socklen_t)ai->ai_addrlen;
+                result.addresses.push_back(address);
+            }
+            freeaddrinfo(list);
+            result.ok = !result.addresses.empty();
+            return result.ok;
+        }
+    };
+
+    // 只发 A 和 AAAA 两个查询的最小 DNS 客户端，目的是拿到 TTL；不做递归，要求服务器支持 RD
+    class UdpResolver : public DnsResolver
+    {
+    public:
+        UdpResolver(const std::string& nameserver, int timeoutMs)
+            : m_timeoutMs(std::max(100, timeoutMs)), m_rng(std::random_device{}())
+        {
+            std::string host = nameserver;
+            int port = 53;
+            size_t colon = host.rfind(':');
+            if (!host.empty() && host.front() == '[') {
+                size_t close = host.find(']');
+                if (close != std::string::npos && close + 1 < host.size() && host[close + 1] == ':') {
+                    port = atoi(host.c_str() + close + 2);
+                }
+                host = host.substr(1, close == std::string::npos ? std::string::npos : close - 1);
+            }
+            else if (colon != std::string::npos && host.find(':') == colon) {
+                port = atoi(host.c_str() + colon + 1);
+                host.resize(colon);
+            }
+            m_valid = ParseIpLiteral(host, m_server);
+            if (m_valid) m_server.SetPort(port);
+        }
+
+        bool Resolve(const std::string& host, DnsResult& result) override
+        {
+            if (!m_valid || host.empty() || host.size() > 253) return false;
+            SocketHandle s = socket(m_server.Family(), SOCK_DGRAM, 0);
+            if (s == kInvalidSocket) return false;
+            if (connect(s, (const sockaddr*)&m_server.addr, m_server.length) != 0) {
+                CloseSocket(s);
+                return false;
+            }
+            uint16_t ids[2];
+            std::string queries[2];
+            const uint16_t types[2] = { kTypeA, kTypeAaaa };
+            {
+                std::lock_guard<std::mutex> lock(m_rngMutex);
+                for (uint16_t& id : ids) id = (uint16_t)m_rng();
+            }
+            for (int i = 0; i < 2; i++) {
+                if (!BuildQuery(host, ids[i], types[i], queries[i])) {
+                    CloseSocket(s);
+                    return false;
+                }
+            }
+            bool answered[2] = { false, false };
+            bool nxdomain = false;
+            int ttl = -1;
+            int negativeTtl = -1;
+            // 超时后重发还没应答的查询，一共三次
+            for (int attempt = 0; attempt < 3 && !(answered[0] && answered[1]); attempt++) {
+                for (int i = 0; i < 2; i++) {
+                    if (!answered[i]) send(s, queries[i].data(), (int)queries[i].size(), 0);
+                }
+                auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_timeoutMs / 3 + 1);
+                while (!(answered[0] && answered[1])) {
+                    auto left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+                    if (left <= 0) break;
+                    // 不用 select：描述符号大于 FD_SETSIZE 时 fd_set 会越界
+                    PollEntry entry = {};
+                    entry.fd = s;
+                    entry.events = POLLIN;
+                    if (PollSockets(&entry, 1, (int)((left + 999) / 1000)) <= 0) break;
+                    unsigned char buffer[4096];
+                    int n = (int)recv(s, (char*)buffer, sizeof(buffer), 0);
+                    if (n < 12) continue;
+                    uint16_t id = (uint16_t)(buffer[0] << 8 | buffer[1]);
+                    int index = id == ids[0] ? 0 : id == ids[1] ? 1 : -1;
+                    if (index < 0 || answered[index]) continue;
+                    int rcode = buffer[3] & 0x0F;
+                    answered[index] = true;
+                    if (rcode == 3) nxdomain = true;
+                    // SERVFAIL 等按没有地址处理；截断的应答里地址不全，但 TTL 可信，照常使用
+                    if (rcode == 0 || rcode == 3) ParseResponse(buffer, (size_t)n, types[index], result, ttl, negativeTtl);
+                }
+            }
+            CloseSocket(s);
+            if (!answered[0] && !answered[1]) return false;
+            result.ok = !nxdomain && !result.addresses.empty();
+            result.ttlSeconds = result.ok ? ttl : negativeTtl;
+            return result.ok;
+        }
+
+    private:
+        static bool BuildQuery(const std::string& host, uint16_t id, uint16_t type, std::string& packet)
+        {
+            unsigned char header[12] = { (unsigned char)(id >> 8), (unsigned char)id, 0x01, 0x00, 0, 1, 0, 0, 0, 0, 0, 0 };
+            packet.assign((const char*)header, sizeof(header));
+            size_t start = 0;
+            while (start < host.size()) {
+                size_t dot = host.find('.', start);
+                if (dot == std::string::npos) dot = host.size();
+                size_t length = dot - start;
+                if (length == 0 || length > 63) return false;
+                packet.push_back((char)length);
+                packet.append(host, start, length);
+                start = dot + 1;
+            }
+            packet.push_back('\0');
+            packet.push_back((char)(type >> 8));
+            packet.push_back((char)type);
+            packet.push_back('\0');
+            packet.push_back('\1');
+            return true;
+        }
+
+        static bool SkipName(const unsigned char* data, size_t size, size_t& pos)
+        {
+            while (pos < size) {
+                unsigned char length = data[pos];
+                if (length == 0) {
+                    pos++;
+                    return true;
+                }
+                if ((length & 0xC0) == 0xC0) {
+                    pos += 2;
+                    return pos <= size;
+                }
+                pos += 1 + length;
+            }
+            return false;
+        }
+
+        static uint32_t Read32(const unsigned char* p) { return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3]; }
+        static uint16_t Read16(const unsigned char* p) { return (uint16_t)(p[0] << 8 | p[1]); }
+
+        static void MergeTtl(int& ttl, uint32_t value)
+        {
+            int seconds = (int)std::min<uint32_t>(value, 0x7FFFFFFF);
+            ttl = ttl < 0 ? seconds : std::min(ttl, seconds);
+        }
+
+        // 地址和 CNAME 取最小的 TTL；没有地址时按 RFC 2308 用 SOA 的 TTL 和 MINIMUM 中较小者
+        static void ParseResponse(const unsigned char* data, size_t size, uint16_t type, DnsResult& result, int& ttl, int& negativeTtl)
+        {
+            size_t pos = 12;
+            int questions = Read16(data + 4);
+            int answers = Read16(data + 6);
+            int authorities = Read16(data + 8);
+            for (int i = 0; i < questions; i++) {
+                if (!SkipName(data, size, pos)) return;
+                pos += 4;
+            }
+            for (int i = 0; i < answers + authorities && pos < size; i++) {
+                if (!SkipName(data, size, pos) || pos + 10 > size) return;
+                uint16_t recordType = Read16(data + pos);
+                uint32_t recordTtl = Read32(data + pos + 4);
+                uint16_t length = Read16(data + pos + 8);
+                pos += 10;
+                if (pos + length > size) return;
+                const unsigned char* rdata = data + pos;
+                pos += length;
+                if (i < answers) {
+                    if (recordType == kTypeCname) {
+                        MergeTtl(ttl, recordTtl);
+                    }
+                    else if (recordType == type && type == kTypeA && length == 4) {
+                        ResolvedAddress address;
+                        auto* sin = (sockaddr_in*)&address.addr;
+                        sin->sin_family = AF_INET;
+                        memcpy(&sin->sin_addr, rdata, 4);
+                        address.length = sizeof(sockaddr_in);
+                        result.addresses.push_back(address);
+                        MergeTtl(ttl, recordTtl);
+                    }
+                    else if (recordType == type && type == kTypeAaaa && length == 16) {
+                        ResolvedAddress address;
+                        auto* sin6 = (sockaddr_in6*)&address.addr;
+                        sin6->sin6_family = AF_INET6;
+                        memcpy(&sin6->sin6_addr, rdata, 16);
+                        address.length = sizeof(sockaddr_in6);
+                        result.addresses.push_back(address);
+                        MergeTtl(ttl, recordTtl);
+                    }
+                }
+                else if (recordType == kTypeSoa && length >= 22) {
+                    // MINIMUM 是 RDATA 的最后 4 字节
+                    MergeTtl(negativeTtl, std::min(recordTtl, Read32(rdata + length - 4)));
+                }
+            }
+        }
+
+        ResolvedAddress m_server;
+        bool m_valid = false;
+        int m_timeoutMs;
+        std::mutex m_rngMutex;
+        std::mt19937 m_rng;
+    };
+}
+
+void ResolvedAddress::SetPort(int port)
+{
+    if (addr.ss_family == AF_INET) {
+        ((sockaddr_in*)&addr)->sin_port = htons((uint16_t)port);
+    }
+    else if (addr.ss_family == AF_INET6) {
+        ((sockaddr_in6*)&addr)->sin6_port = htons((uint16_t)port);
+    }
+}
+
+bool ParseIpLiteral(const std::string& host, ResolvedAddress& address)
+{
+    std::string text = host;
+    if (text.size() > 2 && text.front() == '[' && text.back() == ']') text = text.substr(1, text.size() - 2);
+    address = ResolvedAddress();
+    auto* sin = (sockaddr_in*)&address.addr;
+    if (inet_pton(AF_INET, text.c_str(), &sin->sin_addr) == 1) {
+        sin->sin_family = AF_INET;
+        address.length = sizeof(sockaddr_in);
+        return true;
+    }
+    auto* sin6 = (sockaddr_in6*)&address.addr;
+    if (inet_pton(AF_INET6, text.c_str(), &sin6->sin6_addr) == 1) {
+        sin6->sin6_family = AF_INET6;
+        address.length = sizeof(sockaddr_in6);
+        return true;
+    }
+    return false;
+}
+
+std::unique_ptr<DnsResolver> CreateSystemResolver()
+{
+    return std::make_unique<SystemResolver>();
+}
+
+std::unique_ptr<DnsResolver> CreateUdpResolver(const std::string& nameserver, int timeoutMs)
+{
+    return std::make_unique<UdpResolver>(nameserver, timeoutMs);
+}
+
+DnsCache::DnsCache(const DnsCacheOptions& options, std::unique_ptr<DnsResolver> resolver)
+    : m_options(options), m_resolver(std::move(resolver))
+{
+#ifdef _WIN32
+    static WinsockInit winsock;
+#endif
+    if (!m_resolver) {
+        m_resolver = m_options.nameserver.empty() ? CreateSystemResolver()
+            : CreateUdpResolver(m_options.nameserver, m_options.queryTimeoutMs);
+    }
+    for (int i = 0; i < m_options.prefetchThreads; i++) {
+        m_prefetchThreads.emplace_back(&DnsCache::PrefetchLoop, this);
+    }
+}
+
+DnsCache::~DnsCache()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        // 还没查的预取条目不能一直挂着 pending
+        for (const auto& key : m_prefetchQueue) m_entries.erase(key);
+        m_prefetchQueue.clear();
+    }
+    m_prefetchCv.notify_all();
+    m_resolvedCv.notify_all();
+    for (auto& thread : m_prefetchThreads) thread.join();
+}
+
+std::string DnsCache::Key(const std::string& host)
+{
+    std::string key = host;
+    std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return (char)tolower(c); });
+    if (!key.empty() && key.back() == '.') key.pop_back();
+    return key;
+}
+
+bool DnsCache::Resolve(const std::string& host, int port, std::vector<ResolvedAddress>& addresses)
+{
+    addresses.clear();
+    ResolvedAddress literal;
+    if (ParseIpLiteral(host, literal)) {
+        literal.SetPort(port);
+        addresses.push_back(literal);
+        return true;
+    }
+    std::string key = Key(host);
+    if (!m_options.enabled) {
+        DnsResult result;
+        m_stats.misses++;
+        if (!m_resolver->Resolve(key, result)) return false;
+        addresses = std::move(result.addresses);
+    }
+    else {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(key);
+        if (it != m_entries.end() && it->second.pending) {
+            m_stats.coalesced++;
+            m_resolvedCv.wait(lock, [&] { it = m_entries.find(key); return it == m_entries.end() || !it->second.pending; });
+        }
+        auto now = Clock::now();
+        if (it != m_entries.end() && !it->second.pending && it->second.expires > now) {
+            if (!it->second.ok) {
+                m_stats.negativeHits++;
+                return false;
+            }
+            m_stats.hits++;
+            addresses = it->second.addresses;
+        }
+        else {
+            m_stats.misses++;
+            m_entries[key].pending = true;
+            lock.unlock();
+            Lookup(key);
+            lock.lock();
+            it = m_entries.find(key);
+            if (it == m_entries.end() || !it->second.ok) return false;
+            addresses = it->second.addresses;
+        }
+    }
+    for (auto& address : addresses) address.SetPort(port);
+    return !addresses.empty();
+}
+
+void DnsCache::Lookup(const std::string& key)
+{
+    DnsResult result;
+    bool ok = m_resolver->Resolve(key, result);
+    int ttl;
+    if (ok) {
+        ttl = result.ttlSeconds < 0 ? m_options.defaultTtlSeconds
+            : std::clamp(result.ttlSeconds, m_options.minTtlSeconds, m_options.maxTtlSeconds);
+    }
+    else {
+        ttl = result.ttlSeconds < 0 ? m_options.negativeTtlSeconds : std::min(result.ttlSeconds, m_options.negativeTtlSeconds);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto now = Clock::now();
+        if (m_entries.size() > m_options.maxEntries) EvictLocked(now);
+        Entry& entry = m_entries[key];
+        entry.pending = false;
+        entry.ok = ok;
+        entry.addresses = std::move(result.addresses);
+        entry.expires = now + std::chrono::seconds(ttl);
+    }
+    m_resolvedCv.notify_all();
+}
+
+void DnsCache::EvictLocked(Clock::time_point now)
+{
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (!it->second.pending && it->second.expires <= now) it = m_entries.erase(it);
+        else ++it;
+    }
+    // 全都没过期时整体清掉，宁可多查几次也不无限增长
+    if (m_entries.size() > m_options.maxEntries) {
+        for (auto it = m_entries.begin(); it != m_entries.end();) {
+            if (!it->second.pending) it = m_entries.erase(it);
+            else ++it;
+        }
+    }
+}
+
+void DnsCache::Prefetch(const std::string& host)
+{
+    if (!m_options.enabled || m_prefetchThreads.empty() || host.empty()) return;
+    ResolvedAddress literal;
+    if (ParseIpLiteral(host, literal)) return;
+    std::string key = Key(host);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping) return;
+        auto it = m_entries.find(key);
+        if (it != m_entries.end() && (it->second.pending || it->second.expires > Clock::now())) return;
+        // 先标记为 pending，取到这个主机的工作线程会等预取结果而不是再查一次
+        m_entries[key].pending = true;
+        m_prefetchQueue.push_back(key);
+        m_stats.prefetches++;
+    }
+    m_prefetchCv.notify_one();
+}
+
+void DnsCache::PrefetchLoop()
+{
+    while (true) {
+        std::string key;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_prefetchCv.wait(lock, [&] { return m_stopping || !m_prefetchQueue.empty(); });
+            if (m_stopping) return;
+            key = std::move(m_prefetchQueue.front());
+            m_prefetchQueue.pop_front();
+        }
+        Lookup(key);
+    }
+}
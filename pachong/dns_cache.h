@@ -0,0 +1,126 @@
+﻿#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#endif
+
+struct DnsCacheOptions
+{
+    bool enabled = true;
+    // 为空时用系统解析器（getaddrinfo，拿不到 TTL，按 defaultTtlSeconds 缓存）；
+    // 设为 "ip[:port]" 时直接向该服务器发 UDP 查询并按应答里的 TTL 缓存，可指向本地的桩解析器
+    std::string nameserver;
+    int queryTimeoutMs = 2000;
+    int defaultTtlSeconds = 300;
+    int minTtlSeconds = 5;
+    int maxTtlSeconds = 86400;
+    // 解析失败的缓存时间；UDP 查询得到 NXDOMAIN 时按 SOA 的最小 TTL，但不超过它
+    int negativeTtlSeconds = 30;
+    int prefetchThreads = 2;
+    size_t maxEntries = 100000;
+};
+
+struct ResolvedAddress
+{
+    sockaddr_storage addr = {};
+    socklen_t length = 0;
+
+    int Family() const { return addr.ss_family; }
+    void SetPort(int port);
+};
+
+struct DnsResult
+{
+    bool ok = false;
+    std::vector<ResolvedAddress> addresses;
+    // 小于 0 表示解析器不知道，由缓存使用默认值
+    int ttlSeconds = -1;
+};
+
+class DnsResolver
+{
+public:
+    virtual ~DnsResolver() = default;
+    virtual bool Resolve(const std::string& host, DnsResult& result) = 0;
+};
+
+std::unique_ptr<DnsResolver> CreateSystemResolver();
+std::unique_ptr<DnsResolver> CreateUdpResolver(const std::string& nameserver, int timeoutMs);
+// host 是 IP 字面量（IPv6 可带方括号）时直接填入地址
+bool ParseIpLiteral(const std::string& host, ResolvedAddress& address);
+
+struct DnsCacheStats
+{
+    std::atomic<uint64_t> hits{ 0 };
+    std::atomic<uint64_t> negativeHits{ 0 };
+    std::atomic<uint64_t> misses{ 0 };
+    // 等待正在进行的同一主机查询（通常是预取）而没有重复查询的次数
+    std::atomic<uint64_t> coalesced{ 0 };
+    std::atomic<uint64_t> prefetches{ 0 };
+};
+
+// 进程内的解析缓存：正向按 TTL、失败按负缓存时间保存；同一主机同时只有一个查询，
+// 其余调用者等它的结果。Prefetch 把查询交给后台线程，发现新主机时调用。线程安全
+class DnsCache
+{
+public:
+    explicit DnsCache(const DnsCacheOptions& options, std::unique_ptr<DnsResolver> resolver = nullptr);
+    ~DnsCache();
+    DnsCache(const DnsCache&) = delete;
+    DnsCache& operator=(const DnsCache&) = delete;
+
+    // 阻塞到有结果为止，返回的地址已填好端口
+    bool Resolve(const std::string& host, int port, std::vector<ResolvedAddress>& addresses);
+    // 不阻塞；已缓存或正在查询时什么也不做
+    void Prefetch(const std::string& host);
+    const DnsCacheStats& Stats() const { return m_stats; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry
+    {
+        bool pending = false;
+        bool ok = false;
+        std::vector<ResolvedAddress> addresses;
+        Clock::time_point expires;
+    };
+
+    static std::string Key(const std::string& host);
+    // 调用前已把条目标记为 pending
+    void Lookup(const std::string& key);
+    void EvictLocked(Clock::time_point now);
+    void PrefetchLoop();
+
+    DnsCacheOptions m_options;
+    std::unique_ptr<DnsResolver> m_resolver;
+    DnsCacheStats m_stats;
+    std::mutex m_mutex;
+    std::condition_variable m_resolvedCv;
+    std::unordered_map<std::string, Entry> m_entries;
+    std::condition_variable m_prefetchCv;
+    std::deque<std::string> m_prefetchQueue;
+    bool m_stopping = false;
+    std::vector<std::thread> m_prefetchThreads;
+};
+
+#endif
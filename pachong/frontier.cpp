@@ -0,0 +1,467 @@
+﻿#include "frontier.h"
+#include "scheduler.h"
+#include "url.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+    size_t CountDigits(std::string_view text, size_t pos)
+    {
+        size_t n = 0;
+        while (pos + n < text.size() && IsDigit(text[pos + n])) n++;
+        return n;
+    }
+
+    int ReadNumber(std::string_view text, size_t pos, size_t digits)
+    {
+        int value = 0;
+        for (size_t i = 0; i < digits; ++i) value = value * 10 + (text[pos + i] - '0');
+        return value;
+    }
+
+    // 公历日期到 1970-01-01 的天数
+    long long DaysFromCivil(int year, int month, int day)
+    {
+        year -= month <= 2;
+        long long era = (year >= 0 ? year : year - 399) / 400;
+        long long yoe = year - era * 400;
+        long long doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + doe - 719468;
+    }
+
+    // 找 /2024/05/17/、2024-05-17、20240517、/202405/ 这类写在路径里的日期，日可以省略
+    bool FindUrlDate(std::string_view path, long long& days)
+    {
+        for (size_t i = 0; i + 6 <= path.size(); ++i) {
+            if (i > 0 && IsDigit(path[i - 1])) continue;
+            if (CountDigits(path, i) < 4) continue;
+            int year = ReadNumber(path, i, 4);
+            if (year < 1995 || year > 2099) continue;
+            size_t pos = i + 4;
+            if (pos < path.size() && (path[pos] == '/' || path[pos] == '-' || path[pos] == '_')) pos++;
+            if (CountDigits(path, pos) < 2) continue;
+            int month = ReadNumber(path, pos, 2);
+            if (month < 1 || month > 12) continue;
+            pos += 2;
+            int day = 1;
+            size_t dayPos = pos;
+            if (dayPos < path.size() && (path[dayPos] == '/' || path[dayPos] == '-' || path[dayPos] == '_')) dayPos++;
+            if (CountDigits(path, dayPos) >= 2) {
+                int value = ReadNumber(path, dayPos, 2);
+                if (value >= 1 && value <= 31) day = value;
+            }
+            days = DaysFromCivil(year, month, day);
+            return true;
+        }
+        return false;
+    }
+
+    bool EqualsLower(std::string_view text, std::string_view lower)
+    {
+        if (text.size() != lower.size()) return false;
+        for (size_t i = 0; i < text.size(); ++i) {
+            if (tolower((unsigned char)text[i]) != lower[i]) return false;
+        }
+        return true;
+    }
+
+    bool StartsWithLower(std::string_view text, std::string_view lower)
+    {
+        return text.size() >= lower.size() && EqualsLower(text.substr(0, lower.size()), lower);
+    }
+
+    // URL 中前缀和叶子的分界：最后一个目录分隔符之后，查询串之前
+    size_t PrefixLength(std::string_view url)
+    {
+        size_t scheme = url.find("://");
+        size_t start = scheme == std::string_view::npos ? 0 : scheme + 3;
+        size_t end = url.find_first_of("?#", start);
+        if (end == std::string_view::npos) end = url.size();
+        size_t slash = url.rfind('/', end == 0 ? 0 : end - 1);
+        if (slash == std::string_view::npos || slash < start) return end;
+        return slash + 1;
+    }
+
+    template <typename T>
+    void AppendPod(std::string& out, T value)
+    {
+        out.append((const char*)&value, sizeof(value));
+    }
+
+    template <typename T>
+    bool ReadPod(const std::string& data, size_t& pos, T& value)
+    {
+        if (pos + sizeof(value) > data.size()) return false;
+        memcpy(&value, data.data() + pos, sizeof(value));
+        pos += sizeof(value);
+        return true;
+    }
+}
+
+UrlScorer::UrlScorer(const FrontierOptions& options)
+    : m_options(options)
+{
+    m_options.freshnessHorizonDays = std::max(1, m_options.freshnessHorizonDays);
+}
+
+float UrlScorer::Score(const std::string& url, int depth, time_t lastModified) const
+{
+    if (!m_options.priority) return 0;
+    std::string_view path;
+    std::string_view query;
+    UrlView view;
+    if (ParseUrl(url, view)) {
+        path = view.path;
+        query = view.query;
+    }
+    double score = -m_options.depthWeight * depth;
+    if (!m_options.rules.empty()) {
+        std::string target(path);
+        if (!query.empty()) {
+            target.push_back('?');
+            target.append(query);
+        }
+        for (const auto& rule : m_options.rules) {
+            if (MatchPattern(rule.pattern, target)) score += rule.boost;
+        }
+    }
+    if (LooksLikePagination(path, query)) score -= m_options.paginationPenalty;
+    double freshness = EstimateFreshness(path, lastModified, time(nullptr), m_options.freshnessHorizonDays);
+    score += m_options.freshnessWeight * (freshness < 0 ? 0.5 : freshness);
+    return (float)score;
+}
+
+bool UrlScorer::MatchPattern(std::string_view pattern, std::string_view text)
+{
+    while (!pattern.empty()) {
+        char c = pattern.front();
+        if (c == '*') {
+            pattern.remove_prefix(1);
+            for (size_t i = 0; i <= text.size(); ++i) {
+                if (MatchPattern(pattern, text.substr(i))) return true;
+            }
+            return false;
+        }
+        if (c == '#') {
+            size_t digits = CountDigits(text, 0);
+            pattern.remove_prefix(1);
+            for (size_t i = digits; i >= 1; --i) {
+                if (MatchPattern(pattern, text.substr(i))) return true;
+            }
+            return false;
+        }
+        if (text.empty() || (c != '?' && c != text.front())) return false;
+        pattern.remove_prefix(1);
+        text.remove_prefix(1);
+    }
+    return text.empty();
+}
+
+bool UrlScorer::LooksLikePagination(std::string_view path, std::string_view query)
+{
+    static const std::string_view kPageKeys[] = { "page", "p", "pn", "pageno", "pagenum", "pageindex", "paged",
+        "offset", "start" };
+    size_t pos = 0;
+    while (pos < query.size()) {
+        size_t amp = query.find('&', pos);
+        if (amp == std::string_view::npos) amp = query.size();
+        std::string_view pair = query.substr(pos, amp - pos);
+        size_t eq = pair.find('=');
+        if (eq != std::string_view::npos && eq + 1 < pair.size() && CountDigits(pair, eq + 1) == pair.size() - eq - 1) {
+            for (auto key : kPageKeys) {
+                if (EqualsLower(pair.substr(0, eq), key)) return true;
+            }
+        }
+        pos = amp + 1;
+    }
+    size_t slash = path.rfind('/');
+    std::string_view leaf = slash == std::string_view::npos ? path : path.substr(slash + 1);
+    std::string_view dir = slash == std::string_view::npos ? std::string_view() : path.substr(0, slash);
+    size_t dot = leaf.rfind('.');
+    std::string_view stem = dot == std::string_view::npos ? leaf : leaf.substr(0, dot);
+    // 常见 CMS 的列表翻页：index_2.htm、list3.htm、list_4.htm、/page/5/、栏目下的 2.htm
+    for (std::string_view prefix : { "index", "list", "page" }) {
+        if (!StartsWithLower(stem, prefix)) continue;
+        size_t at = prefix.size();
+        if (at < stem.size() && (stem[at] == '_' || stem[at] == '-')) at++;
+        if (at < stem.size() && CountDigits(stem, at) == stem.size() - at) return true;
+    }
+    if (!stem.empty() && stem.size() <= 3 && CountDigits(stem, 0) == stem.size()) {
+        size_t parent = dir.rfind('/');
+        std::string_view parentName = parent == std::string_view::npos ? dir : dir.substr(parent + 1);
+        if (EqualsLower(parentName, "page")) return true;
+        return dot != std::string_view::npos;
+    }
+    return false;
+}
+
+double UrlScorer::EstimateFreshness(std::string_view path, time_t lastModified, time_t now, int horizonDays)
+{
+    long long days;
+    if (lastModified > 0) {
+        days = (long long)(lastModified / 86400);
+    }
+    else if (!FindUrlDate(path, days)) {
+        return -1;
+    }
+    double age = (double)((long long)(now / 86400) - days);
+    return 1.0 - std::clamp(age / std::max(1, horizonDays), 0.0, 1.0);
+}
+
+namespace
+{
+    // 文件小于它时不整理，已释放的空间最多占这么大
+    const uint64_t kSpillCompactBytes = 16ull * 1024 * 1024;
+}
+
+FrontierSpill::FrontierSpill(const std::string& path)
+    : m_path(path)
+{
+}
+
+FrontierSpill::~FrontierSpill()
+{
+    if (!m_file.is_open()) return;
+    m_file.close();
+    std::error_code ec;
+    fs::remove(m_path, ec);
+}
+
+bool FrontierSpill::Open(bool truncate)
+{
+    std::ios::openmode mode = std::ios::in | std::ios::out | std::ios::binary;
+    if (truncate) mode |= std::ios::trunc;
+    m_file.open(m_path, mode);
+    if (m_file.is_open()) return true;
+    m_failed = true;
+    std::cerr << "Cannot open frontier spill file " << m_path << ", keeping the frontier in memory\n";
+    return false;
+}
+
+bool FrontierSpill::Write(const std::string& data, uint64_t& id)
+{
+    if (m_failed || data.size() > UINT32_MAX) return false;
+    if (!m_file.is_open()) {
+        std::error_code ec;
+        fs::path parent = fs::path(m_path).parent_path();
+        if (!parent.empty()) fs::create_directories(parent, ec);
+        if (!Open(true)) return false;
+    }
+    m_file.clear();
+    m_file.seekp((std::streamoff)m_size);
+    m_file.write(data.data(), (std::streamsize)data.size());
+    if (!m_file) return false;
+    id = m_nextId++;
+    m_extents[id] = { m_size, (uint32_t)data.size() };
+    m_size += data.size();
+    m_diskSize = std::max(m_diskSize, m_size);
+    m_liveBytes += data.size();
+    return true;
+}
+
+bool FrontierSpill::Take(uint64_t id, std::string& data)
+{
+    auto it = m_extents.find(id);
+    if (it == m_extents.end()) return false;
+    Extent extent = it->second;
+    m_extents.erase(it);
+    m_liveBytes -= extent.length;
+    bool ok = false;
+    if (m_file.is_open()) {
+        m_file.clear();
+        m_file.flush();
+        m_file.seekg((std::streamoff)extent.offset);
+        data.resize(extent.length);
+        m_file.read(&data[0], (std::streamsize)extent.length);
+        ok = (bool)m_file;
+    }
+    if (m_extents.empty()) {
+        m_size = 0;
+        if (m_diskSize > kSpillCompactBytes && m_file.is_open()) Shrink(0);
+    }
+    else if (m_size >= kSpillCompactBytes && m_liveBytes < m_size / 2) {
+        Compact();
+    }
+    return ok;
+}
+
+void FrontierSpill::Compact()
+{
+    // 按偏移从小到大把还没读回的段往前挪，每段的新位置不会超过旧位置，整段读进内存后再写不会覆盖未读的数据
+    std::vector<std::pair<uint64_t, uint64_t>> order;
+    order.reserve(m_extents.size());
+    for (const auto& entry : m_extents) order.emplace_back(entry.second.offset, entry.first);
+    std::sort(order.begin(), order.end());
+    uint64_t position = 0;
+    std::string buffer;
+    for (const auto& item : order) {
+        Extent& extent = m_extents[item.second];
+        if (extent.offset != position) {
+            m_file.clear();
+            m_file.flush();
+            m_file.seekg((std::streamoff)extent.offset);
+            buffer.resize(extent.length);
+            m_file.read(&buffer[0], (std::streamsize)extent.length);
+            m_file.seekp((std::streamoff)position);
+            m_file.write(buffer.data(), (std::streamsize)buffer.size());
+            if (!m_file) {
+                // 写了一半的段在新旧位置上都不完整，只能丢掉，之后也不再往文件里写
+                m_liveBytes -= extent.length;
+                m_extents.erase(item.second);
+                m_failed = true;
+                return;
+            }
+            extent.offset = position;
+        }
+        position += extent.length;
+    }
+    m_size = position;
+    Shrink(position);
+}
+
+void FrontierSpill::Shrink(uint64_t length)
+{
+    m_file.close();
+    std::error_code ec;
+    fs::resize_file(m_path, length, ec);
+    // 截不短时尾部的旧数据不再被引用，之后的写入会覆盖它
+    if (!ec) m_diskSize = length;
+    Open(false);
+}
+
+bool HostFrontier::Lower(const Entry& a, const Entry& b)
+{
+    if (a.score != b.score) return a.score < b.score;
+    return a.seq > b.seq;
+}
+
+uint32_t HostFrontier::InternPrefix(std::string_view prefix)
+{
+    auto it = m_prefixIds.find(prefix);
+    if (it != m_prefixIds.end()) return it->second;
+    uint32_t id = (uint32_t)m_prefixes.size();
+    m_prefixes.emplace_back(prefix);
+    m_prefixIds.emplace(m_prefixes.back(), id);
+    return id;
+}
+
+void HostFrontier::Push(const CrawlTask& task, uint32_t seq)
+{
+    std::string_view url = task.url;
+    size_t cut = PrefixLength(url);
+    m_heap.push_back({ task.priority, seq, InternPrefix(url.substr(0, cut)),
+        (uint16_t)std::clamp(task.depth, 0, 0xFFFF), task.id, std::string(url.substr(cut)) });
+    std::push_heap(m_heap.begin(), m_heap.end(), Lower);
+}
+
+bool HostFrontier::Pop(CrawlTask& task, FrontierSpill& spill)
+{
+    while (!m_runs.empty()) {
+        size_t best = 0;
+        for (size_t i = 1; i < m_runs.size(); ++i) {
+            if (m_runs[i].best > m_runs[best].best) best = i;
+        }
+        if (!m_heap.empty() && m_runs[best].best <= m_heap.front().score) break;
+        LoadRun(best, spill);
+    }
+    if (m_heap.empty()) return false;
+    std::pop_heap(m_heap.begin(), m_heap.end(), Lower);
+    Entry& entry = m_heap.back();
+    task.url.assign(m_prefixes[entry.prefix]);
+    task.url.append(entry.leaf);
+    task.depth = entry.depth;
+    task.id = entry.id;
+    task.priority = entry.score;
+    m_heap.pop_back();
+    return true;
+}
+
+size_t HostFrontier::SpillLowest(size_t count, FrontierSpill& spill)
+{
+    count = std::min(count, m_heap.size());
+    if (count == 0) return 0;
+    // 从高到低排好后尾部就是要写出的部分，剩下的前半段本身仍是合法的堆
+    std::sort(m_heap.begin(), m_heap.end(), [](const Entry& a, const Entry& b) { return Lower(b, a); });
+    size_t keep = m_heap.size() - count;
+    std::string data;
+    for (size_t i = keep; i < m_heap.size(); ++i) {
+        const Entry& entry = m_heap[i];
+        AppendPod(data, entry.score);
+        AppendPod(data, entry.seq);
+        AppendPod(data, entry.prefix);
+        AppendPod(data, entry.depth);
+        AppendPod(data, entry.id);
+        AppendPod(data, (uint32_t)entry.leaf.size());
+        data.append(entry.leaf);
+    }
+    uint64_t id;
+    if (!spill.Write(data, id)) return 0;
+    m_runs.push_back({ id, (uint32_t)count, m_heap[keep].score });
+    m_spilled += count;
+    m_heap.resize(keep);
+    return count;
+}
+
+bool HostFrontier::LoadRun(size_t index, FrontierSpill& spill)
+{
+    Run run = m_runs[index];
+    m_runs.erase(m_runs.begin() + index);
+    m_spilled -= run.count;
+    std::string data;
+    if (!spill.Take(run.id, data)) {
+        // 读不回来的任务只能丢掉，检查点里仍记着它们
+        std::cerr << "Lost " << run.count << " spilled frontier entries\n";
+        return false;
+    }
+    size_t pos = 0;
+    for (uint32_t i = 0; i < run.count; ++i) {
+        Entry entry;
+        uint32_t length = 0;
+        if (!ReadPod(data, pos, entry.score) || !ReadPod(data, pos, entry.seq) || !ReadPod(data, pos, entry.prefix) ||
+            !ReadPod(data, pos, entry.depth) || !ReadPod(data, pos, entry.id) || !ReadPod(data, pos, length) ||
+            pos + length > data.size() || entry.prefix >= m_prefixes.size()) {
+            return false;
+        }
+        entry.leaf.assign(data, pos, length);
+        pos += length;
+        m_heap.push_back(std::move(entry));
+        std::push_heap(m_heap.begin(), m_heap.end(), Lower);
+    }
+    return true;
+}
+
+void HostFrontier::AppendScores(std::vector<float>& scores) const
+{
+    for (const auto& entry : m_heap) scores.push_back(entry.score);
+}
+
+void HostFrontier::CountScores(float threshold, size_t& below, size_t& equal) const
+{
+    below = 0;
+    equal = 0;
+    for (const auto& entry : m_heap) {
+        if (entry.score < threshold) below++;
+        else if (entry.score == threshold) equal++;
+    }
+}
+
+float HostFrontier::BestScore() const
+{
+    bool any = !m_heap.empty();
+    float best = any ? m_heap.front().score : 0;
+    for (const auto& run : m_runs) {
+        if (!any || run.best > best) best = run.best;
+        any = true;
+    }
+    return best;
+}
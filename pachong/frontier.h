@@ -0,0 +1,149 @@
+﻿#ifndef FRONTIER_H
+#define FRONTIER_H
+
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct CrawlTask;
+
+struct UrlPatternRule
+{
+    // 匹配路径加查询串：* 任意字符串，? 任意单个字符，# 一个或多个数字
+    std::string pattern;
+    double boost = 0;
+};
+
+struct FrontierOptions
+{
+    // 关闭时所有任务同分，每个主机内按入队顺序抓取
+    bool priority = true;
+    // 每深一层扣的分
+    double depthWeight = 1.0;
+    // 所有匹配的规则的分数相加
+    std::vector<UrlPatternRule> rules = { { "/info/#/*.htm", 2.0 } };
+    // 翻页和列表页扣的分，避免边界被导航链接占满
+    double paginationPenalty = 1.0;
+    // 新鲜度在 0 到 1 之间，按 URL 里的日期或上次抓取的 Last-Modified 估计，不知道时按 0.5
+    double freshnessWeight = 1.0;
+    int freshnessHorizonDays = 365;
+    // 同时可抓的主机之间，已抓得多的主机每翻一倍扣的分
+    double hostFairness = 0.5;
+    // 内存里最多保留的任务数，超出时把分数最低的写到溢出文件
+    size_t maxInMemory = 100000;
+    // 为空时使用程序目录下的 frontier.spill
+    std::string spillPath;
+};
+
+class UrlScorer
+{
+public:
+    explicit UrlScorer(const FrontierOptions& options);
+
+    // lastModified 为 0 时只从 URL 估计新鲜度
+    float Score(const std::string& url, int depth, time_t lastModified = 0) const;
+
+    static bool MatchPattern(std::string_view pattern, std::string_view text);
+    static bool LooksLikePagination(std::string_view path, std::string_view query);
+    // 不知道时返回 -1
+    static double EstimateFreshness(std::string_view path, time_t lastModified, time_t now, int horizonDays);
+
+private:
+    FrontierOptions m_options;
+};
+
+// 所有主机共用的溢出文件，只在本次运行内有效，析构时删除；断点续爬依赖检查点而不是它。
+// 每段写入后只读回一次，读回即释放：全部读回后从头复用文件，释放的空间超过一半时就地整理，
+// 文件在磁盘上的长度不超过整理阈值和仍未读回的数据两者中的较大者
+class FrontierSpill
+{
+public:
+    explicit FrontierSpill(const std::string& path);
+    ~FrontierSpill();
+    FrontierSpill(const FrontierSpill&) = delete;
+    FrontierSpill& operator=(const FrontierSpill&) = delete;
+
+    // id 交给 Take 读回
+    bool Write(const std::string& data, uint64_t& id);
+    bool Take(uint64_t id, std::string& data);
+    // 下一段的写入位置，包括还没整理掉的已释放部分
+    uint64_t Size() const { return m_size; }
+    bool Failed() const { return m_failed; }
+
+private:
+    struct Extent
+    {
+        uint64_t offset;
+        uint32_t length;
+    };
+
+    bool Open(bool truncate);
+    void Compact();
+    void Shrink(uint64_t length);
+
+    std::string m_path;
+    std::fstream m_file;
+    bool m_failed = false;
+    uint64_t m_size = 0;
+    // 文件在磁盘上的长度，写入位置退回开头后可能大于 m_size
+    uint64_t m_diskSize = 0;
+    uint64_t m_liveBytes = 0;
+    uint64_t m_nextId = 0;
+    std::unordered_map<uint64_t, Extent> m_extents;
+};
+
+// 单个主机的待抓取任务，按分数从高到低取，同分按入队顺序。主机名由调度器持有，
+// URL 拆成共享前缀（源站加目录）和叶子两部分存放
+class HostFrontier
+{
+public:
+    void Push(const CrawlTask& task, uint32_t seq);
+    // 只填 url、depth、id 和 priority；内存里的最高分低于溢出部分时先把那一段读回来
+    bool Pop(CrawlTask& task, FrontierSpill& spill);
+    // 把分数最低的至多 count 个任务写到溢出文件，返回实际写出的个数
+    size_t SpillLowest(size_t count, FrontierSpill& spill);
+    // 内存里各任务的分数，调度器据此在所有主机之间挑出要写出的部分
+    void AppendScores(std::vector<float>& scores) const;
+    void CountScores(float threshold, size_t& below, size_t& equal) const;
+
+    bool Empty() const { return m_heap.empty() && m_runs.empty(); }
+    size_t InMemory() const { return m_heap.size(); }
+    size_t Size() const { return m_heap.size() + m_spilled; }
+    // 包括溢出部分，空时返回 0
+    float BestScore() const;
+
+private:
+    struct Entry
+    {
+        float score;
+        uint32_t seq;
+        uint32_t prefix;
+        uint16_t depth;
+        uint64_t id;
+        std::string leaf;
+    };
+    struct Run
+    {
+        uint64_t id;
+        uint32_t count;
+        float best;
+    };
+
+    static bool Lower(const Entry& a, const Entry& b);
+    uint32_t InternPrefix(std::string_view prefix);
+    bool LoadRun(size_t index, FrontierSpill& spill);
+
+    std::vector<Entry> m_heap;
+    // deque 保证扩容时已有字符串不搬家，m_prefixIds 的键指向它们
+    std::deque<std::string> m_prefixes;
+    std::unordered_map<std::string_view, uint32_t> m_prefixIds;
+    std::vector<Run> m_runs;
+    size_t m_spilled = 0;
+};
+
+#endif
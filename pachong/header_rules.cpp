@@ -0,0 +1,62 @@
+#include "header_rules.h"
+#include <algorithm>
+#include <cctype>
+
+namespace
+{
+    bool EqualsNoCase(std::string_view a, std::string_view b)
+    {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); ++i) {
+            if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i])) return false;
+        }
+        return true;
+    }
+
+    std::string_view Trim(std::string_view text)
+    {
+        while (!text.empty() && isspace((unsigned char)text.front())) text.remove_prefix(1);
+        while (!text.empty() && isspace((unsigned char)text.back())) text.remove_suffix(1);
+        return text;
+    }
+}
+
+bool MatchHostPattern(std::string_view pattern, std::string_view host)
+{
+    if (pattern == "*") return true;
+    if (pattern.size() > 2 && pattern[0] == '*' && pattern[1] == '.') {
+        std::string_view domain = pattern.substr(2);
+        if (EqualsNoCase(host, domain)) return true;
+        return host.size() > domain.size() && host[host.size() - domain.size() - 1] == '.' &&
+            EqualsNoCase(host.substr(host.size() - domain.size()), domain);
+    }
+    return EqualsNoCase(pattern, host);
+}
+
+bool ParseHeaderRule(std::string_view text, HeaderRule& rule)
+{
+    text = Trim(text);
+    size_t space = text.find_first_of(" \t");
+    if (space == std::string_view::npos) return false;
+    std::string_view header = Trim(text.substr(space + 1));
+    size_t colon = header.find(':');
+    if (colon == std::string_view::npos) return false;
+    std::string_view name = Trim(header.substr(0, colon));
+    if (name.empty() || name.find_first_of(" \t") != std::string_view::npos) return false;
+    rule.hostPattern = std::string(text.substr(0, space));
+    rule.name = std::string(name);
+    rule.value = std::string(Trim(header.substr(colon + 1)));
+    return true;
+}
+
+void ApplyHeaderRules(const std::vector<HeaderRule>& rules, std::string_view host,
+    std::vector<std::pair<std::string, std::string>>& headers)
+{
+    for (const auto& rule : rules) {
+        if (!MatchHostPattern(rule.hostPattern, host)) continue;
+        headers.erase(std::remove_if(headers.begin(), headers.end(),
+            [&](const std::pair<std::string, std::string>& header) { return EqualsNoCase(header.first, rule.name); }),
+            headers.end());
+        if (!rule.value.empty()) headers.emplace_back(rule.name, rule.value);
+    }
+}
@@ -0,0 +1,25 @@
+﻿#ifndef HEADER_RULES_H
+#define HEADER_RULES_H
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+struct HeaderRule
+{
+    // 精确的主机名；"*.example.com" 匹配 example.com 及其子域名；"*" 匹配所有主机
+    std::string hostPattern;
+    std::string name;
+    // 为空时去掉同名的头，例如不发默认的 Referer
+    std::string value;
+};
+
+bool MatchHostPattern(std::string_view pattern, std::string_view host);
+// 解析 "模式 名称: 值"，用于命令行的 --header 和配置文件里的 header 项
+bool ParseHeaderRule(std::string_view text, HeaderRule& rule);
+// 按顺序应用匹配 host 的规则，同名的头（不区分大小写）被替换，所以更具体的规则应写在后面
+void ApplyHeaderRules(const std::vector<HeaderRule>& rules, std::string_view host,
+    std::vector<std::pair<std::string, std::string>>& headers);
+
+#endif
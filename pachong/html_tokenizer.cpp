@@ -0,0 +1,348 @@
+﻿#include "html_tokenizer.h"
+#include "simd_scan.h"
+#include <cstring>
+
+namespace
+{
+    inline char ToLower(char c)
+    {
+        return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+    }
+
+    inline bool IsSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+    }
+
+    inline bool IsNameChar(char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_' || c == ':';
+    }
+
+    // 查找 "</name"（忽略大小写），返回闭合标签 '>' 之后的位置
+    size_t FindRawTextEnd(std::string_view html, size_t from, std::string_view name)
+    {
+        while (from < html.size()) {
+            const char* lt = (const char*)memchr(html.data() + from, '<', html.size() - from);
+            if (!lt) return std::string_view::npos;
+            size_t pos = lt - html.data();
+            if (pos + 2 + name.size() <= html.size() && html[pos + 1] == '/' &&
+                EqualsIgnoreCase(html.substr(pos + 2, name.size()), name)) {
+                size_t gt = html.find('>', pos + 2 + name.size());
+                return gt == std::string_view::npos ? gt : gt + 1;
+            }
+            from = pos + 1;
+        }
+        return std::string_view::npos;
+    }
+
+    bool HasClassToken(std::string_view classes, std::string_view token)
+    {
+        size_t i = 0;
+        while (i < classes.size()) {
+            while (i < classes.size() && IsSpace(classes[i])) i++;
+            size_t start = i;
+            while (i < classes.size() && !IsSpace(classes[i])) i++;
+            if (i > start && EqualsIgnoreCase(classes.substr(start, i - start), token)) return true;
+        }
+        return false;
+    }
+}
+
+bool EqualsIgnoreCase(std::string_view a, std::string_view b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (ToLower(a[i]) != ToLower(b[i])) return false;
+    }
+    return true;
+}
+
+void HtmlTokenizer::Tokenize(std::string_view html, const HtmlCallbacks& callbacks)
+{
+    m_carry.clear();
+    m_rawTag.clear();
+    Run(html, true, callbacks);
+}
+
+void HtmlTokenizer::Feed(std::string_view chunk, const HtmlCallbacks& callbacks)
+{
+    // 只有上一块末尾不完整的标签/实体会被暂存，其余数据直接在调用方的缓冲区上处理
+    if (m_carry.empty()) {
+        size_t used = Run(chunk, false, callbacks);
+        m_carry.assign(chunk.data() + used, chunk.size() - used);
+    }
+    else {
+        m_carry.append(chunk.data(), chunk.size());
+        size_t used = Run(m_carry, false, callbacks);
+        m_carry.erase(0, used);
+    }
+}
+
+void HtmlTokenizer::Finish(const HtmlCallbacks& callbacks)
+{
+    if (!m_carry.empty() || !m_rawTag.empty()) {
+        Run(m_carry, true, callbacks);
+    }
+    m_carry.clear();
+    m_rawTag.clear();
+}
+
+size_t HtmlTokenizer::Run(std::string_view html, bool final, const HtmlCallbacks& callbacks)
+{
+    size_t pos = 0;
+    const size_t n = html.size();
+    if (!m_rawTag.empty()) {
+        size_t rawEnd = FindRawTextEnd(html, 0, m_rawTag);
+        if (rawEnd == std::string_view::npos) {
+            if (final) m_rawTag.clear();
+            return final ? n : KeepRawTextTail(html, 0);
+        }
+        m_rawTag.clear();
+        pos = rawEnd;
+    }
+    while (pos < n) {
+        const char* lt = (const char*)memchr(html.data() + pos, '<', n - pos);
+        size_t tagStart = lt ? (size_t)(lt - html.data()) : n;
+        size_t tagEnd = (tagStart < n) ? html.find('>', tagStart + 1) : std::string_view::npos;
+        if (tagEnd == std::string_view::npos && tagStart < n) {
+            if (!final) {
+                // 标签还没收完，等下一块
+                if (tagStart > pos && callbacks.onText) callbacks.onText(html.substr(pos, tagStart - pos));
+                return tagStart;
+            }
+            // 与原来的 <[^>]*> 一致：没有闭合 '>' 的 '<' 连同其后内容都按文本处理
+            tagStart = n;
+        }
+        if (tagStart > pos && callbacks.onText) {
+            size_t textEnd = (!final && tagStart == n) ? KeepEntityTail(html, pos) : tagStart;
+            if (textEnd > pos) callbacks.onText(html.substr(pos, textEnd - pos));
+            if (textEnd < tagStart) return textEnd;
+        }
+        if (tagStart >= n) break;
+
+        std::string_view body = html.substr(tagStart + 1, tagEnd - tagStart - 1);
+        pos = tagEnd + 1;
+        if (body.empty() || body[0] == '/' || body[0] == '!' || body[0] == '?') continue;
+        size_t nameEnd = 0;
+        while (nameEnd < body.size() && IsNameChar(body[nameEnd])) nameEnd++;
+        std::string_view name = body.substr(0, nameEnd);
+        if (name.empty()) continue;
+
+        if (EqualsIgnoreCase(name, "script") || EqualsIgnoreCase(name, "style")) {
+            size_t rawEnd = FindRawTextEnd(html, pos, name);
+            if (rawEnd == std::string_view::npos) {
+                if (final) return n;
+                m_rawTag.assign(name.data(), name.size());
+                return KeepRawTextTail(html, pos);
+            }
+            pos = rawEnd;
+            continue;
+        }
+        if (!callbacks.onLink && !callbacks.onMedia) continue;
+        ParseAttributes(body.substr(nameEnd));
+        HandleTag(name, callbacks);
+    }
+    return n;
+}
+
+size_t HtmlTokenizer::KeepRawTextTail(std::string_view html, size_t from) const
+{
+    // 闭合标签可能被切在块边界上，保留最后一个 '<' 起的一小段
+    size_t lastLt = html.rfind('<');
+    if (lastLt != std::string_view::npos && lastLt >= from && html.size() - lastLt <= 64) return lastLt;
+    return html.size();
+}
+
+size_t HtmlTokenizer::KeepEntityTail(std::string_view html, size_t from) const
+{
+    size_t n = html.size();
+    size_t limit = (n - from > 12) ? n - 12 : from;
+    for (size_t i = n; i > limit; --i) {
+        char c = html[i - 1];
+        if (c == ';') break;
+        if (c == '&') return i - 1;
+    }
+    return n;
+}
+
+void HtmlTokenizer::ParseAttributes(std::string_view body)
+{
+    m_attributes.clear();
+    size_t i = 0;
+    const size_t n = body.size();
+    while (i < n) {
+        while (i < n && (IsSpace(body[i]) || body[i] == '/')) i++;
+        size_t nameStart = i;
+        while (i < n && !IsSpace(body[i]) && body[i] != '=' && body[i] != '/') i++;
+        std::string_view name = body.substr(nameStart, i - nameStart);
+        while (i < n && IsSpace(body[i])) i++;
+        std::string_view value;
+        if (i < n && body[i] == '=') {
+            i++;
+            while (i < n && IsSpace(body[i])) i++;
+            if (i < n && (body[i] == '"' || body[i] == '\'')) {
+                char quote = body[i++];
+                size_t valueStart = i;
+                while (i < n && body[i] != quote) i++;
+                value = body.substr(valueStart, i - valueStart);
+                if (i < n) i++;
+            }
+            else {
+                size_t valueStart = i;
+                while (i < n && !IsSpace(body[i])) i++;
+                value = body.substr(valueStart, i - valueStart);
+            }
+        }
+        if (!name.empty()) m_attributes.emplace_back(name, value);
+    }
+}
+
+std::string_view HtmlTokenizer::FindAttribute(std::string_view name) const
+{
+    for (const auto& attribute : m_attributes) {
+        if (EqualsIgnoreCase(attribute.first, name)) return attribute.second;
+    }
+    return std::string_view();
+}
+
+void HtmlTokenizer::HandleTag(std::string_view name, const HtmlCallbacks& callbacks)
+{
+    if (EqualsIgnoreCase(name, "a")) {
+        std::string_view href = FindAttribute("href");
+        if (callbacks.onLink && !href.empty() && href.find('#') == std::string_view::npos) {
+            callbacks.onLink(href);
+        }
+        return;
+    }
+    if (!callbacks.onMedia) return;
+    if (EqualsIgnoreCase(name, "img") || EqualsIgnoreCase(name, "source") || EqualsIgnoreCase(name, "audio")) {
+        std::string_view src = FindAttribute("src");
+        if (!src.empty()) callbacks.onMedia(src);
+    }
+    else if (EqualsIgnoreCase(name, "video")) {
+        std::string_view src = FindAttribute("src");
+        if (!src.empty()) callbacks.onMedia(src);
+        std::string_view poster = FindAttribute("poster");
+        if (!poster.empty()) callbacks.onMedia(poster);
+    }
+    else if (EqualsIgnoreCase(name, "div")) {
+        // 山东理工站点的视频播放器：<div class="wp_video_player" sudy-wp-src="...">
+        if (!HasClassToken(FindAttribute("class"), "wp_video_player")) return;
+        std::string_view src = FindAttribute("sudy-wp-src");
+        if (!src.empty()) callbacks.onMedia(src);
+    }
+}
+
+size_t DecodeHtmlEntity(std::string_view s, char* out, size_t& outLen)
+{
+    static const struct { std::string_view name; char value; } entities[] = {
+        { "&nbsp;", ' ' }, { "&amp;", '&' }, { "&lt;", '<' }, { "&gt;", '>' },
+        { "&quot;", '"' }, { "&apos;", '\'' },
+    };
+    if (s.size() < 3 || s[0] != '&') return 0;
+    if (s[1] != '#') {
+        for (const auto& entity : entities) {
+            if (s.compare(0, entity.name.size(), entity.name) == 0) {
+                out[0] = entity.value;
+                outLen = 1;
+                return entity.name.size();
+            }
+        }
+        return 0;
+    }
+    bool hex = (s[2] == 'x' || s[2] == 'X');
+    size_t i = hex ? 3 : 2;
+    size_t digitsStart = i;
+    uint32_t cp = 0;
+    while (i < s.size() && i - digitsStart < 8) {
+        char c = s[i];
+        int digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (hex && c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else if (hex && c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else break;
+        cp = cp * (hex ? 16 : 10) + digit;
+        i++;
+    }
+    if (i == digitsStart || i >= s.size() || s[i] != ';') return 0;
+    if (cp == 0 || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return 0;
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        outLen = 1;
+    }
+    else if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        outLen = 2;
+    }
+    else if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        outLen = 3;
+    }
+    else {
+        out[0] = (char)(0xF0 | (cp >> 18));
+        out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[3] = (char)(0x80 | (cp & 0x3F));
+        outLen = 4;
+    }
+    return i + 1;
+}
+
+HtmlTextBuilder::HtmlTextBuilder(std::string& out)
+    : m_out(out)
+{
+    m_out.clear();
+}
+
+void HtmlTextBuilder::Emit(const char* data, size_t size)
+{
+    if (m_pendingSpace && !m_out.empty()) m_out.push_back(' ');
+    m_pendingSpace = false;
+    m_out.append(data, size);
+}
+
+void HtmlTextBuilder::Append(std::string_view raw)
+{
+    const char* p = raw.data();
+    const char* end = p + raw.size();
+    while (p < end) {
+        // 普通字节整段拷贝，只在 '&'、空白等特殊字节处停下
+        const char* special = simd::FindTextSpecial(p, end);
+        if (special > p) {
+            Emit(p, special - p);
+            p = special;
+            if (p == end) break;
+        }
+        char c = *p;
+        if (c == '&') {
+            char decoded[4];
+            size_t decodedLen = 0;
+            size_t len = DecodeHtmlEntity(std::string_view(p, end - p), decoded, decodedLen);
+            if (len == 0) {
+                Emit(p, 1);
+                p++;
+            }
+            else if (decodedLen == 1 && IsSpace(decoded[0])) {
+                // &nbsp; 等解码出的空白与其它空白一起合并
+                m_pendingSpace = true;
+                p += len;
+            }
+            else {
+                Emit(decoded, decodedLen);
+                p += len;
+            }
+        }
+        else if (IsSpace(c)) {
+            m_pendingSpace = true;
+            p++;
+        }
+        else {
+            Emit(p, 1);
+            p++;
+        }
+    }
+}
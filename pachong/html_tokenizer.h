@@ -0,0 +1,64 @@
+﻿#ifndef HTML_TOKENIZER_H
+#define HTML_TOKENIZER_H
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+struct HtmlCallbacks
+{
+    // <a href>，值中含 '#' 的链接与原正则一样被忽略
+    std::function<void(std::string_view)> onLink;
+    // img/video/audio/source 的 src、video 的 poster 以及 wp_video_player 的 sudy-wp-src
+    std::function<void(std::string_view)> onMedia;
+    // 标签之外、script/style 之外的原始文本片段，实体尚未解码
+    std::function<void(std::string_view)> onText;
+};
+
+// 一次线性扫描完成标签、属性和可见文本的切分，不回溯
+class HtmlTokenizer
+{
+public:
+    void Tokenize(std::string_view html, const HtmlCallbacks& callbacks);
+    // 流式接口：数据边到边解析，最后调用 Finish 处理剩余部分
+    void Feed(std::string_view chunk, const HtmlCallbacks& callbacks);
+    void Finish(const HtmlCallbacks& callbacks);
+
+private:
+    using Attribute = std::pair<std::string_view, std::string_view>;
+
+    // 返回已消费的字节数；final 为 false 时不完整的结尾留给下一块
+    size_t Run(std::string_view html, bool final, const HtmlCallbacks& callbacks);
+    size_t KeepRawTextTail(std::string_view html, size_t from) const;
+    size_t KeepEntityTail(std::string_view html, size_t from) const;
+
+    void ParseAttributes(std::string_view body);
+    std::string_view FindAttribute(std::string_view name) const;
+    void HandleTag(std::string_view name, const HtmlCallbacks& callbacks);
+
+    std::vector<Attribute> m_attributes;
+    std::string m_carry;
+    std::string m_rawTag;
+};
+
+// 把 onText 收到的片段直接写入调用方的缓冲区：解码实体、合并空白，首尾不留空格
+class HtmlTextBuilder
+{
+public:
+    explicit HtmlTextBuilder(std::string& out);
+    void Append(std::string_view raw);
+
+private:
+    void Emit(const char* data, size_t size);
+
+    std::string& m_out;
+    bool m_pendingSpace = false;
+};
+
+// 解码 &name; / &#NNN; / &#xHH;，成功时把 UTF-8 写入 out（至少 4 字节）并返回实体长度，否则返回 0
+size_t DecodeHtmlEntity(std::string_view s, char* out, size_t& outLen);
+bool EqualsIgnoreCase(std::string_view a, std::string_view b);
+
+#endif
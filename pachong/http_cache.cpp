@@ -0,0 +1,201 @@
+﻿#include "http_cache.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // 字段以 '\t' 分隔、记录以 '\n' 结束，含这两个字符的值无法保存
+    bool IsStorable(const std::string& value)
+    {
+        return value.find_first_of("\t\r\n") == std::string::npos;
+    }
+
+    void SplitFields(const std::string& line, std::vector<std::string>& fields)
+    {
+        fields.clear();
+        size_t start = 0;
+        for (;;) {
+            size_t tab = line.find('\t', start);
+            if (tab == std::string::npos) {
+                fields.push_back(line.substr(start));
+                return;
+            }
+            fields.push_back(line.substr(start, tab - start));
+            start = tab + 1;
+        }
+    }
+
+    time_t ToUnixTime(struct tm& utc)
+    {
+#ifdef _WIN32
+        return _mkgmtime(&utc);
+#else
+        return timegm(&utc);
+#endif
+    }
+}
+
+bool ParseHttpDate(const std::string& value, time_t& result)
+{
+    static const char* const kMonths[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct",
+        "Nov", "Dec" };
+    char month[4] = { 0 };
+    struct tm utc = {};
+    size_t comma = value.find(',');
+    const char* p = value.c_str() + (comma == std::string::npos ? 0 : comma + 1);
+    if (sscanf(p, "%d %3s %d %d:%d:%d", &utc.tm_mday, month, &utc.tm_year, &utc.tm_hour, &utc.tm_min,
+        &utc.tm_sec) != 6) {
+        return false;
+    }
+    utc.tm_mon = -1;
+    for (int i = 0; i < 12; ++i) {
+        if (strcmp(month, kMonths[i]) == 0) utc.tm_mon = i;
+    }
+    if (utc.tm_mon < 0) return false;
+    utc.tm_year -= 1900;
+    result = ToUnixTime(utc);
+    return result != (time_t)-1;
+}
+
+HttpCacheIndex::HttpCacheIndex(const std::string& path)
+    : m_path(path)
+{
+    std::ifstream in(m_path, std::ios::binary);
+    std::string line;
+    std::vector<std::string> fields;
+    while (std::getline(in, line)) {
+        // url \t etag \t lastModified \t contentHash \t #标志 \t 链接数 [\t link]... [\t media]...，
+        // 同一 URL 以最后一条为准。旧格式在 contentHash 之后直接是链接，链接都是绝对地址，不会以 # 开头
+        SplitFields(line, fields);
+        if (fields.size() < 4 || fields[0].empty()) continue;
+        CacheEntry& entry = m_entries[fields[0]];
+        entry.etag = std::move(fields[1]);
+        entry.lastModified = std::move(fields[2]);
+        entry.contentHash = std::move(fields[3]);
+        entry.complete = fields.size() >= 6 && !fields[4].empty() && fields[4][0] == '#';
+        auto links = fields.begin() + 4;
+        auto media = fields.end();
+        entry.externalLinks = false;
+        entry.nearDuplicate = false;
+        entry.indexed = false;
+        if (entry.complete) {
+            // x：含外站链接；d：近似重复；i：已写进索引段
+            entry.externalLinks = fields[4].find('x') != std::string::npos;
+            entry.nearDuplicate = fields[4].find('d') != std::string::npos;
+            entry.indexed = fields[4].find('i') != std::string::npos;
+            links += 2;
+            size_t count = (size_t)strtoull(fields[5].c_str(), nullptr, 10);
+            media = links + (ptrdiff_t)std::min(count, (size_t)(fields.end() - links));
+        }
+        entry.links.assign(std::make_move_iterator(links), std::make_move_iterator(media));
+        entry.mediaUrls.assign(std::make_move_iterator(media), std::make_move_iterator(fields.end()));
+    }
+    in.close();
+    std::error_code ec;
+    fs::path parent = fs::path(m_path).parent_path();
+    if (!parent.empty()) fs::create_directories(parent, ec);
+    m_log.open(m_path, std::ios::binary | std::ios::app);
+    m_ready = m_log.is_open();
+}
+
+bool HttpCacheIndex::Lookup(const std::string& url, CacheEntry& entry)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(url);
+    if (it == m_entries.end()) return false;
+    entry = it->second;
+    return true;
+}
+
+bool HttpCacheIndex::LookupLastModified(const std::string& url, std::string& lastModified)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(url);
+    if (it == m_entries.end() || it->second.lastModified.empty()) return false;
+    lastModified = it->second.lastModified;
+    return true;
+}
+
+void HttpCacheIndex::AppendRecordLocked(std::ofstream& out, const std::string& url, const CacheEntry& entry)
+{
+    out << url << '\t' << (IsStorable(entry.etag) ? entry.etag : "") << '\t'
+        << (IsStorable(entry.lastModified) ? entry.lastModified : "") << '\t' << entry.contentHash << "\t#"
+        << (entry.externalLinks ? "x" : "") << (entry.nearDuplicate ? "d" : "") << (entry.indexed ? "i" : "");
+    size_t linkCount = std::count_if(entry.links.begin(), entry.links.end(), IsStorable);
+    out << '\t' << linkCount;
+    for (const auto& link : entry.links) {
+        if (IsStorable(link)) out << '\t' << link;
+    }
+    for (const auto& url : entry.mediaUrls) {
+        if (IsStorable(url)) out << '\t' << url;
+    }
+    out << '\n';
+}
+
+void HttpCacheIndex::Update(const std::string& url, const CacheEntry& entry)
+{
+    if (!IsStorable(url)) return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries[url] = entry;
+    m_dirty = true;
+    if (m_log.is_open()) {
+        AppendRecordLocked(m_log, url, entry);
+        m_log.flush();
+    }
+}
+
+void HttpCacheIndex::MarkIndexed(const std::string& url)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(url);
+    if (it == m_entries.end() || it->second.indexed) return;
+    it->second.indexed = true;
+    m_dirty = true;
+    if (m_log.is_open()) {
+        AppendRecordLocked(m_log, url, it->second);
+        m_log.flush();
+    }
+}
+
+std::vector<std::string> HttpCacheIndex::Select(const std::function<bool(const CacheEntry&)>& match)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<std::string> urls;
+    for (const auto& item : m_entries) {
+        if (match(item.second)) urls.push_back(item.first);
+    }
+    return urls;
+}
+
+bool HttpCacheIndex::Compact()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_dirty) return true;
+    std::string tempPath = m_path + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) return false;
+        for (const auto& item : m_entries) AppendRecordLocked(out, item.first, item.second);
+        out.close();
+        if (out.fail()) return false;
+    }
+    m_log.close();
+    std::error_code ec;
+    fs::rename(tempPath, m_path, ec);
+    m_log.open(m_path, std::ios::binary | std::ios::app);
+    if (ec) return false;
+    m_dirty = false;
+    return true;
+}
+
+size_t HttpCacheIndex::Size()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
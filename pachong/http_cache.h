@@ -0,0 +1,70 @@
+﻿#ifndef HTTP_CACHE_H
+#define HTTP_CACHE_H
+
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct HttpCacheOptions
+{
+    bool enabled = true;
+    // 为空时使用程序目录下的 http_cache.tsv
+    std::string path;
+};
+
+struct CacheEntry
+{
+    std::string etag;
+    std::string lastModified;
+    // 响应体的 SHA-256，服务器不支持校验头时用来判断内容是否变化
+    std::string contentHash;
+    // 页面上的同源链接，内容未变时直接用它们继续向下抓取
+    std::vector<std::string> links;
+    // 页面引用的媒体地址，内容未变时补下上次没下完的
+    std::vector<std::string> mediaUrls;
+    // 解析时跟随了外站链接，links 里含其他站点的地址
+    bool externalLinks = false;
+    // 当时被判为近似重复，按别名归档，没有进索引
+    bool nearDuplicate = false;
+    // 正文已经写进索引段；进程在写段之前被杀掉时保持 false，下次重新索引
+    bool indexed = false;
+    // 旧格式的记录没有媒体地址，需要重新取回正文解析
+    bool complete = false;
+};
+
+// IMF-fixdate，例如 "Sun, 06 Nov 1994 08:49:37 GMT"
+bool ParseHttpDate(const std::string& value, time_t& result);
+
+// 跨运行保留的 URL -> 校验信息索引。更新以追加日志的形式写入，Compact 时重写为每个 URL 一行。线程安全
+class HttpCacheIndex
+{
+public:
+    explicit HttpCacheIndex(const std::string& path);
+
+    bool IsReady() const { return m_ready; }
+    bool Lookup(const std::string& url, CacheEntry& entry);
+    // 只取 Last-Modified，不复制链接列表
+    bool LookupLastModified(const std::string& url, std::string& lastModified);
+    void Update(const std::string& url, const CacheEntry& entry);
+    void MarkIndexed(const std::string& url);
+    // 记录满足 match 的 URL
+    std::vector<std::string> Select(const std::function<bool(const CacheEntry&)>& match);
+    bool Compact();
+    size_t Size();
+
+private:
+    void AppendRecordLocked(std::ofstream& out, const std::string& url, const CacheEntry& entry);
+
+    std::string m_path;
+    bool m_ready = false;
+    bool m_dirty = false;
+    std::mutex m_mutex;
+    std::unordered_map<std::string, CacheEntry> m_entries;
+    std::ofstream m_log;
+};
+
+#endif
@@ -0,0 +1,479 @@
+﻿#include "index_query.h"
+#include "text_tokenizer.h"
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+    struct QueryNode
+    {
+        enum class Kind
+        {
+            Phrase,
+            Prefix,
+            And,
+            Or,
+            Not
+        };
+        Kind kind = Kind::And;
+        // Phrase：词和它在短语里的相对位置；只有一个词时就是普通的词查询
+        std::vector<std::pair<std::string, uint32_t>> terms;
+        // Prefix：单个汉字
+        std::string prefix;
+        std::vector<QueryNode> children;
+    };
+
+    class QueryParser
+    {
+    public:
+        explicit QueryParser(std::string_view text) : m_text(text) {}
+
+        bool Parse(QueryNode& root, std::string& error)
+        {
+            if (!ParseAnd(root)) {
+                error = m_error;
+                return false;
+            }
+            if (m_offset < m_text.size()) {
+                error = "unexpected ')'";
+                return false;
+            }
+            if (root.kind == QueryNode::Kind::And && root.children.empty()) {
+                error = "empty query";
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        static bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+        void SkipSpaces()
+        {
+            while (m_offset < m_text.size() && IsSpace(m_text[m_offset])) ++m_offset;
+        }
+
+        bool AtOr()
+        {
+            SkipSpaces();
+            return m_text.compare(m_offset, 2, "OR") == 0 &&
+                (m_offset + 2 == m_text.size() || IsSpace(m_text[m_offset + 2]) || m_text[m_offset + 2] == '(' ||
+                    m_text[m_offset + 2] == '"');
+        }
+
+        // 只剩一个子节点的 And/Or 直接换成子节点
+        static void Collapse(QueryNode& node)
+        {
+            if ((node.kind == QueryNode::Kind::And || node.kind == QueryNode::Kind::Or) && node.children.size() == 1) {
+                QueryNode child = std::move(node.children[0]);
+                node = std::move(child);
+            }
+        }
+
+        // 和搜索引擎的习惯一致，OR 比空格结合得紧：a OR b c 即 (a OR b) c
+        bool ParseAnd(QueryNode& node)
+        {
+            node = QueryNode();
+            node.kind = QueryNode::Kind::And;
+            for (;;) {
+                SkipSpaces();
+                if (m_offset >= m_text.size() || m_text[m_offset] == ')') break;
+                if (AtOr()) {
+                    m_error = "OR needs a term on both sides";
+                    return false;
+                }
+                QueryNode item;
+                bool empty = false;
+                if (!ParseOr(item, empty)) return false;
+                if (!empty) node.children.push_back(std::move(item));
+            }
+            bool positive = node.children.empty();
+            for (const auto& child : node.children) {
+                if (child.kind != QueryNode::Kind::Not) positive = true;
+            }
+            if (!positive) {
+                m_error = "a query cannot only exclude terms";
+                return false;
+            }
+            Collapse(node);
+            return true;
+        }
+
+        bool ParseOr(QueryNode& node, bool& empty)
+        {
+            if (!ParseUnary(node, empty)) return false;
+            if (!AtOr()) return true;
+            QueryNode first = std::move(node);
+            node = QueryNode();
+            node.kind = QueryNode::Kind::Or;
+            if (!empty) node.children.push_back(std::move(first));
+            while (AtOr()) {
+                m_offset += 2;
+                SkipSpaces();
+                QueryNode next;
+                bool nextEmpty = false;
+                if (m_offset >= m_text.size() || m_text[m_offset] == ')' || !ParseUnary(next, nextEmpty)) {
+                    if (m_error.empty()) m_error = "OR needs a term on both sides";
+                    return false;
+                }
+                if (!nextEmpty) node.children.push_back(std::move(next));
+            }
+            for (const auto& child : node.children) {
+                if (child.kind == QueryNode::Kind::Not) {
+                    m_error = "excluded terms cannot be combined with OR";
+                    return false;
+                }
+            }
+            empty = node.children.empty();
+            Collapse(node);
+            return true;
+        }
+
+        bool ParseUnary(QueryNode& node, bool& empty)
+        {
+            if (m_text[m_offset] != '-') return ParsePrimary(node, empty);
+            ++m_offset;
+            if (m_offset >= m_text.size() || IsSpace(m_text[m_offset]) || m_text[m_offset] == ')') {
+                empty = true;
+                return true;
+            }
+            QueryNode item;
+            if (!ParsePrimary(item, empty)) return false;
+            node = QueryNode();
+            node.kind = QueryNode::Kind::Not;
+            node.children.push_back(std::move(item));
+            return true;
+        }
+
+        bool ParsePrimary(QueryNode& node, bool& empty)
+        {
+            if (m_text[m_offset] == '(') {
+                ++m_offset;
+                if (!ParseAnd(node)) return false;
+                if (m_offset >= m_text.size() || m_text[m_offset] != ')') {
+                    m_error = "missing ')'";
+                    return false;
+                }
+                ++m_offset;
+                empty = node.kind == QueryNode::Kind::And && node.children.empty();
+                return true;
+            }
+            std::string_view text;
+            if (m_text[m_offset] == '"') {
+                size_t close = m_text.find('"', m_offset + 1);
+                if (close == std::string_view::npos) {
+                    m_error = "missing closing quote";
+                    return false;
+                }
+                text = m_text.substr(m_offset + 1, close - m_offset - 1);
+                m_offset = close + 1;
+            }
+            else {
+                size_t start = m_offset;
+                while (m_offset < m_text.size() && !IsSpace(m_text[m_offset]) && m_text[m_offset] != '(' &&
+                    m_text[m_offset] != ')' && m_text[m_offset] != '"') ++m_offset;
+                text = m_text.substr(start, m_offset - start);
+            }
+            // 词和短语用查询模式分词，得到的词连同相对位置组成短语
+            node = QueryNode();
+            node.kind = QueryNode::Kind::Phrase;
+            TextTokenizer tokenizer(text, TokenizeMode::Query);
+            std::string_view term;
+            uint32_t position = 0;
+            uint32_t firstPosition = 0;
+            while (tokenizer.Next(term, position)) {
+                if (node.terms.empty()) firstPosition = position;
+                node.terms.emplace_back(std::string(term), position - firstPosition);
+            }
+            empty = node.terms.empty();
+            if (node.terms.size() == 1 && TextTokenizer::IsSingleCjk(node.terms[0].first)) {
+                node.kind = QueryNode::Kind::Prefix;
+                node.prefix = std::move(node.terms[0].first);
+                node.terms.clear();
+            }
+            return true;
+        }
+
+        std::string_view m_text;
+        size_t m_offset = 0;
+        std::string m_error;
+    };
+
+    using DocList = std::vector<uint32_t>;
+
+    // 在一个段上求值。And 先算估计命中最少的子节点，其余子节点只在这些候选上过滤，
+    // 过滤时倒排表游标用跳表前进，不必解码整张表
+    class SegmentEvaluator
+    {
+    public:
+        explicit SegmentEvaluator(const IndexSegment& segment) : m_segment(segment) {}
+
+        uint64_t Estimate(const QueryNode& node) const
+        {
+            switch (node.kind) {
+            case QueryNode::Kind::Phrase: {
+                uint64_t smallest = UINT64_MAX;
+                for (const auto& term : node.terms) {
+                    const IndexTermEntry* entry = m_segment.Find(term.first);
+                    smallest = std::min<uint64_t>(smallest, entry ? entry->docFreq : 0);
+                }
+                return smallest;
+            }
+            case QueryNode::Kind::Prefix: {
+                uint64_t first = 0, last = 0, total = 0;
+                m_segment.PrefixRange(node.prefix, first, last);
+                for (uint64_t i = first; i < last; ++i) total += m_segment.Term(i).docFreq;
+                return total;
+            }
+            case QueryNode::Kind::And: {
+                uint64_t smallest = m_segment.DocCount();
+                for (const auto& child : node.children) {
+                    if (child.kind != QueryNode::Kind::Not) smallest = std::min(smallest, Estimate(child));
+                }
+                return smallest;
+            }
+            case QueryNode::Kind::Or: {
+                uint64_t total = 0;
+                for (const auto& child : node.children) total += Estimate(child);
+                return total;
+            }
+            case QueryNode::Kind::Not:
+                return m_segment.DocCount();
+            }
+            return 0;
+        }
+
+        DocList Eval(const QueryNode& node) const
+        {
+            switch (node.kind) {
+            case QueryNode::Kind::Phrase: {
+                // 从最少见的词开始
+                size_t rarest = 0;
+                uint64_t rarestFreq = UINT64_MAX;
+                for (size_t i = 0; i < node.terms.size(); ++i) {
+                    const IndexTermEntry* entry = m_segment.Find(node.terms[i].first);
+                    if (!entry) return {};
+                    if (entry->docFreq < rarestFreq) {
+                        rarestFreq = entry->docFreq;
+                        rarest = i;
+                    }
+                }
+                DocList docs = Decode(*m_segment.Find(node.terms[rarest].first));
+                return node.terms.size() == 1 ? docs : Filter(node, docs);
+            }
+            case QueryNode::Kind::Prefix: {
+                uint64_t first = 0, last = 0;
+                m_segment.PrefixRange(node.prefix, first, last);
+                if (last - first == 1) return Decode(m_segment.Term(first));
+                // 常用字开头的词可能有上千个，逐个合并太慢，按文档打标记
+                std::vector<uint8_t> marks(m_segment.DocCount(), 0);
+                for (uint64_t i = first; i < last; ++i) {
+                    PostingCursor cursor = m_segment.Cursor(m_segment.Term(i));
+                    while (cursor.Next()) marks[cursor.Doc()] = 1;
+                }
+                DocList docs;
+                for (uint32_t doc = 0; doc < marks.size(); ++doc) {
+                    if (marks[doc]) docs.push_back(doc);
+                }
+                return docs;
+            }
+            case QueryNode::Kind::And: {
+                std::vector<const QueryNode*> order;
+                for (const auto& child : node.children) order.push_back(&child);
+                std::vector<uint64_t> estimates;
+                for (const auto* child : order) {
+                    estimates.push_back(child->kind == QueryNode::Kind::Not ? UINT64_MAX : Estimate(*child));
+                }
+                size_t best = std::min_element(estimates.begin(), estimates.end()) - estimates.begin();
+                DocList docs = Eval(*order[best]);
+                for (size_t i = 0; i < order.size() && !docs.empty(); ++i) {
+                    if (i != best) docs = Filter(*order[i], docs);
+                }
+                return docs;
+            }
+            case QueryNode::Kind::Or: {
+                DocList docs;
+                for (const auto& child : node.children) docs = Union(docs, Eval(child));
+                return docs;
+            }
+            case QueryNode::Kind::Not: {
+                DocList all(m_segment.DocCount());
+                for (uint32_t i = 0; i < all.size(); ++i) all[i] = i;
+                return Difference(all, Eval(node.children[0]));
+            }
+            }
+            return {};
+        }
+
+        // 候选里满足 node 的那些
+        DocList Filter(const QueryNode& node, const DocList& candidates) const
+        {
+            switch (node.kind) {
+            case QueryNode::Kind::Phrase:
+                return FilterPhrase(node, candidates);
+            case QueryNode::Kind::Prefix:
+                return Intersect(candidates, Eval(node));
+            case QueryNode::Kind::And: {
+                DocList docs = candidates;
+                for (const auto& child : node.children) {
+                    if (docs.empty()) break;
+                    docs = Filter(child, docs);
+                }
+                return docs;
+            }
+            case QueryNode::Kind::Or: {
+                DocList docs;
+                for (const auto& child : node.children) docs = Union(docs, Filter(child, candidates));
+                return docs;
+            }
+            case QueryNode::Kind::Not:
+                return Difference(candidates, Filter(node.children[0], candidates));
+            }
+            return {};
+        }
+
+    private:
+        DocList Decode(const IndexTermEntry& term) const
+        {
+            DocList docs;
+            docs.reserve(term.docFreq);
+            PostingCursor cursor = m_segment.Cursor(term);
+            while (cursor.Next()) docs.push_back(cursor.Doc());
+            return docs;
+        }
+
+        DocList FilterPhrase(const QueryNode& node, const DocList& candidates) const
+        {
+            std::vector<PostingCursor> cursors;
+            cursors.reserve(node.terms.size());
+            for (const auto& term : node.terms) {
+                const IndexTermEntry* entry = m_segment.Find(term.first);
+                if (!entry) return {};
+                cursors.push_back(m_segment.Cursor(*entry));
+            }
+            DocList docs;
+            std::vector<std::vector<uint32_t>> positions(cursors.size());
+            for (uint32_t doc : candidates) {
+                bool present = true;
+                for (auto& cursor : cursors) {
+                    if (!cursor.SkipTo(doc)) return docs;
+                    if (cursor.Doc() != doc) present = false;
+                }
+                if (!present) continue;
+                if (cursors.size() == 1) {
+                    docs.push_back(doc);
+                    continue;
+                }
+                for (size_t i = 0; i < cursors.size(); ++i) cursors[i].Positions(positions[i]);
+                if (MatchesPhrase(node, positions)) docs.push_back(doc);
+            }
+            return docs;
+        }
+
+        // 第一个词出现在 p 时，其余各词要出现在 p 加上相对位置处
+        static bool MatchesPhrase(const QueryNode& node, const std::vector<std::vector<uint32_t>>& positions)
+        {
+            for (uint32_t start : positions[0]) {
+                bool all = true;
+                for (size_t i = 1; i < positions.size() && all; ++i) {
+                    uint32_t wanted = start + node.terms[i].second;
+                    all = std::binary_search(positions[i].begin(), positions[i].end(), wanted);
+                }
+                if (all) return true;
+            }
+            return false;
+        }
+
+        static DocList Union(const DocList& a, const DocList& b)
+        {
+            DocList out;
+            out.reserve(a.size() + b.size());
+            std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(out));
+            return out;
+        }
+
+        static DocList Intersect(const DocList& a, const DocList& b)
+        {
+            DocList out;
+            std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(out));
+            return out;
+        }
+
+        static DocList Difference(const DocList& a, const DocList& b)
+        {
+            DocList out;
+            std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(out));
+            return out;
+        }
+
+        const IndexSegment& m_segment;
+    };
+
+    struct HitCandidate
+    {
+        int64_t fetchTimeMs;
+        uint64_t fingerprint;
+        const IndexSegment* segment;
+        uint32_t local;
+    };
+
+    // 小顶堆，堆顶是已选中的最旧的一条
+    bool NewerFirst(const HitCandidate& a, const HitCandidate& b)
+    {
+        return a.fetchTimeMs > b.fetchTimeMs;
+    }
+}
+
+bool IndexSearcher::Open(const std::vector<std::string>& directories)
+{
+    m_segments.clear();
+    for (const auto& directory : directories) {
+        for (auto& segment : OpenIndexSegments(directory)) m_segments.push_back(std::move(segment));
+    }
+    return !m_segments.empty();
+}
+
+uint64_t IndexSearcher::DocCount() const
+{
+    uint64_t total = 0;
+    for (const auto& segment : m_segments) total += segment->DocCount();
+    return total;
+}
+
+bool IndexSearcher::Search(std::string_view query, size_t limit, SearchResults& results, std::string& error) const
+{
+    results = SearchResults();
+    QueryNode root;
+    QueryParser parser(query);
+    if (!parser.Parse(root, error)) return false;
+    std::vector<HitCandidate> heap;
+    // 段内编号大致随抓取时间递增，倒着扫，堆很快被新页面填满，后面的候选多数直接淘汰
+    for (auto segment = m_segments.rbegin(); segment != m_segments.rend(); ++segment) {
+        SegmentEvaluator evaluator(**segment);
+        DocList docs = evaluator.Eval(root);
+        results.matches += docs.size();
+        for (auto doc = docs.rbegin(); doc != docs.rend() && limit > 0; ++doc) {
+            const IndexDocEntry& entry = (*segment)->Doc(*doc);
+            if (heap.size() == limit && entry.fetchTimeMs <= heap.front().fetchTimeMs) continue;
+            auto same = std::find_if(heap.begin(), heap.end(),
+                [&](const HitCandidate& hit) { return hit.fingerprint == entry.urlFingerprint; });
+            if (same != heap.end()) {
+                if (same->fetchTimeMs >= entry.fetchTimeMs) continue;
+                *same = { entry.fetchTimeMs, entry.urlFingerprint, segment->get(), *doc };
+                std::make_heap(heap.begin(), heap.end(), NewerFirst);
+                continue;
+            }
+            if (heap.size() == limit) {
+                std::pop_heap(heap.begin(), heap.end(), NewerFirst);
+                heap.pop_back();
+            }
+            heap.push_back({ entry.fetchTimeMs, entry.urlFingerprint, segment->get(), *doc });
+            std::push_heap(heap.begin(), heap.end(), NewerFirst);
+        }
+    }
+    std::sort_heap(heap.begin(), heap.end(), NewerFirst);
+    for (const auto& hit : heap) {
+        results.hits.push_back({ std::string(hit.segment->Url(hit.local)), hit.fetchTimeMs });
+    }
+    return true;
+}
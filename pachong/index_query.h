@@ -0,0 +1,40 @@
+﻿#ifndef INDEX_QUERY_H
+#define INDEX_QUERY_H
+
+#include "inverted_index.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct SearchHit
+{
+    std::string url;
+    int64_t fetchTimeMs = 0;
+};
+
+struct SearchResults
+{
+    // 命中的页面总数（同一 URL 抓过多次时每个版本都算）
+    uint64_t matches = 0;
+    // 按抓取时间从新到旧，同一 URL 只保留最新的一次
+    std::vector<SearchHit> hits;
+};
+
+// 在一个或多个索引目录上查询（分片抓取时每个分片一个目录）。
+// 语法：空格分隔的词都要出现；a OR b 任一出现；-词 排除；"..." 短语；括号分组。
+// 汉字词按相邻两字组成短语匹配，单个汉字匹配含有它的任何词
+class IndexSearcher
+{
+public:
+    bool Open(const std::vector<std::string>& directories);
+    size_t SegmentCount() const { return m_segments.size(); }
+    uint64_t DocCount() const;
+    bool Search(std::string_view query, size_t limit, SearchResults& results, std::string& error) const;
+
+private:
+    std::vector<std::unique_ptr<IndexSegment>> m_segments;
+};
+
+#endif
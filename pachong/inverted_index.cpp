@@ -0,0 +1,774 @@
+﻿#include "inverted_index.h"
+#include "metrics.h"
+#include "text_tokenizer.h"
+#include "visited_store.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const char kSegmentMagic[8] = { 'C', 'R', 'A', 'W', 'L', 'I', 'N', 'V' };
+    const uint32_t kSegmentVersion = 1;
+
+    std::string SegmentName(int id)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "segment-%05d.inv", id);
+        return name;
+    }
+
+    // 解析 segment-NNNNN.inv 的编号，不匹配时返回 -1
+    int ParseSegmentId(const std::string& filename)
+    {
+        if (filename.size() != 17 || filename.compare(0, 8, "segment-") != 0 ||
+            filename.compare(13, 4, ".inv") != 0) return -1;
+        int id = 0;
+        for (size_t i = 8; i < 13; ++i) {
+            if (filename[i] < '0' || filename[i] > '9') return -1;
+            id = id * 10 + (filename[i] - '0');
+        }
+        return id;
+    }
+
+    void PutVarint(std::string& out, uint32_t value)
+    {
+        while (value >= 0x80) {
+            out += (char)(value | 0x80);
+            value >>= 7;
+        }
+        out += (char)value;
+    }
+
+    uint32_t GetVarint(const uint8_t* data, uint32_t& offset)
+    {
+        uint32_t value = data[offset] & 0x7F;
+        int shift = 7;
+        while (data[offset++] & 0x80) {
+            value |= (uint32_t)(data[offset] & 0x7F) << shift;
+            shift += 7;
+        }
+        return value;
+    }
+
+    // 一个词在段文件里的倒排表：按文档顺序加入，每满一块记一条跳表
+    struct PostingEncoder
+    {
+        std::string docs;
+        std::string positions;
+        std::vector<IndexSkipEntry> skips;
+        uint32_t docFreq = 0;
+        uint32_t lastDoc = 0;
+        uint32_t blockPosStart = 0;
+
+        void Clear()
+        {
+            docs.clear();
+            positions.clear();
+            skips.clear();
+            docFreq = 0;
+            lastDoc = 0;
+        }
+
+        void Add(uint32_t doc, std::string_view rawPositions)
+        {
+            if (docFreq % kIndexBlockDocs == 0) blockPosStart = (uint32_t)positions.size();
+            PutVarint(docs, doc - lastDoc);
+            PutVarint(docs, (uint32_t)rawPositions.size());
+            positions.append(rawPositions);
+            lastDoc = doc;
+            if (++docFreq % kIndexBlockDocs == 0) skips.push_back({ doc, (uint32_t)docs.size(), blockPosStart });
+        }
+
+        // 最后一块不满时补上它的跳表项
+        void Finish()
+        {
+            if (docFreq % kIndexBlockDocs != 0) skips.push_back({ lastDoc, (uint32_t)docs.size(), blockPosStart });
+        }
+    };
+
+    // 段文件按顺序写：先写占位的文件头，写完各部分后回填。写到 .tmp，完成后改名
+    class SegmentFileWriter
+    {
+    public:
+        bool Open(const std::string& path, uint64_t baseDoc, uint32_t docCount)
+        {
+            m_path = path;
+            m_buffer.resize(1 << 20);
+            m_out.rdbuf()->pubsetbuf(m_buffer.data(), (std::streamsize)m_buffer.size());
+            m_out.open(path + ".tmp", std::ios::binary | std::ios::trunc);
+            memset(&m_header, 0, sizeof(m_header));
+            memcpy(m_header.magic, kSegmentMagic, sizeof(kSegmentMagic));
+            m_header.version = kSegmentVersion;
+            m_header.baseDoc = baseDoc;
+            m_header.docCount = docCount;
+            m_header.docsOffset = sizeof(IndexSegmentHeader);
+            Write(&m_header, sizeof(m_header));
+            return m_out.is_open();
+        }
+
+        // 文档表之后紧跟 URL 字符串，调用方先按顺序给出全部条目再给出全部 URL
+        uint64_t UrlsOffset() const
+        {
+            return m_header.docsOffset + (uint64_t)m_header.docCount * sizeof(IndexDocEntry);
+        }
+        void Write(const void* data, size_t size)
+        {
+            m_out.write((const char*)data, (std::streamsize)size);
+            m_position += size;
+        }
+
+        void AddTerm(std::string_view term, const PostingEncoder& postings)
+        {
+            // 跳表按 4 字节对齐，mmap 后可以直接读
+            static const char zeros[8] = { 0 };
+            if (m_position % 4) Write(zeros, 4 - m_position % 4);
+            IndexTermEntry entry;
+            entry.termOffset = m_termBytes.size();
+            entry.termLength = (uint32_t)term.size();
+            entry.docFreq = postings.docFreq;
+            entry.postingsOffset = m_position;
+            entry.postingsLength =
+                postings.skips.size() * sizeof(IndexSkipEntry) + postings.docs.size() + postings.positions.size();
+            Write(postings.skips.data(), postings.skips.size() * sizeof(IndexSkipEntry));
+            Write(postings.docs.data(), postings.docs.size());
+            Write(postings.positions.data(), postings.positions.size());
+            m_terms.push_back(entry);
+            m_termBytes.append(term);
+        }
+
+        bool Finish()
+        {
+            static const char zeros[8] = { 0 };
+            if (m_position % 8) Write(zeros, 8 - m_position % 8);
+            m_header.termCount = m_terms.size();
+            m_header.termsOffset = m_position;
+            uint64_t stringsOffset = m_position + m_terms.size() * sizeof(IndexTermEntry);
+            for (auto& entry : m_terms) entry.termOffset += stringsOffset;
+            Write(m_terms.data(), m_terms.size() * sizeof(IndexTermEntry));
+            Write(m_termBytes.data(), m_termBytes.size());
+            m_header.fileSize = m_position;
+            m_out.seekp(0);
+            m_out.write((const char*)&m_header, sizeof(m_header));
+            m_out.close();
+            if (m_out.fail()) {
+                Abandon();
+                return false;
+            }
+            std::error_code ec;
+            fs::rename(m_path + ".tmp", m_path, ec);
+            return !ec;
+        }
+
+        void Abandon()
+        {
+            if (m_out.is_open()) m_out.close();
+            std::error_code ec;
+            fs::remove(m_path + ".tmp", ec);
+        }
+
+    private:
+        std::string m_path;
+        std::vector<char> m_buffer;
+        std::ofstream m_out;
+        IndexSegmentHeader m_header;
+        uint64_t m_position = 0;
+        std::vector<IndexTermEntry> m_terms;
+        std::string m_termBytes;
+    };
+
+    int Tier(uint32_t docCount, int mergeFactor)
+    {
+        return (int)(std::log((double)std::max<uint32_t>(docCount, 1)) / std::log((double)mergeFactor));
+    }
+}
+
+PostingCursor::PostingCursor(const uint8_t* postings, uint64_t length, uint32_t docFreq)
+{
+    m_blockCount = (docFreq + kIndexBlockDocs - 1) / kIndexBlockDocs;
+    if (m_blockCount == 0 || length < (uint64_t)m_blockCount * sizeof(IndexSkipEntry)) return;
+    m_skips = (const IndexSkipEntry*)postings;
+    m_docs = postings + m_blockCount * sizeof(IndexSkipEntry);
+    m_positions = m_docs + m_skips[m_blockCount - 1].docEnd;
+    LoadBlock(0);
+    m_atEnd = false;
+}
+
+bool PostingCursor::LoadBlock(uint32_t block)
+{
+    m_block = block;
+    m_docOffset = block > 0 ? m_skips[block - 1].docEnd : 0;
+    m_docEnd = m_skips[block].docEnd;
+    m_posOffset = m_skips[block].posStart;
+    m_posBytes = 0;
+    // 块内第一篇的编号差相对于上一块的最后一篇
+    m_doc = block > 0 ? m_skips[block - 1].lastDoc : 0;
+    return true;
+}
+
+bool PostingCursor::Next()
+{
+    if (m_atEnd) return false;
+    m_posOffset += m_posBytes;
+    if (m_docOffset >= m_docEnd) {
+        if (m_block + 1 >= m_blockCount) {
+            m_atEnd = true;
+            return false;
+        }
+        LoadBlock(m_block + 1);
+    }
+    m_doc += GetVarint(m_docs, m_docOffset);
+    m_posBytes = GetVarint(m_docs, m_docOffset);
+    m_started = true;
+    return true;
+}
+
+bool PostingCursor::SkipTo(uint32_t target)
+{
+    if (m_atEnd) return false;
+    if (m_started && m_doc >= target) return true;
+    if (m_skips[m_block].lastDoc < target) {
+        uint32_t low = m_block + 1;
+        uint32_t high = m_blockCount;
+        while (low < high) {
+            uint32_t middle = (low + high) / 2;
+            if (m_skips[middle].lastDoc < target) low = middle + 1;
+            else high = middle;
+        }
+        if (low >= m_blockCount) {
+            m_atEnd = true;
+            return false;
+        }
+        LoadBlock(low);
+    }
+    while (Next()) {
+        if (m_doc >= target) return true;
+    }
+    return false;
+}
+
+void PostingCursor::Positions(std::vector<uint32_t>& out) const
+{
+    out.clear();
+    uint32_t offset = m_posOffset;
+    uint32_t end = m_posOffset + m_posBytes;
+    uint32_t position = 0;
+    while (offset < end) {
+        position += GetVarint(m_positions, offset);
+        out.push_back(position);
+    }
+}
+
+std::string_view PostingCursor::RawPositions() const
+{
+    return std::string_view((const char*)m_positions + m_posOffset, m_posBytes);
+}
+
+IndexSegment::~IndexSegment()
+{
+    Close();
+}
+
+void IndexSegment::Close()
+{
+#ifdef _WIN32
+    if (m_data) UnmapViewOfFile(m_data);
+    if (m_mapHandle) CloseHandle(m_mapHandle);
+    if (m_fileHandle && m_fileHandle != INVALID_HANDLE_VALUE) CloseHandle(m_fileHandle);
+    m_mapHandle = nullptr;
+    m_fileHandle = nullptr;
+#else
+    if (m_data) munmap((void*)m_data, m_size);
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_header = nullptr;
+    m_docs = nullptr;
+    m_terms = nullptr;
+}
+
+bool IndexSegment::Open(const std::string& path)
+{
+    Close();
+    m_path = path;
+#ifdef _WIN32
+    m_fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_fileHandle == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_fileHandle, &size) || size.QuadPart < (LONGLONG)sizeof(IndexSegmentHeader)) return false;
+    m_size = (size_t)size.QuadPart;
+    m_mapHandle = CreateFileMappingA(m_fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!m_mapHandle) return false;
+    m_data = (const uint8_t*)MapViewOfFile(m_mapHandle, FILE_MAP_READ, 0, 0, 0);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(IndexSegmentHeader)) {
+        close(fd);
+        return false;
+    }
+    m_size = (size_t)st.st_size;
+    void* mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    m_data = (mapping == MAP_FAILED) ? nullptr : (const uint8_t*)mapping;
+#endif
+    if (!m_data) return false;
+    const auto* header = (const IndexSegmentHeader*)m_data;
+    if (memcmp(header->magic, kSegmentMagic, sizeof(kSegmentMagic)) != 0 || header->version != kSegmentVersion ||
+        header->fileSize != m_size ||
+        header->docsOffset + (uint64_t)header->docCount * sizeof(IndexDocEntry) > m_size ||
+        header->termsOffset % 8 != 0 || header->termsOffset + header->termCount * sizeof(IndexTermEntry) > m_size) {
+        Close();
+        return false;
+    }
+    m_header = header;
+    m_docs = (const IndexDocEntry*)(m_data + header->docsOffset);
+    m_terms = (const IndexTermEntry*)(m_data + header->termsOffset);
+    return true;
+}
+
+std::string_view IndexSegment::Url(uint32_t local) const
+{
+    const IndexDocEntry& doc = m_docs[local];
+    return std::string_view((const char*)m_data + doc.urlOffset, doc.urlLength);
+}
+
+std::string_view IndexSegment::TermText(uint64_t i) const
+{
+    return std::string_view((const char*)m_data + m_terms[i].termOffset, m_terms[i].termLength);
+}
+
+uint64_t IndexSegment::LowerBound(std::string_view term) const
+{
+    uint64_t low = 0;
+    uint64_t high = m_header->termCount;
+    while (low < high) {
+        uint64_t middle = (low + high) / 2;
+        if (TermText(middle) < term) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+const IndexTermEntry* IndexSegment::Find(std::string_view term) const
+{
+    uint64_t i = LowerBound(term);
+    return i < m_header->termCount && TermText(i) == term ? &m_terms[i] : nullptr;
+}
+
+void IndexSegment::PrefixRange(std::string_view prefix, uint64_t& first, uint64_t& last) const
+{
+    first = LowerBound(prefix);
+    last = first;
+    while (last < m_header->termCount && TermText(last).substr(0, prefix.size()) == prefix) ++last;
+}
+
+PostingCursor IndexSegment::Cursor(const IndexTermEntry& term) const
+{
+    return PostingCursor(m_data + term.postingsOffset, term.postingsLength, term.docFreq);
+}
+
+std::vector<std::unique_ptr<IndexSegment>> OpenIndexSegments(const std::string& directory)
+{
+    std::vector<std::pair<int, std::string>> found;
+    std::error_code ec;
+    for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+        int id = ParseSegmentId(it->path().filename().string());
+        if (id >= 0) found.emplace_back(id, it->path().string());
+    }
+    // 编号大的段更新，覆盖范围相同时优先保留
+    std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+    std::vector<std::unique_ptr<IndexSegment>> segments;
+    for (const auto& entry : found) {
+        auto segment = std::make_unique<IndexSegment>();
+        if (!segment->Open(entry.second)) continue;
+        uint64_t first = segment->BaseDoc();
+        uint64_t last = first + segment->DocCount();
+        bool covered = false;
+        for (const auto& kept : segments) {
+            if (kept->BaseDoc() <= first && last <= kept->BaseDoc() + kept->DocCount()) covered = true;
+        }
+        if (!covered) segments.push_back(std::move(segment));
+    }
+    std::sort(segments.begin(), segments.end(),
+        [](const auto& a, const auto& b) { return a->BaseDoc() < b->BaseDoc(); });
+    return segments;
+}
+
+IndexWriter::IndexWriter(const IndexOptions& options, CrawlMetrics* metrics)
+    : m_options(options), m_metrics(metrics), m_budget(options.queueBudgetBytes)
+{
+    m_options.mergeFactor = std::max(2, m_options.mergeFactor);
+    std::error_code ec;
+    fs::create_directories(m_options.directory, ec);
+    // 上次中断时留下的半成品和已经被合并进新段的旧段
+    std::vector<std::string> stale;
+    for (fs::directory_iterator it(m_options.directory, ec), end; !ec && it != end; it.increment(ec)) {
+        std::string name = it->path().filename().string();
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0) stale.push_back(it->path().string());
+        int id = ParseSegmentId(name);
+        if (id >= 0) {
+            m_nextId = std::max(m_nextId, id + 1);
+            stale.push_back(it->path().string());
+        }
+    }
+    for (const auto& segment : OpenIndexSegments(m_options.directory)) {
+        stale.erase(std::remove(stale.begin(), stale.end(), segment->Path()), stale.end());
+        int id = ParseSegmentId(fs::path(segment->Path()).filename().string());
+        m_segments.push_back({ id, segment->Path(), segment->BaseDoc(), segment->DocCount() });
+        m_nextDoc = std::max(m_nextDoc, segment->BaseDoc() + segment->DocCount());
+    }
+    for (const auto& path : stale) fs::remove(path, ec);
+    m_ready = fs::is_directory(m_options.directory, ec);
+    if (m_ready) m_thread = std::thread(&IndexWriter::WriterLoop, this);
+}
+
+IndexWriter::~IndexWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable()) m_thread.join();
+}
+
+bool IndexWriter::Add(const std::string& url, int64_t fetchTimeMs, const std::string& text,
+    std::function<void()> onDurable)
+{
+    if (!IsReady()) return false;
+    auto doc = std::make_unique<PendingDoc>();
+    doc->url = url;
+    doc->fetchTimeMs = fetchTimeMs;
+    doc->text = text;
+    doc->onDurable = std::move(onDurable);
+    doc->reserved = m_budget.Acquire((long long)(url.size() + text.size()));
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(std::move(doc));
+    }
+    m_cv.notify_one();
+    return true;
+}
+
+void IndexWriter::Flush()
+{
+    if (!m_thread.joinable()) return;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    uint64_t target = ++m_flushRequested;
+    m_cv.notify_one();
+    m_flushedCv.wait(lock, [&] { return m_flushCompleted >= target; });
+}
+
+size_t IndexWriter::SegmentCount()
+{
+    std::lock_guard<std::mutex> lock(m_segmentsMutex);
+    return m_segments.size();
+}
+
+std::string IndexWriter::SegmentPath(int id) const
+{
+    return (fs::path(m_options.directory) / SegmentName(id)).string();
+}
+
+void IndexWriter::WriterLoop()
+{
+    using Clock = std::chrono::steady_clock;
+    const auto interval = std::chrono::seconds(std::max(1, m_options.flushIntervalSeconds));
+    Clock::time_point lastWrite = Clock::now();
+    for (;;) {
+        std::unique_ptr<PendingDoc> doc;
+        uint64_t flushTarget = 0;
+        bool stopping = false;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait_until(lock, lastWrite + interval,
+                [&] { return !m_queue.empty() || m_stopping || m_flushRequested > m_flushCompleted; });
+            flushTarget = m_flushRequested;
+            stopping = m_stopping;
+            if (!m_queue.empty()) {
+                doc = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+        }
+        Clock::time_point now = Clock::now();
+        if (doc) {
+            auto started = Clock::now();
+            IndexDocument(*doc);
+            if (doc->onDurable) m_onDurable.push_back(std::move(doc->onDurable));
+            if (m_metrics) m_metrics->RecordStage(MetricStage::Index, started);
+            m_budget.Release(doc->reserved);
+            if (m_memoryBytes >= m_options.segmentMemoryBytes || now - lastWrite >= interval) {
+                WriteSegment();
+                lastWrite = now;
+            }
+            continue;
+        }
+        // 队列已空：Flush 之前加入的页面都处理过了
+        if (flushTarget > m_flushCompleted || stopping || now - lastWrite >= interval) {
+            WriteSegment();
+            lastWrite = now;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_flushCompleted = flushTarget;
+            m_flushedCv.notify_all();
+        }
+        if (stopping) return;
+    }
+}
+
+void IndexWriter::IndexDocument(PendingDoc& doc)
+{
+    uint32_t local = (uint32_t)m_docs.size();
+    // 同一个词在本页的各次出现用 next 串起来，不用排序就能按词分组，位置保持升序
+    m_occurrences.clear();
+    m_docTerms.clear();
+    TextTokenizer tokenizer(doc.text, TokenizeMode::Document);
+    std::string_view term;
+    uint32_t position = 0;
+    while (tokenizer.Next(term, position)) {
+        uint32_t id = InternTerm(term);
+        TermBuffer& buffer = m_terms[id];
+        uint32_t index = (uint32_t)m_occurrences.size();
+        m_occurrences.push_back({ position, UINT32_MAX });
+        if (buffer.docMark != local) {
+            buffer.docMark = local;
+            buffer.firstOccurrence = index;
+            m_docTerms.push_back(id);
+        }
+        else {
+            m_occurrences[buffer.lastOccurrence].next = index;
+        }
+        buffer.lastOccurrence = index;
+    }
+    for (uint32_t id : m_docTerms) {
+        TermBuffer& buffer = m_terms[id];
+        m_encoded.clear();
+        uint32_t previous = 0;
+        for (uint32_t i = buffer.firstOccurrence; i != UINT32_MAX; i = m_occurrences[i].next) {
+            PutVarint(m_encoded, m_occurrences[i].position - previous);
+            previous = m_occurrences[i].position;
+        }
+        size_t before = buffer.postings.size();
+        PutVarint(buffer.postings, local - buffer.lastDoc);
+        PutVarint(buffer.postings, (uint32_t)m_encoded.size());
+        buffer.postings += m_encoded;
+        buffer.lastDoc = local;
+        buffer.docFreq++;
+        m_memoryBytes += buffer.postings.size() - before;
+    }
+    IndexDocEntry entry;
+    entry.urlFingerprint = FingerprintUrl(doc.url);
+    entry.fetchTimeMs = doc.fetchTimeMs;
+    entry.urlOffset = m_urls.size();
+    entry.urlLength = (uint32_t)doc.url.size();
+    entry.termCount = (uint32_t)m_occurrences.size();
+    m_docs.push_back(entry);
+    m_urls += doc.url;
+    m_memoryBytes += sizeof(IndexDocEntry) + doc.url.size();
+    m_stats.documents++;
+}
+
+uint32_t IndexWriter::InternTerm(std::string_view term)
+{
+    if ((m_terms.size() + 1) * 10 > m_termSlots.size() * 7) {
+        std::vector<uint64_t> old(std::max<size_t>(4096, m_termSlots.size() * 2), 0);
+        old.swap(m_termSlots);
+        size_t mask = m_termSlots.size() - 1;
+        for (uint64_t slot : old) {
+            if (slot == 0) continue;
+            size_t i = (slot >> 32) & mask;
+            while (m_termSlots[i]) i = (i + 1) & mask;
+            m_termSlots[i] = slot;
+        }
+        m_memoryBytes += (m_termSlots.size() - old.size()) * sizeof(uint64_t);
+    }
+    uint32_t hash = (uint32_t)std::hash<std::string_view>()(term);
+    size_t mask = m_termSlots.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        uint64_t slot = m_termSlots[i];
+        if (slot == 0) {
+            uint32_t id = (uint32_t)m_terms.size();
+            m_terms.emplace_back();
+            m_terms.back().term.assign(term);
+            m_termSlots[i] = (uint64_t)hash << 32 | (id + 1);
+            m_memoryBytes += sizeof(TermBuffer) + term.size();
+            return id;
+        }
+        uint32_t id = (uint32_t)slot - 1;
+        if ((uint32_t)(slot >> 32) == hash && m_terms[id].term == term) return id;
+    }
+}
+
+bool IndexWriter::WriteSegment()
+{
+    if (m_docs.empty()) return true;
+    int id = m_nextId++;
+    std::string path = SegmentPath(id);
+    SegmentFileWriter writer;
+    bool ok = writer.Open(path, m_nextDoc, (uint32_t)m_docs.size());
+    if (ok) {
+        uint64_t urlsOffset = writer.UrlsOffset();
+        for (auto entry : m_docs) {
+            entry.urlOffset += urlsOffset;
+            writer.Write(&entry, sizeof(entry));
+        }
+        writer.Write(m_urls.data(), m_urls.size());
+        std::vector<uint32_t> order(m_terms.size());
+        for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+        std::sort(order.begin(), order.end(),
+            [&](uint32_t a, uint32_t b) { return m_terms[a].term < m_terms[b].term; });
+        // 内存里每篇的编号差、位置字节数和位置数据连在一起，这里拆成文档流和位置流
+        PostingEncoder encoder;
+        for (uint32_t i : order) {
+            const TermBuffer& buffer = m_terms[i];
+            const uint8_t* data = (const uint8_t*)buffer.postings.data();
+            uint32_t offset = 0;
+            uint32_t doc = 0;
+            encoder.Clear();
+            while (offset < buffer.postings.size()) {
+                doc += GetVarint(data, offset);
+                uint32_t length = GetVarint(data, offset);
+                encoder.Add(doc, std::string_view(buffer.postings.data() + offset, length));
+                offset += length;
+            }
+            encoder.Finish();
+            writer.AddTerm(buffer.term, encoder);
+        }
+        ok = writer.Finish();
+    }
+    if (!ok) {
+        writer.Abandon();
+        m_failed = true;
+    }
+    else {
+        std::lock_guard<std::mutex> lock(m_segmentsMutex);
+        m_segments.push_back({ id, path, m_nextDoc, (uint32_t)m_docs.size() });
+    }
+    m_nextDoc += m_docs.size();
+    m_stats.segmentsWritten++;
+    m_termSlots.clear();
+    m_terms.clear();
+    m_docs.clear();
+    m_urls.clear();
+    m_memoryBytes = 0;
+    if (ok) {
+        for (auto& callback : m_onDurable) callback();
+    }
+    m_onDurable.clear();
+    if (ok) MaybeMerge();
+    return ok;
+}
+
+void IndexWriter::MaybeMerge()
+{
+    // 从最新的段往前，把量级不超过其中最大者的段连成一串，够 mergeFactor 个就合并，
+    // 偶尔按时间写出的小段也会被后面的大段带着合并掉
+    for (;;) {
+        size_t count = m_segments.size();
+        if (count < (size_t)m_options.mergeFactor) return;
+        int tier = Tier(m_segments[count - 1].docCount, m_options.mergeFactor);
+        size_t run = 1;
+        while (run < count) {
+            int previous = Tier(m_segments[count - 1 - run].docCount, m_options.mergeFactor);
+            if (previous > tier) break;
+            ++run;
+        }
+        if (run < (size_t)m_options.mergeFactor || !Merge(count - run, run)) return;
+    }
+}
+
+bool IndexWriter::Merge(size_t first, size_t count)
+{
+    std::vector<std::unique_ptr<IndexSegment>> inputs;
+    uint64_t baseDoc = m_segments[first].baseDoc;
+    uint64_t docCount = 0;
+    for (size_t i = first; i < first + count; ++i) {
+        const SegmentInfo& info = m_segments[i];
+        auto segment = std::make_unique<IndexSegment>();
+        if (info.baseDoc != baseDoc + docCount || !segment->Open(info.path)) return false;
+        docCount += info.docCount;
+        inputs.push_back(std::move(segment));
+    }
+    if (docCount > UINT32_MAX) return false;
+    int id = m_nextId++;
+    std::string path = SegmentPath(id);
+    SegmentFileWriter writer;
+    if (!writer.Open(path, baseDoc, (uint32_t)docCount)) {
+        writer.Abandon();
+        return false;
+    }
+    uint64_t urlOffset = writer.UrlsOffset();
+    for (const auto& input : inputs) {
+        for (uint32_t i = 0; i < input->DocCount(); ++i) {
+            IndexDocEntry entry = input->Doc(i);
+            entry.urlOffset = urlOffset;
+            urlOffset += entry.urlLength;
+            writer.Write(&entry, sizeof(entry));
+        }
+    }
+    for (const auto& input : inputs) {
+        for (uint32_t i = 0; i < input->DocCount(); ++i) {
+            std::string_view url = input->Url(i);
+            writer.Write(url.data(), url.size());
+        }
+    }
+    // 各段的词表都已排序，多路归并；同一个词的倒排表按段的顺序接起来，只需重写编号差
+    std::vector<uint64_t> heads(inputs.size(), 0);
+    PostingEncoder merged;
+    for (;;) {
+        std::string_view term;
+        bool any = false;
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            if (heads[i] >= inputs[i]->TermCount()) continue;
+            std::string_view candidate = inputs[i]->TermText(heads[i]);
+            if (!any || candidate < term) term = candidate;
+            any = true;
+        }
+        if (!any) break;
+        merged.Clear();
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            if (heads[i] >= inputs[i]->TermCount() || inputs[i]->TermText(heads[i]) != term) continue;
+            uint32_t shift = (uint32_t)(inputs[i]->BaseDoc() - baseDoc);
+            PostingCursor cursor = inputs[i]->Cursor(inputs[i]->Term(heads[i]));
+            while (cursor.Next()) merged.Add(cursor.Doc() + shift, cursor.RawPositions());
+            ++heads[i];
+        }
+        merged.Finish();
+        writer.AddTerm(term, merged);
+    }
+    if (!writer.Finish()) {
+        writer.Abandon();
+        return false;
+    }
+    std::vector<std::string> oldPaths;
+    for (auto& input : inputs) {
+        oldPaths.push_back(input->Path());
+        input->Close();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_segmentsMutex);
+        m_segments.erase(m_segments.begin() + first, m_segments.begin() + first + count);
+        m_segments.insert(m_segments.begin() + first, { id, path, baseDoc, (uint32_t)docCount });
+    }
+    // 新段改名完成后才删旧段；删不掉（例如 Windows 上正被查询映射）时由下次启动清理
+    std::error_code ec;
+    for (const auto& old : oldPaths) fs::remove(old, ec);
+    m_stats.merges++;
+    return true;
+}
@@ -0,0 +1,269 @@
+﻿#ifndef INVERTED_INDEX_H
+#define INVERTED_INDEX_H
+
+#include "byte_budget.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+class CrawlMetrics;
+
+struct IndexOptions
+{
+    bool enabled = true;
+    // 为空时使用数据目录下的 index
+    std::string directory;
+    // 内存里的倒排表超过这个大小时写成一个段
+    size_t segmentMemoryBytes = 64u * 1024 * 1024;
+    // 抓取中途也定期写出，查询能看到最近的页面
+    int flushIntervalSeconds = 300;
+    // 末尾同一量级的段攒到这么多个时合并成一个
+    int mergeFactor = 10;
+    // 排队等待分词的正文总字节数上限，超过后抓取线程阻塞
+    long long queueBudgetBytes = 32ll * 1024 * 1024;
+};
+
+// 段文件（segment-NNNNN.inv）的布局，全部按小端写入，mmap 之后直接当数组用：
+//   文件头 | IndexDocEntry[docCount] | URL 字符串 | 各词的倒排表 | IndexTermEntry[termCount] | 词字符串
+// 词表按词的字节序排好，二分查找。文档编号在整个索引里递增，每个段覆盖连续的一段编号
+struct IndexSegmentHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t docCount;
+    uint64_t baseDoc;
+    uint64_t termCount;
+    uint64_t docsOffset;
+    uint64_t termsOffset;
+    uint64_t fileSize;
+    uint64_t reserved;
+};
+static_assert(sizeof(IndexSegmentHeader) == 64, "IndexSegmentHeader layout is part of the file format");
+
+struct IndexDocEntry
+{
+    uint64_t urlFingerprint;
+    int64_t fetchTimeMs;
+    uint64_t urlOffset;
+    uint32_t urlLength;
+    uint32_t termCount;
+};
+static_assert(sizeof(IndexDocEntry) == 32, "IndexDocEntry layout is part of the file format");
+
+// 倒排表：IndexSkipEntry[块数] | 文档流 | 位置流。每 128 篇文档一块；
+// 文档流每篇是 varint(与上一篇的编号差) + varint(该篇位置数据的字节数)，
+// 位置流每篇是若干 varint(与上一个位置的差)。编号都是段内编号
+struct IndexTermEntry
+{
+    uint64_t termOffset;
+    uint32_t termLength;
+    uint32_t docFreq;
+    uint64_t postingsOffset;
+    uint64_t postingsLength;
+};
+static_assert(sizeof(IndexTermEntry) == 32, "IndexTermEntry layout is part of the file format");
+
+struct IndexSkipEntry
+{
+    // 块内最后一篇文档的编号
+    uint32_t lastDoc;
+    // 块在文档流里的结束位置
+    uint32_t docEnd;
+    // 块在位置流里的起始位置
+    uint32_t posStart;
+};
+static_assert(sizeof(IndexSkipEntry) == 12, "IndexSkipEntry layout is part of the file format");
+
+constexpr uint32_t kIndexBlockDocs = 128;
+
+// 顺序读取一个词的倒排表，SkipTo 借助跳表越过整块
+class PostingCursor
+{
+public:
+    PostingCursor() = default;
+    PostingCursor(const uint8_t* postings, uint64_t length, uint32_t docFreq);
+
+    // 停在第一篇编号 >= target 的文档上，没有了返回 false
+    bool SkipTo(uint32_t target);
+    bool Next();
+    uint32_t Doc() const { return m_doc; }
+    bool AtEnd() const { return m_atEnd; }
+    // 当前文档里的位置，升序
+    void Positions(std::vector<uint32_t>& out) const;
+    // 当前文档的位置数据，合并时原样复制
+    std::string_view RawPositions() const;
+
+private:
+    bool LoadBlock(uint32_t block);
+
+    const IndexSkipEntry* m_skips = nullptr;
+    uint32_t m_blockCount = 0;
+    const uint8_t* m_docs = nullptr;
+    const uint8_t* m_positions = nullptr;
+    uint32_t m_block = 0;
+    uint32_t m_docOffset = 0;
+    uint32_t m_docEnd = 0;
+    uint32_t m_posOffset = 0;
+    uint32_t m_posBytes = 0;
+    uint32_t m_doc = 0;
+    bool m_started = false;
+    bool m_atEnd = true;
+};
+
+// 只读映射的段文件
+class IndexSegment
+{
+public:
+    IndexSegment() = default;
+    ~IndexSegment();
+    IndexSegment(const IndexSegment&) = delete;
+    IndexSegment& operator=(const IndexSegment&) = delete;
+
+    bool Open(const std::string& path);
+    void Close();
+    const std::string& Path() const { return m_path; }
+    uint64_t BaseDoc() const { return m_header->baseDoc; }
+    uint32_t DocCount() const { return m_header->docCount; }
+    uint64_t TermCount() const { return m_header->termCount; }
+    const IndexDocEntry& Doc(uint32_t local) const { return m_docs[local]; }
+    std::string_view Url(uint32_t local) const;
+    const IndexTermEntry& Term(uint64_t i) const { return m_terms[i]; }
+    std::string_view TermText(uint64_t i) const;
+    // 找不到返回 nullptr
+    const IndexTermEntry* Find(std::string_view term) const;
+    // 以 prefix 开头的词在词表里的下标范围 [first, last)
+    void PrefixRange(std::string_view prefix, uint64_t& first, uint64_t& last) const;
+    PostingCursor Cursor(const IndexTermEntry& term) const;
+
+private:
+    uint64_t LowerBound(std::string_view term) const;
+
+    std::string m_path;
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void* m_fileHandle = nullptr;
+    void* m_mapHandle = nullptr;
+#endif
+    const IndexSegmentHeader* m_header = nullptr;
+    const IndexDocEntry* m_docs = nullptr;
+    const IndexTermEntry* m_terms = nullptr;
+};
+
+// 打开目录里的全部段，按起始编号排序。合并写出新段之后、删除旧段之前中断时，
+// 旧段的编号范围被新段包含，这里跳过它们
+std::vector<std::unique_ptr<IndexSegment>> OpenIndexSegments(const std::string& directory);
+
+struct IndexWriterStats
+{
+    std::atomic<uint64_t> documents{ 0 };
+    std::atomic<uint64_t> segmentsWritten{ 0 };
+    std::atomic<uint64_t> merges{ 0 };
+};
+
+// 抓取时增量建索引：Add 只把正文放进队列，由单独的线程分词并在内存里累积压缩的倒排表，
+// 超出内存上限或到了时间就写成一个段，末尾同一量级的段够多时合并，段的数量按对数增长
+class IndexWriter
+{
+public:
+    // metrics 不为空时记录每页的分词耗时
+    explicit IndexWriter(const IndexOptions& options, CrawlMetrics* metrics = nullptr);
+    ~IndexWriter();
+    IndexWriter(const IndexWriter&) = delete;
+    IndexWriter& operator=(const IndexWriter&) = delete;
+
+    bool IsReady() const { return m_ready && !m_failed; }
+    // 线程安全；排队的正文超出预算时阻塞。onDurable 在这一页所在的段写完后由写线程调用，写段失败时不调用
+    bool Add(const std::string& url, int64_t fetchTimeMs, const std::string& text,
+        std::function<void()> onDurable = nullptr);
+    // 等此前加入的页面全部写进段文件
+    void Flush();
+    const IndexWriterStats& Stats() const { return m_stats; }
+    size_t SegmentCount();
+
+private:
+    struct PendingDoc
+    {
+        std::string url;
+        int64_t fetchTimeMs = 0;
+        std::string text;
+        long long reserved = 0;
+        std::function<void()> onDurable;
+    };
+    // 内存里一个词的倒排表：每篇依次是 varint(编号差)、varint(位置字节数)、位置数据，
+    // 分词时每个词只碰一块缓冲，写段时再拆成文档流、位置流和跳表
+    struct TermBuffer
+    {
+        std::string term;
+        std::string postings;
+        uint32_t docFreq = 0;
+        uint32_t lastDoc = 0;
+        // 正在分词的页面里这个词的出现链，docMark 不是当前页时无效
+        uint32_t docMark = UINT32_MAX;
+        uint32_t firstOccurrence = 0;
+        uint32_t lastOccurrence = 0;
+    };
+    struct Occurrence
+    {
+        uint32_t position;
+        uint32_t next;
+    };
+    struct SegmentInfo
+    {
+        int id;
+        std::string path;
+        uint64_t baseDoc;
+        uint32_t docCount;
+    };
+
+    void WriterLoop();
+    void IndexDocument(PendingDoc& doc);
+    uint32_t InternTerm(std::string_view term);
+    bool WriteSegment();
+    void MaybeMerge();
+    bool Merge(size_t first, size_t count);
+    std::string SegmentPath(int id) const;
+
+    IndexOptions m_options;
+    CrawlMetrics* m_metrics;
+    bool m_ready = false;
+    std::atomic<bool> m_failed{ false };
+    IndexWriterStats m_stats;
+    ByteBudget m_budget;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::condition_variable m_flushedCv;
+    std::deque<std::unique_ptr<PendingDoc>> m_queue;
+    uint64_t m_flushRequested = 0;
+    uint64_t m_flushCompleted = 0;
+    bool m_stopping = false;
+    std::thread m_thread;
+
+    // 以下只由写线程访问（m_segments 的读取另外加锁）
+    std::mutex m_segmentsMutex;
+    std::vector<SegmentInfo> m_segments;
+    int m_nextId = 1;
+    uint64_t m_nextDoc = 0;
+    std::vector<TermBuffer> m_terms;
+    // 线性探测的词表：高 32 位是词的哈希，低 32 位是 m_terms 下标加 1，0 表示空位。
+    // 每个词每页都要查一次，比 unordered_map 少一次指针跳转
+    std::vector<uint64_t> m_termSlots;
+    std::vector<IndexDocEntry> m_docs;
+    // 已经分词、还在内存里的页面的回调，写段成功后依次调用
+    std::vector<std::function<void()>> m_onDurable;
+    std::string m_urls;
+    size_t m_memoryBytes = 0;
+    std::vector<Occurrence> m_occurrences;
+    std::vector<uint32_t> m_docTerms;
+    std::string m_encoded;
+};
+
+#endif
@@ -1,15 +1,256 @@
 ﻿#include <iostream>
 #include <limits>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#ifdef _WIN32
 #include <windows.h>
 #include <tchar.h>
+#else
+#include <unistd.h>
+#endif
+#include "batch_config.h"
 #include "crawler.h"
+#include "index_query.h"
 
 #ifdef max
 #undef max
 #endif
 
-int main()
+namespace
+{
+    struct CommandLine
+    {
+        BatchConfig config;
+        bool coordinator = false;
+        bool spawn = true;
+        // 不为空时只在已有的索引上查询，"-" 表示从标准输入逐行读查询
+        std::string search;
+        size_t limit = 20;
+        // 原样转给分片进程的参数，分片相关的参数除外
+        std::vector<std::string> forwarded;
+    };
+
+    void PrintUsage()
+    {
+        std::cerr << "usage: pachong [--config file] [options] [url ...]\n"
+            "       pachong --shards n [--shard i] [--coordinator addr] [--no-spawn] [options] [url ...]\n"
+            "       pachong --search query|- [--limit n] [--output dir] [--shards n]\n"
+            "  addr: unix:/path/to.sock or tcp:host:port\n"
+            "  query: words must all appear; a OR b; -word excludes; \"exact phrase\"; (grouping)\n"
+            "  --config file       settings as name = value lines, [host pattern] sections list headers\n"
+            "  --external, --head-probe, --near-dup may be given without a value\n"
+            << BatchSettingsHelp()
+            << "exit codes: 0 ok, 1 error, 2 usage, 3 partial (bad seeds or too many failures), 4 nothing fetched\n";
+    }
+
+    bool ParseCommandLine(int argc, char** argv, CommandLine& cmd, std::string& error)
+    {
+        ShardOptions& shard = cmd.config.crawler.shard;
+        // 配置文件先读，命令行上的设置覆盖它
+        for (int i = 1; i + 1 < argc; ++i) {
+            if (std::string(argv[i]) == "--config" && !LoadBatchConfig(argv[i + 1], cmd.config, error)) return false;
+        }
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--shards" && hasValue) {
+                shard.count = std::max(1, atoi(argv[++i]));
+                cmd.coordinator = true;
+            }
+            else if (arg == "--shard" && hasValue) {
+                shard.index = atoi(argv[++i]);
+                cmd.coordinator = false;
+            }
+            else if (arg == "--coordinator" && hasValue) shard.coordinator = argv[++i];
+            else if (arg == "--no-spawn") cmd.spawn = false;
+            else if (arg == "--search" && hasValue) cmd.search = argv[++i];
+            else if (arg == "--limit" && hasValue) cmd.limit = (size_t)std::max(1, atoi(argv[++i]));
+            else if (arg == "--config" && hasValue) {
+                cmd.forwarded.push_back(arg);
+                cmd.forwarded.push_back(argv[++i]);
+            }
+            else if (arg == "--external" || arg == "--head-probe" || arg == "--near-dup") {
+                if (!ApplyBatchSetting(cmd.config, arg.substr(2), "on", error)) return false;
+                cmd.forwarded.push_back(arg);
+            }
+            else if (arg.rfind("--", 0) == 0) {
+                if (!hasValue) {
+                    error = "missing value for " + arg;
+                    return false;
+                }
+                if (!ApplyBatchSetting(cmd.config, arg.substr(2), argv[i + 1], error)) return false;
+                cmd.forwarded.push_back(arg);
+                cmd.forwarded.push_back(argv[++i]);
+            }
+            else {
+                cmd.config.urls.push_back(arg);
+                cmd.forwarded.push_back(arg);
+            }
+        }
+        if (!cmd.search.empty()) return true;
+        if (cmd.config.urls.empty() && cmd.config.seedFiles.empty()) {
+            error = "no seed URL or seed file given";
+            return false;
+        }
+        if (shard.index < 0 || shard.index >= shard.count) {
+            error = "shard index out of range";
+            return false;
+        }
+        if (shard.count > 1) {
+            // 每个分片都要读完整的种子，标准输入只能读一次
+            for (const auto& file : cmd.config.seedFiles) {
+                if (file == "-") {
+                    error = "seeds from stdin cannot be shared between shards";
+                    return false;
+                }
+            }
+            if (shard.coordinator.empty()) {
+#ifdef _WIN32
+                shard.coordinator = "tcp:127.0.0.1:7733";
+#else
+                shard.coordinator = "unix:/tmp/pachong-" + std::to_string(getpid()) + ".sock";
+#endif
+            }
+        }
+        return true;
+    }
+
+    std::string FormatTime(int64_t timeMs)
+    {
+        time_t seconds = (time_t)(timeMs / 1000);
+        struct tm utc;
+#ifdef _WIN32
+        gmtime_s(&utc, &seconds);
+#else
+        gmtime_r(&seconds, &utc);
+#endif
+        char buffer[32];
+        strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", &utc);
+        return buffer;
+    }
+
+    // 在抓取时建好的索引上查询；分片抓取时依次打开各分片目录下的索引
+    int RunSearch(const CommandLine& cmd)
+    {
+        CrawlerOptions options = cmd.config.crawler;
+        std::vector<std::string> directories;
+        for (int i = 0; i < options.shard.count; ++i) {
+            options.shard.index = i;
+            directories.push_back(Crawler::DataDirectory(options) + "index");
+        }
+        IndexSearcher searcher;
+        if (!searcher.Open(directories)) {
+            std::cerr << "No index found in " << directories[0] << (directories.size() > 1 ? " and other shards" : "")
+                << "\n";
+            return kExitError;
+        }
+        std::cout << searcher.DocCount() << " pages in " << searcher.SegmentCount() << " segments\n";
+        int code = kExitOk;
+        auto run = [&](const std::string& query) {
+            SearchResults results;
+            std::string error;
+            auto started = std::chrono::steady_clock::now();
+            if (!searcher.Search(query, cmd.limit, results, error)) {
+                std::cerr << "pachong: " << error << ": " << query << "\n";
+                code = kExitUsage;
+                return;
+            }
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+            std::cout << query << ": " << results.matches << " matches in " << ms << " ms\n";
+            for (const auto& hit : results.hits) {
+                std::cout << "  " << FormatTime(hit.fetchTimeMs) << "  " << hit.url << "\n";
+            }
+        };
+        if (cmd.search != "-") {
+            run(cmd.search);
+            return code;
+        }
+        std::string line;
+        while (std::getline(std::cin, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.find_first_not_of(" \t") != std::string::npos) run(line);
+        }
+        return code;
+    }
+
+    // 协调进程：启动各分片进程（--no-spawn 时由用户自己在别的机器上启动），转发链接直到抓取结束。
+    // 所有分片的退出码相同时沿用它，不同时按部分成功处理
+    int RunCoordinator(const CommandLine& cmd)
+    {
+        const ShardOptions& shard = cmd.config.crawler.shard;
+        ShardCoordinator coordinator(shard.coordinator, shard.count);
+        if (!coordinator.Listen()) {
+            std::cerr << "Cannot listen on " << shard.coordinator << "\n";
+            return kExitError;
+        }
+        std::vector<intptr_t> children;
+        bool spawnFailed = false;
+        if (cmd.spawn) {
+            for (int i = 0; i < shard.count; ++i) {
+                std::vector<std::string> args = { "--shards", std::to_string(shard.count), "--shard", std::to_string(i),
+                    "--coordinator", shard.coordinator };
+                args.insert(args.end(), cmd.forwarded.begin(), cmd.forwarded.end());
+                intptr_t child = SpawnSelf(args);
+                if (!child) {
+                    std::cerr << "Failed to start shard " << i << "\n";
+                    spawnFailed = true;
+                    continue;
+                }
+                children.push_back(child);
+            }
+        }
+        bool ok = coordinator.Run();
+        int result = -1;
+        for (intptr_t child : children) {
+            int code = WaitProcess(child);
+            if (code != kExitOk && code != kExitPartial && code != kExitNothingFetched) ok = false;
+            else if (result < 0) result = code;
+            else if (result != code) result = kExitPartial;
+        }
+        std::cout << "Coordinator: " << coordinator.RoutedLinks() << " links and " << coordinator.RoutedMedia()
+            << " media URLs routed between " << shard.count << " shards\n";
+        if (!ok || spawnFailed) return kExitError;
+        return result < 0 ? kExitOk : result;
+    }
+
+    int RunCommandLine(int argc, char** argv)
+    {
+        if (std::string(argv[1]) == "--help") {
+            PrintUsage();
+            return kExitOk;
+        }
+        CommandLine cmd;
+        std::string error;
+        if (!ParseCommandLine(argc, argv, cmd, error)) {
+            std::cerr << "pachong: " << error << "\n";
+            PrintUsage();
+            return kExitUsage;
+        }
+        const BatchConfig& config = cmd.config;
+        if (!cmd.search.empty()) return RunSearch(cmd);
+        if (config.crawler.shard.count > 1 && cmd.coordinator) return RunCoordinator(cmd);
+        SeedReader seeds;
+        for (const auto& url : config.urls) seeds.Add(url);
+        for (const auto& file : config.seedFiles) seeds.AddFile(file);
+        Crawler crawler(config.crawler);
+        if (!crawler.Start(seeds)) return kExitError;
+        int code = BatchExitCode(crawler.Summary(), seeds.Failed(), config);
+        if (!config.summaryPath.empty()) {
+            std::string path = config.summaryPath;
+            if (config.crawler.shard.count > 1) path += ".shard-" + std::to_string(config.crawler.shard.index);
+            if (!WriteBatchSummary(path, crawler.Summary(), code)) std::cerr << "Cannot write summary " << path << "\n";
+        }
+        return code;
+    }
+}
+
+int main(int argc, char** argv)
 {
+    // 带参数时不进入交互模式，分片的子进程也走这里
+    if (argc > 1) return RunCommandLine(argc, argv);
+
     std::cout << "*****************************************************\n";
     std::cout << "*             高级反反爬网络爬虫系统 v2.0           *\n";
     std::cout << "*   支持 HTTPS / Cookie / 随机 UA / 延迟 / Referer  *\n";
@@ -0,0 +1,379 @@
+﻿#include "media_downloader.h"
+#include "metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // 解析 "bytes 0-99/1000" 或 "bytes */1000"，未知的部分置为 -1
+    bool ParseContentRange(const std::string& value, long long& start, long long& total)
+    {
+        start = -1;
+        total = -1;
+        if (value.compare(0, 6, "bytes ") != 0) return false;
+        const char* p = value.c_str() + 6;
+        if (*p == '*') {
+            p++;
+        }
+        else {
+            char* end = nullptr;
+            start = strtoll(p, &end, 10);
+            if (end == p || *end != '-') return false;
+            p = end + 1;
+            strtoll(p, &end, 10);
+            if (end == p) return false;
+            p = end;
+        }
+        if (*p != '/') return false;
+        p++;
+        if (*p != '*') {
+            char* end = nullptr;
+            total = strtoll(p, &end, 10);
+            if (end == p) total = -1;
+        }
+        return true;
+    }
+
+    // 断点续传或出错后，用磁盘上已有的内容重新建立摘要状态，返回已有的字节数
+    long long RehashPartFile(const std::string& path, Sha256& hasher)
+    {
+        hasher.Reset();
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open()) return 0;
+        char buffer[65536];
+        long long size = 0;
+        while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0) {
+            hasher.Update(buffer, (size_t)in.gcount());
+            size += in.gcount();
+        }
+        return size;
+    }
+
+    long long SizeLimit(const MediaDownloadOptions& options, MediaType type)
+    {
+        switch (type) {
+        case MediaType::Image: return options.maxImageBytes;
+        case MediaType::Video: return options.maxVideoBytes;
+        case MediaType::Audio: return options.maxAudioBytes;
+        default: return 0;
+        }
+    }
+}
+
+MediaDownloader::MediaDownloader(HttpTransport& transport, const MediaDownloadOptions& options,
+    CrawlMetrics* metrics)
+    : m_transport(transport), m_options(options), m_metrics(metrics), m_budget(options.inFlightBudgetBytes)
+{
+    m_options.workerCount = std::max(1, m_options.workerCount);
+    m_options.queueCapacity = std::max<size_t>(1, m_options.queueCapacity);
+    m_options.chunkBytes = std::max(64ll * 1024, m_options.chunkBytes);
+    m_options.maxAttempts = std::max(1, m_options.maxAttempts);
+    for (int i = 0; i < m_options.workerCount; ++i) {
+        m_workers.emplace_back(&MediaDownloader::WorkerLoop, this);
+    }
+}
+
+MediaDownloader::~MediaDownloader()
+{
+    Finish();
+}
+
+bool MediaDownloader::Enqueue(MediaJob job)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_notFull.wait(lock, [&] { return m_closed || m_queue.size() < m_options.queueCapacity; });
+    if (m_closed) return false;
+    m_queue.push_back(std::move(job));
+    m_notEmpty.notify_one();
+    return true;
+}
+
+void MediaDownloader::Finish()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+    }
+    m_notEmpty.notify_all();
+    m_notFull.notify_all();
+    for (auto& worker : m_workers) {
+        if (worker.joinable()) worker.join();
+    }
+    m_workers.clear();
+}
+
+void MediaDownloader::WorkerLoop()
+{
+    for (;;) {
+        MediaJob job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_notEmpty.wait(lock, [&] { return m_closed || !m_queue.empty(); });
+            if (m_queue.empty()) return;
+            job = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        m_notFull.notify_one();
+        Download(job);
+    }
+}
+
+bool MediaDownloader::Download(const MediaJob& job)
+{
+    std::error_code ec;
+    // 有完成回调时由回调方负责去重，已存在的 filepath 会被覆盖
+    if (!job.onComplete && fs::exists(job.filepath, ec)) return true;
+    if (!m_transport.IsReady()) return false;
+    std::string partPath = job.filepath + ".part";
+    Sha256 hasher;
+    long long offset = RehashPartFile(partPath, hasher);
+    if (offset > 0) m_stats.resumed++;
+    MediaCheck check;
+    if (m_options.probeWithHead && offset == 0 && !Probe(job, check)) return Fail(check);
+    long long total = -1;
+    int failures = 0;
+    for (;;) {
+        ChunkResult result = FetchChunk(job, partPath, offset, total, hasher, check);
+        if (result == ChunkResult::Complete) {
+            fs::rename(partPath, job.filepath, ec);
+            if (ec) break;
+            if (job.onComplete && !job.onComplete(job, hasher.HexDigest(), check.classified ? check.type : job.type)) {
+                // 没能收进存储的暂存文件不留在磁盘上
+                fs::remove(job.filepath, ec);
+                break;
+            }
+            m_stats.completed++;
+            if (m_metrics) m_metrics->RecordMediaResult(true);
+            return true;
+        }
+        if (result == ChunkResult::Progress) {
+            failures = 0;
+            continue;
+        }
+        if (result == ChunkResult::Rejected) break;
+        if (++failures >= m_options.maxAttempts) {
+            // 保留 .part，下次遇到同一地址时从断点继续
+            if (result == ChunkResult::Restart) fs::remove(partPath, ec);
+            break;
+        }
+        if (result == ChunkResult::Restart) {
+            fs::remove(partPath, ec);
+            total = -1;
+        }
+        offset = RehashPartFile(partPath, hasher);
+        std::this_thread::sleep_for(std::chrono::milliseconds(500 * failures));
+    }
+    return Fail(check);
+}
+
+bool MediaDownloader::Fail(const MediaCheck& check)
+{
+    if (check.notMedia) m_stats.rejectedType++;
+    if (check.tooLarge) m_stats.rejectedSize++;
+    m_stats.failed++;
+    if (m_metrics) m_metrics->RecordMediaResult(false);
+    return false;
+}
+
+bool MediaDownloader::Probe(const MediaJob& job, MediaCheck& check)
+{
+    m_stats.probes++;
+    HttpRequest request;
+    request.method = "HEAD";
+    request.url = job.url;
+    request.headers = job.headers;
+    request.headers.emplace_back("Accept-Encoding", "identity");
+    HttpResponse response;
+    bool ok = m_transport.Send(request, response);
+    if (m_metrics) m_metrics->RecordTransport(response.timing);
+    // 不支持 HEAD 或探测失败时交给 GET 再判断
+    if (!ok || response.status < 200 || response.status >= 300) return true;
+    if (CheckHeaders(response, response.ContentLength(), "", job.type, check)) return true;
+    if (m_metrics) m_metrics->RecordFailure(nullptr, check.tooLarge ? FailureReason::MediaTooLarge : FailureReason::NotMedia);
+    return false;
+}
+
+bool MediaDownloader::CheckHeaders(const HttpResponse& response, long long total, const std::string& partPath,
+    MediaType hint, MediaCheck& check)
+{
+    if (!check.classified) {
+        MediaType type = MediaType::Unknown;
+        if (!MediaTypeFromContentType(response.GetHeader("Content-Type"), type)) {
+            check.notMedia = true;
+            return false;
+        }
+        if (type != MediaType::Unknown) {
+            check.type = type;
+            check.classified = true;
+        }
+        else if (!partPath.empty()) {
+            // 续传时文件头已经在 .part 里
+            char head[512];
+            std::ifstream in(partPath, std::ios::binary);
+            in.read(head, sizeof(head));
+            if (in.gcount() > 0 && !CheckContent(head, (size_t)in.gcount(), hint, check)) return false;
+        }
+    }
+    return CheckSize(check, total);
+}
+
+bool MediaDownloader::CheckSize(MediaCheck& check, long long size) const
+{
+    if (!check.classified || size < 0) return true;
+    long long limit = SizeLimit(m_options, check.type);
+    if (limit <= 0 || size <= limit) return true;
+    check.tooLarge = true;
+    return false;
+}
+
+bool MediaDownloader::CheckContent(const char* data, size_t size, MediaType hint, MediaCheck& check)
+{
+    MediaType type = MediaType::Unknown;
+    if (!SniffMediaType(data, size, type) || (type == MediaType::Unknown && hint == MediaType::Unknown)) {
+        check.notMedia = true;
+        return false;
+    }
+    check.type = type != MediaType::Unknown ? type : hint;
+    check.classified = true;
+    return true;
+}
+
+MediaDownloader::ChunkResult MediaDownloader::FetchChunk(const MediaJob& job, const std::string& partPath,
+    long long& offset, long long& total, Sha256& hasher, MediaCheck& check)
+{
+    long long want = m_options.chunkBytes;
+    if (total >= 0) want = std::max(1ll, std::min(want, total - offset));
+    long long reserved = m_budget.Acquire(want);
+    bool capped = false;
+    // 服务器不理 Range、回整个文件时按实际大小记账。先放掉已占的再按新总量申请，不会拿着预算等预算
+    auto charge = [&](long long bytes) {
+        if (bytes <= reserved || capped) return;
+        m_budget.Release(reserved);
+        long long needed = std::max(bytes, reserved + want);
+        reserved = m_budget.Acquire(needed);
+        capped = reserved < needed;
+    };
+
+    HttpRequest request;
+    request.url = job.url;
+    request.headers = job.headers;
+    // Range 以线上字节计，媒体文件不要求压缩
+    request.headers.emplace_back("Accept-Encoding", "identity");
+    request.headers.emplace_back("Range", "bytes=" + std::to_string(offset) + "-" + std::to_string(offset + want - 1));
+
+    std::ofstream outFile;
+    int status = 0;
+    bool mismatch = false;
+    bool writeFailed = false;
+    bool rejected = false;
+    long long received = 0;
+    uint64_t writeMicros = 0;
+    request.onHeaders = [&](const HttpResponse& response) {
+        status = response.status;
+        if (status == 206) {
+            long long start = -1;
+            if (!ParseContentRange(response.GetHeader("Content-Range"), start, total) || start != offset) {
+                mismatch = true;
+                return false;
+            }
+            // 类型或大小不合要求时在读响应体之前就断开
+            if (!CheckHeaders(response, total, offset > 0 ? partPath : std::string(), job.type, check)) {
+                rejected = true;
+                return false;
+            }
+            outFile.open(partPath, std::ios::binary | std::ios::app);
+        }
+        else if (status == 200) {
+            // 服务器不支持 Range，整个文件重新下载
+            offset = 0;
+            total = response.ContentLength();
+            if (!CheckHeaders(response, total, std::string(), job.type, check)) {
+                rejected = true;
+                return false;
+            }
+            if (total > 0) charge(total);
+            hasher.Reset();
+            outFile.open(partPath, std::ios::binary | std::ios::trunc);
+        }
+        else {
+            if (status == 416) {
+                long long start = -1;
+                ParseContentRange(response.GetHeader("Content-Range"), start, total);
+            }
+            return false;
+        }
+        return outFile.is_open();
+    };
+    request.onBody = [&](const char* data, size_t size) {
+        // 响应头没能判定类型时看文件头；没有或虚报 Content-Length 时按实际收到的字节数限制大小
+        if ((!check.classified && !CheckContent(data, size, job.type, check)) ||
+            !CheckSize(check, total) || !CheckSize(check, offset + (long long)size)) {
+            rejected = true;
+            return false;
+        }
+        charge(received + (long long)size);
+        auto started = std::chrono::steady_clock::now();
+        bool written = (bool)outFile.write(data, size);
+        writeMicros += (uint64_t)ElapsedMicros(started);
+        if (!written) {
+            writeFailed = true;
+            return false;
+        }
+        hasher.Update(data, size);
+        offset += (long long)size;
+        received += (long long)size;
+        m_stats.bytes += size;
+        return true;
+    };
+    HttpResponse response;
+    bool ok = m_transport.Send(request, response);
+    m_budget.Release(reserved);
+    if (outFile.is_open()) {
+        auto started = std::chrono::steady_clock::now();
+        outFile.close();
+        if (outFile.fail()) writeFailed = true;
+        writeMicros += (uint64_t)ElapsedMicros(started);
+    }
+    if (m_metrics) {
+        m_metrics->RecordTransport(response.timing);
+        if (received > 0) {
+            m_metrics->RecordMediaBytes((uint64_t)received);
+            m_metrics->RecordStage(MetricStage::DiskWrite, writeMicros);
+        }
+        if (rejected) m_metrics->RecordFailure(nullptr, check.tooLarge ? FailureReason::MediaTooLarge : FailureReason::NotMedia);
+        else if (!ok && !writeFailed) m_metrics->RecordFailure(nullptr, FailureFromTransport(response.error));
+        else if (ok && status >= 400 && status != 416) m_metrics->RecordFailure(nullptr, FailureReason::HttpStatus, status);
+    }
+
+    if (rejected) {
+        std::error_code ec;
+        fs::remove(partPath, ec);
+        offset = 0;
+        return ChunkResult::Rejected;
+    }
+    if (!ok || writeFailed) return ChunkResult::Failed;
+    if (mismatch) return ChunkResult::Restart;
+    if (status == 200) return ChunkResult::Complete;
+    if (status == 206) {
+        if (received == 0) return ChunkResult::Failed;
+        if (total >= 0) return offset >= total ? ChunkResult::Complete : ChunkResult::Progress;
+        // 总长度未知时，收到的比请求的少说明已到末尾
+        return received < want ? ChunkResult::Complete : ChunkResult::Progress;
+    }
+    if (status == 416 && total == offset) {
+        // .part 已经完整（或文件本身为空）
+        std::ofstream touch(partPath, std::ios::binary | std::ios::app);
+        return touch.is_open() ? ChunkResult::Complete : ChunkResult::Failed;
+    }
+    if (status == 416) return ChunkResult::Restart;
+    // 其余状态码（404 等）视为永久失败
+    std::error_code ec;
+    fs::remove(partPath, ec);
+    offset = 0;
+    return ChunkResult::Rejected;
+}
@@ -0,0 +1,130 @@
+﻿#ifndef MEDIA_DOWNLOADER_H
+#define MEDIA_DOWNLOADER_H
+
+#include "byte_budget.h"
+#include "media_type.h"
+#include "sha256.h"
+#include "transport.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class CrawlMetrics;
+
+struct MediaDownloadOptions
+{
+    int workerCount = 4;
+    // 等待下载的任务数上限，队列满时入队方阻塞
+    size_t queueCapacity = 256;
+    // 每个 Range 请求的字节数
+    long long chunkBytes = 4ll * 1024 * 1024;
+    // 所有下载线程已请求但尚未收完的字节总数上限
+    long long inFlightBudgetBytes = 32ll * 1024 * 1024;
+    // 单个分段网络失败后从 .part 断点重试的次数
+    int maxAttempts = 3;
+    // 各类文件的大小上限，<= 0 表示不限；响应头给出的长度超限时不读响应体
+    long long maxImageBytes = 32ll * 1024 * 1024;
+    long long maxVideoBytes = 1024ll * 1024 * 1024;
+    long long maxAudioBytes = 128ll * 1024 * 1024;
+    // 下载前先发 HEAD 确认类型和大小；服务器不支持 HEAD 时照常 GET
+    bool probeWithHead = false;
+};
+
+struct MediaJob
+{
+    std::string url;
+    std::string filepath;
+    // 每个请求都附带的头，例如 Referer
+    std::vector<std::pair<std::string, std::string>> headers;
+    // 按 URL 后缀猜出的类型，响应头和文件头都判断不出时才用它
+    MediaType type = MediaType::Unknown;
+    // 文件完整写入 filepath 后在下载线程上调用，digest 为边下载边计算的 SHA-256，type 为最终判定的类型。
+    // 返回 false 表示保存失败，这次下载计为失败
+    std::function<bool(const MediaJob&, const std::string& digest, MediaType type)> onComplete;
+};
+
+struct MediaDownloadStats
+{
+    std::atomic<uint64_t> completed{ 0 };
+    std::atomic<uint64_t> failed{ 0 };
+    std::atomic<uint64_t> resumed{ 0 };
+    std::atomic<uint64_t> bytes{ 0 };
+    // 内容不是媒体（例如 .jpg 地址返回的错误页）或超过大小上限而放弃的文件
+    std::atomic<uint64_t> rejectedType{ 0 };
+    std::atomic<uint64_t> rejectedSize{ 0 };
+    std::atomic<uint64_t> probes{ 0 };
+};
+
+// 独立于页面抓取的媒体下载阶段：有界队列 + 工作线程，大文件按 Range 分段写入 .part 并可断点续传
+class MediaDownloader
+{
+public:
+    // metrics 不为空时记录失败原因、写盘耗时和下载字节数
+    MediaDownloader(HttpTransport& transport, const MediaDownloadOptions& options, CrawlMetrics* metrics = nullptr);
+    ~MediaDownloader();
+
+    // 队列满时阻塞；Finish 之后返回 false
+    bool Enqueue(MediaJob job);
+    // 不再接受新任务，等队列中的任务全部完成
+    void Finish();
+    // 在调用线程上同步下载
+    bool Download(const MediaJob& job);
+
+    const MediaDownloadStats& Stats() const { return m_stats; }
+
+private:
+    enum class ChunkResult
+    {
+        Progress,
+        Complete,
+        Restart,
+        Failed,
+        Rejected
+    };
+
+    // 一次下载里对类型和大小的判断，跨分段保留
+    struct MediaCheck
+    {
+        MediaType type = MediaType::Unknown;
+        bool classified = false;
+        // 放弃的原因，只在 ChunkResult::Rejected 时有意义
+        bool tooLarge = false;
+        bool notMedia = false;
+    };
+
+    void WorkerLoop();
+    // HEAD 已经能判定不下载时返回 false
+    bool Probe(const MediaJob& job, MediaCheck& check);
+    // 按响应头判断类型和大小，不能接受时返回 false
+    // 续传时 partPath 为已有的 .part，用来补看文件头
+    bool CheckHeaders(const HttpResponse& response, long long total, const std::string& partPath, MediaType hint,
+        MediaCheck& check);
+    bool CheckSize(MediaCheck& check, long long size) const;
+    // 按文件头判定类型，认不出时退回 hint
+    static bool CheckContent(const char* data, size_t size, MediaType hint, MediaCheck& check);
+    // 记入失败统计，返回 false
+    bool Fail(const MediaCheck& check);
+    ChunkResult FetchChunk(const MediaJob& job, const std::string& partPath, long long& offset, long long& total,
+        Sha256& hasher, MediaCheck& check);
+
+    HttpTransport& m_transport;
+    MediaDownloadOptions m_options;
+    CrawlMetrics* m_metrics;
+    ByteBudget m_budget;
+    MediaDownloadStats m_stats;
+    std::mutex m_mutex;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
+    std::deque<MediaJob> m_queue;
+    bool m_closed = false;
+    std::vector<std::thread> m_workers;
+};
+
+#endif
@@ -0,0 +1,130 @@
+﻿#include "media_store.h"
+#include "visited_store.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // 已有的可见文件是否就是这份内容：链接时指向同一对象，复制时逐字节相同
+    bool SameContent(const fs::path& visible, const std::string& objectPath)
+    {
+        std::error_code ec;
+        if (fs::equivalent(visible, objectPath, ec)) return true;
+        if (ec || fs::file_size(visible, ec) != fs::file_size(objectPath, ec) || ec) return false;
+        std::ifstream a(visible, std::ios::binary);
+        std::ifstream b(objectPath, std::ios::binary);
+        char bufferA[65536];
+        char bufferB[65536];
+        while (a && b) {
+            a.read(bufferA, sizeof(bufferA));
+            b.read(bufferB, sizeof(bufferB));
+            if (a.gcount() != b.gcount() || memcmp(bufferA, bufferB, (size_t)a.gcount()) != 0) return false;
+        }
+        return a.eof() && b.eof();
+    }
+}
+
+MediaStore::MediaStore(const std::string& directory, bool hardLink)
+    : m_directory(directory), m_hardLink(hardLink)
+{
+    std::error_code ec;
+    fs::create_directories(fs::path(m_directory) / "objects", ec);
+    fs::create_directories(fs::path(m_directory) / "staging", ec);
+    std::string indexPath = (fs::path(m_directory) / "index.tsv").string();
+    std::ifstream in(indexPath, std::ios::binary);
+    std::string line;
+    while (std::getline(in, line)) {
+        // 每行 "摘要\tURL"，最后一行可能因异常退出而不完整
+        size_t tab = line.find('\t');
+        if (tab != 64 || line.size() <= tab + 1) continue;
+        m_index[line.substr(tab + 1)] = line.substr(0, tab);
+    }
+    in.close();
+    m_indexFile.open(indexPath, std::ios::binary | std::ios::app);
+    m_ready = m_indexFile.is_open();
+}
+
+bool MediaStore::Lookup(const std::string& url, std::string& digest)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(url);
+    if (it == m_index.end()) return false;
+    digest = it->second;
+    return true;
+}
+
+std::string MediaStore::StagingPath(const std::string& url) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)FingerprintUrl(url));
+    return (fs::path(m_directory) / "staging" / name).string();
+}
+
+std::string MediaStore::ObjectPath(const std::string& digest) const
+{
+    return (fs::path(m_directory) / "objects" / digest.substr(0, 2) / digest).string();
+}
+
+bool MediaStore::LinkVisible(const std::string& objectPath, const std::string& visiblePath)
+{
+    std::error_code ec;
+    if (m_hardLink) {
+        fs::create_hard_link(objectPath, visiblePath, ec);
+        if (!ec) return true;
+        // 不支持硬链接的文件系统上用相对路径的符号链接，数据目录整体搬走后仍然有效
+        fs::path target = fs::relative(objectPath, fs::path(visiblePath).parent_path(), ec);
+        if (ec || target.empty()) target = fs::absolute(objectPath, ec);
+        ec.clear();
+        fs::create_symlink(target, visiblePath, ec);
+        if (!ec) return true;
+    }
+    return fs::copy_file(objectPath, visiblePath, ec) && !ec;
+}
+
+std::string MediaStore::Commit(const std::string& url, const std::string& stagingPath,
+    const std::string& digest, const std::string& visiblePath)
+{
+    std::error_code ec;
+    fs::path visible(visiblePath);
+    std::string extension = visible.extension().string();
+    std::string objectPath = ObjectPath(digest);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    fs::create_directories(fs::path(objectPath).parent_path(), ec);
+    if (fs::exists(objectPath, ec)) {
+        // 相同内容已经存过，丢弃这一份
+        fs::remove(stagingPath, ec);
+    }
+    else {
+        fs::rename(stagingPath, objectPath, ec);
+        if (ec) return "";
+    }
+
+    std::string finalPath = visiblePath;
+    if (fs::exists(visible, ec)) {
+        if (!SameContent(visible, objectPath)) {
+            // 不同内容同名（例如各站点的 logo.png），文件名加上摘要前缀区分
+            fs::path alternate = visible.parent_path() /
+                (visible.stem().string() + "_" + digest.substr(0, 12) + extension);
+            finalPath = alternate.string();
+            if (!fs::exists(alternate, ec) && !LinkVisible(objectPath, finalPath)) return "";
+        }
+    }
+    else if (!LinkVisible(objectPath, finalPath)) {
+        return "";
+    }
+
+    if (m_index.emplace(url, digest).second && m_indexFile.is_open()) {
+        m_indexFile << digest << '\t' << url << '\n';
+        m_indexFile.flush();
+    }
+    return finalPath;
+}
+
+size_t MediaStore::Size()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_index.size();
+}
@@ -0,0 +1,48 @@
+﻿#ifndef MEDIA_STORE_H
+#define MEDIA_STORE_H
+
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+struct MediaStoreOptions
+{
+    // 为空时使用程序目录下的 media_store
+    std::string directory;
+    // 对外可见的文件用硬链接指向对象，不支持时依次退回符号链接和复制
+    bool hardLink = true;
+};
+
+// 按内容寻址的媒体仓库：objects/<摘要前两位>/<摘要> 每份内容只存一次，
+// URL -> 摘要 的索引以追加方式写入 index.tsv，跨运行保留。线程安全
+class MediaStore
+{
+public:
+    explicit MediaStore(const std::string& directory, bool hardLink = true);
+
+    bool IsReady() const { return m_ready; }
+    // 已经下载过的 URL 返回 true，无需再访问网络
+    bool Lookup(const std::string& url, std::string& digest);
+    // 下载中的临时文件路径，按 URL 固定，便于下次运行断点续传
+    std::string StagingPath(const std::string& url) const;
+    // 把下载完成的临时文件并入仓库，并在 visiblePath 处建立链接；
+    // 同名但内容不同的文件已存在时改用带摘要前缀的文件名。返回最终可见路径，失败时返回空串
+    std::string Commit(const std::string& url, const std::string& stagingPath,
+        const std::string& digest, const std::string& visiblePath);
+
+    size_t Size();
+
+private:
+    std::string ObjectPath(const std::string& digest) const;
+    bool LinkVisible(const std::string& objectPath, const std::string& visiblePath);
+
+    std::string m_directory;
+    bool m_hardLink;
+    bool m_ready = false;
+    std::mutex m_mutex;
+    std::unordered_map<std::string, std::string> m_index;
+    std::ofstream m_indexFile;
+};
+
+#endif
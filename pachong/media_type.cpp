@@ -0,0 +1,137 @@
+﻿#include "media_type.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace
+{
+    struct Extension
+    {
+        const char* suffix;
+        MediaType type;
+    };
+
+    const Extension kExtensions[] = {
+        { ".jpg", MediaType::Image }, { ".jpeg", MediaType::Image }, { ".png", MediaType::Image },
+        { ".gif", MediaType::Image }, { ".bmp", MediaType::Image }, { ".webp", MediaType::Image },
+        { ".svg", MediaType::Image }, { ".ico", MediaType::Image },
+        { ".mp4", MediaType::Video }, { ".avi", MediaType::Video }, { ".mov", MediaType::Video },
+        { ".wmv", MediaType::Video }, { ".flv", MediaType::Video }, { ".webm", MediaType::Video },
+        { ".mkv", MediaType::Video },
+        { ".mp3", MediaType::Audio }, { ".wav", MediaType::Audio }, { ".ogg", MediaType::Audio },
+        { ".flac", MediaType::Audio }, { ".aac", MediaType::Audio }, { ".m4a", MediaType::Audio },
+    };
+
+    bool EndsWithNoCase(std::string_view value, std::string_view suffix)
+    {
+        if (value.size() < suffix.size()) return false;
+        value.remove_prefix(value.size() - suffix.size());
+        for (size_t i = 0; i < suffix.size(); ++i) {
+            if (tolower((unsigned char)value[i]) != suffix[i]) return false;
+        }
+        return true;
+    }
+
+    bool StartsWith(const char* data, size_t size, const char* magic, size_t length, size_t at = 0)
+    {
+        return size >= at + length && memcmp(data + at, magic, length) == 0;
+    }
+
+    // ISO BMFF（mp4/mov/m4a/avif/heic）按 ftyp 里的主品牌区分
+    MediaType FromBrand(const char* brand)
+    {
+        static const char* const audioBrands[] = { "M4A ", "M4B ", "M4P " };
+        static const char* const imageBrands[] = { "avif", "avis", "heic", "heix", "mif1", "msf1" };
+        for (const char* candidate : audioBrands) {
+            if (memcmp(brand, candidate, 4) == 0) return MediaType::Audio;
+        }
+        for (const char* candidate : imageBrands) {
+            if (memcmp(brand, candidate, 4) == 0) return MediaType::Image;
+        }
+        return MediaType::Video;
+    }
+}
+
+const char* MediaTypeName(MediaType type)
+{
+    switch (type) {
+    case MediaType::Image: return "image";
+    case MediaType::Video: return "video";
+    case MediaType::Audio: return "audio";
+    default: return "unknown";
+    }
+}
+
+MediaType MediaTypeFromUrl(std::string_view url)
+{
+    size_t end = url.find_first_of("?#");
+    if (end != std::string_view::npos) url = url.substr(0, end);
+    for (const auto& ext : kExtensions) {
+        if (EndsWithNoCase(url, ext.suffix)) return ext.type;
+    }
+    return MediaType::Unknown;
+}
+
+bool MediaTypeFromContentType(std::string_view contentType, MediaType& type)
+{
+    type = MediaType::Unknown;
+    size_t end = contentType.find(';');
+    if (end != std::string_view::npos) contentType = contentType.substr(0, end);
+    while (!contentType.empty() && isspace((unsigned char)contentType.back())) contentType.remove_suffix(1);
+    while (!contentType.empty() && isspace((unsigned char)contentType.front())) contentType.remove_prefix(1);
+    std::string lower(contentType);
+    for (auto& c : lower) c = (char)tolower((unsigned char)c);
+    if (lower.compare(0, 6, "image/") == 0) type = MediaType::Image;
+    else if (lower.compare(0, 6, "video/") == 0 || lower == "application/mp4") type = MediaType::Video;
+    else if (lower.compare(0, 6, "audio/") == 0 || lower == "application/ogg") type = MediaType::Audio;
+    if (type != MediaType::Unknown) return true;
+    // 不少服务器给所有下载文件都返回这几种
+    static const char* const generic[] = { "", "application/octet-stream", "binary/octet-stream",
+        "application/x-download", "application/force-download", "application/download", "application/unknown" };
+    for (const char* candidate : generic) {
+        if (lower == candidate) return true;
+    }
+    return false;
+}
+
+bool SniffMediaType(const char* data, size_t size, MediaType& type)
+{
+    type = MediaType::Unknown;
+    if (StartsWith(data, size, "\xFF\xD8\xFF", 3) || StartsWith(data, size, "\x89PNG\r\n\x1A\n", 8) ||
+        StartsWith(data, size, "GIF87a", 6) || StartsWith(data, size, "GIF89a", 6) ||
+        StartsWith(data, size, "II*\0", 4) || StartsWith(data, size, "MM\0*", 4) ||
+        StartsWith(data, size, "\0\0\1\0", 4) || (StartsWith(data, size, "RIFF", 4) && StartsWith(data, size, "WEBP", 4, 8)) ||
+        (StartsWith(data, size, "BM", 2) && size >= 14)) {
+        type = MediaType::Image;
+        return true;
+    }
+    if (StartsWith(data, size, "ftyp", 4, 4) && size >= 12) {
+        type = FromBrand(data + 8);
+        return true;
+    }
+    if (StartsWith(data, size, "\x1A\x45\xDF\xA3", 4) || StartsWith(data, size, "FLV\x01", 4) ||
+        (StartsWith(data, size, "RIFF", 4) && StartsWith(data, size, "AVI ", 4, 8)) ||
+        StartsWith(data, size, "\x30\x26\xB2\x75\x8E\x66\xCF\x11", 8) || StartsWith(data, size, "\0\0\1\xBA", 4) ||
+        (size > 188 && data[0] == 0x47 && data[188] == 0x47)) {
+        type = MediaType::Video;
+        return true;
+    }
+    if (StartsWith(data, size, "ID3", 3) || StartsWith(data, size, "OggS", 4) || StartsWith(data, size, "fLaC", 4) ||
+        StartsWith(data, size, "#!AMR", 5) || (StartsWith(data, size, "RIFF", 4) && StartsWith(data, size, "WAVE", 4, 8)) ||
+        (size >= 2 && (unsigned char)data[0] == 0xFF && ((unsigned char)data[1] & 0xE0) == 0xE0)) {
+        type = MediaType::Audio;
+        return true;
+    }
+    // 跳过 BOM 和空白后看是不是标记语言或 JSON；SVG 是唯一以文本形式出现的图片
+    size_t i = StartsWith(data, size, "\xEF\xBB\xBF", 3) ? 3 : 0;
+    while (i < size && isspace((unsigned char)data[i])) ++i;
+    if (i < size && (data[i] == '<' || data[i] == '{' || data[i] == '[')) {
+        std::string_view head(data + i, std::min<size_t>(size - i, 1024));
+        if (data[i] == '<' && head.find("<svg") != std::string_view::npos) {
+            type = MediaType::Image;
+            return true;
+        }
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,26 @@
+﻿#ifndef MEDIA_TYPE_H
+#define MEDIA_TYPE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+enum class MediaType
+{
+    Image,
+    Video,
+    Audio,
+    Unknown
+};
+
+const char* MediaTypeName(MediaType type);
+
+// 只看路径部分的扩展名，查询串和片段不影响结果
+MediaType MediaTypeFromUrl(std::string_view url);
+// 明确不是媒体（text/html、application/json 等）时返回 false；
+// 没有或是 application/octet-stream 这类笼统类型时返回 true 且 type 为 Unknown，需要再看文件头
+bool MediaTypeFromContentType(std::string_view contentType, MediaType& type);
+// 按文件开头的特征字节识别；内容看起来是 HTML/XML/JSON 等文本时返回 false，认不出时 type 为 Unknown
+bool SniffMediaType(const char* data, size_t size, MediaType& type);
+
+#endif
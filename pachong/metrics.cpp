@@ -0,0 +1,344 @@
+﻿#include "metrics.h"
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const char* const kStageNames[] = { "dns", "connect", "tls", "first_byte", "body", "parse", "text_extract",
+        "transcode", "disk_write", "politeness_wait", "index" };
+    const char* const kFailureNames[] = { "http_status", "timeout", "dns", "connect", "tls", "bad_url", "protocol",
+        "decode", "aborted", "not_media", "media_too_large" };
+    static_assert(sizeof(kStageNames) / sizeof(kStageNames[0]) == (size_t)MetricStage::Count, "stage names");
+    static_assert(sizeof(kFailureNames) / sizeof(kFailureNames[0]) == (size_t)FailureReason::Count, "failure names");
+
+    std::string Seconds(uint64_t micros)
+    {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.6f", micros / 1e6);
+        return buffer;
+    }
+
+    // Prometheus 标签值与 JSON 字符串的转义规则在这里用到的字符上一致
+    std::string Escape(const std::string& value)
+    {
+        std::string result;
+        result.reserve(value.size());
+        for (char c : value) {
+            if (c == '\\' || c == '"') {
+                result.push_back('\\');
+                result.push_back(c);
+            }
+            else if (c == '\n') {
+                result += "\\n";
+            }
+            else if ((unsigned char)c >= 0x20) {
+                result.push_back(c);
+            }
+        }
+        return result;
+    }
+
+    void WriteHistogram(std::ostream& out, const std::string& name, const std::string& labels,
+        const LatencyHistogram& histogram)
+    {
+        std::string prefix = labels.empty() ? "{" : "{" + labels + ",";
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < LatencyHistogram::kBucketCount; ++i) {
+            cumulative += histogram.Bucket(i);
+            out << name << "_bucket" << prefix << "le=\"" << Seconds(LatencyHistogram::BucketBoundMicros(i)) << "\"} "
+                << cumulative << "\n";
+        }
+        cumulative += histogram.Bucket(LatencyHistogram::kBucketCount);
+        out << name << "_bucket" << prefix << "le=\"+Inf\"} " << cumulative << "\n";
+        std::string suffix = labels.empty() ? "" : "{" + labels + "}";
+        out << name << "_sum" << suffix << " " << Seconds(histogram.SumMicros()) << "\n";
+        out << name << "_count" << suffix << " " << cumulative << "\n";
+    }
+
+    void WriteJsonHistogram(std::ostream& out, const LatencyHistogram& histogram)
+    {
+        out << "{\"count\":" << histogram.Count() << ",\"sumSeconds\":" << Seconds(histogram.SumMicros())
+            << ",\"p50Seconds\":" << Seconds(histogram.QuantileMicros(0.5))
+            << ",\"p90Seconds\":" << Seconds(histogram.QuantileMicros(0.9))
+            << ",\"p99Seconds\":" << Seconds(histogram.QuantileMicros(0.99)) << ",\"buckets\":[";
+        for (size_t i = 0; i <= LatencyHistogram::kBucketCount; ++i) {
+            if (i > 0) out << ",";
+            out << histogram.Bucket(i);
+        }
+        out << "]}";
+    }
+}
+
+const char* MetricStageName(MetricStage stage)
+{
+    return stage < MetricStage::Count ? kStageNames[(size_t)stage] : "unknown";
+}
+
+const char* FailureReasonName(FailureReason reason)
+{
+    return reason < FailureReason::Count ? kFailureNames[(size_t)reason] : "unknown";
+}
+
+FailureReason FailureFromTransport(TransportError error)
+{
+    switch (error) {
+    case TransportError::BadUrl: return FailureReason::BadUrl;
+    case TransportError::Dns: return FailureReason::Dns;
+    case TransportError::Connect: return FailureReason::Connect;
+    case TransportError::Tls: return FailureReason::Tls;
+    case TransportError::Timeout: return FailureReason::Timeout;
+    case TransportError::Decode: return FailureReason::Decode;
+    case TransportError::Aborted: return FailureReason::Aborted;
+    default: return FailureReason::Protocol;
+    }
+}
+
+void LatencyHistogram::Record(uint64_t micros)
+{
+    // 第 i 个桶覆盖 (100 * 2^(i-1), 100 * 2^i] 微秒
+    uint64_t steps = (micros + 99) / 100;
+    size_t index = steps <= 1 ? 0 : (size_t)std::bit_width(steps - 1);
+    if (index > kBucketCount) index = kBucketCount;
+    m_buckets[index].fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(micros, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::QuantileMicros(double q) const
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i <= kBucketCount; ++i) total += Bucket(i);
+    if (total == 0) return 0;
+    uint64_t rank = (uint64_t)(q * (double)total);
+    if (rank >= total) rank = total - 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBucketCount; ++i) {
+        seen += Bucket(i);
+        if (seen > rank) return BucketBoundMicros(i);
+    }
+    return BucketBoundMicros(kBucketCount);
+}
+
+CrawlMetrics::CrawlMetrics()
+    : m_started(Clock::now())
+{
+}
+
+CrawlMetrics::~CrawlMetrics()
+{
+    StopReporter();
+}
+
+uint64_t CrawlMetrics::MicrosSince(Clock::time_point start)
+{
+    return (uint64_t)ElapsedMicros(start);
+}
+
+HostMetrics& CrawlMetrics::Host(const std::string& host)
+{
+    std::lock_guard<std::mutex> lock(m_hostMutex);
+    auto& slot = m_hosts[host];
+    if (!slot) slot = std::make_unique<HostMetrics>();
+    return *slot;
+}
+
+void CrawlMetrics::RecordPage(HostMetrics& host, uint64_t bytes, uint64_t fetchMicros)
+{
+    m_pages.fetch_add(1, std::memory_order_relaxed);
+    m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    host.pages.fetch_add(1, std::memory_order_relaxed);
+    host.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    host.fetch.Record(fetchMicros);
+}
+
+void CrawlMetrics::RecordFailure(HostMetrics* host, FailureReason reason, int httpStatus)
+{
+    if (reason >= FailureReason::Count) reason = FailureReason::Protocol;
+    m_failures[(size_t)reason].fetch_add(1, std::memory_order_relaxed);
+    if (reason == FailureReason::HttpStatus && httpStatus > 0 && httpStatus < 600) {
+        m_statusCounts[httpStatus].fetch_add(1, std::memory_order_relaxed);
+    }
+    if (host) host->failures.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CrawlMetrics::RecordTransport(const TransportTiming& timing)
+{
+    if (timing.dnsUs >= 0) RecordStage(MetricStage::Dns, (uint64_t)timing.dnsUs);
+    if (timing.connectUs >= 0) RecordStage(MetricStage::Connect, (uint64_t)timing.connectUs);
+    if (timing.tlsUs >= 0) RecordStage(MetricStage::Tls, (uint64_t)timing.tlsUs);
+    if (timing.firstByteUs >= 0) RecordStage(MetricStage::FirstByte, (uint64_t)timing.firstByteUs);
+    if (timing.bodyUs >= 0) RecordStage(MetricStage::Body, (uint64_t)timing.bodyUs);
+}
+
+void CrawlMetrics::RecordMediaResult(bool ok)
+{
+    if (ok) m_mediaFiles.fetch_add(1, std::memory_order_relaxed);
+    else m_mediaFailures.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CrawlMetrics::WritePrometheus(std::ostream& out)
+{
+    out << "# TYPE crawler_uptime_seconds gauge\ncrawler_uptime_seconds " << Seconds(MicrosSince(m_started)) << "\n";
+    out << "# TYPE crawler_pages_total counter\ncrawler_pages_total " << m_pages.load() << "\n";
+    out << "# TYPE crawler_page_bytes_total counter\ncrawler_page_bytes_total " << m_bytes.load() << "\n";
+    out << "# TYPE crawler_media_files_total counter\ncrawler_media_files_total " << m_mediaFiles.load() << "\n";
+    out << "# TYPE crawler_media_failures_total counter\ncrawler_media_failures_total " << m_mediaFailures.load() << "\n";
+    out << "# TYPE crawler_media_bytes_total counter\ncrawler_media_bytes_total " << m_mediaBytes.load() << "\n";
+    out << "# TYPE crawler_failures_total counter\n";
+    for (size_t i = 0; i < (size_t)FailureReason::Count; ++i) {
+        out << "crawler_failures_total{reason=\"" << kFailureNames[i] << "\"} " << m_failures[i].load() << "\n";
+    }
+    out << "# TYPE crawler_http_status_failures_total counter\n";
+    for (size_t i = 0; i < 600; ++i) {
+        uint64_t count = m_statusCounts[i].load();
+        if (count > 0) out << "crawler_http_status_failures_total{status=\"" << i << "\"} " << count << "\n";
+    }
+    out << "# TYPE crawler_stage_seconds histogram\n";
+    for (size_t i = 0; i < (size_t)MetricStage::Count; ++i) {
+        WriteHistogram(out, "crawler_stage_seconds", std::string("stage=\"") + kStageNames[i] + "\"", m_stages[i]);
+    }
+    std::lock_guard<std::mutex> lock(m_hostMutex);
+    out << "# TYPE crawler_host_pages_total counter\n";
+    for (const auto& host : m_hosts) {
+        out << "crawler_host_pages_total{host=\"" << Escape(host.first) << "\"} " << host.second->pages.load() << "\n";
+    }
+    out << "# TYPE crawler_host_bytes_total counter\n";
+    for (const auto& host : m_hosts) {
+        out << "crawler_host_bytes_total{host=\"" << Escape(host.first) << "\"} " << host.second->bytes.load() << "\n";
+    }
+    out << "# TYPE crawler_host_failures_total counter\n";
+    for (const auto& host : m_hosts) {
+        out << "crawler_host_failures_total{host=\"" << Escape(host.first) << "\"} "
+            << host.second->failures.load() << "\n";
+    }
+    out << "# TYPE crawler_host_fetch_seconds histogram\n";
+    for (const auto& host : m_hosts) {
+        WriteHistogram(out, "crawler_host_fetch_seconds", "host=\"" + Escape(host.first) + "\"", host.second->fetch);
+    }
+}
+
+void CrawlMetrics::WriteJson(std::ostream& out)
+{
+    out << "{\"uptimeSeconds\":" << Seconds(MicrosSince(m_started)) << ",\"pages\":" << m_pages.load()
+        << ",\"pageBytes\":" << m_bytes.load() << ",\"mediaFiles\":" << m_mediaFiles.load()
+        << ",\"mediaFailures\":" << m_mediaFailures.load() << ",\"mediaBytes\":" << m_mediaBytes.load()
+        << ",\"failures\":{";
+    for (size_t i = 0; i < (size_t)FailureReason::Count; ++i) {
+        if (i > 0) out << ",";
+        out << "\"" << kFailureNames[i] << "\":" << m_failures[i].load();
+    }
+    out << "},\"httpStatus\":{";
+    bool first = true;
+    for (size_t i = 0; i < 600; ++i) {
+        uint64_t count = m_statusCounts[i].load();
+        if (count == 0) continue;
+        out << (first ? "" : ",") << "\"" << i << "\":" << count;
+        first = false;
+    }
+    out << "},\"stages\":{";
+    for (size_t i = 0; i < (size_t)MetricStage::Count; ++i) {
+        if (i > 0) out << ",";
+        out << "\"" << kStageNames[i] << "\":";
+        WriteJsonHistogram(out, m_stages[i]);
+    }
+    out << "},\"hosts\":{";
+    std::lock_guard<std::mutex> lock(m_hostMutex);
+    first = true;
+    for (const auto& host : m_hosts) {
+        out << (first ? "" : ",") << "\"" << Escape(host.first) << "\":{\"pages\":" << host.second->pages.load()
+            << ",\"bytes\":" << host.second->bytes.load() << ",\"failures\":" << host.second->failures.load()
+            << ",\"fetch\":";
+        WriteJsonHistogram(out, host.second->fetch);
+        out << "}";
+        first = false;
+    }
+    out << "}}\n";
+}
+
+std::string CrawlMetrics::Summary() const
+{
+    uint64_t failures = 0;
+    for (const auto& count : m_failures) failures += count.load();
+    double seconds = std::max(1e-3, MicrosSince(m_started) / 1e6);
+    std::ostringstream line;
+    line.setf(std::ios::fixed);
+    line.precision(1);
+    line << "Pages: " << m_pages.load() << " (" << m_pages.load() / seconds << "/s), "
+        << m_bytes.load() / seconds / 1024 << " KB/s, media: " << m_mediaFiles.load() << ", failures: " << failures;
+    return line.str();
+}
+
+bool CrawlMetrics::WriteFile()
+{
+    // 先写临时文件再改名，采集方不会读到写了一半的内容
+    std::string tempPath = m_path + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::trunc);
+        if (!out.is_open()) return false;
+        if (m_options.format == MetricsFormat::Json) WriteJson(out);
+        else WritePrometheus(out);
+        if (out.fail()) return false;
+    }
+    std::error_code ec;
+    fs::rename(tempPath, m_path, ec);
+    return !ec;
+}
+
+void CrawlMetrics::StartReporter(const MetricsOptions& options, const std::string& defaultDirectory)
+{
+    StopReporter();
+    m_options = options;
+    m_options.intervalMs = std::max(100, m_options.intervalMs);
+    m_path = options.path;
+    if (m_path.empty()) {
+        m_path = defaultDirectory + (options.format == MetricsFormat::Json ? "metrics.json" : "metrics.prom");
+    }
+    m_stopping = false;
+    m_reporter = std::thread(&CrawlMetrics::ReporterLoop, this);
+}
+
+void CrawlMetrics::StopReporter()
+{
+    if (!m_reporter.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(m_stopMutex);
+        m_stopping = true;
+    }
+    m_stopCv.notify_all();
+    m_reporter.join();
+    WriteFile();
+}
+
+void CrawlMetrics::ReporterLoop()
+{
+    uint64_t lastPages = m_pages.load();
+    uint64_t lastBytes = m_bytes.load() + m_mediaBytes.load();
+    Clock::time_point last = Clock::now();
+    std::unique_lock<std::mutex> lock(m_stopMutex);
+    while (!m_stopping) {
+        m_stopCv.wait_for(lock, std::chrono::milliseconds(m_options.intervalMs));
+        if (m_stopping) break;
+        lock.unlock();
+        if (!WriteFile()) std::cerr << "Failed to write metrics to " << m_path << "\n";
+        if (m_options.consoleRate) {
+            uint64_t pages = m_pages.load();
+            uint64_t bytes = m_bytes.load() + m_mediaBytes.load();
+            double seconds = std::max(1e-3, MicrosSince(last) / 1e6);
+            char line[128];
+            snprintf(line, sizeof(line), "[rate] %.1f pages/s, %.1f KB/s, %llu pages total\n",
+                (pages - lastPages) / seconds, (bytes - lastBytes) / seconds / 1024, (unsigned long long)pages);
+            std::cout << line << std::flush;
+            lastPages = pages;
+            lastBytes = bytes;
+            last = Clock::now();
+        }
+        lock.lock();
+    }
+}
@@ -0,0 +1,165 @@
+﻿#ifndef METRICS_H
+#define METRICS_H
+
+#include "transport.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+enum class MetricStage
+{
+    Dns,
+    Connect,
+    Tls,
+    FirstByte,
+    Body,
+    // 抓取流程里正文与链接在同一遍扫描中得到，都计入 Parse；
+    // TextExtract 只记单独调用 ExtractTextContent 的耗时
+    Parse,
+    TextExtract,
+    // 编码检测与转换为 UTF-8
+    Transcode,
+    DiskWrite,
+    PolitenessWait,
+    // 建全文索引时的分词与累积倒排表，在单独的线程里
+    Index,
+    Count
+};
+
+enum class FailureReason
+{
+    HttpStatus,
+    Timeout,
+    Dns,
+    Connect,
+    Tls,
+    // 地址无法解析成 scheme/host/port（原先 WinHttpCrackUrl 失败的情况）
+    BadUrl,
+    Protocol,
+    Decode,
+    Aborted,
+    // 媒体下载：内容不是媒体，或超过该类型的大小上限
+    NotMedia,
+    MediaTooLarge,
+    Count
+};
+
+const char* MetricStageName(MetricStage stage);
+const char* FailureReasonName(FailureReason reason);
+FailureReason FailureFromTransport(TransportError error);
+
+enum class MetricsFormat
+{
+    Prometheus,
+    Json
+};
+
+struct MetricsOptions
+{
+    bool enabled = true;
+    // 为空时使用程序目录下的 metrics.prom 或 metrics.json
+    std::string path;
+    MetricsFormat format = MetricsFormat::Prometheus;
+    int intervalMs = 5000;
+    // 每个周期在控制台打印一行页面数/秒与字节数/秒
+    bool consoleRate = true;
+};
+
+// 以 100us 为起点按 2 倍增长的固定桶，记录只做几次 relaxed 原子加法
+class LatencyHistogram
+{
+public:
+    static constexpr size_t kBucketCount = 18;
+
+    void Record(uint64_t micros);
+    uint64_t Count() const { return m_count.load(std::memory_order_relaxed); }
+    uint64_t SumMicros() const { return m_sum.load(std::memory_order_relaxed); }
+    uint64_t Bucket(size_t i) const { return m_buckets[i].load(std::memory_order_relaxed); }
+    // 第 i 个桶的上限，最后一个桶（i == kBucketCount）没有上限
+    static uint64_t BucketBoundMicros(size_t i) { return 100ull << i; }
+    // 按桶上限估计的分位数
+    uint64_t QuantileMicros(double q) const;
+
+private:
+    std::atomic<uint64_t> m_count{ 0 };
+    std::atomic<uint64_t> m_sum{ 0 };
+    std::atomic<uint64_t> m_buckets[kBucketCount + 1]{};
+};
+
+struct HostMetrics
+{
+    std::atomic<uint64_t> pages{ 0 };
+    std::atomic<uint64_t> bytes{ 0 };
+    std::atomic<uint64_t> failures{ 0 };
+    // 从发出请求到收完响应体
+    LatencyHistogram fetch;
+};
+
+// 抓取过程的计数器与各阶段耗时，全部方法线程安全
+class CrawlMetrics
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    CrawlMetrics();
+    ~CrawlMetrics();
+    CrawlMetrics(const CrawlMetrics&) = delete;
+    CrawlMetrics& operator=(const CrawlMetrics&) = delete;
+
+    void RecordStage(MetricStage stage, uint64_t micros) { m_stages[(size_t)stage].Record(micros); }
+    void RecordStage(MetricStage stage, Clock::time_point start) { RecordStage(stage, MicrosSince(start)); }
+    // 记录传输层测得的 DNS/连接/TLS/首字节/响应体耗时，没有经过的阶段不计
+    void RecordTransport(const TransportTiming& timing);
+    // 主机表只在第一次见到某主机时加锁插入，返回的引用一直有效
+    HostMetrics& Host(const std::string& host);
+    void RecordPage(HostMetrics& host, uint64_t bytes, uint64_t fetchMicros);
+    void RecordFailure(HostMetrics* host, FailureReason reason, int httpStatus = 0);
+    void RecordMediaBytes(uint64_t bytes) { m_mediaBytes.fetch_add(bytes, std::memory_order_relaxed); }
+    void RecordMediaResult(bool ok);
+    uint64_t PageBytes() const { return m_bytes.load(std::memory_order_relaxed); }
+
+    void WritePrometheus(std::ostream& out);
+    void WriteJson(std::ostream& out);
+    // 控制台一行的概况，供 Start 结束时打印
+    std::string Summary() const;
+
+    // 启动后台线程，按 intervalMs 写出指标文件并打印速率
+    void StartReporter(const MetricsOptions& options, const std::string& defaultDirectory);
+    // 停止后台线程并最后写出一次
+    void StopReporter();
+
+    static uint64_t MicrosSince(Clock::time_point start);
+
+private:
+    bool WriteFile();
+    void ReporterLoop();
+
+    Clock::time_point m_started;
+    LatencyHistogram m_stages[(size_t)MetricStage::Count];
+    std::atomic<uint64_t> m_failures[(size_t)FailureReason::Count]{};
+    std::atomic<uint64_t> m_statusCounts[600]{};
+    std::atomic<uint64_t> m_pages{ 0 };
+    std::atomic<uint64_t> m_bytes{ 0 };
+    std::atomic<uint64_t> m_mediaFiles{ 0 };
+    std::atomic<uint64_t> m_mediaFailures{ 0 };
+    std::atomic<uint64_t> m_mediaBytes{ 0 };
+
+    std::mutex m_hostMutex;
+    std::map<std::string, std::unique_ptr<HostMetrics>> m_hosts;
+
+    MetricsOptions m_options;
+    std::string m_path;
+    std::mutex m_stopMutex;
+    std::condition_variable m_stopCv;
+    bool m_stopping = false;
+    std::thread m_reporter;
+};
+
+#endif
@@ -0,0 +1,157 @@
+﻿#include "near_duplicate.h"
+#include <algorithm>
+#include <array>
+
+namespace
+{
+    uint64_t Mix(uint64_t x)
+    {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ull;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebull;
+        x ^= x >> 31;
+        return x;
+    }
+
+    bool IsAsciiWord(unsigned char c)
+    {
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    }
+
+    // 依次产生词的哈希：ASCII 字母数字连成一个词并转小写，非 ASCII 的每个 UTF-8 字符单独成词，其余为分隔符
+    template <typename Callback>
+    void ForEachToken(std::string_view text, Callback&& callback)
+    {
+        size_t i = 0;
+        while (i < text.size()) {
+            unsigned char c = (unsigned char)text[i];
+            if (IsAsciiWord(c)) {
+                uint64_t hash = 0xcbf29ce484222325ull;
+                while (i < text.size() && IsAsciiWord((unsigned char)text[i])) {
+                    unsigned char w = (unsigned char)text[i++];
+                    if (w >= 'A' && w <= 'Z') w = (unsigned char)(w - 'A' + 'a');
+                    hash = (hash ^ w) * 0x100000001b3ull;
+                }
+                callback(hash);
+            }
+            else if (c >= 0x80) {
+                size_t length = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+                uint64_t hash = 0xcbf29ce484222325ull;
+                for (size_t k = 0; k < length && i < text.size(); ++k) {
+                    hash = (hash ^ (unsigned char)text[i++]) * 0x100000001b3ull;
+                }
+                // 全角空格和 CJK 标点（U+3000-U+303F）不算内容
+                if (!(length == 3 && (unsigned char)text[i - 3] == 0xE3 && (unsigned char)text[i - 2] == 0x80)) {
+                    callback(hash);
+                }
+            }
+            else {
+                i++;
+            }
+        }
+    }
+}
+
+uint64_t SimHash(std::string_view text, int shingleSize)
+{
+    shingleSize = std::clamp(shingleSize, 1, 8);
+    // 表里第 b 项的第 i 个字节是 b 的第 i 位，一次加法同时给 8 个位计数；
+    // 字节计数器最多到 255，满了就并入 ones
+    static const auto spread = [] {
+        std::array<uint64_t, 256> table{};
+        for (int b = 0; b < 256; ++b) {
+            for (int i = 0; i < 8; ++i) table[b] |= (uint64_t)((b >> i) & 1) << (8 * i);
+        }
+        return table;
+    }();
+    uint32_t ones[64] = {};
+    uint64_t lanes[8] = {};
+    uint32_t features = 0;
+    uint32_t pending = 0;
+    uint64_t window[8] = {};
+    size_t tokens = 0;
+    auto flush = [&] {
+        for (int j = 0; j < 8; ++j) {
+            for (int i = 0; i < 8; ++i) ones[8 * j + i] += (uint32_t)((lanes[j] >> (8 * i)) & 0xFF);
+            lanes[j] = 0;
+        }
+        pending = 0;
+    };
+    auto add = [&](uint64_t feature) {
+        feature = Mix(feature);
+        for (int j = 0; j < 8; ++j) lanes[j] += spread[(feature >> (8 * j)) & 0xFF];
+        features++;
+        if (++pending == 255) flush();
+    };
+    // 按位置旋转后异或，同样的词换了顺序得到不同的特征
+    auto combine = [&](size_t count, size_t first) {
+        uint64_t feature = 0;
+        for (size_t k = 0; k < count; ++k) {
+            uint64_t token = window[(first + k) % shingleSize];
+            int shift = (int)(k * 7 % 64);
+            feature ^= shift == 0 ? token : (token << shift) | (token >> (64 - shift));
+        }
+        return feature;
+    };
+    ForEachToken(text, [&](uint64_t token) {
+        window[tokens % shingleSize] = token;
+        tokens++;
+        if (tokens >= (size_t)shingleSize) add(combine(shingleSize, tokens));
+    });
+    // 词数不够一个 shingle 时把已有的词合成一个特征
+    if (tokens > 0 && tokens < (size_t)shingleSize) add(combine(tokens, 0));
+    flush();
+    uint64_t fingerprint = 0;
+    for (int bit = 0; bit < 64; ++bit) {
+        if (ones[bit] * 2 > features) fingerprint |= 1ull << bit;
+    }
+    return fingerprint;
+}
+
+NearDuplicateIndex::NearDuplicateIndex(const NearDuplicateOptions& options)
+    : m_options(options)
+{
+    m_options.maxDistance = std::clamp(m_options.maxDistance, 0, 7);
+    m_blocks = m_options.maxDistance + 1;
+    m_blockBits = (64 + m_blocks - 1) / m_blocks;
+    m_tables.resize(m_blocks);
+}
+
+uint64_t NearDuplicateIndex::Block(uint64_t fingerprint, int block) const
+{
+    int shift = block * m_blockBits;
+    int bits = std::min(m_blockBits, 64 - shift);
+    uint64_t mask = bits >= 64 ? ~0ull : (1ull << bits) - 1;
+    return (fingerprint >> shift) & mask;
+}
+
+bool NearDuplicateIndex::FindOrAdd(const std::string& url, std::string_view text, std::string& original)
+{
+    if (text.size() < m_options.minTextBytes) return false;
+    uint64_t fingerprint = SimHash(text, m_options.shingleSize);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (int block = 0; block < m_blocks; ++block) {
+        auto it = m_tables[block].find(Block(fingerprint, block));
+        if (it == m_tables[block].end()) continue;
+        for (uint32_t index : it->second) {
+            if (HammingDistance(m_fingerprints[index], fingerprint) <= m_options.maxDistance) {
+                original = m_urls[index];
+                return true;
+            }
+        }
+    }
+    uint32_t index = (uint32_t)m_fingerprints.size();
+    m_fingerprints.push_back(fingerprint);
+    m_urls.push_back(url);
+    for (int block = 0; block < m_blocks; ++block) {
+        m_tables[block][Block(fingerprint, block)].push_back(index);
+    }
+    return false;
+}
+
+size_t NearDuplicateIndex::Size()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_fingerprints.size();
+}
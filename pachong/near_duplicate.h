@@ -0,0 +1,62 @@
+﻿#ifndef NEAR_DUPLICATE_H
+#define NEAR_DUPLICATE_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct NearDuplicateOptions
+{
+    // 默认关闭：打开后近似重复的页面只在归档里记为别名，不写正文也不进全文索引
+    bool enabled = false;
+    // 两个指纹相差不超过这么多位就算近似重复，最大 7
+    int maxDistance = 3;
+    // 连续几个词（中文按字）组成一个特征
+    int shingleSize = 3;
+    // 正文太短的页面（跳转页、空模板）不参与比较
+    size_t minTextBytes = 200;
+    // 近似重复的页面不再展开链接
+    bool suppressLinks = false;
+};
+
+// 64 位 SimHash：英文和数字按词、其他字符按字切分，对相邻 shingleSize 个词的组合加权
+uint64_t SimHash(std::string_view text, int shingleSize);
+
+inline int HammingDistance(uint64_t a, uint64_t b)
+{
+    uint64_t x = a ^ b;
+    int count = 0;
+    while (x) {
+        x &= x - 1;
+        count++;
+    }
+    return count;
+}
+
+// 已见页面的 SimHash 索引。指纹切成 maxDistance + 1 段，距离不超过 maxDistance 的两个指纹
+// 至少有一段完全相同，所以只需在每段的表里找候选再逐个比较。线程安全
+class NearDuplicateIndex
+{
+public:
+    explicit NearDuplicateIndex(const NearDuplicateOptions& options);
+
+    // 找到近似重复时返回 true 并给出最早的那个 URL；否则记下这一页
+    bool FindOrAdd(const std::string& url, std::string_view text, std::string& original);
+    size_t Size();
+
+private:
+    uint64_t Block(uint64_t fingerprint, int block) const;
+
+    NearDuplicateOptions m_options;
+    int m_blocks;
+    int m_blockBits;
+    std::mutex m_mutex;
+    std::vector<uint64_t> m_fingerprints;
+    std::vector<std::string> m_urls;
+    std::vector<std::unordered_map<uint64_t, std::vector<uint32_t>>> m_tables;
+};
+
+#endif
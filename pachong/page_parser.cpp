@@ -0,0 +1,62 @@
+﻿#include "page_parser.h"
+
+bool ResolveLink(std::string_view href, const UrlView& base, std::string& absoluteUrl, bool sameOrigin)
+{
+    absoluteUrl.clear();
+    if (href.empty() || !AppendResolvedUrl(base, href, absoluteUrl)) return false;
+    UrlView resolved;
+    if (!ParseUrl(absoluteUrl, resolved)) return false;
+    return sameOrigin ? IsSameOrigin(base, resolved) : resolved.IsHttp();
+}
+
+bool ResolveMediaUrl(std::string_view src, const UrlView& base, std::string& absoluteUrl)
+{
+    absoluteUrl.clear();
+    if (src.empty() || !AppendResolvedUrl(base, src, absoluteUrl)) return false;
+    UrlView resolved;
+    return ParseUrl(absoluteUrl, resolved) && resolved.IsHttp();
+}
+
+PageParser::PageParser(const std::string& baseUrl, bool wantLinks, PageContent& page, bool sameOrigin)
+    : m_wantLinks(wantLinks), m_sameOrigin(sameOrigin), m_page(page), m_textBuilder(page.text)
+{
+    m_page.links.clear();
+    m_page.mediaUrls.clear();
+    Rebase(baseUrl);
+    m_callbacks.onText = [this](std::string_view raw) { m_textBuilder.Append(raw); };
+}
+
+void PageParser::Rebase(const std::string& baseUrl)
+{
+    // 基准地址每页只解析一次，之后每个链接只为结果字符串分配内存
+    m_baseUrl = baseUrl;
+    bool baseValid = ParseUrl(m_baseUrl, m_base) && m_base.IsHttp();
+    m_callbacks.onLink = nullptr;
+    m_callbacks.onMedia = nullptr;
+    if (m_wantLinks && baseValid) {
+        m_callbacks.onLink = [this](std::string_view href) {
+            std::string absoluteUrl;
+            if (ResolveLink(href, m_base, absoluteUrl, m_sameOrigin)) {
+                m_page.links.push_back(std::move(absoluteUrl));
+            }
+        };
+    }
+    if (baseValid) {
+        m_callbacks.onMedia = [this](std::string_view src) {
+            std::string absoluteUrl;
+            if (ResolveMediaUrl(src, m_base, absoluteUrl)) {
+                m_page.mediaUrls.insert(std::move(absoluteUrl));
+            }
+        };
+    }
+}
+
+void PageParser::Feed(std::string_view chunk)
+{
+    m_tokenizer.Feed(chunk, m_callbacks);
+}
+
+void PageParser::Finish()
+{
+    m_tokenizer.Finish(m_callbacks);
+}
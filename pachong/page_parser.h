@@ -0,0 +1,48 @@
+﻿#ifndef PAGE_PARSER_H
+#define PAGE_PARSER_H
+
+#include "html_tokenizer.h"
+#include "url.h"
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct PageContent
+{
+    // 原始响应体，抓取线程之间不共享，多页之间复用容量
+    std::string html;
+    std::vector<std::string> links;
+    std::set<std::string> mediaUrls;
+    std::string text;
+};
+
+// http(s) 链接才返回 true，sameOrigin 时还要求与 base 同源
+bool ResolveLink(std::string_view href, const UrlView& base, std::string& absoluteUrl, bool sameOrigin = true);
+bool ResolveMediaUrl(std::string_view src, const UrlView& base, std::string& absoluteUrl);
+
+// 边接收边解析：每收到一块响应体就 Feed，结束后 Finish，page 里的结果随之更新
+class PageParser
+{
+public:
+    PageParser(const std::string& baseUrl, bool wantLinks, PageContent& page, bool sameOrigin = true);
+    PageParser(const PageParser&) = delete;
+    PageParser& operator=(const PageParser&) = delete;
+
+    // 第一次 Feed 之前可以换成重定向后的地址，相对链接和同源判断都以它为准
+    void Rebase(const std::string& baseUrl);
+    void Feed(std::string_view chunk);
+    void Finish();
+
+private:
+    std::string m_baseUrl;
+    UrlView m_base;
+    bool m_wantLinks;
+    bool m_sameOrigin;
+    PageContent& m_page;
+    HtmlTextBuilder m_textBuilder;
+    HtmlCallbacks m_callbacks;
+    HtmlTokenizer m_tokenizer;
+};
+
+#endif
@@ -0,0 +1,160 @@
+﻿#include "rate_limiter.h"
+#include "http_cache.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // 本地或很快的主机上首字节时间的抖动不算变慢
+    const double kMinSlowdownUs = 100000;
+}
+
+HostRateLimiter::HostRateLimiter(const RateLimiterOptions& options)
+    : m_options(options)
+{
+    m_options.minRate = std::max(0.001, m_options.minRate);
+    m_options.maxRate = std::max(m_options.minRate, m_options.maxRate);
+    m_options.initialRate = std::clamp(m_options.initialRate, m_options.minRate, m_options.maxRate);
+    m_options.burst = std::max(1.0, m_options.burst);
+    m_options.backoffFactor = std::clamp(m_options.backoffFactor, 0.01, 1.0);
+    m_options.slowFactor = std::clamp(m_options.slowFactor, 0.01, 1.0);
+    Load();
+}
+
+HostFeedback HostRateLimiter::ClassifyStatus(int status)
+{
+    if (status == 429 || status == 503) return HostFeedback::Throttled;
+    if (status >= 500) return HostFeedback::ServerError;
+    if (status >= 200 && status < 400) return HostFeedback::Success;
+    return HostFeedback::Neutral;
+}
+
+long long HostRateLimiter::ParseRetryAfterSeconds(const std::string& value, time_t now)
+{
+    if (value.empty()) return -1;
+    char* end = nullptr;
+    long long seconds = strtoll(value.c_str(), &end, 10);
+    if (end != value.c_str() && *end == '\0') return seconds >= 0 ? seconds : -1;
+    time_t date;
+    if (!ParseHttpDate(value, date)) return -1;
+    return date > now ? (long long)(date - now) : 0;
+}
+
+HostRateLimiter::HostState& HostRateLimiter::StateLocked(const std::string& host)
+{
+    HostState& state = m_hosts[host];
+    if (state.rate <= 0) state.rate = m_options.initialRate;
+    if (!state.started) {
+        // 第一个请求不用等待
+        state.started = true;
+        state.tokens = 1;
+        state.refilledAt = Clock::now();
+    }
+    return state;
+}
+
+void HostRateLimiter::RefillLocked(HostState& state, Clock::time_point now)
+{
+    if (now <= state.refilledAt) return;
+    double seconds = std::chrono::duration<double>(now - state.refilledAt).count();
+    state.tokens = std::min(m_options.burst, state.tokens + seconds * state.rate);
+    state.refilledAt = now;
+}
+
+HostRateLimiter::Clock::time_point HostRateLimiter::NextAllowed(const std::string& host, Clock::time_point now)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    HostState& state = StateLocked(host);
+    RefillLocked(state, now);
+    Clock::time_point allowed = now;
+    if (state.tokens < 1) {
+        auto wait = std::chrono::duration<double>((1 - state.tokens) / state.rate);
+        allowed = now + std::chrono::duration_cast<Clock::duration>(wait);
+    }
+    return std::max(allowed, state.blockedUntil);
+}
+
+void HostRateLimiter::Consume(const std::string& host, Clock::time_point now)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    HostState& state = StateLocked(host);
+    RefillLocked(state, now);
+    state.tokens -= 1;
+}
+
+void HostRateLimiter::Report(const std::string& host, HostFeedback feedback, long long latencyUs,
+    const std::string& retryAfter)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    HostState& state = StateLocked(host);
+    RefillLocked(state, Clock::now());
+    double factor = 1;
+    if (feedback == HostFeedback::Throttled || feedback == HostFeedback::NetworkError) factor = m_options.backoffFactor;
+    else if (feedback == HostFeedback::ServerError) factor = (1 + m_options.backoffFactor) / 2;
+    if (latencyUs > 0) {
+        bool slow = state.latencyUs > 0 && latencyUs > state.latencyUs * m_options.slowLatencyRatio &&
+            latencyUs - state.latencyUs > kMinSlowdownUs;
+        state.latencyUs = state.latencyUs > 0 ? state.latencyUs * 0.8 + latencyUs * 0.2 : (double)latencyUs;
+        if (slow) factor = std::min(factor, m_options.slowFactor);
+        else if (feedback == HostFeedback::Success) state.rate += m_options.increaseStep;
+    }
+    state.rate = std::clamp(state.rate * factor, m_options.minRate, m_options.maxRate);
+    // 退让后桶里积攒的令牌按新速率作废，避免马上又连发
+    if (factor < 1) state.tokens = std::min(state.tokens, 0.0);
+    long long seconds = ParseRetryAfterSeconds(retryAfter, time(nullptr));
+    if (seconds >= 0 && feedback != HostFeedback::Success) {
+        seconds = std::min<long long>(seconds, m_options.maxRetryAfterSeconds);
+        state.blockedUntil = std::max(state.blockedUntil, Clock::now() + std::chrono::seconds(seconds));
+    }
+}
+
+double HostRateLimiter::Rate(const std::string& host)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_hosts.find(host);
+    return it == m_hosts.end() || it->second.rate <= 0 ? m_options.initialRate : it->second.rate;
+}
+
+void HostRateLimiter::Load()
+{
+    if (m_options.statePath.empty()) return;
+    std::ifstream in(m_options.statePath);
+    std::string line;
+    while (std::getline(in, line)) {
+        // host \t 速率 \t 首字节时间均值（微秒）
+        std::istringstream fields(line);
+        std::string host;
+        double rate = 0, latencyUs = 0;
+        if (!std::getline(fields, host, '\t') || !(fields >> rate)) continue;
+        fields >> latencyUs;
+        HostState& state = m_hosts[host];
+        state.rate = std::clamp(rate, m_options.minRate, m_options.maxRate);
+        state.latencyUs = std::max(0.0, latencyUs);
+    }
+}
+
+bool HostRateLimiter::Save()
+{
+    if (m_options.statePath.empty()) return false;
+    std::string tempPath = m_options.statePath + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::trunc);
+        if (!out.is_open()) return false;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& host : m_hosts) {
+            if (host.second.rate <= 0) continue;
+            out << host.first << '\t' << host.second.rate << '\t' << (long long)host.second.latencyUs << '\n';
+        }
+        if (out.fail()) return false;
+    }
+    std::error_code ec;
+    fs::rename(tempPath, m_options.statePath, ec);
+    return !ec;
+}
@@ -0,0 +1,90 @@
+﻿#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+struct RateLimiterOptions
+{
+    // 关闭时按 SchedulerOptions 的随机间隔抓取
+    bool enabled = true;
+    // 每秒请求数；第一次见到的主机从 initialRate 开始
+    double initialRate = 1.0;
+    double minRate = 0.05;
+    double maxRate = 10.0;
+    // 令牌桶容量，1 表示请求之间严格按 1/rate 间隔
+    double burst = 1.0;
+    // 每个又快又成功的响应让速率加多少
+    double increaseStep = 0.1;
+    // 429/503/连接失败时速率乘以该系数
+    double backoffFactor = 0.5;
+    // 首字节时间超过平均值这么多倍时视为变慢，速率乘以 slowFactor
+    double slowLatencyRatio = 2.0;
+    double slowFactor = 0.8;
+    // Retry-After 的上限
+    int maxRetryAfterSeconds = 3600;
+    // 为空时使用程序目录下的 rate_limits.tsv
+    std::string statePath;
+};
+
+enum class HostFeedback
+{
+    Success,
+    // 429、503
+    Throttled,
+    // 其余 5xx
+    ServerError,
+    // 连接失败、超时等网络层错误
+    NetworkError,
+    // 4xx 等与负载无关的结果，不调整速率
+    Neutral
+};
+
+// 按主机的自适应令牌桶：响应又快又成功时线性提速，被限流、出错或变慢时成倍退让（AIMD）。
+// 学到的速率写入 statePath，下次抓取从上次的速率开始。线程安全
+class HostRateLimiter
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit HostRateLimiter(const RateLimiterOptions& options);
+
+    // 该主机最早可以发出下一个请求的时间
+    Clock::time_point NextAllowed(const std::string& host, Clock::time_point now);
+    // 发出请求时取走一个令牌
+    void Consume(const std::string& host, Clock::time_point now);
+    // latencyUs 为首字节时间，retryAfter 为原始响应头
+    void Report(const std::string& host, HostFeedback feedback, long long latencyUs, const std::string& retryAfter);
+    double Rate(const std::string& host);
+    bool Save();
+
+    static HostFeedback ClassifyStatus(int status);
+    // 秒数或 HTTP 日期，无法解析时返回 -1
+    static long long ParseRetryAfterSeconds(const std::string& value, time_t now);
+
+private:
+    struct HostState
+    {
+        double rate = 0;
+        double tokens = 0;
+        // 首字节时间的指数移动平均，0 表示还没有样本
+        double latencyUs = 0;
+        Clock::time_point refilledAt;
+        Clock::time_point blockedUntil;
+        bool started = false;
+    };
+
+    HostState& StateLocked(const std::string& host);
+    void RefillLocked(HostState& state, Clock::time_point now);
+    void Load();
+
+    RateLimiterOptions m_options;
+    std::mutex m_mutex;
+    std::unordered_map<std::string, HostState> m_hosts;
+};
+
+#endif
@@ -0,0 +1,223 @@
+﻿#include "scheduler.h"
+#include <algorithm>
+#include <cmath>
+
+PolitenessScheduler::PolitenessScheduler(const SchedulerOptions& options, HostRateLimiter* limiter)
+    : m_options(options), m_limiter(limiter), m_rng(std::random_device{}())
+{
+    m_options.perHostConcurrency = std::max(1, m_options.perHostConcurrency);
+    m_options.minDelayMs = std::max(0, m_options.minDelayMs);
+    m_options.maxDelayMs = std::max(m_options.minDelayMs, m_options.maxDelayMs);
+    m_options.frontier.maxInMemory = std::max<size_t>(16, m_options.frontier.maxInMemory);
+    std::string spillPath = m_options.frontier.spillPath.empty() ? "frontier.spill" : m_options.frontier.spillPath;
+    m_spill = std::make_unique<FrontierSpill>(spillPath);
+}
+
+void PolitenessScheduler::Push(CrawlTask task)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stopped) return;
+    HostQueue& queue = m_hosts[task.host];
+    queue.tasks.Push(task, m_seq++);
+    IndexLocked(queue);
+    m_pending++;
+    m_inMemory++;
+    m_idleReported = false;
+    if (m_inMemory > m_options.frontier.maxInMemory) SpillLocked();
+    ScheduleLocked(task.host, queue);
+    m_cv.notify_one();
+}
+
+bool PolitenessScheduler::Pop(CrawlTask& task)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        if (m_stopped) return false;
+        Clock::time_point now = Clock::now();
+        ForgetDrainedLocked(now);
+        while (!m_ready.empty() && m_ready.top().first <= now) {
+            ReadyEntry entry = m_ready.top();
+            m_ready.pop();
+            double rank = RankLocked(m_hosts[entry.second]);
+            m_runnable.push({ rank, entry.first, std::move(entry.second) });
+        }
+        if (m_runnable.empty()) {
+            if (m_ready.empty()) {
+                if (m_pending == 0 && m_inFlight == 0) {
+                    if (!m_held) {
+                        m_cv.notify_all();
+                        return false;
+                    }
+                    if (!m_idleReported) {
+                        m_idleReported = true;
+                        if (m_onIdle) m_onIdle();
+                    }
+                }
+                m_cv.wait(lock);
+            }
+            else {
+                m_cv.wait_until(lock, m_ready.top().first);
+            }
+            continue;
+        }
+        std::string host = m_runnable.top().host;
+        m_runnable.pop();
+        HostQueue& queue = m_hosts[host];
+        queue.scheduled = false;
+        if (queue.tasks.Empty() || queue.active >= m_options.perHostConcurrency) continue;
+        // 限流或退让可能在排队期间推迟了该主机，取任务前再问一次
+        if (m_limiter) queue.nextAllowed = std::max(queue.nextAllowed, m_limiter->NextAllowed(host, now));
+        if (queue.nextAllowed > now) {
+            ScheduleLocked(host, queue);
+            continue;
+        }
+        // 从溢出文件读回的任务会让内存里的个数变多，读失败丢掉的任务也要从计数里去掉
+        size_t sizeBefore = queue.tasks.Size();
+        size_t memoryBefore = queue.tasks.InMemory();
+        bool popped = queue.tasks.Pop(task, *m_spill);
+        m_pending -= sizeBefore - queue.tasks.Size();
+        m_inMemory = m_inMemory - memoryBefore + queue.tasks.InMemory();
+        IndexLocked(queue);
+        if (!popped) {
+            if (queue.active == 0) m_drained.emplace(queue.nextAllowed, host);
+            continue;
+        }
+        task.host = host;
+        queue.active++;
+        queue.fetched++;
+        if (m_limiter) m_limiter->Consume(host, now);
+        else queue.nextAllowed = now + NextDelayLocked();
+        m_inFlight++;
+        if (m_inMemory > m_options.frontier.maxInMemory) SpillLocked();
+        ScheduleLocked(host, queue);
+        return true;
+    }
+}
+
+void PolitenessScheduler::Done(const CrawlTask& task)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    HostQueue& queue = m_hosts[task.host];
+    if (queue.active > 0) queue.active--;
+    if (m_inFlight > 0) m_inFlight--;
+    if (queue.active == 0 && queue.tasks.Empty()) m_drained.emplace(queue.nextAllowed, task.host);
+    ScheduleLocked(task.host, queue);
+    m_cv.notify_all();
+}
+
+void PolitenessScheduler::Stop()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopped = true;
+    m_cv.notify_all();
+}
+
+void PolitenessScheduler::Hold(std::function<void()> onIdle)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_held = true;
+    m_idleReported = false;
+    m_onIdle = std::move(onIdle);
+}
+
+void PolitenessScheduler::Release()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_held = false;
+    m_cv.notify_all();
+}
+
+bool PolitenessScheduler::IsIdle()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pending == 0 && m_inFlight == 0;
+}
+
+size_t PolitenessScheduler::Pending()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pending;
+}
+
+void PolitenessScheduler::ScheduleLocked(const std::string& host, HostQueue& queue)
+{
+    if (queue.scheduled || queue.tasks.Empty() || queue.active >= m_options.perHostConcurrency) return;
+    queue.scheduled = true;
+    m_ready.emplace(std::max(queue.nextAllowed, Clock::now()), host);
+}
+
+double PolitenessScheduler::RankLocked(const HostQueue& queue) const
+{
+    return queue.tasks.BestScore() - m_options.frontier.hostFairness * std::log2(1.0 + (double)queue.fetched);
+}
+
+void PolitenessScheduler::SpillLocked()
+{
+    // 一次降到上限的 3/4，不必每次入队都写一小段。写出的是所有主机合起来分数最低的那部分，
+    // 任务分散在很多主机上时也能降下来
+    size_t target = m_options.frontier.maxInMemory / 4 * 3;
+    if (m_inMemory <= target || m_spill->Failed() || m_bySize.empty()) return;
+    std::vector<float> scores;
+    std::vector<HostQueue*> hosts;
+    scores.reserve(m_inMemory);
+    hosts.reserve(m_bySize.size());
+    for (const auto& item : m_bySize) {
+        hosts.push_back(item.second);
+        item.second->tasks.AppendScores(scores);
+    }
+    size_t excess = std::min(m_inMemory - target, scores.size());
+    if (excess == 0) return;
+    std::nth_element(scores.begin(), scores.begin() + (excess - 1), scores.end());
+    float threshold = scores[excess - 1];
+    // 分数正好等于门槛的任务只写出够数的那几个
+    size_t ties = (size_t)std::count(scores.begin(), scores.begin() + excess, threshold);
+    for (HostQueue* queue : hosts) {
+        if (m_spill->Failed()) return;
+        size_t below = 0;
+        size_t equal = 0;
+        queue->tasks.CountScores(threshold, below, equal);
+        equal = std::min(equal, ties);
+        ties -= equal;
+        if (below + equal == 0) continue;
+        m_inMemory -= queue->tasks.SpillLowest(below + equal, *m_spill);
+        IndexLocked(*queue);
+    }
+}
+
+void PolitenessScheduler::IndexLocked(HostQueue& queue)
+{
+    size_t size = queue.tasks.InMemory();
+    if (size == queue.indexedSize) return;
+    if (queue.indexedSize > 0 && size > 0) {
+        // 复用节点，入队出队时不分配内存
+        auto node = m_bySize.extract({ queue.indexedSize, &queue });
+        node.value().first = size;
+        m_bySize.insert(std::move(node));
+    }
+    else if (size > 0) {
+        m_bySize.emplace(size, &queue);
+    }
+    else {
+        m_bySize.erase({ queue.indexedSize, &queue });
+    }
+    queue.indexedSize = size;
+}
+
+void PolitenessScheduler::ForgetDrainedLocked(Clock::time_point now)
+{
+    while (!m_drained.empty() && m_drained.top().first <= now) {
+        auto it = m_hosts.find(m_drained.top().second);
+        m_drained.pop();
+        if (it == m_hosts.end()) continue;
+        const HostQueue& queue = it->second;
+        // 期间又有了任务、正在抓或者间隔被推后的主机留着，等下次取完再说
+        if (queue.active > 0 || queue.scheduled || !queue.tasks.Empty() || queue.nextAllowed > now) continue;
+        m_hosts.erase(it);
+    }
+}
+
+std::chrono::milliseconds PolitenessScheduler::NextDelayLocked()
+{
+    std::uniform_int_distribution<> dis(m_options.minDelayMs, m_options.maxDelayMs);
+    return std::chrono::milliseconds(dis(m_rng));
+}
@@ -0,0 +1,122 @@
+﻿#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <chrono>
+#include "frontier.h"
+#include "rate_limiter.h"
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct CrawlTask
+{
+    std::string url;
+    int depth = 0;
+    std::string host;
+    // 检查点里的任务编号，0 表示未记录
+    uint64_t id = 0;
+    // 越大越先抓，见 UrlScorer
+    float priority = 0;
+};
+
+struct SchedulerOptions
+{
+    int perHostConcurrency = 1;
+    // 没有速率限制器时同一主机两次请求之间的随机间隔
+    int minDelayMs = 500;
+    int maxDelayMs = 2000;
+    RateLimiterOptions rateLimit;
+    FrontierOptions frontier;
+};
+
+// 按主机分队列的抓取边界：不同主机可并行抓取，同一主机的请求间隔由速率限制器决定，
+// 没有限制器时保持随机礼貌间隔。主机内按任务分数取，同时可抓的几个主机之间先抓
+// 最高分减去公平性扣分后更高的那个；内存里的任务超过上限时把低分任务写到溢出文件。
+// 任务取完、礼貌间隔也已过去的主机从表里删掉，再出现时公平性计数从零开始
+class PolitenessScheduler
+{
+public:
+    explicit PolitenessScheduler(const SchedulerOptions& options, HostRateLimiter* limiter = nullptr);
+
+    void Push(CrawlTask task);
+    // 阻塞到有主机可以抓取为止；边界为空且没有进行中的任务或已停止时返回 false
+    bool Pop(CrawlTask& task);
+    void Done(const CrawlTask& task);
+    void Stop();
+    // 分片模式下本地边界空了也不结束，等别的分片发来链接；每次变为空闲时在持锁状态下调用 onIdle
+    void Hold(std::function<void()> onIdle);
+    // 取消 Hold，空闲的 Pop 随即返回 false
+    void Release();
+    bool IsIdle();
+    // 待抓取的任务数，包括溢出到文件的部分
+    size_t Pending();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct HostQueue
+    {
+        HostFrontier tasks;
+        int active = 0;
+        bool scheduled = false;
+        Clock::time_point nextAllowed;
+        uint64_t fetched = 0;
+        // 在 m_bySize 里登记时的内存任务数，0 表示没有登记
+        size_t indexedSize = 0;
+    };
+    using ReadyEntry = std::pair<Clock::time_point, std::string>;
+    struct RunnableEntry
+    {
+        double rank;
+        Clock::time_point readyAt;
+        std::string host;
+
+        bool operator<(const RunnableEntry& other) const
+        {
+            if (rank != other.rank) return rank < other.rank;
+            return readyAt > other.readyAt;
+        }
+    };
+
+    void ScheduleLocked(const std::string& host, HostQueue& queue);
+    double RankLocked(const HostQueue& queue) const;
+    void SpillLocked();
+    // 主机内存里的任务数变化后调用，保持 m_bySize 有序
+    void IndexLocked(HostQueue& queue);
+    void ForgetDrainedLocked(Clock::time_point now);
+    std::chrono::milliseconds NextDelayLocked();
+
+    SchedulerOptions m_options;
+    HostRateLimiter* m_limiter;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::map<std::string, HostQueue> m_hosts;
+    // 还没到时间的主机按时间排，到了时间的移到 m_runnable 按分数排
+    std::priority_queue<ReadyEntry, std::vector<ReadyEntry>, std::greater<ReadyEntry>> m_ready;
+    std::priority_queue<RunnableEntry> m_runnable;
+    // 内存里有任务的主机按任务数排，溢出时从最大的开始，不必遍历所有主机
+    std::set<std::pair<size_t, HostQueue*>> m_bySize;
+    // 任务取完的主机按礼貌间隔结束的时间排，到时仍然空闲就删掉
+    std::priority_queue<ReadyEntry, std::vector<ReadyEntry>, std::greater<ReadyEntry>> m_drained;
+    std::unique_ptr<FrontierSpill> m_spill;
+    uint32_t m_seq = 0;
+    size_t m_inMemory = 0;
+    size_t m_pending = 0;
+    size_t m_inFlight = 0;
+    bool m_stopped = false;
+    bool m_held = false;
+    bool m_idleReported = false;
+    std::function<void()> m_onIdle;
+    std::mt19937 m_rng;
+};
+
+#endif
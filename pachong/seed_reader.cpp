@@ -0,0 +1,57 @@
+﻿#include "seed_reader.h"
+#include <iostream>
+
+bool SeedReader::Next(std::string& url)
+{
+    if (m_nextUrl < m_urls.size()) {
+        url = m_urls[m_nextUrl++];
+        return true;
+    }
+    for (;;) {
+        if (!m_in && !OpenNext()) return false;
+        while (std::getline(*m_in, m_line)) {
+            ++m_lineNumber;
+            size_t begin = 0;
+            // UTF-8 BOM 只会出现在第一行
+            if (m_lineNumber == 1 && m_line.compare(0, 3, "\xEF\xBB\xBF") == 0) begin = 3;
+            begin = m_line.find_first_not_of(" \t\r", begin);
+            if (begin == std::string::npos || m_line[begin] == '#') continue;
+            size_t end = m_line.find_first_of(" \t\r", begin);
+            url.assign(m_line, begin, end == std::string::npos ? std::string::npos : end - begin);
+            return true;
+        }
+        m_file.reset();
+        m_in = nullptr;
+    }
+}
+
+std::string SeedReader::Where() const
+{
+    if (!m_in) return "command line";
+    return (m_path == "-" ? std::string("stdin") : m_path) + ":" + std::to_string(m_lineNumber);
+}
+
+bool SeedReader::OpenNext()
+{
+    while (m_nextFile < m_files.size()) {
+        m_path = m_files[m_nextFile++];
+        m_lineNumber = 0;
+        if (m_path == "-") {
+            m_in = &std::cin;
+            return true;
+        }
+        // 百万行的种子文件逐行读，放大缓冲区减少系统调用
+        m_buffer.resize(1 << 20);
+        m_file = std::make_unique<std::ifstream>();
+        m_file->rdbuf()->pubsetbuf(m_buffer.data(), (std::streamsize)m_buffer.size());
+        m_file->open(m_path, std::ios::binary);
+        if (m_file->is_open()) {
+            m_in = m_file.get();
+            return true;
+        }
+        std::cerr << "Cannot open seed file " << m_path << "\n";
+        m_failed = true;
+        m_file.reset();
+    }
+    return false;
+}
@@ -0,0 +1,44 @@
+﻿#ifndef SEED_READER_H
+#define SEED_READER_H
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// 逐行读取种子地址：先返回 Add 给出的地址，再依次读各个种子文件，整个文件不会读进内存。
+// 空行和以 # 开头的行跳过，每行只取第一个空白之前的部分
+class SeedReader
+{
+public:
+    SeedReader() = default;
+    explicit SeedReader(const std::string& url) { Add(url); }
+
+    void Add(const std::string& url) { m_urls.push_back(url); }
+    // path 为 "-" 时读标准输入；文件在第一次 Next 时才打开
+    void AddFile(const std::string& path) { m_files.push_back(path); }
+    bool Next(std::string& url);
+
+    // 有种子文件打不开，Next 跳过了它
+    bool Failed() const { return m_failed; }
+    // 当前种子的来源，用于报告格式错误的行
+    std::string Where() const;
+
+private:
+    bool OpenNext();
+
+    std::vector<std::string> m_urls;
+    std::vector<std::string> m_files;
+    size_t m_nextUrl = 0;
+    size_t m_nextFile = 0;
+    std::unique_ptr<std::ifstream> m_file;
+    std::istream* m_in = nullptr;
+    std::string m_path;
+    std::string m_line;
+    std::vector<char> m_buffer;
+    uint64_t m_lineNumber = 0;
+    bool m_failed = false;
+};
+
+#endif
@@ -0,0 +1,27 @@
+﻿#ifndef SHA256_H
+#define SHA256_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// FIPS 180-4 SHA-256，可分块增量计算
+class Sha256
+{
+public:
+    Sha256();
+    void Reset();
+    void Update(const void* data, size_t size);
+    // 结束计算并返回 64 位小写十六进制摘要，之后需 Reset 才能再次使用
+    std::string HexDigest();
+
+private:
+    void Transform(const uint8_t* block);
+
+    uint32_t m_state[8];
+    uint8_t m_buffer[64];
+    uint64_t m_length;
+    size_t m_bufferSize;
+};
+
+#endif
@@ -0,0 +1,582 @@
+﻿#include "shard.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifdef _WIN32
+    using SocketHandle = SOCKET;
+    const SocketHandle kInvalidSocket = INVALID_SOCKET;
+    void CloseSocket(SocketHandle s) { closesocket(s); }
+    int PollSockets(WSAPOLLFD* fds, size_t count, int timeoutMs) { return WSAPoll(fds, (ULONG)count, timeoutMs); }
+    using PollEntry = WSAPOLLFD;
+    bool WouldBlock() { return WSAGetLastError() == WSAEWOULDBLOCK; }
+
+    void SetNonBlocking(SocketHandle s)
+    {
+        u_long on = 1;
+        ioctlsocket(s, FIONBIO, &on);
+    }
+
+    void EnsureWinsock()
+    {
+        static bool started = [] {
+            WSADATA data;
+            return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+        }();
+        (void)started;
+    }
+#else
+    using SocketHandle = int;
+    const SocketHandle kInvalidSocket = -1;
+    void CloseSocket(SocketHandle s) { close(s); }
+    int PollSockets(pollfd* fds, size_t count, int timeoutMs) { return poll(fds, (nfds_t)count, timeoutMs); }
+    using PollEntry = pollfd;
+    bool WouldBlock() { return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR; }
+
+    void SetNonBlocking(SocketHandle s)
+    {
+        fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+    }
+
+    void EnsureWinsock() {}
+#endif
+
+    const size_t kMaxFrameBytes = 16u << 20;
+
+    SocketHandle ToSocket(intptr_t value) { return (SocketHandle)value; }
+
+    void PutU32(std::string& out, uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i) out.push_back((char)(value >> (8 * i)));
+    }
+
+    void PutU64(std::string& out, uint64_t value)
+    {
+        for (int i = 0; i < 8; ++i) out.push_back((char)(value >> (8 * i)));
+    }
+
+    uint32_t GetU32(std::string_view data, size_t pos)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; ++i) value |= (uint32_t)(unsigned char)data[pos + i] << (8 * i);
+        return value;
+    }
+
+    uint64_t GetU64(std::string_view data, size_t pos)
+    {
+        uint64_t value = 0;
+        for (int i = 0; i < 8; ++i) value |= (uint64_t)(unsigned char)data[pos + i] << (8 * i);
+        return value;
+    }
+
+    // 帧格式：4 字节小端长度（含类型字节）+ 1 字节类型 + 负载
+    void AppendFrame(std::string& out, char type, std::string_view payload)
+    {
+        PutU32(out, (uint32_t)(payload.size() + 1));
+        out.push_back(type);
+        out.append(payload);
+    }
+
+    // 从 buffer 头部取出完整的帧交给 handler，返回 false 表示数据损坏或 handler 要求断开
+    template <typename Handler>
+    bool DrainFrames(std::string& buffer, Handler&& handler)
+    {
+        size_t pos = 0;
+        bool ok = true;
+        while (buffer.size() - pos >= 4) {
+            uint32_t length = GetU32(buffer, pos);
+            if (length == 0 || length > kMaxFrameBytes) {
+                ok = false;
+                break;
+            }
+            if (buffer.size() - pos - 4 < length) break;
+            std::string_view frame(buffer.data() + pos + 4, length);
+            pos += 4 + length;
+            if (!handler(frame[0], frame.substr(1))) {
+                ok = false;
+                break;
+            }
+        }
+        buffer.erase(0, pos);
+        return ok;
+    }
+
+    struct SocketAddress
+    {
+        sockaddr_storage addr = {};
+        socklen_t length = 0;
+        bool isUnix = false;
+        std::string unixPath;
+    };
+
+    bool ParseAddress(const std::string& address, SocketAddress& out)
+    {
+        if (address.compare(0, 5, "unix:") == 0) {
+#ifdef _WIN32
+            std::cerr << "Unix-domain sockets are not supported here, use tcp:host:port\n";
+            return false;
+#else
+            auto* un = (sockaddr_un*)&out.addr;
+            std::string path = address.substr(5);
+            if (path.empty() || path.size() >= sizeof(un->sun_path)) return false;
+            un->sun_family = AF_UNIX;
+            memcpy(un->sun_path, path.c_str(), path.size() + 1);
+            out.length = (socklen_t)(offsetof(sockaddr_un, sun_path) + path.size() + 1);
+            out.isUnix = true;
+            out.unixPath = path;
+            return true;
+#endif
+        }
+        std::string rest = address.compare(0, 4, "tcp:") == 0 ? address.substr(4) : address;
+        size_t colon = rest.rfind(':');
+        if (colon == std::string::npos) return false;
+        std::string host = rest.substr(0, colon);
+        std::string port = rest.substr(colon + 1);
+        if (host.size() > 2 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo* result = nullptr;
+        if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result) != 0 || !result) return false;
+        memcpy(&out.addr, result->ai_addr, result->ai_addrlen);
+        out.length = (socklen_t)result->ai_addrlen;
+        freeaddrinfo(result);
+        return true;
+    }
+
+    SocketHandle OpenSocket(const SocketAddress& address)
+    {
+        SocketHandle s = socket(address.addr.ss_family, SOCK_STREAM, 0);
+        if (s == kInvalidSocket) return s;
+        if (!address.isUnix) {
+            int one = 1;
+            setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+        }
+        return s;
+    }
+
+    bool SendAll(SocketHandle s, const char* data, size_t size)
+    {
+        while (size > 0) {
+            int sent = (int)send(s, data, (int)std::min<size_t>(size, 1 << 20), 0);
+            if (sent <= 0) {
+#ifndef _WIN32
+                if (sent < 0 && errno == EINTR) continue;
+#endif
+                return false;
+            }
+            data += sent;
+            size -= (size_t)sent;
+        }
+        return true;
+    }
+}
+
+int ShardOfHost(std::string_view host, int count)
+{
+    if (count <= 1) return 0;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (char c : host) {
+        if (c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+        hash = (hash ^ (unsigned char)c) * 0x100000001b3ull;
+    }
+    return (int)(hash % (uint64_t)count);
+}
+
+struct ShardCoordinator::Connection
+{
+    SocketHandle socket = kInvalidSocket;
+    std::string in;
+    std::string out;
+    int shard = -1;
+    bool closed = false;
+};
+
+ShardCoordinator::ShardCoordinator(const std::string& address, int shardCount)
+    : m_address(address), m_shardCount(std::max(1, shardCount)), m_outbox(m_shardCount), m_shards(m_shardCount, nullptr),
+    m_forwarded(m_shardCount, 0), m_idleReceived(m_shardCount, 0), m_idle(m_shardCount, false),
+    m_gone(m_shardCount, false)
+{
+    EnsureWinsock();
+}
+
+ShardCoordinator::~ShardCoordinator()
+{
+    for (auto& conn : m_connections) {
+        if (!conn->closed) CloseSocket(conn->socket);
+    }
+    if (m_listener != -1) {
+        CloseSocket(ToSocket(m_listener));
+#ifndef _WIN32
+        SocketAddress address;
+        if (ParseAddress(m_address, address) && address.isUnix) unlink(address.unixPath.c_str());
+#endif
+    }
+}
+
+bool ShardCoordinator::Listen()
+{
+    SocketAddress address;
+    if (!ParseAddress(m_address, address)) {
+        std::cerr << "Invalid coordinator address " << m_address << "\n";
+        return false;
+    }
+#ifndef _WIN32
+    if (address.isUnix) unlink(address.unixPath.c_str());
+#endif
+    SocketHandle s = OpenSocket(address);
+    if (s == kInvalidSocket) return false;
+    int one = 1;
+    if (!address.isUnix) setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+    if (bind(s, (const sockaddr*)&address.addr, address.length) != 0 || listen(s, 64) != 0) {
+        std::cerr << "Cannot listen on " << m_address << "\n";
+        CloseSocket(s);
+        return false;
+    }
+    SetNonBlocking(s);
+    m_listener = (intptr_t)s;
+    return true;
+}
+
+void ShardCoordinator::Route(int target, char type, std::string_view payload)
+{
+    if (m_gone[target]) return;
+    m_forwarded[target]++;
+    m_idle[target] = false;
+    std::string& out = m_shards[target] ? m_shards[target]->out : m_outbox[target];
+    AppendFrame(out, type, payload);
+}
+
+bool ShardCoordinator::HandleFrame(Connection& conn, char type, std::string_view payload)
+{
+    if (type == 'H') {
+        if (payload.size() < 8) return false;
+        int index = (int)GetU32(payload, 0);
+        int count = (int)GetU32(payload, 4);
+        if (count != m_shardCount || index < 0 || index >= m_shardCount || m_shards[index] || conn.shard >= 0) {
+            std::cerr << "Rejected shard " << index << "/" << count << "\n";
+            return false;
+        }
+        conn.shard = index;
+        m_shards[index] = &conn;
+        conn.out += m_outbox[index];
+        std::string().swap(m_outbox[index]);
+        return true;
+    }
+    if (conn.shard < 0) return false;
+    if (type == 'L' || type == 'M') {
+        if (payload.size() < 4) return false;
+        int target = (int)GetU32(payload, 0);
+        if (target < 0 || target >= m_shardCount) return false;
+        Route(target, type, payload);
+        if (type == 'L') m_routedLinks++;
+        else m_routedMedia++;
+        return true;
+    }
+    if (type == 'I') {
+        if (payload.size() < 8) return false;
+        m_idle[conn.shard] = true;
+        m_idleReceived[conn.shard] = GetU64(payload, 0);
+        return true;
+    }
+    return false;
+}
+
+bool ShardCoordinator::Finished() const
+{
+    bool any = false;
+    for (int i = 0; i < m_shardCount; ++i) {
+        if (m_gone[i]) continue;
+        if (!m_shards[i] || !m_idle[i] || m_idleReceived[i] != m_forwarded[i]) return false;
+        any = true;
+    }
+    return any;
+}
+
+bool ShardCoordinator::Run()
+{
+    if (m_listener == -1 && !Listen()) return false;
+    std::vector<PollEntry> fds;
+    char buffer[64 * 1024];
+    for (;;) {
+        fds.clear();
+        PollEntry listener = {};
+        listener.fd = ToSocket(m_listener);
+        listener.events = POLLIN;
+        fds.push_back(listener);
+        for (auto& conn : m_connections) {
+            PollEntry entry = {};
+            entry.fd = conn->socket;
+            entry.events = POLLIN;
+            if (!conn->out.empty()) entry.events |= POLLOUT;
+            fds.push_back(entry);
+        }
+        if (PollSockets(fds.data(), fds.size(), 1000) < 0) {
+#ifndef _WIN32
+            if (errno == EINTR) continue;
+#endif
+            return false;
+        }
+        size_t existing = m_connections.size();
+        if (fds[0].revents & POLLIN) {
+            for (;;) {
+                SocketHandle s = accept(ToSocket(m_listener), nullptr, nullptr);
+                if (s == kInvalidSocket) break;
+                SetNonBlocking(s);
+                int one = 1;
+                setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+                auto conn = std::make_unique<Connection>();
+                conn->socket = s;
+                m_connections.push_back(std::move(conn));
+            }
+        }
+        for (size_t i = 0; i < existing; ++i) {
+            Connection& conn = *m_connections[i];
+            short events = fds[i + 1].revents;
+            if (events & (POLLIN | POLLHUP | POLLERR)) {
+                for (;;) {
+                    int n = (int)recv(conn.socket, buffer, sizeof(buffer), 0);
+                    if (n > 0) {
+                        conn.in.append(buffer, (size_t)n);
+                        continue;
+                    }
+                    if (n < 0 && WouldBlock()) break;
+                    conn.closed = true;
+                    break;
+                }
+                if (!DrainFrames(conn.in, [&](char type, std::string_view payload) { return HandleFrame(conn, type, payload); })) {
+                    conn.closed = true;
+                }
+            }
+            if (!conn.closed && (events & POLLOUT) && !conn.out.empty()) {
+                int n = (int)send(conn.socket, conn.out.data(), (int)std::min<size_t>(conn.out.size(), 1 << 20), 0);
+                if (n > 0) conn.out.erase(0, (size_t)n);
+                else if (n < 0 && !WouldBlock()) conn.closed = true;
+            }
+        }
+        // 结束前断开的分片不再等待，发给它的消息丢弃
+        for (auto it = m_connections.begin(); it != m_connections.end();) {
+            Connection& conn = **it;
+            if (!conn.closed) {
+                ++it;
+                continue;
+            }
+            CloseSocket(conn.socket);
+            if (conn.shard >= 0) {
+                m_shards[conn.shard] = nullptr;
+                if (!m_stopping) {
+                    std::cerr << "Shard " << conn.shard << " disconnected before the crawl finished\n";
+                    m_gone[conn.shard] = true;
+                }
+            }
+            it = m_connections.erase(it);
+        }
+        if (!m_stopping && Finished()) {
+            m_stopping = true;
+            for (auto* conn : m_shards) {
+                if (conn) AppendFrame(conn->out, 'S', "");
+            }
+        }
+        if (m_stopping && m_connections.empty()) return true;
+        if (!m_stopping && std::all_of(m_gone.begin(), m_gone.end(), [](bool gone) { return gone; })) return false;
+    }
+}
+
+ShardClient::ShardClient(const ShardOptions& options, Handlers handlers)
+    : m_options(options), m_handlers(std::move(handlers))
+{
+    EnsureWinsock();
+}
+
+ShardClient::~ShardClient()
+{
+    Close();
+}
+
+bool ShardClient::Connect()
+{
+    SocketAddress address;
+    if (!ParseAddress(m_options.coordinator, address)) {
+        std::cerr << "Invalid coordinator address " << m_options.coordinator << "\n";
+        return false;
+    }
+    // 协调进程可能稍晚才开始监听，重试几秒
+    SocketHandle s = kInvalidSocket;
+    for (int attempt = 0; attempt < 50 && s == kInvalidSocket; ++attempt) {
+        s = OpenSocket(address);
+        if (s == kInvalidSocket) return false;
+        if (connect(s, (const sockaddr*)&address.addr, address.length) != 0) {
+            CloseSocket(s);
+            s = kInvalidSocket;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+    if (s == kInvalidSocket) {
+        std::cerr << "Cannot connect to coordinator " << m_options.coordinator << "\n";
+        return false;
+    }
+    m_socket = (intptr_t)s;
+    std::string hello;
+    PutU32(hello, (uint32_t)m_options.index);
+    PutU32(hello, (uint32_t)m_options.count);
+    if (!SendFrame('H', hello)) return false;
+    m_reader = std::thread(&ShardClient::ReaderLoop, this);
+    return true;
+}
+
+bool ShardClient::SendFrame(char type, const std::string& payload)
+{
+    std::string frame;
+    AppendFrame(frame, type, payload);
+    std::lock_guard<std::mutex> lock(m_sendMutex);
+    if (m_socket == -1) return false;
+    return SendAll(ToSocket(m_socket), frame.data(), frame.size());
+}
+
+void ShardClient::SendLink(int shard, int depth, const std::string& url)
+{
+    std::string payload;
+    PutU32(payload, (uint32_t)shard);
+    PutU32(payload, (uint32_t)std::max(0, depth));
+    payload += url;
+    if (SendFrame('L', payload)) m_sentLinks++;
+}
+
+void ShardClient::SendMedia(int shard, const std::string& url)
+{
+    std::string payload;
+    PutU32(payload, (uint32_t)shard);
+    payload += url;
+    SendFrame('M', payload);
+}
+
+void ShardClient::ReportIdle()
+{
+    std::string payload;
+    PutU64(payload, m_received);
+    SendFrame('I', payload);
+}
+
+void ShardClient::ReaderLoop()
+{
+    std::string in;
+    char buffer[64 * 1024];
+    bool stopped = false;
+    for (;;) {
+        int n = (int)recv(ToSocket(m_socket), buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+#ifndef _WIN32
+            if (n < 0 && errno == EINTR) continue;
+#endif
+            break;
+        }
+        in.append(buffer, (size_t)n);
+        bool handled = false;
+        bool ok = DrainFrames(in, [&](char type, std::string_view payload) {
+            if (type == 'L' && payload.size() >= 8) {
+                m_handlers.onLink(std::string(payload.substr(8)), (int)GetU32(payload, 4));
+                m_receivedLinks++;
+            }
+            else if (type == 'M' && payload.size() >= 4) {
+                m_handlers.onMedia(std::string(payload.substr(4)));
+            }
+            else if (type == 'S') {
+                stopped = true;
+                m_handlers.onStop();
+                return true;
+            }
+            else {
+                return false;
+            }
+            // 计数在回调之后增加：报告的数目里的消息一定已经进了本地边界
+            m_received++;
+            handled = true;
+            return true;
+        });
+        if (!ok) break;
+        // 收到的链接都是重复的时候边界不会变化，需要在这里补一次空闲报告
+        if (handled && !stopped && m_handlers.isIdle()) ReportIdle();
+    }
+    if (!stopped) m_handlers.onStop();
+}
+
+void ShardClient::Close()
+{
+    if (m_socket == -1) return;
+    shutdown(ToSocket(m_socket), 2);
+    if (m_reader.joinable()) m_reader.join();
+    std::lock_guard<std::mutex> lock(m_sendMutex);
+    CloseSocket(ToSocket(m_socket));
+    m_socket = -1;
+}
+
+intptr_t SpawnSelf(const std::vector<std::string>& args)
+{
+#ifdef _WIN32
+    char path[MAX_PATH] = { 0 };
+    GetModuleFileNameA(NULL, path, MAX_PATH);
+    std::string commandLine = std::string("\"") + path + "\"";
+    for (const auto& arg : args) commandLine += " \"" + arg + "\"";
+    STARTUPINFOA startup = {};
+    startup.cb = sizeof(startup);
+    PROCESS_INFORMATION info = {};
+    if (!CreateProcessA(path, &commandLine[0], NULL, NULL, FALSE, 0, NULL, NULL, &startup, &info)) return 0;
+    CloseHandle(info.hThread);
+    return (intptr_t)info.hProcess;
+#else
+    char path[4096] = { 0 };
+    ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (len <= 0) return 0;
+    std::vector<char*> argv;
+    argv.push_back(path);
+    for (const auto& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+    pid_t pid = fork();
+    if (pid < 0) return 0;
+    if (pid == 0) {
+        execv(path, argv.data());
+        _exit(127);
+    }
+    return (intptr_t)pid;
+#endif
+}
+
+int WaitProcess(intptr_t process)
+{
+#ifdef _WIN32
+    HANDLE handle = (HANDLE)process;
+    WaitForSingleObject(handle, INFINITE);
+    DWORD code = 1;
+    GetExitCodeProcess(handle, &code);
+    CloseHandle(handle);
+    return (int)code;
+#else
+    int status = 0;
+    while (waitpid((pid_t)process, &status, 0) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#endif
+}
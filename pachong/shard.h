@@ -0,0 +1,112 @@
+﻿#ifndef SHARD_H
+#define SHARD_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+struct ShardOptions
+{
+    // 大于 1 时按主机哈希把 URL 分给 count 个进程，每个进程只抓属于自己的主机
+    int count = 1;
+    int index = 0;
+    // 协调进程地址："unix:/path/to.sock"（仅 POSIX）或 "tcp:host:port"
+    std::string coordinator;
+};
+
+// 各进程必须得到相同的结果，不能用 std::hash
+int ShardOfHost(std::string_view host, int count);
+
+// 在分片之间转发链接和媒体地址，并判断整个抓取何时结束：所有分片都报告空闲，
+// 且每个分片收到的消息数等于转发给它的消息数时，通知全部分片退出
+class ShardCoordinator
+{
+public:
+    ShardCoordinator(const std::string& address, int shardCount);
+    ~ShardCoordinator();
+    ShardCoordinator(const ShardCoordinator&) = delete;
+    ShardCoordinator& operator=(const ShardCoordinator&) = delete;
+
+    bool Listen();
+    // 阻塞到抓取结束；出错时返回 false
+    bool Run();
+    uint64_t RoutedLinks() const { return m_routedLinks; }
+    uint64_t RoutedMedia() const { return m_routedMedia; }
+
+private:
+    struct Connection;
+
+    void Route(int target, char type, std::string_view payload);
+    bool HandleFrame(Connection& conn, char type, std::string_view payload);
+    bool Finished() const;
+
+    std::string m_address;
+    int m_shardCount;
+    intptr_t m_listener = -1;
+    std::vector<std::unique_ptr<Connection>> m_connections;
+    // 按分片编号：还没连上的分片的消息先攒在这里
+    std::vector<std::string> m_outbox;
+    std::vector<Connection*> m_shards;
+    std::vector<uint64_t> m_forwarded;
+    std::vector<uint64_t> m_idleReceived;
+    std::vector<bool> m_idle;
+    std::vector<bool> m_gone;
+    bool m_stopping = false;
+    uint64_t m_routedLinks = 0;
+    uint64_t m_routedMedia = 0;
+};
+
+// 分片进程到协调进程的连接。收到的消息在单独的线程上交给回调
+class ShardClient
+{
+public:
+    struct Handlers
+    {
+        std::function<void(const std::string& url, int depth)> onLink;
+        std::function<void(const std::string& url)> onMedia;
+        // 本分片没有待抓和进行中的任务
+        std::function<bool()> isIdle;
+        // 协调进程要求结束或连接断开
+        std::function<void()> onStop;
+    };
+
+    ShardClient(const ShardOptions& options, Handlers handlers);
+    ~ShardClient();
+    ShardClient(const ShardClient&) = delete;
+    ShardClient& operator=(const ShardClient&) = delete;
+
+    bool Connect();
+    void SendLink(int shard, int depth, const std::string& url);
+    void SendMedia(int shard, const std::string& url);
+    // 告诉协调进程本分片空闲，附带已处理完的消息数
+    void ReportIdle();
+    void Close();
+    uint64_t SentLinks() const { return m_sentLinks; }
+    uint64_t ReceivedLinks() const { return m_receivedLinks; }
+
+private:
+    bool SendFrame(char type, const std::string& payload);
+    void ReaderLoop();
+
+    ShardOptions m_options;
+    Handlers m_handlers;
+    intptr_t m_socket = -1;
+    std::mutex m_sendMutex;
+    std::thread m_reader;
+    std::atomic<uint64_t> m_received{ 0 };
+    std::atomic<uint64_t> m_sentLinks{ 0 };
+    std::atomic<uint64_t> m_receivedLinks{ 0 };
+};
+
+// 用相同的程序文件启动一个子进程，返回进程句柄，失败返回 0
+intptr_t SpawnSelf(const std::vector<std::string>& args);
+// 等待子进程退出并返回退出码
+int WaitProcess(intptr_t process);
+
+#endif
@@ -0,0 +1,88 @@
+﻿#ifndef SIMD_SCAN_H
+#define SIMD_SCAN_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CRAWLER_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace simd
+{
+    inline unsigned CountTrailingZeros(uint32_t mask)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return (unsigned)index;
+#else
+        return (unsigned)__builtin_ctz(mask);
+#endif
+    }
+
+    // 正文里需要特殊处理的字节：'<'、'&' 以及 <= 0x20 的空白/控制字符
+    inline bool IsTextSpecial(unsigned char c)
+    {
+        return c <= 0x20 || c == '<' || c == '&';
+    }
+
+    // 返回 [p, end) 中第一个特殊字节的位置，没有则返回 end；每次比较 16 字节
+    inline const char* FindTextSpecial(const char* p, const char* end)
+    {
+#ifdef CRAWLER_HAVE_SSE2
+        const __m128i lt = _mm_set1_epi8('<');
+        const __m128i amp = _mm_set1_epi8('&');
+        const __m128i space = _mm_set1_epi8(0x20);
+        while (end - p >= 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)p);
+            // 无符号 v <= 0x20 等价于 min(v, 0x20) == v
+            __m128i ctl = _mm_cmpeq_epi8(_mm_min_epu8(v, space), v);
+            __m128i hit = _mm_or_si128(ctl, _mm_or_si128(_mm_cmpeq_epi8(v, lt), _mm_cmpeq_epi8(v, amp)));
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(hit);
+            if (mask) return p + CountTrailingZeros(mask);
+            p += 16;
+        }
+#endif
+        while (p < end && !IsTextSpecial((unsigned char)*p)) ++p;
+        return p;
+    }
+
+    // 返回 [p, end) 中第一个 >= 0x80 的字节，没有则返回 end
+    inline const char* FindNonAscii(const char* p, const char* end)
+    {
+#ifdef CRAWLER_HAVE_SSE2
+        while (end - p >= 16) {
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p));
+            if (mask) return p + CountTrailingZeros(mask);
+            p += 16;
+        }
+#endif
+        while (p < end && (unsigned char)*p < 0x80) ++p;
+        return p;
+    }
+
+    inline size_t CountNonAscii(const char* p, const char* end)
+    {
+        size_t count = 0;
+#ifdef CRAWLER_HAVE_SSE2
+        while (end - p >= 16) {
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p));
+            while (mask) {
+                mask &= mask - 1;
+                ++count;
+            }
+            p += 16;
+        }
+#endif
+        for (; p < end; ++p) count += (unsigned char)*p >= 0x80;
+        return count;
+    }
+}
+
+#endif
@@ -0,0 +1,150 @@
+﻿#include "text_tokenizer.h"
+
+namespace
+{
+    enum class CharClass
+    {
+        Separator,
+        Word,
+        Cjk
+    };
+
+    // 非法字节按长度 1 的分隔符处理
+    size_t DecodeUtf8(std::string_view text, size_t offset, uint32_t& cp)
+    {
+        unsigned char lead = (unsigned char)text[offset];
+        if (lead < 0x80) {
+            cp = lead;
+            return 1;
+        }
+        size_t length = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 0;
+        if (length == 0 || offset + length > text.size()) {
+            cp = 0xFFFD;
+            return 1;
+        }
+        cp = lead & (0x7F >> length);
+        for (size_t i = 1; i < length; ++i) {
+            unsigned char next = (unsigned char)text[offset + i];
+            if ((next & 0xC0) != 0x80) {
+                cp = 0xFFFD;
+                return 1;
+            }
+            cp = (cp << 6) | (next & 0x3F);
+        }
+        return length;
+    }
+
+    CharClass Classify(uint32_t cp)
+    {
+        if (cp < 0x80) {
+            return (cp >= '0' && cp <= '9') || (cp >= 'a' && cp <= 'z') || (cp >= 'A' && cp <= 'Z') ?
+                CharClass::Word : CharClass::Separator;
+        }
+        // 假名、中日韩统一表意文字及扩展、谚文音节、兼容表意文字
+        if ((cp >= 0x3040 && cp <= 0x30FF) || (cp >= 0x3400 && cp <= 0x4DBF) || (cp >= 0x4E00 && cp <= 0x9FFF) ||
+            (cp >= 0xAC00 && cp <= 0xD7AF) || (cp >= 0xF900 && cp <= 0xFAFF) || (cp >= 0x20000 && cp <= 0x2FFFF)) {
+            return CharClass::Cjk;
+        }
+        // 全角字母数字
+        if ((cp >= 0xFF10 && cp <= 0xFF19) || (cp >= 0xFF21 && cp <= 0xFF3A) || (cp >= 0xFF41 && cp <= 0xFF5A)) {
+            return CharClass::Word;
+        }
+        // Latin-1 的标点符号、通用标点到各种符号、中日韩标点、私用区、全角标点、特殊字符、表情符号
+        if (cp <= 0xBF || cp == 0xD7 || cp == 0xF7 || (cp >= 0x2000 && cp <= 0x2BFF) || (cp >= 0x3000 && cp <= 0x303F) ||
+            (cp >= 0xE000 && cp <= 0xF8FF) || (cp >= 0xFE30 && cp <= 0xFE4F) || (cp >= 0xFF00 && cp <= 0xFFFF) ||
+            (cp >= 0x1F000 && cp <= 0x1FFFF)) {
+            return CharClass::Separator;
+        }
+        return CharClass::Word;
+    }
+
+    // 全角字母数字折成半角，ASCII 大写转小写，其余原样追加
+    void AppendFolded(std::string& out, std::string_view text, size_t offset, size_t length, uint32_t cp)
+    {
+        if (cp >= 0xFF10 && cp <= 0xFF19) out += (char)('0' + (cp - 0xFF10));
+        else if (cp >= 0xFF21 && cp <= 0xFF3A) out += (char)('a' + (cp - 0xFF21));
+        else if (cp >= 0xFF41 && cp <= 0xFF5A) out += (char)('a' + (cp - 0xFF41));
+        else if (cp >= 'A' && cp <= 'Z') out += (char)(cp + ('a' - 'A'));
+        else out.append(text.data() + offset, length);
+    }
+}
+
+size_t TextTokenizer::Decode(size_t offset, uint32_t& cp)
+{
+    // 汉字段里每个字都被前一个字向后看过一次，直接用那次的结果
+    if (offset == m_peekOffset) {
+        cp = m_peekCp;
+        return m_peekLength;
+    }
+    return DecodeUtf8(m_text, offset, cp);
+}
+
+bool TextTokenizer::Next(std::string_view& term, uint32_t& position)
+{
+    while (m_offset < m_text.size()) {
+        uint32_t cp = 0;
+        size_t length = Decode(m_offset, cp);
+        CharClass kind = Classify(cp);
+        if (kind == CharClass::Separator) {
+            m_inCjkRun = false;
+            m_offset += length;
+            continue;
+        }
+        if (kind == CharClass::Cjk) {
+            size_t start = m_offset;
+            m_offset += length;
+            uint32_t nextCp = 0;
+            size_t nextLength = 0;
+            if (m_offset < m_text.size()) {
+                nextLength = DecodeUtf8(m_text, m_offset, nextCp);
+                m_peekOffset = m_offset;
+                m_peekCp = nextCp;
+                m_peekLength = nextLength;
+            }
+            bool pairs = nextLength > 0 && Classify(nextCp) == CharClass::Cjk;
+            bool trailing = m_inCjkRun && !pairs;
+            m_inCjkRun = pairs;
+            position = m_position++;
+            if (pairs) {
+                term = m_text.substr(start, length + nextLength);
+                return true;
+            }
+            if (trailing && m_mode == TokenizeMode::Query) continue;
+            term = m_text.substr(start, length);
+            return true;
+        }
+        // 字母数字连成的词；只含小写 ASCII 时直接指向原文
+        m_inCjkRun = false;
+        size_t start = m_offset;
+        bool plain = true;
+        m_scratch.clear();
+        while (m_offset < m_text.size()) {
+            unsigned char c = (unsigned char)m_text[m_offset];
+            if (plain && ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))) {
+                ++m_offset;
+                continue;
+            }
+            size_t charLength = Decode(m_offset, cp);
+            if (Classify(cp) != CharClass::Word) break;
+            if (plain && (cp >= 0x80 || (cp >= 'A' && cp <= 'Z'))) {
+                plain = false;
+                m_scratch.assign(m_text.data() + start, m_offset - start);
+            }
+            if (!plain) AppendFolded(m_scratch, m_text, m_offset, charLength, cp);
+            m_offset += charLength;
+        }
+        if (m_offset - start > kMaxTermBytes) continue;
+        position = m_position++;
+        term = plain ? m_text.substr(start, m_offset - start) : std::string_view(m_scratch);
+        return true;
+    }
+    return false;
+}
+
+bool TextTokenizer::IsSingleCjk(std::string_view term)
+{
+    if (term.empty()) return false;
+    uint32_t cp = 0;
+    size_t length = DecodeUtf8(term, 0, cp);
+    return length == term.size() && Classify(cp) == CharClass::Cjk;
+}
@@ -0,0 +1,48 @@
+﻿#ifndef TEXT_TOKENIZER_H
+#define TEXT_TOKENIZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+enum class TokenizeMode
+{
+    Document,
+    // 不产生汉字段末尾的单字词，但位置照样前进，短语里各词的相对位置与文档一致
+    Query
+};
+
+// 把 UTF-8 正文切成检索词：字母和数字连成的词转小写，全角字母数字折成半角；
+// 中日韩文字按相邻两字切分。文档模式下每段汉字的最后一个字另记一个单字词，
+// 单字查询按"以该字开头的词"展开后就能命中任何位置
+class TextTokenizer
+{
+public:
+    static constexpr size_t kMaxTermBytes = 64;
+
+    TextTokenizer(std::string_view text, TokenizeMode mode) : m_text(text), m_mode(mode) {}
+
+    // term 可能指向原文，也可能指向内部缓冲，在下一次调用前有效
+    bool Next(std::string_view& term, uint32_t& position);
+
+    // 单个中日韩文字，查询时按前缀展开
+    static bool IsSingleCjk(std::string_view term);
+
+private:
+    size_t Decode(size_t offset, uint32_t& cp);
+
+    std::string_view m_text;
+    TokenizeMode m_mode;
+    size_t m_offset = 0;
+    uint32_t m_position = 0;
+    // 上一个字是汉字，当前的字处在一段汉字中间或末尾
+    bool m_inCjkRun = false;
+    // 上一次向后看时解码的字
+    size_t m_peekOffset = SIZE_MAX;
+    uint32_t m_peekCp = 0;
+    size_t m_peekLength = 0;
+    std::string m_scratch;
+};
+
+#endif
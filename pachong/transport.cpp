@@ -0,0 +1,182 @@
+﻿#include "transport.h"
+#include "url.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+std::string HttpTarget::Origin() const
+{
+    std::string origin = scheme + "://" + host;
+    if ((scheme == "http" && port != 80) || (scheme == "https" && port != 443)) {
+        origin += ":" + std::to_string(port);
+    }
+    return origin;
+}
+
+std::string HttpTarget::PathAndQuery() const
+{
+    // 请求行里不能出现空格和非 ASCII 字节，按 UTF-8 百分号编码
+    static const char hex[] = "0123456789ABCDEF";
+    std::string raw = path.empty() ? "/" : path;
+    raw += query;
+    std::string result;
+    result.reserve(raw.size());
+    for (unsigned char c : raw) {
+        if (c <= 0x20 || c >= 0x7F) {
+            result.push_back('%');
+            result.push_back(hex[c >> 4]);
+            result.push_back(hex[c & 0xF]);
+        }
+        else {
+            result.push_back((char)c);
+        }
+    }
+    return result;
+}
+
+std::string HttpTarget::PoolKey() const
+{
+    return scheme + "://" + host + ":" + std::to_string(port);
+}
+
+bool ParseHttpTarget(const std::string& url, HttpTarget& target)
+{
+    UrlView view;
+    if (!ParseUrl(url, view) || !view.IsHttp()) return false;
+    int port = view.EffectivePort();
+    if (port <= 0) return false;
+    target.scheme = std::string(view.scheme);
+    std::transform(target.scheme.begin(), target.scheme.end(), target.scheme.begin(), ::tolower);
+    target.host = std::string(view.host);
+    target.port = port;
+    target.path = std::string(view.path);
+    target.query.clear();
+    if (view.hasQuery) target.query = "?" + std::string(view.query);
+    return true;
+}
+
+std::string HttpResponse::GetHeader(const std::string& name) const
+{
+    for (const auto& header : headers) {
+        if (header.first.size() == name.size() &&
+            std::equal(header.first.begin(), header.first.end(), name.begin(),
+                [](char a, char b) { return ::tolower((unsigned char)a) == ::tolower((unsigned char)b); })) {
+            return header.second;
+        }
+    }
+    return "";
+}
+
+long long HttpResponse::ContentLength() const
+{
+    std::string value = GetHeader("Content-Length");
+    if (value.empty()) return -1;
+    char* end = nullptr;
+    long long length = strtoll(value.c_str(), &end, 10);
+    if (end == value.c_str() || length < 0) return -1;
+    return length;
+}
+
+void HttpResponse::Reset()
+{
+    status = 0;
+    headers.clear();
+    body.clear();
+    finalUrl.clear();
+    error = TransportError::None;
+    timing = TransportTiming();
+}
+
+ConnectionPool::ConnectionPool(int maxPerHost, int idleTimeoutMs)
+    : m_maxPerHost(std::max(1, maxPerHost)), m_idleTimeout(idleTimeoutMs)
+{
+}
+
+std::unique_ptr<PooledConnection> ConnectionPool::Acquire(const std::string& key)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [&] { return m_hosts[key].active < m_maxPerHost; });
+    HostSlot& slot = m_hosts[key];
+    slot.active++;
+    auto now = std::chrono::steady_clock::now();
+    while (!slot.idle.empty()) {
+        IdleEntry entry = std::move(slot.idle.back());
+        slot.idle.pop_back();
+        if (now - entry.since > m_idleTimeout) continue;
+        if (!entry.conn->IsAlive()) continue;
+        return std::move(entry.conn);
+    }
+    return nullptr;
+}
+
+void ConnectionPool::Release(const std::string& key, std::unique_ptr<PooledConnection> conn)
+{
+    std::vector<std::unique_ptr<PooledConnection>> discard;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_hosts.find(key);
+        if (it == m_hosts.end()) it = m_hosts.emplace(key, HostSlot()).first;
+        HostSlot& slot = it->second;
+        if (slot.active > 0) slot.active--;
+        auto now = std::chrono::steady_clock::now();
+        if (conn) {
+            if ((int)slot.idle.size() < m_maxPerHost) {
+                slot.idle.push_back({ std::move(conn), now });
+            }
+            else {
+                discard.push_back(std::move(conn));
+            }
+        }
+        if (slot.active == 0 && slot.idle.empty()) m_hosts.erase(it);
+        // 不再访问的主机上的空闲连接也要按时关闭，否则池子会随访问过的主机数一直增长
+        if (now >= m_nextSweep) {
+            SweepLocked(now, discard);
+            m_nextSweep = now + std::max(m_idleTimeout / 2, std::chrono::milliseconds(100));
+        }
+    }
+    m_cv.notify_all();
+}
+
+void ConnectionPool::SweepLocked(std::chrono::steady_clock::time_point now,
+    std::vector<std::unique_ptr<PooledConnection>>& discard)
+{
+    for (auto it = m_hosts.begin(); it != m_hosts.end();) {
+        auto& idle = it->second.idle;
+        for (auto& entry : idle) {
+            if (now - entry.since > m_idleTimeout) discard.push_back(std::move(entry.conn));
+        }
+        idle.erase(std::remove_if(idle.begin(), idle.end(), [](const IdleEntry& entry) { return !entry.conn; }),
+            idle.end());
+        if (it->second.active == 0 && idle.empty()) {
+            it = m_hosts.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+void ConnectionPool::Clear()
+{
+    std::vector<std::unique_ptr<PooledConnection>> discard;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto it = m_hosts.begin(); it != m_hosts.end();) {
+        for (auto& entry : it->second.idle) discard.push_back(std::move(entry.conn));
+        it->second.idle.clear();
+        if (it->second.active == 0) {
+            it = m_hosts.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+std::unique_ptr<HttpTransport> CreateHttpTransport(const TransportOptions& options)
+{
+#ifdef _WIN32
+    return CreateWinHttpTransport(options);
+#else
+    return CreatePosixTransport(options);
+#endif
+}
@@ -0,0 +1,185 @@
+﻿#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include "content_decoder.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct HttpTarget
+{
+    std::string scheme;
+    std::string host;
+    int port = 0;
+    std::string path;
+    std::string query;
+
+    std::string Origin() const;
+    std::string PathAndQuery() const;
+    std::string PoolKey() const;
+};
+
+bool ParseHttpTarget(const std::string& url, HttpTarget& target);
+
+// 按 Content-Length 预留缓冲区时的上限，避免被虚报的长度撑爆内存
+constexpr long long kMaxBodyReserve = 64ll * 1024 * 1024;
+
+enum class TransportError
+{
+    None,
+    BadUrl,
+    Dns,
+    Connect,
+    Tls,
+    Timeout,
+    Protocol,
+    Decode,
+    // onHeaders/onBody 要求中止
+    Aborted,
+    TooManyRedirects
+};
+
+// 最后一跳各阶段的耗时（微秒），-1 表示没有经过该阶段，例如复用的连接没有 DNS/连接/TLS
+struct TransportTiming
+{
+    long long dnsUs = -1;
+    long long connectUs = -1;
+    long long tlsUs = -1;
+    // 从开始发送请求到收到状态行
+    long long firstByteUs = -1;
+    long long bodyUs = -1;
+};
+
+struct HttpResponse
+{
+    int status = 0;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+    std::string finalUrl;
+    // Send 返回 false 时说明失败原因
+    TransportError error = TransportError::None;
+    TransportTiming timing;
+
+    std::string GetHeader(const std::string& name) const;
+    // 没有或无法解析时返回 -1
+    long long ContentLength() const;
+    // 清空各字段但保留 body 已分配的容量，供重定向和重试复用
+    void Reset();
+};
+
+struct HttpRequest
+{
+    std::string method = "GET";
+    std::string url;
+    std::vector<std::pair<std::string, std::string>> headers;
+    // 收到响应头后调用，返回 false 则不再读取响应体
+    std::function<bool(const HttpResponse&)> onHeaders;
+    // 设置后响应体按块交给回调而不写入 HttpResponse::body，返回 false 中止传输
+    std::function<bool(const char*, size_t)> onBody;
+};
+
+class DnsCache;
+
+struct TransportOptions
+{
+    std::string userAgent = "Crawler/1.0";
+    int maxConnectionsPerHost = 4;
+    int connectTimeoutMs = 10000;
+    int ioTimeoutMs = 30000;
+    int idleTimeoutMs = 15000;
+    int maxRedirects = 5;
+    // 请求未自带 Accept-Encoding 时声明本次编译支持的压缩格式，响应体边收边解压
+    bool acceptCompression = true;
+    // 多个传输层和爬虫共用的解析缓存，为空时每次连接都直接解析
+    std::shared_ptr<DnsCache> dnsCache;
+};
+
+struct TransportStats
+{
+    std::atomic<uint64_t> requests{ 0 };
+    std::atomic<uint64_t> connectionsOpened{ 0 };
+    std::atomic<uint64_t> connectionsReused{ 0 };
+    std::atomic<uint64_t> failures{ 0 };
+    // 按 Content-Encoding 分别统计线上收到的字节数和解码后的字节数
+    std::atomic<uint64_t> wireBytes[(size_t)ContentEncoding::Count]{};
+    std::atomic<uint64_t> decodedBytes[(size_t)ContentEncoding::Count]{};
+};
+
+class PooledConnection
+{
+public:
+    virtual ~PooledConnection() = default;
+    virtual bool IsAlive() = 0;
+};
+
+// 按 scheme://host:port 分组缓存空闲的长连接，并限制每个主机同时使用的连接数
+class ConnectionPool
+{
+public:
+    ConnectionPool(int maxPerHost, int idleTimeoutMs);
+
+    // 阻塞直到该主机有空闲名额；有可复用的连接时返回它，否则返回 nullptr 由调用方新建
+    std::unique_ptr<PooledConnection> Acquire(const std::string& key);
+    // 归还名额；conn 为空或已不可用时直接丢弃
+    void Release(const std::string& key, std::unique_ptr<PooledConnection> conn);
+    void Clear();
+
+private:
+    struct IdleEntry
+    {
+        std::unique_ptr<PooledConnection> conn;
+        std::chrono::steady_clock::time_point since;
+    };
+    struct HostSlot
+    {
+        int active = 0;
+        std::vector<IdleEntry> idle;
+    };
+
+    // 关闭所有主机上超时的空闲连接并删掉已经没有连接的主机，连接移到 discard 里在锁外析构
+    void SweepLocked(std::chrono::steady_clock::time_point now,
+        std::vector<std::unique_ptr<PooledConnection>>& discard);
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::map<std::string, HostSlot> m_hosts;
+    int m_maxPerHost;
+    std::chrono::milliseconds m_idleTimeout;
+    std::chrono::steady_clock::time_point m_nextSweep;
+};
+
+class HttpTransport
+{
+public:
+    virtual ~HttpTransport() = default;
+    // 仅在网络层失败时返回 false，HTTP 状态码由调用方检查
+    virtual bool Send(const HttpRequest& request, HttpResponse& response) = 0;
+    virtual bool IsReady() const = 0;
+
+    const TransportStats& Stats() const { return m_stats; }
+
+protected:
+    TransportStats m_stats;
+};
+
+#ifdef _WIN32
+std::unique_ptr<HttpTransport> CreateWinHttpTransport(const TransportOptions& options);
+#else
+std::unique_ptr<HttpTransport> CreatePosixTransport(const TransportOptions& options);
+#endif
+std::unique_ptr<HttpTransport> CreateHttpTransport(const TransportOptions& options = TransportOptions());
+
+inline long long ElapsedMicros(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+#endif
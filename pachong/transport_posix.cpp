@@ -0,0 +1,550 @@
+﻿#ifndef _WIN32
+
+#include "dns_cache.h"
+#include "transport.h"
+#include "url.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#ifdef CRAWLER_USE_OPENSSL
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#endif
+
+namespace
+{
+    class PosixConnection : public PooledConnection
+    {
+    public:
+        PosixConnection(int fd, int ioTimeoutMs)
+            : m_fd(fd), m_ioTimeoutMs(ioTimeoutMs), m_buffer(16 * 1024)
+        {
+        }
+
+        ~PosixConnection() override
+        {
+#ifdef CRAWLER_USE_OPENSSL
+            if (m_ssl) {
+                SSL_shutdown(m_ssl);
+                SSL_free(m_ssl);
+            }
+#endif
+            if (m_fd >= 0) close(m_fd);
+        }
+
+#ifdef CRAWLER_USE_OPENSSL
+        bool StartTls(SSL_CTX* ctx, const std::string& host)
+        {
+            m_ssl = SSL_new(ctx);
+            if (!m_ssl) return false;
+            SSL_set_fd(m_ssl, m_fd);
+            SSL_set_tlsext_host_name(m_ssl, host.c_str());
+            SSL_set1_host(m_ssl, host.c_str());
+            return SSL_connect(m_ssl) == 1;
+        }
+#endif
+
+        bool IsAlive() override
+        {
+            if (m_start < m_end) return false;
+            char probe;
+            ssize_t n = recv(m_fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+            if (n == 0) return false;
+            if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+            return false;
+        }
+
+        bool WriteAll(const char* data, size_t size)
+        {
+            while (size > 0) {
+                if (!WaitFor(POLLOUT)) return false;
+                ssize_t n;
+#ifdef CRAWLER_USE_OPENSSL
+                if (m_ssl) n = SSL_write(m_ssl, data, (int)size);
+                else
+#endif
+                n = send(m_fd, data, size, MSG_NOSIGNAL);
+                if (n <= 0) {
+                    if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+                    return false;
+                }
+                data += n;
+                size -= (size_t)n;
+            }
+            return true;
+        }
+
+        // 返回读到的字节数，0 表示对端关闭，-1 表示出错或超时
+        ssize_t ReadSome(char* out, size_t size)
+        {
+            if (m_start < m_end) {
+                size_t n = std::min(size, m_end - m_start);
+                memcpy(out, m_buffer.data() + m_start, n);
+                m_start += n;
+                return (ssize_t)n;
+            }
+            return RawRead(out, size);
+        }
+
+        bool ReadLine(std::string& line)
+        {
+            line.clear();
+            for (;;) {
+                if (m_start == m_end) {
+                    ssize_t n = RawRead(m_buffer.data(), m_buffer.size());
+                    if (n <= 0) return false;
+                    m_start = 0;
+                    m_end = (size_t)n;
+                }
+                const char* begin = m_buffer.data() + m_start;
+                const char* nl = (const char*)memchr(begin, '\n', m_end - m_start);
+                if (nl) {
+                    line.append(begin, nl - begin);
+                    m_start += (nl - begin) + 1;
+                    if (!line.empty() && line.back() == '\r') line.pop_back();
+                    return true;
+                }
+                line.append(begin, m_end - m_start);
+                m_start = m_end;
+                if (line.size() > 64 * 1024) return false;
+            }
+        }
+
+        bool receivedAny = false;
+        // 最近一次等待是否因超时而失败
+        bool timedOut = false;
+
+    private:
+        bool WaitFor(short events)
+        {
+#ifdef CRAWLER_USE_OPENSSL
+            if (m_ssl && (events & POLLIN) && SSL_pending(m_ssl) > 0) return true;
+#endif
+            pollfd pfd = { m_fd, events, 0 };
+            for (;;) {
+                int rc = poll(&pfd, 1, m_ioTimeoutMs);
+                if (rc < 0 && errno == EINTR) continue;
+                if (rc == 0) timedOut = true;
+                return rc > 0;
+            }
+        }
+
+        ssize_t RawRead(char* out, size_t size)
+        {
+            for (;;) {
+                if (!WaitFor(POLLIN)) return -1;
+                ssize_t n;
+#ifdef CRAWLER_USE_OPENSSL
+                if (m_ssl) {
+                    n = SSL_read(m_ssl, out, (int)size);
+                    if (n <= 0) {
+                        int err = SSL_get_error(m_ssl, (int)n);
+                        if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) continue;
+                        return err == SSL_ERROR_ZERO_RETURN ? 0 : -1;
+                    }
+                }
+                else
+#endif
+                n = recv(m_fd, out, size, 0);
+                if (n < 0 && errno == EINTR) continue;
+                if (n > 0) receivedAny = true;
+                return n;
+            }
+        }
+
+        int m_fd;
+        int m_ioTimeoutMs;
+        std::vector<char> m_buffer;
+        size_t m_start = 0;
+        size_t m_end = 0;
+#ifdef CRAWLER_USE_OPENSSL
+        SSL* m_ssl = nullptr;
+#endif
+    };
+
+    bool IEquals(const std::string& a, const char* b)
+    {
+        size_t len = strlen(b);
+        if (a.size() != len) return false;
+        for (size_t i = 0; i < len; ++i) {
+            if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i])) return false;
+        }
+        return true;
+    }
+
+    std::string Trim(const std::string& s)
+    {
+        size_t start = s.find_first_not_of(" \t");
+        if (start == std::string::npos) return "";
+        size_t end = s.find_last_not_of(" \t");
+        return s.substr(start, end - start + 1);
+    }
+
+    class PosixTransport : public HttpTransport
+    {
+    public:
+        explicit PosixTransport(const TransportOptions& options)
+            : m_options(options), m_pool(options.maxConnectionsPerHost, options.idleTimeoutMs), m_dns(options.dnsCache)
+        {
+            if (!m_dns) {
+                DnsCacheOptions uncached;
+                uncached.enabled = false;
+                uncached.prefetchThreads = 0;
+                m_dns = std::make_shared<DnsCache>(uncached);
+            }
+#ifdef CRAWLER_USE_OPENSSL
+            m_sslCtx = SSL_CTX_new(TLS_client_method());
+            if (m_sslCtx) {
+                SSL_CTX_set_default_verify_paths(m_sslCtx);
+                SSL_CTX_set_verify(m_sslCtx, SSL_VERIFY_PEER, nullptr);
+            }
+#endif
+        }
+
+        ~PosixTransport() override
+        {
+            m_pool.Clear();
+#ifdef CRAWLER_USE_OPENSSL
+            if (m_sslCtx) SSL_CTX_free(m_sslCtx);
+#endif
+        }
+
+        bool IsReady() const override { return true; }
+
+        bool Send(const HttpRequest& request, HttpResponse& response) override
+        {
+            m_stats.requests++;
+            std::string url = request.url;
+            std::string firstHost;
+            // 跳到别的主机后不再带条件请求和分段请求头，它们描述的是原主机上的资源
+            const HttpRequest* current = &request;
+            HttpRequest crossHost;
+            for (int redirects = 0; redirects <= m_options.maxRedirects; ++redirects) {
+                HttpTarget target;
+                response.Reset();
+                response.finalUrl = url;
+                if (!ParseHttpTarget(url, target)) {
+                    response.error = TransportError::BadUrl;
+                    m_stats.failures++;
+                    return false;
+                }
+                if (redirects == 0) {
+                    firstHost = target.host;
+                }
+                else if (current == &request && !IEquals(target.host, firstHost.c_str())) {
+                    crossHost = request;
+                    auto& headers = crossHost.headers;
+                    headers.erase(std::remove_if(headers.begin(), headers.end(), [](const auto& header) {
+                        return IEquals(header.first, "If-None-Match") || IEquals(header.first, "If-Modified-Since") ||
+                            IEquals(header.first, "Range");
+                    }), headers.end());
+                    current = &crossHost;
+                }
+                if (target.scheme == "https" && !SupportsHttps()) {
+                    response.error = TransportError::Tls;
+                    m_stats.failures++;
+                    return false;
+                }
+                std::string location;
+                bool ok = SendOnce(target, *current, response, location, true);
+                if (!ok) {
+                    if (response.error == TransportError::None) response.error = TransportError::Protocol;
+                    m_stats.failures++;
+                    return false;
+                }
+                if (location.empty()) return true;
+                UrlView base;
+                ParseUrl(url, base);
+                url = ResolveUrl(base, location);
+            }
+            response.error = TransportError::TooManyRedirects;
+            m_stats.failures++;
+            return false;
+        }
+
+    private:
+        // 没有编译 TLS 支持时 https 请求一律以 Tls 错误失败，提示只打印一次
+        bool SupportsHttps()
+        {
+#ifdef CRAWLER_USE_OPENSSL
+            return true;
+#else
+            if (!m_httpsWarned.exchange(true)) std::cerr << "HTTPS requires building with CRAWLER_USE_OPENSSL.\n";
+            return false;
+#endif
+        }
+
+        std::unique_ptr<PosixConnection> Connect(const HttpTarget& target, HttpResponse& response)
+        {
+            std::vector<ResolvedAddress> addresses;
+            auto started = std::chrono::steady_clock::now();
+            if (!m_dns->Resolve(target.host, target.port, addresses)) {
+                response.error = TransportError::Dns;
+                return nullptr;
+            }
+            response.timing.dnsUs = ElapsedMicros(started);
+            started = std::chrono::steady_clock::now();
+            int fd = -1;
+            bool timedOut = false;
+            for (const auto& address : addresses) {
+                fd = socket(address.Family(), SOCK_STREAM | SOCK_CLOEXEC, 0);
+                if (fd < 0) continue;
+                if (ConnectWithTimeout(fd, (const sockaddr*)&address.addr, address.length, timedOut)) break;
+                close(fd);
+                fd = -1;
+            }
+            if (fd < 0) {
+                response.error = timedOut ? TransportError::Timeout : TransportError::Connect;
+                return nullptr;
+            }
+            response.timing.connectUs = ElapsedMicros(started);
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            auto conn = std::make_unique<PosixConnection>(fd, m_options.ioTimeoutMs);
+            if (target.scheme == "https") {
+#ifdef CRAWLER_USE_OPENSSL
+                started = std::chrono::steady_clock::now();
+                if (!m_sslCtx || !conn->StartTls(m_sslCtx, target.host)) {
+                    response.error = TransportError::Tls;
+                    return nullptr;
+                }
+                response.timing.tlsUs = ElapsedMicros(started);
+#endif
+            }
+            m_stats.connectionsOpened++;
+            return conn;
+        }
+
+        bool ConnectWithTimeout(int fd, const sockaddr* addr, socklen_t len, bool& timedOut)
+        {
+            int flags = fcntl(fd, F_GETFL, 0);
+            fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+            int rc = connect(fd, addr, len);
+            if (rc < 0 && errno != EINPROGRESS) return false;
+            if (rc < 0) {
+                pollfd pfd = { fd, POLLOUT, 0 };
+                int rc = poll(&pfd, 1, m_options.connectTimeoutMs);
+                if (rc == 0) timedOut = true;
+                if (rc <= 0) return false;
+                int err = 0;
+                socklen_t errLen = sizeof(err);
+                if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errLen) < 0 || err != 0) return false;
+            }
+            fcntl(fd, F_SETFL, flags);
+            return true;
+        }
+
+        bool SendOnce(const HttpTarget& target, const HttpRequest& request, HttpResponse& response,
+            std::string& location, bool allowRetry)
+        {
+            std::string key = target.PoolKey();
+            std::unique_ptr<PooledConnection> pooled = m_pool.Acquire(key);
+            bool reused = pooled != nullptr;
+            std::unique_ptr<PosixConnection> conn;
+            if (reused) {
+                conn.reset(static_cast<PosixConnection*>(pooled.release()));
+                m_stats.connectionsReused++;
+            }
+            else {
+                conn = Connect(target, response);
+                if (!conn) {
+                    m_pool.Release(key, nullptr);
+                    return false;
+                }
+            }
+            bool keepAlive = false;
+            bool ok = Exchange(*conn, target, request, response, location, keepAlive);
+            if (!ok && response.error == TransportError::None) {
+                response.error = conn->timedOut ? TransportError::Timeout : TransportError::Protocol;
+            }
+            // 复用的连接可能已被服务器关闭，在还没收到任何数据时换新连接重试一次
+            if (!ok && reused && allowRetry && !conn->receivedAny) {
+                m_pool.Release(key, nullptr);
+                // finalUrl 是重定向后的地址，不是 request.url
+                std::string finalUrl = std::move(response.finalUrl);
+                response.Reset();
+                response.finalUrl = std::move(finalUrl);
+                location.clear();
+                return SendOnce(target, request, response, location, false);
+            }
+            conn->receivedAny = false;
+            conn->timedOut = false;
+            if (ok && keepAlive) m_pool.Release(key, std::move(conn));
+            else m_pool.Release(key, nullptr);
+            return ok;
+        }
+
+        bool Exchange(PosixConnection& conn, const HttpTarget& target, const HttpRequest& request,
+            HttpResponse& response, std::string& location, bool& keepAlive)
+        {
+            std::string head;
+            head.reserve(512);
+            head += request.method + " " + target.PathAndQuery() + " HTTP/1.1\r\n";
+            head += "Host: " + target.host;
+            if ((target.scheme == "http" && target.port != 80) || (target.scheme == "https" && target.port != 443)) {
+                head += ":" + std::to_string(target.port);
+            }
+            head += "\r\nUser-Agent: " + m_options.userAgent + "\r\n";
+            bool hasAccept = false;
+            bool hasAcceptEncoding = false;
+            for (const auto& header : request.headers) {
+                if (IEquals(header.first, "Accept")) hasAccept = true;
+                if (IEquals(header.first, "Accept-Encoding")) hasAcceptEncoding = true;
+                head += header.first + ": " + header.second + "\r\n";
+            }
+            if (!hasAccept) head += "Accept: */*\r\n";
+            if (!hasAcceptEncoding && m_options.acceptCompression && !SupportedAcceptEncoding().empty()) {
+                head += "Accept-Encoding: " + SupportedAcceptEncoding() + "\r\n";
+            }
+            head += "Connection: keep-alive\r\n\r\n";
+            auto started = std::chrono::steady_clock::now();
+            if (!conn.WriteAll(head.data(), head.size())) return false;
+
+            std::string line;
+            do {
+                if (!conn.ReadLine(line)) return false;
+                if (response.timing.firstByteUs < 0) response.timing.firstByteUs = ElapsedMicros(started);
+                if (line.compare(0, 5, "HTTP/") != 0) return false;
+                size_t sp = line.find(' ');
+                if (sp == std::string::npos) return false;
+                response.status = atoi(line.c_str() + sp + 1);
+                keepAlive = line.compare(0, 8, "HTTP/1.1") == 0;
+                response.headers.clear();
+                for (;;) {
+                    if (!conn.ReadLine(line)) return false;
+                    if (line.empty()) break;
+                    size_t colon = line.find(':');
+                    if (colon == std::string::npos) continue;
+                    response.headers.emplace_back(Trim(line.substr(0, colon)), Trim(line.substr(colon + 1)));
+                }
+            } while (response.status >= 100 && response.status < 200);
+
+            std::string connection = response.GetHeader("Connection");
+            if (IEquals(connection, "close")) keepAlive = false;
+            else if (IEquals(connection, "keep-alive")) keepAlive = true;
+
+            bool noBody = request.method == "HEAD" || response.status == 204 || response.status == 304;
+            bool chunked = IEquals(response.GetHeader("Transfer-Encoding"), "chunked");
+            long long contentLength = response.ContentLength();
+            if (!chunked && contentLength < 0 && !noBody) keepAlive = false;
+
+            bool isRedirect = (response.status == 301 || response.status == 302 || response.status == 303 ||
+                response.status == 307 || response.status == 308) &&
+                (request.method == "GET" || request.method == "HEAD");
+            if (isRedirect) location = response.GetHeader("Location");
+
+            started = std::chrono::steady_clock::now();
+            bool deliver = location.empty();
+            if (deliver && request.onHeaders && !request.onHeaders(response)) {
+                if (!noBody) keepAlive = false;
+                return true;
+            }
+            if (noBody) return true;
+
+            ContentEncoding encoding = ParseContentEncoding(response.GetHeader("Content-Encoding"));
+            std::unique_ptr<ContentDecoder> decoder;
+            if (deliver && encoding != ContentEncoding::Identity) decoder = CreateContentDecoder(encoding);
+            if (deliver && !decoder && !request.onBody && contentLength > 0) {
+                response.body.reserve((size_t)std::min(contentLength, kMaxBodyReserve));
+            }
+
+            bool aborted = false;
+            bool callerAborted = false;
+            auto deliverDecoded = [&](const char* data, size_t size) {
+                m_stats.decodedBytes[(size_t)encoding] += size;
+                if (request.onBody && !request.onBody(data, size)) {
+                    callerAborted = true;
+                    return false;
+                }
+                if (!request.onBody) response.body.append(data, size);
+                return true;
+            };
+            auto sink = [&](const char* data, size_t size) {
+                if (!deliver) return true;
+                m_stats.wireBytes[(size_t)encoding] += size;
+                // 解不开的编码按原样交给调用方，Content-Encoding 头仍保留在响应里
+                bool ok = decoder ? decoder->Decode(data, size, deliverDecoded) : deliverDecoded(data, size);
+                if (!ok) aborted = true;
+                return ok;
+            };
+
+            char buffer[8192];
+            if (chunked) {
+                for (;;) {
+                    if (!conn.ReadLine(line)) return false;
+                    long long chunkSize = strtoll(line.c_str(), nullptr, 16);
+                    if (chunkSize < 0) return false;
+                    if (chunkSize == 0) {
+                        do {
+                            if (!conn.ReadLine(line)) return false;
+                        } while (!line.empty());
+                        break;
+                    }
+                    while (chunkSize > 0) {
+                        ssize_t n = conn.ReadSome(buffer, (size_t)std::min<long long>(chunkSize, sizeof(buffer)));
+                        if (n <= 0) return false;
+                        if (!sink(buffer, (size_t)n)) break;
+                        chunkSize -= n;
+                    }
+                    if (aborted) break;
+                    if (!conn.ReadLine(line)) return false;
+                }
+            }
+            else if (contentLength >= 0) {
+                long long remaining = contentLength;
+                while (remaining > 0) {
+                    ssize_t n = conn.ReadSome(buffer, (size_t)std::min<long long>(remaining, sizeof(buffer)));
+                    if (n <= 0) return false;
+                    if (!sink(buffer, (size_t)n)) break;
+                    remaining -= n;
+                }
+            }
+            else {
+                for (;;) {
+                    ssize_t n = conn.ReadSome(buffer, sizeof(buffer));
+                    if (n < 0) return false;
+                    if (n == 0) break;
+                    if (!sink(buffer, (size_t)n)) break;
+                }
+            }
+            response.timing.bodyUs = ElapsedMicros(started);
+            if (aborted) {
+                keepAlive = false;
+                response.error = callerAborted ? TransportError::Aborted : TransportError::Decode;
+                return false;
+            }
+            // 压缩流被截断
+            if (decoder && !decoder->Finish()) {
+                response.error = TransportError::Decode;
+                return false;
+            }
+            return true;
+        }
+
+        TransportOptions m_options;
+        ConnectionPool m_pool;
+        std::shared_ptr<DnsCache> m_dns;
+#ifdef CRAWLER_USE_OPENSSL
+        SSL_CTX* m_sslCtx = nullptr;
+#else
+        std::atomic<bool> m_httpsWarned{ false };
+#endif
+    };
+}
+
+std::unique_ptr<HttpTransport> CreatePosixTransport(const TransportOptions& options)
+{
+    return std::make_unique<PosixTransport>(options);
+}
+
+#endif
@@ -0,0 +1,279 @@
+﻿#ifdef _WIN32
+
+#include "dns_cache.h"
+#include "transport.h"
+#define NOMINMAX
+#include <windows.h>
+#include <winhttp.h>
+#include <algorithm>
+
+#pragma comment(lib, "winhttp.lib")
+
+namespace
+{
+    std::wstring Widen(const std::string& s)
+    {
+        if (s.empty()) return L"";
+        int len = MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), nullptr, 0);
+        std::wstring result(len, L'\0');
+        MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), &result[0], len);
+        return result;
+    }
+
+    std::string Narrow(const std::wstring& s)
+    {
+        if (s.empty()) return "";
+        int len = WideCharToMultiByte(CP_UTF8, 0, s.data(), (int)s.size(), nullptr, 0, nullptr, nullptr);
+        std::string result(len, '\0');
+        WideCharToMultiByte(CP_UTF8, 0, s.data(), (int)s.size(), &result[0], len, nullptr, nullptr);
+        return result;
+    }
+
+    class WinHttpConnection : public PooledConnection
+    {
+    public:
+        explicit WinHttpConnection(HINTERNET hConnect) : m_hConnect(hConnect) {}
+        ~WinHttpConnection() override { WinHttpCloseHandle(m_hConnect); }
+        // 底层 keep-alive 套接字由 WinHTTP 会话维护，连接句柄本身一直可用
+        bool IsAlive() override { return true; }
+        HINTERNET Handle() const { return m_hConnect; }
+
+    private:
+        HINTERNET m_hConnect;
+    };
+
+    std::wstring QueryWideHeader(HINTERNET hRequest, DWORD infoLevel)
+    {
+        DWORD dwSize = 0;
+        WinHttpQueryHeaders(hRequest, infoLevel, WINHTTP_HEADER_NAME_BY_INDEX,
+            WINHTTP_NO_OUTPUT_BUFFER, &dwSize, WINHTTP_NO_HEADER_INDEX);
+        if (GetLastError() != ERROR_INSUFFICIENT_BUFFER || dwSize == 0) return L"";
+        std::wstring buffer(dwSize / sizeof(wchar_t), L'\0');
+        if (!WinHttpQueryHeaders(hRequest, infoLevel, WINHTTP_HEADER_NAME_BY_INDEX,
+            &buffer[0], &dwSize, WINHTTP_NO_HEADER_INDEX)) {
+            return L"";
+        }
+        buffer.resize(dwSize / sizeof(wchar_t));
+        return buffer;
+    }
+
+    std::string QueryFinalUrl(HINTERNET hRequest)
+    {
+        DWORD dwSize = 0;
+        WinHttpQueryOption(hRequest, WINHTTP_OPTION_URL, nullptr, &dwSize);
+        if (GetLastError() != ERROR_INSUFFICIENT_BUFFER || dwSize == 0) return "";
+        std::wstring buffer(dwSize / sizeof(wchar_t), L'\0');
+        if (!WinHttpQueryOption(hRequest, WINHTTP_OPTION_URL, &buffer[0], &dwSize)) return "";
+        buffer.resize(wcsnlen(buffer.c_str(), buffer.size()));
+        return Narrow(buffer);
+    }
+
+    TransportError ErrorFromLastError()
+    {
+        switch (GetLastError()) {
+        case ERROR_WINHTTP_TIMEOUT: return TransportError::Timeout;
+        case ERROR_WINHTTP_NAME_NOT_RESOLVED: return TransportError::Dns;
+        case ERROR_WINHTTP_CANNOT_CONNECT:
+        case ERROR_WINHTTP_CONNECTION_ERROR: return TransportError::Connect;
+        case ERROR_WINHTTP_SECURE_FAILURE: return TransportError::Tls;
+        case ERROR_WINHTTP_REDIRECT_FAILED: return TransportError::TooManyRedirects;
+        default: return TransportError::Protocol;
+        }
+    }
+
+    void ParseRawHeaders(const std::string& raw, HttpResponse& response)
+    {
+        size_t pos = raw.find("\r\n");
+        while (pos != std::string::npos && pos + 2 < raw.size()) {
+            size_t start = pos + 2;
+            pos = raw.find("\r\n", start);
+            std::string line = raw.substr(start, (pos == std::string::npos ? raw.size() : pos) - start);
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) continue;
+            std::string name = line.substr(0, colon);
+            size_t valueStart = line.find_first_not_of(" \t", colon + 1);
+            std::string value = (valueStart == std::string::npos) ? "" : line.substr(valueStart);
+            response.headers.emplace_back(name, value);
+        }
+    }
+
+    class WinHttpTransport : public HttpTransport
+    {
+    public:
+        explicit WinHttpTransport(const TransportOptions& options)
+            : m_options(options), m_pool(options.maxConnectionsPerHost, options.idleTimeoutMs), m_hSession(nullptr)
+        {
+            m_hSession = WinHttpOpen(Widen(options.userAgent).c_str(), WINHTTP_ACCESS_TYPE_DEFAULT_PROXY,
+                WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
+            if (!m_hSession) return;
+            DWORD maxConns = (DWORD)options.maxConnectionsPerHost;
+            WinHttpSetOption(m_hSession, WINHTTP_OPTION_MAX_CONNS_PER_SERVER, &maxConns, sizeof(maxConns));
+            WinHttpSetOption(m_hSession, WINHTTP_OPTION_MAX_CONNS_PER_1_0_SERVER, &maxConns, sizeof(maxConns));
+            WinHttpSetTimeouts(m_hSession, 0, options.connectTimeoutMs, options.ioTimeoutMs, options.ioTimeoutMs);
+#ifdef WINHTTP_OPTION_DECOMPRESSION
+            if (options.acceptCompression && SupportedAcceptEncoding().empty()) {
+                // 没有编译 zlib/brotli 时交给系统解压 gzip/deflate（Windows 8.1 起），此时无法统计线上字节数
+                DWORD decompression = WINHTTP_DECOMPRESSION_FLAG_ALL;
+                WinHttpSetOption(m_hSession, WINHTTP_OPTION_DECOMPRESSION, &decompression, sizeof(decompression));
+            }
+#endif
+        }
+
+        ~WinHttpTransport() override
+        {
+            m_pool.Clear();
+            if (m_hSession) {
+                WinHttpCloseHandle(m_hSession);
+            }
+        }
+
+        bool IsReady() const override { return m_hSession != nullptr; }
+
+        bool Send(const HttpRequest& request, HttpResponse& response) override
+        {
+            m_stats.requests++;
+            HttpTarget target;
+            if (!m_hSession || !ParseHttpTarget(request.url, target)) {
+                response.Reset();
+                response.error = m_hSession ? TransportError::BadUrl : TransportError::Protocol;
+                m_stats.failures++;
+                return false;
+            }
+            std::string key = target.PoolKey();
+            std::unique_ptr<PooledConnection> pooled = m_pool.Acquire(key);
+            if (pooled) {
+                m_stats.connectionsReused++;
+            }
+            else {
+                // WinHTTP 自己解析主机名，无法交给它现成的地址；这里查一次缓存，
+                // 已知解析失败的主机直接返回，预取过的主机此时系统解析缓存也已是热的
+                std::vector<ResolvedAddress> addresses;
+                if (m_options.dnsCache && !m_options.dnsCache->Resolve(target.host, target.port, addresses)) {
+                    response.Reset();
+                    response.error = TransportError::Dns;
+                    m_pool.Release(key, nullptr);
+                    m_stats.failures++;
+                    return false;
+                }
+                HINTERNET hConnect = WinHttpConnect(m_hSession, Widen(target.host).c_str(), (INTERNET_PORT)target.port, 0);
+                if (!hConnect) {
+                    response.Reset();
+                    response.error = ErrorFromLastError();
+                    m_pool.Release(key, nullptr);
+                    m_stats.failures++;
+                    return false;
+                }
+                pooled = std::make_unique<WinHttpConnection>(hConnect);
+                m_stats.connectionsOpened++;
+            }
+            HINTERNET hConnect = static_cast<WinHttpConnection*>(pooled.get())->Handle();
+            bool ok = Exchange(hConnect, target, request, response);
+            m_pool.Release(key, std::move(pooled));
+            if (!ok) m_stats.failures++;
+            return ok;
+        }
+
+    private:
+        bool Exchange(HINTERNET hConnect, const HttpTarget& target, const HttpRequest& request, HttpResponse& response)
+        {
+            response.Reset();
+            response.finalUrl = request.url;
+            DWORD dwOpenRequestFlags = (target.scheme == "https") ? WINHTTP_FLAG_SECURE : 0;
+            HINTERNET hRequest = WinHttpOpenRequest(hConnect, Widen(request.method).c_str(),
+                Widen(target.PathAndQuery()).c_str(), NULL, WINHTTP_NO_REFERER,
+                WINHTTP_DEFAULT_ACCEPT_TYPES, dwOpenRequestFlags);
+            if (!hRequest) {
+                response.error = ErrorFromLastError();
+                return false;
+            }
+            std::wstring headers;
+            bool hasAcceptEncoding = false;
+            for (const auto& header : request.headers) {
+                if (_stricmp(header.first.c_str(), "Accept-Encoding") == 0) hasAcceptEncoding = true;
+                headers += Widen(header.first + ": " + header.second) + L"\r\n";
+            }
+            if (!hasAcceptEncoding && m_options.acceptCompression && !SupportedAcceptEncoding().empty()) {
+                headers += Widen("Accept-Encoding: " + SupportedAcceptEncoding()) + L"\r\n";
+            }
+            if (!headers.empty()) {
+                WinHttpAddRequestHeaders(hRequest, headers.c_str(), (DWORD)-1L, WINHTTP_ADDREQ_FLAG_ADD);
+            }
+            // WinHTTP 在 SendRequest 内部完成解析、连接和握手，这里只能把它们都算进首字节时间
+            auto started = std::chrono::steady_clock::now();
+            BOOL bResults = WinHttpSendRequest(hRequest, WINHTTP_NO_ADDITIONAL_HEADERS, 0,
+                WINHTTP_NO_REQUEST_DATA, 0, 0, 0);
+            if (bResults) bResults = WinHttpReceiveResponse(hRequest, NULL);
+            if (!bResults) {
+                response.error = ErrorFromLastError();
+                WinHttpCloseHandle(hRequest);
+                return false;
+            }
+            response.timing.firstByteUs = ElapsedMicros(started);
+            DWORD dwStatusCode = 0;
+            DWORD dwSize = sizeof(dwStatusCode);
+            WinHttpQueryHeaders(hRequest, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
+                WINHTTP_HEADER_NAME_BY_INDEX, &dwStatusCode, &dwSize, WINHTTP_NO_HEADER_INDEX);
+            response.status = (int)dwStatusCode;
+            ParseRawHeaders(Narrow(QueryWideHeader(hRequest, WINHTTP_QUERY_RAW_HEADERS_CRLF)), response);
+            std::string finalUrl = QueryFinalUrl(hRequest);
+            if (!finalUrl.empty()) response.finalUrl = finalUrl;
+            if (request.onHeaders && !request.onHeaders(response)) {
+                WinHttpCloseHandle(hRequest);
+                return true;
+            }
+            ContentEncoding encoding = ParseContentEncoding(response.GetHeader("Content-Encoding"));
+            std::unique_ptr<ContentDecoder> decoder;
+            if (encoding != ContentEncoding::Identity) decoder = CreateContentDecoder(encoding);
+            long long contentLength = response.ContentLength();
+            if (!decoder && !request.onBody && contentLength > 0) {
+                response.body.reserve((size_t)std::min(contentLength, kMaxBodyReserve));
+            }
+            bool callerAborted = false;
+            auto deliverDecoded = [&](const char* data, size_t size) {
+                m_stats.decodedBytes[(size_t)encoding] += size;
+                if (request.onBody && !request.onBody(data, size)) {
+                    callerAborted = true;
+                    return false;
+                }
+                if (!request.onBody) response.body.append(data, size);
+                return true;
+            };
+            started = std::chrono::steady_clock::now();
+            bool ok = true;
+            char buffer[8192];
+            DWORD dwRead = 0;
+            for (;;) {
+                if (!WinHttpReadData(hRequest, buffer, sizeof(buffer), &dwRead)) {
+                    response.error = ErrorFromLastError();
+                    ok = false;
+                    break;
+                }
+                if (dwRead == 0) break;
+                m_stats.wireBytes[(size_t)encoding] += dwRead;
+                ok = decoder ? decoder->Decode(buffer, dwRead, deliverDecoded) : deliverDecoded(buffer, dwRead);
+                if (!ok) {
+                    response.error = callerAborted ? TransportError::Aborted : TransportError::Decode;
+                    break;
+                }
+            }
+            if (ok && decoder && !decoder->Finish()) {
+                response.error = TransportError::Decode;
+                ok = false;
+            }
+            response.timing.bodyUs = ElapsedMicros(started);
+            WinHttpCloseHandle(hRequest);
+            return ok;
+        }
+
+        TransportOptions m_options;
+        ConnectionPool m_pool;
+        HINTERNET m_hSession;
+    };
+}
+
+std::unique_ptr<HttpTransport> CreateWinHttpTransport(const TransportOptions& options)
+{
+    return std::make_unique<WinHttpTransport>(options);
+}
+
+#endif
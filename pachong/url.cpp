@@ -0,0 +1,311 @@
+﻿#include "url.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace
+{
+    inline bool IsAlpha(char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    }
+
+    inline bool IsSchemeChar(char c)
+    {
+        return IsAlpha(c) || (c >= '0' && c <= '9') || c == '+' || c == '-' || c == '.';
+    }
+
+    inline bool IsTrimmable(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+    }
+
+    bool EqualsNoCase(std::string_view a, std::string_view b)
+    {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); ++i) {
+            char x = a[i], y = b[i];
+            if (x >= 'A' && x <= 'Z') x = (char)(x - 'A' + 'a');
+            if (y >= 'A' && y <= 'Z') y = (char)(y - 'A' + 'a');
+            if (x != y) return false;
+        }
+        return true;
+    }
+
+    std::string_view Trim(std::string_view s)
+    {
+        while (!s.empty() && IsTrimmable(s.front())) s.remove_prefix(1);
+        while (!s.empty() && IsTrimmable(s.back())) s.remove_suffix(1);
+        return s;
+    }
+
+    // RFC 3986 5.2.4，在 s[begin, end) 上原地进行，输出不会比输入长
+    void RemoveDotSegments(std::string& s, size_t begin)
+    {
+        const size_t n = s.size();
+        size_t r = begin;
+        size_t w = begin;
+        if (r < n && s[r] == '/') {
+            r++;
+            w++;
+        }
+        const size_t root = w;
+        for (;;) {
+            size_t segEnd = s.find('/', r);
+            bool last = (segEnd == std::string::npos);
+            if (last) segEnd = n;
+            size_t len = segEnd - r;
+            if (len == 1 && s[r] == '.') {
+                // 丢弃 "."
+            }
+            else if (len == 2 && s[r] == '.' && s[r + 1] == '.') {
+                if (w > root) {
+                    size_t k = w - 1;
+                    while (k > root && s[k - 1] != '/') k--;
+                    w = k;
+                }
+            }
+            else {
+                if (w != r) memmove(&s[w], &s[r], len);
+                w += len;
+                if (!last) s[w++] = '/';
+            }
+            if (last) break;
+            r = segEnd + 1;
+        }
+        s.resize(w);
+    }
+}
+
+bool UrlView::IsHttp() const
+{
+    return hasAuthority && !host.empty() && (EqualsNoCase(scheme, "http") || EqualsNoCase(scheme, "https"));
+}
+
+int UrlView::EffectivePort() const
+{
+    if (!port.empty()) {
+        int value = 0;
+        for (char c : port) {
+            if (c < '0' || c > '9' || value > 65535) return 0;
+            value = value * 10 + (c - '0');
+        }
+        return value <= 65535 ? value : 0;
+    }
+    if (EqualsNoCase(scheme, "http")) return 80;
+    if (EqualsNoCase(scheme, "https")) return 443;
+    return 0;
+}
+
+bool ParseUrl(std::string_view url, UrlView& out)
+{
+    out = UrlView();
+    url = Trim(url);
+    size_t i = 0;
+    const size_t n = url.size();
+    // scheme ":"
+    if (n > 0 && IsAlpha(url[0])) {
+        size_t j = 1;
+        while (j < n && IsSchemeChar(url[j])) j++;
+        if (j < n && url[j] == ':') {
+            out.scheme = url.substr(0, j);
+            i = j + 1;
+        }
+    }
+    // "//" authority
+    if (n - i >= 2 && url[i] == '/' && url[i + 1] == '/') {
+        size_t start = i + 2;
+        size_t end = start;
+        while (end < n && url[end] != '/' && url[end] != '?' && url[end] != '#') end++;
+        out.hasAuthority = true;
+        out.authority = url.substr(start, end - start);
+        std::string_view hostPort = out.authority;
+        size_t at = hostPort.rfind('@');
+        if (at != std::string_view::npos) hostPort.remove_prefix(at + 1);
+        size_t colon = hostPort.rfind(':');
+        size_t bracket = hostPort.rfind(']');
+        if (colon != std::string_view::npos && (bracket == std::string_view::npos || colon > bracket)) {
+            out.host = hostPort.substr(0, colon);
+            out.port = hostPort.substr(colon + 1);
+        }
+        else {
+            out.host = hostPort;
+        }
+        i = end;
+    }
+    size_t pathEnd = i;
+    while (pathEnd < n && url[pathEnd] != '?' && url[pathEnd] != '#') pathEnd++;
+    out.path = url.substr(i, pathEnd - i);
+    i = pathEnd;
+    if (i < n && url[i] == '?') {
+        size_t end = url.find('#', i);
+        if (end == std::string_view::npos) end = n;
+        out.hasQuery = true;
+        out.query = url.substr(i + 1, end - i - 1);
+        i = end;
+    }
+    if (i < n && url[i] == '#') {
+        out.hasFragment = true;
+        out.fragment = url.substr(i + 1);
+    }
+    return true;
+}
+
+bool AppendResolvedUrl(const UrlView& base, std::string_view reference, std::string& out)
+{
+    if (base.scheme.empty()) return false;
+    UrlView ref;
+    ParseUrl(reference, ref);
+    const UrlView* authoritySource = &base;
+    std::string_view query = ref.query;
+    bool hasQuery = ref.hasQuery;
+    enum { RefPath, BasePath, MergedPath } pathMode = RefPath;
+
+    if (!ref.scheme.empty()) {
+        authoritySource = &ref;
+    }
+    else if (ref.hasAuthority) {
+        authoritySource = &ref;
+    }
+    else if (ref.path.empty()) {
+        pathMode = BasePath;
+        if (!ref.hasQuery) {
+            query = base.query;
+            hasQuery = base.hasQuery;
+        }
+    }
+    else if (ref.path[0] != '/') {
+        pathMode = MergedPath;
+    }
+
+    out.reserve(out.size() + base.scheme.size() + base.authority.size() + base.path.size() + reference.size() + 4);
+    out.append(ref.scheme.empty() ? base.scheme : ref.scheme);
+    out.push_back(':');
+    if (authoritySource->hasAuthority) {
+        out.append("//");
+        out.append(authoritySource->authority);
+    }
+    size_t pathStart = out.size();
+    if (pathMode == BasePath) {
+        out.append(base.path);
+    }
+    else if (pathMode == MergedPath) {
+        if (base.hasAuthority && base.path.empty()) {
+            out.push_back('/');
+        }
+        else {
+            size_t lastSlash = base.path.rfind('/');
+            if (lastSlash != std::string_view::npos) out.append(base.path.substr(0, lastSlash + 1));
+        }
+        out.append(ref.path);
+    }
+    else {
+        out.append(ref.path);
+    }
+    if (pathMode != BasePath) RemoveDotSegments(out, pathStart);
+    if (hasQuery) {
+        out.push_back('?');
+        out.append(query);
+    }
+    if (ref.hasFragment) {
+        out.push_back('#');
+        out.append(ref.fragment);
+    }
+    return true;
+}
+
+std::string ResolveUrl(const UrlView& base, std::string_view reference)
+{
+    std::string result;
+    if (!AppendResolvedUrl(base, reference, result)) return std::string(reference);
+    return result;
+}
+
+bool IsSameOrigin(const UrlView& a, const UrlView& b)
+{
+    return EqualsNoCase(a.scheme, b.scheme) && EqualsNoCase(a.host, b.host) && a.EffectivePort() == b.EffectivePort();
+}
+
+namespace
+{
+    bool MatchesParam(std::string_view name, const std::vector<std::string>& patterns)
+    {
+        for (const auto& pattern : patterns) {
+            if (!pattern.empty() && pattern.back() == '*') {
+                std::string_view prefix(pattern.data(), pattern.size() - 1);
+                if (name.size() >= prefix.size() && EqualsNoCase(name.substr(0, prefix.size()), prefix)) return true;
+            }
+            else if (EqualsNoCase(name, pattern)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline char ToLowerAscii(char c)
+    {
+        return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+    }
+
+    inline char ToUpperAscii(char c)
+    {
+        return (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : c;
+    }
+
+    // 追加时把 %xx 的十六进制统一为大写
+    void AppendNormalizedEscapes(std::string_view s, std::string& out)
+    {
+        for (size_t i = 0; i < s.size(); ++i) {
+            out.push_back(s[i]);
+            if (s[i] == '%' && i + 2 < s.size() && isxdigit((unsigned char)s[i + 1]) && isxdigit((unsigned char)s[i + 2])) {
+                out.push_back(ToUpperAscii(s[i + 1]));
+                out.push_back(ToUpperAscii(s[i + 2]));
+                i += 2;
+            }
+        }
+    }
+}
+
+bool CanonicalizeUrl(std::string_view url, const CanonicalizeOptions& options, std::string& out)
+{
+    out.clear();
+    UrlView view;
+    if (!ParseUrl(url, view) || !view.IsHttp()) return false;
+    int port = view.EffectivePort();
+    if (port <= 0) return false;
+    for (char c : view.scheme) out.push_back(ToLowerAscii(c));
+    out.append("://");
+    std::string_view host = view.host;
+    while (!host.empty() && host.back() == '.') host.remove_suffix(1);
+    for (char c : host) out.push_back(ToLowerAscii(c));
+    bool defaultPort = (port == 80 && out[4] == ':') || (port == 443 && out[4] == 's');
+    if (!defaultPort) {
+        out.push_back(':');
+        out.append(std::to_string(port));
+    }
+    size_t pathStart = out.size();
+    if (view.path.empty() || view.path[0] != '/') out.push_back('/');
+    AppendNormalizedEscapes(view.path, out);
+    RemoveDotSegments(out, pathStart);
+    if (options.stripTrailingSlash && out.size() > pathStart + 1 && out.back() == '/') out.pop_back();
+
+    if (view.hasQuery && !view.query.empty()) {
+        std::vector<std::string_view> params;
+        std::string_view query = view.query;
+        while (!query.empty()) {
+            size_t amp = query.find('&');
+            std::string_view param = query.substr(0, amp);
+            query = (amp == std::string_view::npos) ? std::string_view() : query.substr(amp + 1);
+            if (param.empty()) continue;
+            std::string_view name = param.substr(0, param.find('='));
+            if (MatchesParam(name, options.stripQueryParams)) continue;
+            params.push_back(param);
+        }
+        if (options.sortQueryParams) std::stable_sort(params.begin(), params.end());
+        for (size_t i = 0; i < params.size(); ++i) {
+            out.push_back(i == 0 ? '?' : '&');
+            AppendNormalizedEscapes(params[i], out);
+        }
+    }
+    return true;
+}
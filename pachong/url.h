@@ -0,0 +1,49 @@
+﻿#ifndef URL_H
+#define URL_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// RFC 3986 的各组成部分，全部是对原字符串的视图，原字符串必须比它活得久
+struct UrlView
+{
+    std::string_view scheme;
+    std::string_view authority;
+    std::string_view host;
+    std::string_view port;
+    std::string_view path;
+    std::string_view query;
+    std::string_view fragment;
+    bool hasAuthority = false;
+    bool hasQuery = false;
+    bool hasFragment = false;
+
+    bool IsHttp() const;
+    // 未写端口时返回 scheme 的默认端口，无法确定时返回 0
+    int EffectivePort() const;
+};
+
+bool ParseUrl(std::string_view url, UrlView& out);
+
+// 按 RFC 3986 5.2 把引用解析为绝对地址并追加到 out，只会写 out 这一处内存
+bool AppendResolvedUrl(const UrlView& base, std::string_view reference, std::string& out);
+std::string ResolveUrl(const UrlView& base, std::string_view reference);
+
+// scheme、host、端口都相同（大小写不敏感）
+bool IsSameOrigin(const UrlView& a, const UrlView& b);
+
+struct CanonicalizeOptions
+{
+    // 需要去掉的查询参数名，以 '*' 结尾表示前缀匹配。默认只去掉纯跟踪用的参数，
+    // from 之类在不少站点上是分页或检索条件，需要时通过 strip-param 配置添加
+    std::vector<std::string> stripQueryParams = { "utm_*", "spm", "share_token" };
+    bool stripTrailingSlash = true;
+    bool sortQueryParams = true;
+};
+
+// 生成用于去重的规范形式：scheme/host 小写、去掉默认端口和片段、消除点段、
+// 统一百分号编码大小写并按配置过滤查询参数。非 http(s) 地址返回 false
+bool CanonicalizeUrl(std::string_view url, const CanonicalizeOptions& options, std::string& out);
+
+#endif
@@ -0,0 +1,322 @@
+﻿#include "visited_store.h"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <queue>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const size_t kBlockEntries = 512;
+
+    inline uint64_t Mix64(uint64_t x)
+    {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    }
+
+    // 顺序读取一个溢出段，合并时使用
+    class RunReader
+    {
+    public:
+        explicit RunReader(const std::string& path) : m_file(path, std::ios::binary), m_buffer(4096) {}
+
+        bool Next(uint64_t& value)
+        {
+            if (m_pos == m_count) {
+                m_file.read(reinterpret_cast<char*>(m_buffer.data()), m_buffer.size() * sizeof(uint64_t));
+                m_count = (size_t)m_file.gcount() / sizeof(uint64_t);
+                m_pos = 0;
+                if (m_count == 0) return false;
+            }
+            value = m_buffer[m_pos++];
+            return true;
+        }
+
+    private:
+        std::ifstream m_file;
+        std::vector<uint64_t> m_buffer;
+        size_t m_pos = 0;
+        size_t m_count = 0;
+    };
+
+    // 写入有序指纹并记录每块的首个键作为稀疏索引
+    class RunWriter
+    {
+    public:
+        explicit RunWriter(const std::string& path) : m_file(path, std::ios::binary | std::ios::trunc) {}
+
+        bool IsOpen() const { return m_file.is_open(); }
+
+        void Add(uint64_t value)
+        {
+            if (m_count % kBlockEntries == 0) m_index.push_back(value);
+            m_buffer.push_back(value);
+            m_count++;
+            if (m_buffer.size() == 4096) Flush();
+        }
+
+        bool Finish()
+        {
+            Flush();
+            m_file.close();
+            return !m_file.fail();
+        }
+
+        uint64_t Count() const { return m_count; }
+        std::vector<uint64_t>& Index() { return m_index; }
+
+    private:
+        void Flush()
+        {
+            if (m_buffer.empty()) return;
+            m_file.write(reinterpret_cast<const char*>(m_buffer.data()), m_buffer.size() * sizeof(uint64_t));
+            m_buffer.clear();
+        }
+
+        std::ofstream m_file;
+        std::vector<uint64_t> m_buffer;
+        std::vector<uint64_t> m_index;
+        uint64_t m_count = 0;
+    };
+}
+
+uint64_t FingerprintUrl(std::string_view canonicalUrl)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : canonicalUrl) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    hash = Mix64(hash ^ canonicalUrl.size());
+    return hash ? hash : 1;
+}
+
+BloomFilter::BloomFilter(size_t expectedItems, double falsePositiveRate)
+{
+    expectedItems = std::max<size_t>(expectedItems, 1024);
+    falsePositiveRate = std::min(std::max(falsePositiveRate, 1e-6), 0.5);
+    const double ln2 = std::log(2.0);
+    double bits = -(double)expectedItems * std::log(falsePositiveRate) / (ln2 * ln2);
+    m_bitCount = std::max<uint64_t>(64, (uint64_t)bits);
+    m_bits.assign((size_t)((m_bitCount + 63) / 64), 0);
+    m_hashCount = std::max(1, (int)std::lround(bits / expectedItems * ln2));
+}
+
+bool BloomFilter::MayContain(uint64_t fingerprint) const
+{
+    uint64_t h1 = fingerprint;
+    uint64_t h2 = Mix64(fingerprint) | 1;
+    for (int i = 0; i < m_hashCount; ++i) {
+        uint64_t bit = (h1 + (uint64_t)i * h2) % m_bitCount;
+        if (!(m_bits[bit >> 6] & (1ULL << (bit & 63)))) return false;
+    }
+    return true;
+}
+
+void BloomFilter::Add(uint64_t fingerprint)
+{
+    uint64_t h1 = fingerprint;
+    uint64_t h2 = Mix64(fingerprint) | 1;
+    for (int i = 0; i < m_hashCount; ++i) {
+        uint64_t bit = (h1 + (uint64_t)i * h2) % m_bitCount;
+        m_bits[bit >> 6] |= (1ULL << (bit & 63));
+    }
+}
+
+FingerprintSet::FingerprintSet()
+    : m_slots(1024, 0), m_size(0)
+{
+}
+
+bool FingerprintSet::Insert(uint64_t fingerprint)
+{
+    if (NeedsGrow()) Grow();
+    size_t mask = m_slots.size() - 1;
+    for (size_t i = (size_t)fingerprint & mask;; i = (i + 1) & mask) {
+        if (m_slots[i] == fingerprint) return false;
+        if (m_slots[i] == 0) {
+            m_slots[i] = fingerprint;
+            m_size++;
+            return true;
+        }
+    }
+}
+
+bool FingerprintSet::Contains(uint64_t fingerprint) const
+{
+    size_t mask = m_slots.size() - 1;
+    for (size_t i = (size_t)fingerprint & mask;; i = (i + 1) & mask) {
+        if (m_slots[i] == fingerprint) return true;
+        if (m_slots[i] == 0) return false;
+    }
+}
+
+void FingerprintSet::Grow()
+{
+    std::vector<uint64_t> old(m_slots.size() * 2, 0);
+    old.swap(m_slots);
+    size_t mask = m_slots.size() - 1;
+    for (uint64_t fingerprint : old) {
+        if (!fingerprint) continue;
+        size_t i = (size_t)fingerprint & mask;
+        while (m_slots[i]) i = (i + 1) & mask;
+        m_slots[i] = fingerprint;
+    }
+}
+
+std::vector<uint64_t> FingerprintSet::TakeSorted()
+{
+    std::vector<uint64_t> result;
+    result.reserve(m_size);
+    for (uint64_t fingerprint : m_slots) {
+        if (fingerprint) result.push_back(fingerprint);
+    }
+    std::sort(result.begin(), result.end());
+    std::fill(m_slots.begin(), m_slots.end(), 0);
+    m_size = 0;
+    return result;
+}
+
+VisitedStore::VisitedStore(const VisitedStoreOptions& options)
+    : m_options(options)
+{
+    if (m_options.useBloomFilter) {
+        m_bloom = std::make_unique<BloomFilter>(m_options.expectedUrls, m_options.bloomFalsePositiveRate);
+    }
+    if (!m_options.spillDirectory.empty()) {
+        std::error_code ec;
+        fs::create_directories(m_options.spillDirectory, ec);
+    }
+}
+
+VisitedStore::~VisitedStore()
+{
+    for (auto& run : m_runs) {
+        run->file.close();
+        std::error_code ec;
+        fs::remove(run->path, ec);
+    }
+}
+
+bool VisitedStore::Insert(uint64_t fingerprint)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // 布隆过滤器判定为不存在时一定是新地址，省掉磁盘查找
+    bool maybeSeen = !m_bloom || m_bloom->MayContain(fingerprint);
+    if (maybeSeen && ContainsLocked(fingerprint)) return false;
+    if (m_bloom) m_bloom->Add(fingerprint);
+    if (m_memory.NeedsGrow() && !m_options.spillDirectory.empty() &&
+        m_memory.GrownBytes() > m_options.memoryBudgetBytes) {
+        SpillLocked();
+    }
+    m_memory.Insert(fingerprint);
+    return true;
+}
+
+bool VisitedStore::Contains(uint64_t fingerprint)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_bloom && !m_bloom->MayContain(fingerprint)) return false;
+    return ContainsLocked(fingerprint);
+}
+
+size_t VisitedStore::Size()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_memory.Size() + (size_t)m_diskCount;
+}
+
+bool VisitedStore::ContainsLocked(uint64_t fingerprint)
+{
+    if (m_memory.Contains(fingerprint)) return true;
+    for (auto& run : m_runs) {
+        if (RunContains(*run, fingerprint)) return true;
+    }
+    return false;
+}
+
+bool VisitedStore::RunContains(SpillRun& run, uint64_t fingerprint)
+{
+    if (run.blockFirstKeys.empty() || fingerprint < run.blockFirstKeys.front()) return false;
+    size_t block = (size_t)(std::upper_bound(run.blockFirstKeys.begin(), run.blockFirstKeys.end(), fingerprint) -
+        run.blockFirstKeys.begin()) - 1;
+    uint64_t offset = (uint64_t)block * kBlockEntries;
+    size_t entries = (size_t)std::min<uint64_t>(kBlockEntries, run.count - offset);
+    uint64_t buffer[kBlockEntries];
+    run.file.clear();
+    run.file.seekg((std::streamoff)(offset * sizeof(uint64_t)));
+    run.file.read(reinterpret_cast<char*>(buffer), entries * sizeof(uint64_t));
+    if ((size_t)run.file.gcount() != entries * sizeof(uint64_t)) return false;
+    return std::binary_search(buffer, buffer + entries, fingerprint);
+}
+
+std::string VisitedStore::NextRunPathLocked()
+{
+    return (fs::path(m_options.spillDirectory) / ("visited_" + std::to_string(m_nextRunId++) + ".run")).string();
+}
+
+void VisitedStore::SpillLocked()
+{
+    std::vector<uint64_t> sorted = m_memory.TakeSorted();
+    if (sorted.empty()) return;
+    auto run = std::make_unique<SpillRun>();
+    run->path = NextRunPathLocked();
+    RunWriter writer(run->path);
+    if (!writer.IsOpen()) {
+        std::cerr << "Failed to spill visited set to " << run->path << "\n";
+        for (uint64_t fingerprint : sorted) m_memory.Insert(fingerprint);
+        return;
+    }
+    for (uint64_t fingerprint : sorted) writer.Add(fingerprint);
+    writer.Finish();
+    run->count = writer.Count();
+    run->blockFirstKeys = std::move(writer.Index());
+    run->file.open(run->path, std::ios::binary);
+    m_diskCount += run->count;
+    m_runs.push_back(std::move(run));
+    if (m_runs.size() >= 8) MergeRunsLocked();
+}
+
+void VisitedStore::MergeRunsLocked()
+{
+    // 多路归并成一个段，保证每次查找最多读少量磁盘块
+    using Head = std::pair<uint64_t, size_t>;
+    std::vector<std::unique_ptr<RunReader>> readers;
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heap;
+    for (size_t i = 0; i < m_runs.size(); ++i) {
+        readers.push_back(std::make_unique<RunReader>(m_runs[i]->path));
+        uint64_t value;
+        if (readers[i]->Next(value)) heap.emplace(value, i);
+    }
+    auto merged = std::make_unique<SpillRun>();
+    merged->path = NextRunPathLocked();
+    RunWriter writer(merged->path);
+    if (!writer.IsOpen()) return;
+    while (!heap.empty()) {
+        Head head = heap.top();
+        heap.pop();
+        writer.Add(head.first);
+        uint64_t value;
+        if (readers[head.second]->Next(value)) heap.emplace(value, head.second);
+    }
+    writer.Finish();
+    readers.clear();
+    for (auto& run : m_runs) {
+        run->file.close();
+        std::error_code ec;
+        fs::remove(run->path, ec);
+    }
+    m_runs.clear();
+    merged->count = writer.Count();
+    merged->blockFirstKeys = std::move(writer.Index());
+    merged->file.open(merged->path, std::ios::binary);
+    m_diskCount = merged->count;
+    m_runs.push_back(std::move(merged));
+}
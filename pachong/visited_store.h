@@ -0,0 +1,94 @@
+﻿#ifndef VISITED_STORE_H
+#define VISITED_STORE_H
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct VisitedStoreOptions
+{
+    // 内存指纹表的上限，超过后若配置了 spillDirectory 则把指纹写入磁盘
+    size_t memoryBudgetBytes = 256u * 1024 * 1024;
+    bool useBloomFilter = false;
+    size_t expectedUrls = 10000000;
+    double bloomFalsePositiveRate = 0.01;
+    std::string spillDirectory;
+};
+
+// 64 位 URL 指纹，永远不为 0
+uint64_t FingerprintUrl(std::string_view canonicalUrl);
+
+class BloomFilter
+{
+public:
+    BloomFilter(size_t expectedItems, double falsePositiveRate);
+    bool MayContain(uint64_t fingerprint) const;
+    void Add(uint64_t fingerprint);
+    size_t MemoryBytes() const { return m_bits.size() * sizeof(uint64_t); }
+
+private:
+    std::vector<uint64_t> m_bits;
+    uint64_t m_bitCount;
+    int m_hashCount;
+};
+
+// 开放寻址的指纹哈希集合，每个 URL 只占 8 字节
+class FingerprintSet
+{
+public:
+    FingerprintSet();
+    bool Insert(uint64_t fingerprint);
+    bool Contains(uint64_t fingerprint) const;
+    bool NeedsGrow() const { return (m_size + 1) * 10 > m_slots.size() * 7; }
+    size_t GrownBytes() const { return m_slots.size() * 2 * sizeof(uint64_t); }
+    void Grow();
+    size_t Size() const { return m_size; }
+    size_t MemoryBytes() const { return m_slots.size() * sizeof(uint64_t); }
+    std::vector<uint64_t> TakeSorted();
+
+private:
+    std::vector<uint64_t> m_slots;
+    size_t m_size;
+};
+
+// 已访问集合：布隆过滤器（可选）+ 内存指纹表 + 磁盘上有序的溢出段，线程安全
+class VisitedStore
+{
+public:
+    explicit VisitedStore(const VisitedStoreOptions& options = VisitedStoreOptions());
+    ~VisitedStore();
+
+    // 第一次见到返回 true
+    bool Insert(uint64_t fingerprint);
+    bool Contains(uint64_t fingerprint);
+    size_t Size();
+
+private:
+    struct SpillRun
+    {
+        std::string path;
+        uint64_t count = 0;
+        std::vector<uint64_t> blockFirstKeys;
+        std::ifstream file;
+    };
+
+    bool ContainsLocked(uint64_t fingerprint);
+    bool RunContains(SpillRun& run, uint64_t fingerprint);
+    void SpillLocked();
+    void MergeRunsLocked();
+    std::string NextRunPathLocked();
+
+    VisitedStoreOptions m_options;
+    std::mutex m_mutex;
+    FingerprintSet m_memory;
+    std::unique_ptr<BloomFilter> m_bloom;
+    std::vector<std::unique_ptr<SpillRun>> m_runs;
+    uint64_t m_diskCount = 0;
+    int m_nextRunId = 0;
+};
+
+#endif